@@ -0,0 +1,211 @@
+// ================================================================================
+//
+//	File:
+//      atomic.h
+//
+//	Component:
+//      Photon System
+//
+//	Description:
+//      Atomic operations on shared words
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __ATOMIC_H__
+#define __ATOMIC_H__
+
+// ================================================================================
+//	INLINE FUNCTIONS
+//
+//	Every operation is a full memory barrier, so a store followed by a load of
+//	another word is never reordered.  The Relaxed and AcqRel variants are
+//	weaker and only suit reference counts.
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicIncrement
+//
+//  Description:
+//      Add one to a word
+//
+//  Inputs:
+//		plValue == IN: Word
+//
+//  Returns:
+//      New value
+// --------------------------------------------------------------------------------
+inline LONG AtomicIncrement
+(
+	volatile LONG* plValue
+)
+{
+#if defined (__WIN32__)
+	return InterlockedIncrement(plValue);
+#elif defined (__LINUX__)
+	return __atomic_add_fetch(plValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicDecrement
+//
+//  Description:
+//      Subtract one from a word
+//
+//  Inputs:
+//		plValue == IN: Word
+//
+//  Returns:
+//      New value
+// --------------------------------------------------------------------------------
+inline LONG AtomicDecrement
+(
+	volatile LONG* plValue
+)
+{
+#if defined (__WIN32__)
+	return InterlockedDecrement(plValue);
+#elif defined (__LINUX__)
+	return __atomic_sub_fetch(plValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicIncrementRelaxed
+//
+//  Description:
+//      Add one to a word without ordering other memory accesses.  Only for a
+//		count the caller already holds a share of.
+//
+//  Inputs:
+//		plValue == IN: Word
+//
+//  Returns:
+//      New value
+// --------------------------------------------------------------------------------
+inline LONG AtomicIncrementRelaxed
+(
+	volatile LONG* plValue
+)
+{
+#if defined (__WIN32__)
+	return InterlockedIncrement(plValue);
+#elif defined (__LINUX__)
+	return __atomic_add_fetch(plValue, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicDecrementAcqRel
+//
+//  Description:
+//      Subtract one from a word.  Earlier accesses are released before the
+//		decrement, and the thread that sees zero acquires them all.
+//
+//  Inputs:
+//		plValue == IN: Word
+//
+//  Returns:
+//      New value
+// --------------------------------------------------------------------------------
+inline LONG AtomicDecrementAcqRel
+(
+	volatile LONG* plValue
+)
+{
+#if defined (__WIN32__)
+	return InterlockedDecrement(plValue);
+#elif defined (__LINUX__)
+	return __atomic_sub_fetch(plValue, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicCompareExchange
+//
+//  Description:
+//      Store a value if a word holds an expected value
+//
+//  Inputs:
+//		plValue		== IN: Word
+//		lValue		== IN: Value to store
+//		lExpected	== IN: Value the word must hold
+//
+//  Returns:
+//      Value the word held; the store was made if it equals lExpected
+// --------------------------------------------------------------------------------
+inline LONG AtomicCompareExchange
+(
+	volatile LONG*	plValue,
+	LONG			lValue,
+	LONG			lExpected
+)
+{
+#if defined (__WIN32__)
+	return InterlockedCompareExchange(plValue, lValue, lExpected);
+#elif defined (__LINUX__)
+	__atomic_compare_exchange_n(plValue, &lExpected, lValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return lExpected;
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicLoad
+//
+//  Description:
+//      Read a word
+//
+//  Inputs:
+//		plValue == IN: Word
+//
+//  Returns:
+//      Value of the word
+// --------------------------------------------------------------------------------
+inline LONG AtomicLoad
+(
+	volatile LONG* plValue
+)
+{
+#if defined (__WIN32__)
+	return InterlockedCompareExchange(plValue, 0, 0);
+#elif defined (__LINUX__)
+	return __atomic_load_n(plValue, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      AtomicStore
+//
+//  Description:
+//      Write a word
+//
+//  Inputs:
+//		plValue == IN: Word
+//		lValue	== IN: Value to store
+// --------------------------------------------------------------------------------
+inline void AtomicStore
+(
+	volatile LONG*	plValue,
+	LONG			lValue
+)
+{
+#if defined (__WIN32__)
+	InterlockedExchange(plValue, lValue);
+#elif defined (__LINUX__)
+	__atomic_store_n(plValue, lValue, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#endif // __ATOMIC_H__
@@ -28,6 +28,9 @@
 // --------------------------------------------------------------------------------
 #include <vector>
 #include <queue>
+#include <map>
+#include <set>
+#include <algorithm>
 
 // --------------------------------------------------------------------------------
 // INTERNAL SYSTEM HEADERS
@@ -39,6 +42,15 @@
 // --------------------------------------------------------------------------------
 #include "version.h"
 #include "dbstruct.h"
+#include "dblog.h"
+#include "dbversion.h"
+#include "dbpage.h"
+#include "dbbuffer.h"
+#include "dbindex.h"
+#include "dbbtree.h"
+#include "dbhash.h"
+#include "dbscan.h"
 #include "dbfile.h"
 #include "dbtable.h"
+#include "dbcursor.h"
 
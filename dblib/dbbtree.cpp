@@ -0,0 +1,729 @@
+// ================================================================================
+//
+//	File:
+//		dbbtree.cpp
+//
+//	Component:
+//		Database Engine
+//
+//	Description:
+//		B+tree index implementation
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::CDbBTree
+//
+//  Description:
+//      Default constructor
+//
+//  Inputs:
+//		pdbFile		== IN: Owning database file
+//      idxCatalog	== IN: Slot of the index in the index catalog
+// --------------------------------------------------------------------------------
+CDbBTree::CDbBTree
+(
+	CDbFile*	pdbFile,
+	UINT		idxCatalog
+) : CDbIndex(pdbFile, idxCatalog)
+{
+	TRACE_INIT("CDbBTree::CDbBTree");
+
+	m_cbKey		= GetIndexInfo()->Size;
+	m_cbEntry	= m_cbKey + sizeof(DBPOS);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::~CDbBTree
+//
+//  Description:
+//      Default destructor
+// --------------------------------------------------------------------------------
+CDbBTree::~CDbBTree()
+{
+	TRACE_INIT("CDbBTree::~CDbBTree");
+}
+
+// ================================================================================
+// INDEX OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::Insert
+//
+//  Description:
+//      Add entry to the index.  A split of the root adds a level to the tree.
+//
+//  Inputs:
+//      pKey	== IN: Key value
+//		idxSlot	== IN: Table slot holding the record
+// --------------------------------------------------------------------------------
+void CDbBTree::Insert
+(
+	const BYTE*	pKey,
+	DBPOS		idxSlot
+)
+{
+	TRACE_INIT("CDbBTree::Insert");
+
+	m_mutex.Lock();
+
+	try
+	{
+		vector<BYTE>	rgEntry(m_cbEntry);
+		vector<BYTE>	rgSplit(m_cbEntry);
+		FILEOFFSET		offSplit = 0;
+
+		memcpy(&rgEntry[0], pKey, m_cbKey);
+		memcpy(&rgEntry[m_cbKey], &idxSlot, sizeof(DBPOS));
+
+		// Start the tree with an empty leaf
+		if (GetIndexInfo()->Offset == 0)
+		{
+			GetIndexInfo()->Offset = NewNode(DB_NODE_LEAF);
+			GetIndexInfo()->Height = 1;
+		}
+
+		if (InsertNode(GetIndexInfo()->Offset, &rgEntry[0], &rgSplit[0], &offSplit))
+		{
+			// Root was split - new root points at both halves
+			FILEOFFSET		offRoot	= NewNode(0);
+			CDbPage*		pPage	= m_pBufferMgr->Pin(offRoot / DB_PAGE_SIZE);
+			DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+
+			pNode->Child = GetIndexInfo()->Offset;
+			pNode->Count = 1;
+			memcpy(GetEntry(pNode, 0), &rgSplit[0], m_cbEntry);
+			memcpy(GetEntry(pNode, 0) + m_cbEntry, &offSplit, sizeof(FILEOFFSET));
+
+			m_pBufferMgr->Unpin(pPage, true);
+
+			GetIndexInfo()->Offset = offRoot;
+			GetIndexInfo()->Height++;
+		}
+
+		GetIndexInfo()->Entries++;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::Remove
+//
+//  Description:
+//      Remove entry from the index.  Nodes are not merged when they underflow.
+//
+//  Inputs:
+//      pKey	== IN: Key value
+//		idxSlot	== IN: Table slot holding the record
+// --------------------------------------------------------------------------------
+void CDbBTree::Remove
+(
+	const BYTE*	pKey,
+	DBPOS		idxSlot
+)
+{
+	TRACE_INIT("CDbBTree::Remove");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (GetIndexInfo()->Offset != 0)
+		{
+			vector<BYTE> rgEntry(m_cbEntry);
+
+			memcpy(&rgEntry[0], pKey, m_cbKey);
+			memcpy(&rgEntry[m_cbKey], &idxSlot, sizeof(DBPOS));
+
+			FILEOFFSET		offLeaf	= FindLeaf(&rgEntry[0]);
+			CDbPage*		pPage	= m_pBufferMgr->Pin(offLeaf / DB_PAGE_SIZE);
+			DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+			UINT			idx		= LowerBound(pNode, &rgEntry[0]);
+			bool			fFound	= (idx < pNode->Count) &&
+									  (CompareEntry(GetEntry(pNode, idx), &rgEntry[0]) == 0);
+
+			if (fFound)
+			{
+				BYTE* pPos = GetEntry(pNode, idx);
+				memmove(pPos, pPos + m_cbEntry, (pNode->Count - idx - 1) * m_cbEntry);
+				pNode->Count--;
+
+				GetIndexInfo()->Entries--;
+			}
+
+			m_pBufferMgr->Unpin(pPage, fFound);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::Find
+//
+//  Description:
+//      Find first entry with the key
+//
+//  Inputs:
+//      pKey		== IN:	Key value
+//		pidxSlot	== OUT:	Table slot holding the record
+//
+//  Returns:
+//      true if the key was found
+// --------------------------------------------------------------------------------
+bool CDbBTree::Find
+(
+	const BYTE*	pKey,
+	DBPOS*		pidxSlot
+)
+{
+	bool fFound = false;
+
+	TRACE_INIT("CDbBTree::Find");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (GetIndexInfo()->Offset != 0)
+		{
+			vector<BYTE> rgEntry(m_cbEntry, 0);
+			memcpy(&rgEntry[0], pKey, m_cbKey);
+
+			// Lowest possible entry for the key; duplicates may continue in the
+			// following leaves
+			FILEOFFSET offLeaf = FindLeaf(&rgEntry[0]);
+
+			while (offLeaf != 0)
+			{
+				CDbPage*		pPage	= m_pBufferMgr->Pin(offLeaf / DB_PAGE_SIZE);
+				DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+				UINT			idx		= LowerBound(pNode, &rgEntry[0]);
+
+				if (idx < pNode->Count)
+				{
+					BYTE* pEntry = GetEntry(pNode, idx);
+
+					fFound = (CompareKey(pEntry, pKey) == 0);
+
+					if (fFound)
+					{
+						memcpy(pidxSlot, pEntry + m_cbKey, sizeof(DBPOS));
+					}
+
+					m_pBufferMgr->Unpin(pPage);
+					break;
+				}
+
+				offLeaf = pNode->Next;
+				m_pBufferMgr->Unpin(pPage);
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return fFound;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::GetPages
+//
+//  Description:
+//      List every node page of the tree
+//
+//  Inputs:
+//      rgPages == OUT: File offsets of the pages
+// --------------------------------------------------------------------------------
+void CDbBTree::GetPages
+(
+	vector<FILEOFFSET>& rgPages
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		vector<FILEOFFSET> rgPending;
+
+		if (GetIndexInfo()->Offset != 0)
+		{
+			rgPending.push_back(GetIndexInfo()->Offset);
+		}
+
+		while (!rgPending.empty())
+		{
+			FILEOFFSET		offNode	= rgPending.back();
+			CDbPage*		pPage	= m_pBufferMgr->Pin(offNode / DB_PAGE_SIZE);
+			DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+
+			rgPending.pop_back();
+			rgPages.push_back(offNode);
+
+			if (!(pNode->Flags & DB_NODE_LEAF))
+			{
+				for (UINT idx = 0; idx <= pNode->Count; idx++)
+				{
+					rgPending.push_back(GetChild(pNode, idx));
+				}
+			}
+
+			m_pBufferMgr->Unpin(pPage);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// ================================================================================
+// NODE OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::InsertNode
+//
+//  Description:
+//      Insert entry into the subtree rooted at a node.  Only one node is pinned
+//		while descending.
+//
+//  Inputs:
+//      offNode		== IN:	Subtree root
+//		pEntry		== IN:	Entry (key, slot)
+//		pSplit		== OUT:	Separator entry when the node was split
+//		poffSplit	== OUT:	New right node when the node was split
+//
+//  Returns:
+//      true if the node was split
+// --------------------------------------------------------------------------------
+bool CDbBTree::InsertNode
+(
+	FILEOFFSET	offNode,
+	const BYTE*	pEntry,
+	BYTE*		pSplit,
+	FILEOFFSET*	poffSplit
+)
+{
+	CDbPage*		pPage	= m_pBufferMgr->Pin(offNode / DB_PAGE_SIZE);
+	DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+
+	if (pNode->Flags & DB_NODE_LEAF)
+	{
+		return InsertEntry(pPage, pEntry, 0, pSplit, poffSplit);
+	}
+
+	// Descend to the child covering the entry
+	FILEOFFSET offChild = GetChild(pNode, UpperBound(pNode, pEntry));
+	m_pBufferMgr->Unpin(pPage);
+
+	vector<BYTE>	rgSplit(m_cbEntry);
+	FILEOFFSET		offChildSplit = 0;
+
+	if (!InsertNode(offChild, pEntry, &rgSplit[0], &offChildSplit))
+	{
+		return false;
+	}
+
+	// Child was split - add the separator for its new right half
+	pPage = m_pBufferMgr->Pin(offNode / DB_PAGE_SIZE);
+	return InsertEntry(pPage, &rgSplit[0], offChildSplit, pSplit, poffSplit);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::InsertEntry
+//
+//  Description:
+//      Insert entry into a pinned node, splitting it when full.  Leaf splits
+//		copy the separator up; interior splits move it up.  Unpins the node.
+//
+//  Inputs:
+//      pPage		== IN:	Pinned node page
+//		pEntry		== IN:	Entry (key, slot)
+//		offChild	== IN:	Child for the entry (interior nodes)
+//		pSplit		== OUT:	Separator entry when the node was split
+//		poffSplit	== OUT:	New right node when the node was split
+//
+//  Returns:
+//      true if the node was split
+// --------------------------------------------------------------------------------
+bool CDbBTree::InsertEntry
+(
+	CDbPage*	pPage,
+	const BYTE*	pEntry,
+	FILEOFFSET	offChild,
+	BYTE*		pSplit,
+	FILEOFFSET*	poffSplit
+)
+{
+	DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+	UINT			cbEntry	= GetEntrySize(pNode);
+	UINT			idx		= LowerBound(pNode, pEntry);
+	bool			fLeaf	= (pNode->Flags & DB_NODE_LEAF) != 0;
+	vector<BYTE>	rgEntry(cbEntry);
+
+	memcpy(&rgEntry[0], pEntry, m_cbEntry);
+
+	if (!fLeaf)
+	{
+		memcpy(&rgEntry[m_cbEntry], &offChild, sizeof(FILEOFFSET));
+	}
+
+	// Room in the node - shift entries up
+	if (pNode->Count < GetMaxEntries(pNode))
+	{
+		BYTE* pPos = GetEntry(pNode, idx);
+		memmove(pPos + cbEntry, pPos, (pNode->Count - idx) * cbEntry);
+		memcpy(pPos, &rgEntry[0], cbEntry);
+		pNode->Count++;
+
+		m_pBufferMgr->Unpin(pPage, true);
+		return false;
+	}
+
+	// Node is full - merge the new entry into a work buffer and split it
+	UINT			cTotal	= pNode->Count + 1;
+	UINT			cLeft	= cTotal / 2;
+	vector<BYTE>	rgWork(cTotal * cbEntry);
+
+	memcpy(&rgWork[0], GetEntry(pNode, 0), idx * cbEntry);
+	memcpy(&rgWork[idx * cbEntry], &rgEntry[0], cbEntry);
+	memcpy(&rgWork[(idx + 1) * cbEntry], GetEntry(pNode, idx), (pNode->Count - idx) * cbEntry);
+
+	CDbPage*		pRightPage	= NULL;
+	DbIndexNode*	pRight		= NULL;
+	FILEOFFSET		offRight	= 0;
+
+	try
+	{
+		offRight	= NewNode(pNode->Flags);
+		pRightPage	= m_pBufferMgr->Pin(offRight / DB_PAGE_SIZE);
+		pRight		= (DbIndexNode*) pRightPage->GetData();
+	}
+	catch ( ... )
+	{
+		m_pBufferMgr->Unpin(pPage);
+		throw;
+	}
+
+	if (fLeaf)
+	{
+		// Right leaf starts with the separator
+		pRight->Count = cTotal - cLeft;
+		memcpy(GetEntry(pRight, 0), &rgWork[cLeft * cbEntry], pRight->Count * cbEntry);
+
+		pRight->Next = pNode->Next;
+		pNode->Next	 = offRight;
+	}
+	else
+	{
+		// Separator moves up; its child becomes the leftmost child on the right
+		memcpy(&pRight->Child, &rgWork[(cLeft * cbEntry) + m_cbEntry], sizeof(FILEOFFSET));
+
+		pRight->Count = cTotal - cLeft - 1;
+		memcpy(GetEntry(pRight, 0), &rgWork[(cLeft + 1) * cbEntry], pRight->Count * cbEntry);
+	}
+
+	pNode->Count = cLeft;
+	memcpy(GetEntry(pNode, 0), &rgWork[0], cLeft * cbEntry);
+
+	memcpy(pSplit, &rgWork[cLeft * cbEntry], m_cbEntry);
+	*poffSplit = offRight;
+
+	m_pBufferMgr->Unpin(pRightPage, true);
+	m_pBufferMgr->Unpin(pPage, true);
+
+	return true;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::FindLeaf
+//
+//  Description:
+//      Descend from the root to the leaf that covers an entry
+//
+//  Inputs:
+//      pEntry == IN: Entry (key, slot)
+//
+//  Returns:
+//      Leaf node offset
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbBTree::FindLeaf
+(
+	const BYTE* pEntry
+)
+{
+	FILEOFFSET offNode = GetIndexInfo()->Offset;
+
+	while (true)
+	{
+		CDbPage*		pPage	= m_pBufferMgr->Pin(offNode / DB_PAGE_SIZE);
+		DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+
+		if (pNode->Flags & DB_NODE_LEAF)
+		{
+			m_pBufferMgr->Unpin(pPage);
+			return offNode;
+		}
+
+		offNode = GetChild(pNode, UpperBound(pNode, pEntry));
+		m_pBufferMgr->Unpin(pPage);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::NewNode
+//
+//  Description:
+//      Allocate and initialize an empty node
+//
+//  Inputs:
+//      fFlags == IN: Node flags
+//
+//  Returns:
+//      Node offset
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbBTree::NewNode
+(
+	UINT fFlags
+)
+{
+	FILEOFFSET		offNode	= AllocatePage();
+	CDbPage*		pPage	= m_pBufferMgr->Pin(offNode / DB_PAGE_SIZE);
+	DbIndexNode*	pNode	= (DbIndexNode*) pPage->GetData();
+
+	memset(pNode, 0, DB_PAGE_SIZE);
+	pNode->Flags = fFlags;
+
+	m_pBufferMgr->Unpin(pPage, true);
+	return offNode;
+}
+
+// ================================================================================
+// NODE LAYOUT
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::LowerBound
+//
+//  Description:
+//      Binary search for the first entry not less than an entry
+//
+//  Inputs:
+//      pNode	== IN: Node
+//		pEntry	== IN: Entry (key, slot)
+//
+//  Returns:
+//      Entry index (Count if every entry is less)
+// --------------------------------------------------------------------------------
+UINT CDbBTree::LowerBound
+(
+	DbIndexNode*	pNode,
+	const BYTE*		pEntry
+)
+{
+	UINT idxLow	 = 0;
+	UINT idxHigh = pNode->Count;
+
+	while (idxLow < idxHigh)
+	{
+		UINT idxMid = (idxLow + idxHigh) / 2;
+
+		if (CompareEntry(GetEntry(pNode, idxMid), pEntry) < 0)
+		{
+			idxLow = idxMid + 1;
+		}
+		else
+		{
+			idxHigh = idxMid;
+		}
+	}
+
+	return idxLow;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::UpperBound
+//
+//  Description:
+//      Binary search for the first entry greater than an entry
+//
+//  Inputs:
+//      pNode	== IN: Node
+//		pEntry	== IN: Entry (key, slot)
+//
+//  Returns:
+//      Entry index (Count if no entry is greater)
+// --------------------------------------------------------------------------------
+UINT CDbBTree::UpperBound
+(
+	DbIndexNode*	pNode,
+	const BYTE*		pEntry
+)
+{
+	UINT idxLow	 = 0;
+	UINT idxHigh = pNode->Count;
+
+	while (idxLow < idxHigh)
+	{
+		UINT idxMid = (idxLow + idxHigh) / 2;
+
+		if (CompareEntry(GetEntry(pNode, idxMid), pEntry) <= 0)
+		{
+			idxLow = idxMid + 1;
+		}
+		else
+		{
+			idxHigh = idxMid;
+		}
+	}
+
+	return idxLow;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::CompareEntry
+//
+//  Description:
+//      Compare two entries by key and then by slot
+//
+//  Inputs:
+//      pEntry1 == IN: First entry
+//		pEntry2 == IN: Second entry
+//
+//  Returns:
+//      < 0, 0, > 0 as first entry is less than, equal to or greater than second
+// --------------------------------------------------------------------------------
+INT CDbBTree::CompareEntry
+(
+	const BYTE* pEntry1,
+	const BYTE* pEntry2
+)
+{
+	INT iCompare = CompareKey(pEntry1, pEntry2);
+
+	if (iCompare != 0)
+	{
+		return iCompare;
+	}
+
+	DBPOS idxSlot1;
+	DBPOS idxSlot2;
+
+	memcpy(&idxSlot1, pEntry1 + m_cbKey, sizeof(DBPOS));
+	memcpy(&idxSlot2, pEntry2 + m_cbKey, sizeof(DBPOS));
+
+	return (idxSlot1 < idxSlot2) ? -1 : (idxSlot1 > idxSlot2) ? 1 : 0;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::GetEntry
+//
+//  Description:
+//      Address of an entry in a node
+// --------------------------------------------------------------------------------
+BYTE* CDbBTree::GetEntry
+(
+	DbIndexNode*	pNode,
+	UINT			idx
+)
+{
+	return ((BYTE*) (pNode + 1)) + (idx * GetEntrySize(pNode));
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::GetEntrySize
+//
+//  Description:
+//      Size of the entries of a node.  Interior entries carry a child offset.
+// --------------------------------------------------------------------------------
+UINT CDbBTree::GetEntrySize
+(
+	DbIndexNode* pNode
+)
+{
+	if (pNode->Flags & DB_NODE_LEAF)
+	{
+		return m_cbEntry;
+	}
+
+	return m_cbEntry + sizeof(FILEOFFSET);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::GetMaxEntries
+//
+//  Description:
+//      Count of entries that fit in a node
+// --------------------------------------------------------------------------------
+UINT CDbBTree::GetMaxEntries
+(
+	DbIndexNode* pNode
+)
+{
+	return (DB_PAGE_SIZE - sizeof(DbIndexNode)) / GetEntrySize(pNode);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBTree::GetChild
+//
+//  Description:
+//      Child pointer of an interior node.  Child 0 is the leftmost child; child
+//		n is stored with entry n - 1.
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbBTree::GetChild
+(
+	DbIndexNode*	pNode,
+	UINT			idx
+)
+{
+	FILEOFFSET offChild = pNode->Child;
+
+	if (idx > 0)
+	{
+		memcpy(&offChild, GetEntry(pNode, idx - 1) + m_cbEntry, sizeof(FILEOFFSET));
+	}
+
+	return offChild;
+}
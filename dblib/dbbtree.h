@@ -0,0 +1,82 @@
+// ================================================================================
+//
+//	File:
+//      dbbtree.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      B+tree index definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBBTREE_H__
+#define __DBBTREE_H__
+
+// Node flags
+const UINT DB_NODE_LEAF = 0x0001;
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbIndexNode
+//
+//  Description:
+//      B+tree node header.  Each node fills one page and the header is followed
+//		by the node entries:
+//
+//		Leaf		-> key, slot
+//		Interior	-> key, slot, child (child holds entries >= key, slot)
+// --------------------------------------------------------------------------------
+struct DbIndexNode
+{
+	UINT		Flags;			// Node flags
+	UINT		Count;			// Count of entries in the node
+	FILEOFFSET	Next;			// Right sibling (leaf nodes)
+	FILEOFFSET	Child;			// Child holding entries below the first key (interior nodes)
+};
+
+// ================================================================================
+// Class:
+//      CDbBTree
+//
+//  Description:
+//      B+tree index.  Entries are ordered by (key, slot).  Leaves are linked so
+//		duplicate keys can be followed across nodes.  Removal does not merge
+//		nodes; space is reclaimed when the file is compacted.
+// ================================================================================
+class CDbBTree : public CDbIndex
+{
+public:
+	CDbBTree(CDbFile* pdbFile, UINT idxCatalog);
+	~CDbBTree();
+
+	void Insert(const BYTE* pKey, DBPOS idxSlot);
+	void Remove(const BYTE* pKey, DBPOS idxSlot);
+	bool Find(const BYTE* pKey, DBPOS* pidxSlot);
+	void GetPages(vector<FILEOFFSET>& rgPages);
+
+private:
+	bool		InsertNode(FILEOFFSET offNode, const BYTE* pEntry, BYTE* pSplit, FILEOFFSET* poffSplit);
+	bool		InsertEntry(CDbPage* pPage, const BYTE* pEntry, FILEOFFSET offChild, BYTE* pSplit, FILEOFFSET* poffSplit);
+	FILEOFFSET	FindLeaf(const BYTE* pEntry);
+	FILEOFFSET	NewNode(UINT fFlags);
+
+	UINT		LowerBound(DbIndexNode* pNode, const BYTE* pEntry);
+	UINT		UpperBound(DbIndexNode* pNode, const BYTE* pEntry);
+	INT			CompareEntry(const BYTE* pEntry1, const BYTE* pEntry2);
+
+	BYTE*		GetEntry(DbIndexNode* pNode, UINT idx);
+	UINT		GetEntrySize(DbIndexNode* pNode);
+	UINT		GetMaxEntries(DbIndexNode* pNode);
+	FILEOFFSET	GetChild(DbIndexNode* pNode, UINT idx);
+
+private:
+	UINT		m_cbKey;		// Key width
+	UINT		m_cbEntry;		// Leaf entry size (key, slot)
+};
+
+#endif // __DBBTREE_H__
@@ -0,0 +1,1283 @@
+// ================================================================================
+//
+//	File:
+//		dbbuffer.cpp
+//
+//	Component:
+//		Database Engine
+//
+//	Description:
+//		Page buffer pool implementation
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// Smallest pool that still leaves room for a few pinned pages
+const UINT DB_MIN_CACHE_PAGES = 8;
+
+// Longest wait for a pinned frame to be released (ms)
+const UINT DB_PIN_WAIT = 5000;
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      ComparePageId
+//
+//  Description:
+//      Order pages by file position
+// --------------------------------------------------------------------------------
+static bool ComparePageId
+(
+	CDbPage* pPage1,
+	CDbPage* pPage2
+)
+{
+	return pPage1->GetPageID() < pPage2->GetPageID();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::CDbBufferManager
+//
+//  Description:
+//      Default constructor.  Allocates the frame pool.
+//
+//  Inputs:
+//		pFile	== IN: Disk file backing the cache
+//		cbCache	== IN: Memory budget (bytes)
+// --------------------------------------------------------------------------------
+CDbBufferManager::CDbBufferManager
+(
+	CFile*	pFile,
+	UINT	cbCache
+)
+{
+	TRACE_INIT("CDbBufferManager::CDbBufferManager");
+
+	m_pFile		= pFile;
+	m_cPages	= max(cbCache / DB_PAGE_SIZE, DB_MIN_CACHE_PAGES);
+	m_idxClock	= 0;
+	m_pPool		= CFile::AllocBuffer(m_cPages * DB_PAGE_SIZE);
+	m_rgPages	= new CDbPage*[m_cPages];
+
+	m_fWriteThrough	= false;
+	m_fChange		= false;
+	m_idWriter		= 0;
+
+	for (UINT idx = 0; idx < m_cPages; idx++)
+	{
+		m_rgPages[idx] = new CDbPage(this, m_pPool + (idx * DB_PAGE_SIZE));
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::~CDbBufferManager
+//
+//  Description:
+//      Default destructor.  Outstanding changes must be flushed by the owner.
+// --------------------------------------------------------------------------------
+CDbBufferManager::~CDbBufferManager()
+{
+	TRACE_INIT("CDbBufferManager::~CDbBufferManager");
+
+	for (UINT idx = 0; idx < m_cPages; idx++)
+	{
+		FreeImage(m_rgPages[idx]);
+		delete m_rgPages[idx];
+	}
+
+	delete[] m_rgPages;
+	CFile::FreeBuffer(m_pPool);
+}
+
+// ================================================================================
+// PAGE OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::Pin
+//
+//  Description:
+//      Pin page in the cache.  The page is not evicted until it is unpinned.
+//		The access lock is only held to find or claim the frame; the page is
+//		loaded, or another thread's load waited out, after it is released.
+//		A page pinned by the thread making the current change is not flushed
+//		until it is unpinned, since that thread may modify it in place.
+//
+//  Inputs:
+//      idPage == IN: File page
+//
+//  Returns:
+//      Pointer to pinned page
+// --------------------------------------------------------------------------------
+CDbPage* CDbBufferManager::Pin
+(
+	DBPAGEID idPage
+)
+{
+	CDbPage* pPage = PinPage(idPage, 1);
+
+	// The caller may modify the page before it is unpinned
+	if (m_pLog)
+	{
+		m_mutex.Lock();
+		SaveImage(pPage);
+
+		if (m_idWriter == CThread::GetCurrentId())
+		{
+			pPage->m_cWritePin++;
+		}
+
+		m_mutex.Unlock();
+	}
+
+	return pPage;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::Unpin
+//
+//  Description:
+//      Release pin on a page
+//
+//  Inputs:
+//      pPage	== IN: Pinned page
+//		fDirty	== IN: Page data was modified while pinned
+// --------------------------------------------------------------------------------
+void CDbBufferManager::Unpin
+(
+	CDbPage*	pPage,
+	bool		fDirty
+)
+{
+	m_mutex.Lock();
+
+	_ASSERTE(pPage->m_cPin > 0);
+
+	if (fDirty)
+	{
+		MarkDirty(pPage, 0, DB_PAGE_SIZE);
+	}
+
+	if (pPage->m_cWritePin > 0 && m_idWriter == CThread::GetCurrentId())
+	{
+		pPage->m_cWritePin--;
+	}
+
+	pPage->m_cPin--;
+
+	if (!pPage->IsPinned())
+	{
+		m_evUnpin.Set();
+	}
+
+	m_mutex.Unlock();
+}
+
+// ================================================================================
+// DATA OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::Read
+//
+//  Description:
+//      Read n bytes at a file offset through the cache.  Runs of pages that
+//		are not resident are read with one batch of asynchronous requests.
+//		The access lock is held only to find and pin each page; the disk
+//		reads and the copy happen under the frame latches.
+//
+//  Inputs:
+//		offset	== IN:	File offset
+//      pBuffer	== OUT: Output buffer
+//		cbLen	== IN:	Count of bytes to read
+//
+//	Returns:
+//		Count of bytes read
+// --------------------------------------------------------------------------------
+UINT CDbBufferManager::Read
+(
+	FILEOFFSET	offset,
+	void*		pBuffer,
+	UINT		cbLen
+)
+{
+	BYTE*	pOut	= (BYTE*) pBuffer;
+	UINT	cbRead	= 0;
+
+	if (!pBuffer)
+	{
+		throw invalid_argument("Read buffer invalid");
+	}
+
+	while (cbRead < cbLen)
+	{
+		UINT		cbPage	= offset % DB_PAGE_SIZE;
+		UINT		cbCopy	= min(DB_PAGE_SIZE - cbPage, cbLen - cbRead);
+		DBPAGEID	idPage	= offset / DB_PAGE_SIZE;
+		UINT		cPages	= ((offset + (cbLen - cbRead) - 1) / DB_PAGE_SIZE) - idPage + 1;
+		CDbPage*	pPage	= PinPage(idPage, cPages);
+
+		// Keeps writers off the frame while it is copied
+		pPage->m_latch.ReadLock();
+		memcpy(pOut + cbRead, pPage->m_pData + cbPage, cbCopy);
+		pPage->m_latch.Unlock();
+
+		Unpin(pPage);
+
+		offset += cbCopy;
+		cbRead += cbCopy;
+	}
+
+	return cbRead;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::Write
+//
+//  Description:
+//      Write n bytes at a file offset through the cache.  Pages that are
+//		completely overwritten are not read from disk first.  With a log
+//		attached only the bytes that actually change are tracked, except on
+//		pages that reach past the end of the file: those are tracked whole so
+//		the file grows to cover them even where the new bytes are zero.
+//
+//  Inputs:
+//		offset	== IN:	File offset
+//      pBuffer	== IN:	Input buffer
+//		cbLen	== IN:	Count of bytes to write
+//
+//	Returns:
+//		Count of bytes written
+// --------------------------------------------------------------------------------
+UINT CDbBufferManager::Write
+(
+	FILEOFFSET	offset,
+	const void*	pBuffer,
+	UINT		cbLen
+)
+{
+	const BYTE*	pIn			= (const BYTE*) pBuffer;
+	UINT		cbWritten	= 0;
+
+	if (!pBuffer)
+	{
+		throw invalid_argument("Input buffer invalid");
+	}
+
+	m_mutex.Lock();
+
+	try
+	{
+		UINT cbFile = m_pLog ? m_pFile->GetFileSize() : 0;
+
+		while (cbWritten < cbLen)
+		{
+			UINT	 cbPage	= offset % DB_PAGE_SIZE;
+			UINT	 cbCopy	= min(DB_PAGE_SIZE - cbPage, cbLen - cbWritten);
+			CDbPage* pPage	= GetPage(offset / DB_PAGE_SIZE, cbCopy < DB_PAGE_SIZE);
+
+			UINT	 cbStart = cbPage;
+			UINT	 cbEnd	 = cbPage + cbCopy;
+
+			// Keep readers copying outside the access lock off the frame
+			LatchPage(pPage, cbCopy < DB_PAGE_SIZE);
+
+			// Trim unchanged bytes so the log holds only real changes.  Pages
+			// that were not read from disk must be logged whole, and bytes past
+			// the end of the file read as zero but are not yet on disk.
+			if (m_pLog && cbCopy < DB_PAGE_SIZE && pPage->GetOffset() + DB_PAGE_SIZE <= cbFile)
+			{
+				const BYTE* pSrc = pIn + cbWritten - cbPage;
+
+				while (cbStart < cbEnd && pPage->m_pData[cbStart] == pSrc[cbStart])
+				{
+					cbStart++;
+				}
+
+				while (cbEnd > cbStart && pPage->m_pData[cbEnd - 1] == pSrc[cbEnd - 1])
+				{
+					cbEnd--;
+				}
+			}
+
+			if (cbStart < cbEnd)
+			{
+				SaveImage(pPage);
+			}
+
+			memcpy(pPage->m_pData + cbPage, pIn + cbWritten, cbCopy);
+
+			if (cbStart < cbEnd)
+			{
+				MarkDirty(pPage, cbStart, cbEnd);
+			}
+
+			// Logged changes reach the file after they are committed
+			if (m_fWriteThrough && !m_pLog)
+			{
+				try
+				{
+					WritePage(pPage);
+				}
+				catch ( ... )
+				{
+					pPage->m_latch.Unlock();
+					throw;
+				}
+			}
+
+			pPage->m_latch.Unlock();
+
+			offset	  += cbCopy;
+			cbWritten += cbCopy;
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return cbWritten;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::Flush
+//
+//  Description:
+//      Write all modified pages to disk in file order.  The writes are queued
+//		together so the device sees many requests at once.  Pages holding
+//		changes that have not been logged are skipped, and so are pages the
+//		thread making the current change has pinned: it may be modifying
+//		them before the change is marked on the page.
+// --------------------------------------------------------------------------------
+void CDbBufferManager::Flush()
+{
+	TRACE_INIT("CDbBufferManager::Flush");
+
+	m_mutex.Lock();
+
+	try
+	{
+		vector<CDbPage*>	rgWrite;
+		DBLSN				lsnMax = 0;
+
+		for (PageMap::iterator it = m_mapPages.begin(); it != m_mapPages.end(); it++)
+		{
+			CDbPage* pPage = it->second;
+
+			if (pPage->m_fDirty && !(m_pLog && pPage->IsUnlogged()) && pPage->m_cWritePin == 0)
+			{
+				rgWrite.push_back(pPage);
+				lsnMax = max(lsnMax, pPage->m_lsn);
+			}
+		}
+
+		// Write-ahead: one log flush covers every page in the batch
+		if (m_pLog && lsnMax > m_pLog->GetFlushedLsn())
+		{
+			m_pLog->Flush(lsnMax);
+		}
+
+		for (UINT idx = 0; idx < rgWrite.size(); idx++)
+		{
+			m_pFile->WriteAtAsync(rgWrite[idx]->GetOffset(), rgWrite[idx]->m_pData, DB_PAGE_SIZE);
+		}
+
+		m_pFile->WaitAsync();
+
+		for (UINT idx = 0; idx < rgWrite.size(); idx++)
+		{
+			rgWrite[idx]->m_fDirty = false;
+		}
+
+		m_pFile->Flush();
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::Invalidate
+//
+//  Description:
+//      Discard all cached pages without writing them.  Used once the file has
+//		been flushed and closed.
+// --------------------------------------------------------------------------------
+void CDbBufferManager::Invalidate()
+{
+	m_mutex.Lock();
+
+	for (UINT idx = 0; idx < m_cPages; idx++)
+	{
+		CDbPage* pPage = m_rgPages[idx];
+
+		_ASSERTE(!pPage->IsPinned());
+
+		pPage->m_fValid			= false;
+		pPage->m_fDirty			= false;
+		pPage->m_fReferenced	= false;
+		pPage->m_fFailed		= false;
+		pPage->m_cbLogStart		= 0;
+		pPage->m_cbLogEnd		= 0;
+		pPage->m_lsn			= 0;
+
+		FreeImage(pPage);
+	}
+
+	m_mapPages.clear();
+	m_rgUnlogged.clear();
+	m_rgImages.clear();
+	m_idxClock = 0;
+	m_fChange  = false;
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::LogPages
+//
+//  Description:
+//      Append every change that has not been logged to the log, in file order.
+//		The pages may be written once the returned LSN is durable.
+//
+//  Returns:
+//      LSN of the last record appended (zero if nothing changed)
+// --------------------------------------------------------------------------------
+DBLSN CDbBufferManager::LogPages()
+{
+	DBLSN lsn = 0;
+
+	TRACE_INIT("CDbBufferManager::LogPages");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_pLog)
+		{
+			throw logic_error("No log attached");
+		}
+
+		sort(m_rgUnlogged.begin(), m_rgUnlogged.end(), ComparePageId);
+
+		for (UINT idx = 0; idx < m_rgUnlogged.size(); idx++)
+		{
+			CDbPage* pPage = m_rgUnlogged[idx];
+
+			lsn = m_pLog->Append(DB_LOG_DATA,
+								 pPage->GetOffset() + pPage->m_cbLogStart,
+								 pPage->m_pData + pPage->m_cbLogStart,
+								 pPage->m_cbLogEnd - pPage->m_cbLogStart);
+
+			pPage->m_lsn		= lsn;
+			pPage->m_cbLogStart	= 0;
+			pPage->m_cbLogEnd	= 0;
+
+			// The logged data is now the committed data
+			FreeImage(pPage);
+		}
+
+		m_rgUnlogged.clear();
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return lsn;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::BeginChange
+//
+//  Description:
+//      Start a change that may be rolled back.  Until EndChange, a dirty page
+//		keeps an image of its committed data from the time it is first pinned
+//		or written.  Only applies with a log attached: without one, modified
+//		pages may reach the file at any time.  The calling thread is the one
+//		making the change.
+// --------------------------------------------------------------------------------
+void CDbBufferManager::BeginChange()
+{
+	m_mutex.Lock();
+	m_fChange	= true;
+	m_idWriter	= CThread::GetCurrentId();
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::EndChange
+//
+//  Description:
+//      Finish a change started by BeginChange.  On commit the changes must
+//		already have been logged by LogPages.  Otherwise every change that has
+//		not been logged is discarded: dirty pages get their committed image
+//		back, and pages that were clean are dropped and read again when next
+//		used.  Pinned clean pages are read again at once.
+//
+//  Inputs:
+//      fCommit == IN: Change completed (otherwise it is rolled back)
+// --------------------------------------------------------------------------------
+void CDbBufferManager::EndChange
+(
+	bool fCommit
+)
+{
+	TRACE_INIT("CDbBufferManager::EndChange");
+
+	m_mutex.Lock();
+
+	for (UINT idx = 0; !fCommit && idx < m_rgUnlogged.size(); idx++)
+	{
+		CDbPage* pPage = m_rgUnlogged[idx];
+
+		// Keep readers copying outside the access lock off the frame
+		pPage->m_latch.WriteLock();
+
+		pPage->m_cbLogStart	= 0;
+		pPage->m_cbLogEnd	= 0;
+
+		if (pPage->m_pImage)
+		{
+			memcpy(pPage->m_pData, pPage->m_pImage, DB_PAGE_SIZE);
+		}
+		else
+		{
+			pPage->m_fDirty = false;
+
+			try
+			{
+				if (pPage->IsPinned())
+				{
+					ReadPage(pPage);
+				}
+				else
+				{
+					DropFrame(pPage);
+				}
+			}
+			catch ( ... )
+			{
+				// Threads waiting on the frame load the page again
+				pPage->m_fFailed = true;
+				DropFrame(pPage);
+			}
+		}
+
+		pPage->m_latch.Unlock();
+	}
+
+	if (!fCommit)
+	{
+		m_rgUnlogged.clear();
+	}
+
+	for (UINT idx = 0; idx < m_rgImages.size(); idx++)
+	{
+		FreeImage(m_rgImages[idx]);
+	}
+
+	m_rgImages.clear();
+	m_fChange	= false;
+	m_idWriter	= 0;
+
+	m_mutex.Unlock();
+}
+
+// ================================================================================
+// FRAME MANAGEMENT
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::PinPage
+//
+//  Description:
+//      Pin a page that has finished loading.  The access lock is held only to
+//		find and pin the page, or to claim frames for it and the pages after
+//		it that are not resident.  The claimed pages are read with one batch
+//		of asynchronous requests once the lock is released.  A page another
+//		thread is loading is waited out on its latch; if that load fails the
+//		page is claimed again.
+//
+//  Inputs:
+//      idPage	== IN: File page
+//		cPages	== IN: Count of pages the caller reads from idPage on
+//
+//  Returns:
+//      Pointer to pinned page
+//
+//  Exceptions:
+//		runtime_error == page could not be read
+// --------------------------------------------------------------------------------
+CDbPage* CDbBufferManager::PinPage
+(
+	DBPAGEID	idPage,
+	UINT		cPages
+)
+{
+	while (true)
+	{
+		CDbPage*		 pPage = NULL;
+		vector<CDbPage*> rgLoad;
+
+		m_mutex.Lock();
+
+		try
+		{
+			PageMap::iterator it = m_mapPages.find(idPage);
+
+			// Bring the missing pages of a long read in together
+			if (it == m_mapPages.end())
+			{
+				ClaimPages(idPage, cPages, rgLoad);
+				it = m_mapPages.find(idPage);
+			}
+
+			pPage = it->second;
+			pPage->m_fReferenced = true;
+			pPage->m_cPin++;
+		}
+		catch ( ... )
+		{
+			m_mutex.Unlock();
+			throw;
+		}
+
+		m_mutex.Unlock();
+
+		bool fLoaded = false;
+
+		try
+		{
+			if (!rgLoad.empty())
+			{
+				LoadPages(rgLoad);
+			}
+
+			// Waits while another thread loads the page
+			pPage->m_latch.ReadLock();
+			fLoaded = !pPage->m_fFailed;
+			pPage->m_latch.Unlock();
+		}
+		catch ( ... )
+		{
+			Unpin(pPage);
+			throw;
+		}
+
+		if (fLoaded)
+		{
+			return pPage;
+		}
+
+		// Another thread failed to load the page - load it again
+		Unpin(pPage);
+		CThread::Relinquish();
+	}
+}
+
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::GetPage
+//
+//  Description:
+//      Find page in the cache or bring it into a free frame.  Caller must hold
+//		the access lock, which is released while waiting for a frame.
+//
+//  Inputs:
+//      idPage	== IN: File page
+//		fLoad	== IN: Read page contents from disk (otherwise zero filled)
+//
+//  Returns:
+//      Pointer to resident page
+// --------------------------------------------------------------------------------
+CDbPage* CDbBufferManager::GetPage
+(
+	DBPAGEID	idPage,
+	bool		fLoad
+)
+{
+	CDbPage* pPage = NULL;
+
+	while (true)
+	{
+		PageMap::iterator it = m_mapPages.find(idPage);
+
+		if (it != m_mapPages.end())
+		{
+			it->second->m_fReferenced = true;
+			return it->second;
+		}
+
+		// Page is not resident - reuse a frame
+		if ((pPage = GetFrame(idPage)) != NULL)
+		{
+			break;
+		}
+
+		// Another thread may bring the page in meanwhile
+		WaitForUnpin();
+	}
+
+	try
+	{
+		if (fLoad)
+		{
+			ReadPage(pPage);
+		}
+		else
+		{
+			memset(pPage->m_pData, 0, DB_PAGE_SIZE);
+		}
+	}
+	catch ( ... )
+	{
+		DropFrame(pPage);
+		throw;
+	}
+
+	return pPage;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::GetFrame
+//
+//  Description:
+//      Assign a free frame to a page that is not resident.  The frame data is
+//		not initialized.  Caller must hold the access lock.
+//
+//  Inputs:
+//      idPage == IN: File page
+//
+//  Returns:
+//      Pointer to frame; NULL if every frame that could be reused is pinned
+// --------------------------------------------------------------------------------
+CDbPage* CDbBufferManager::GetFrame
+(
+	DBPAGEID idPage
+)
+{
+	CDbPage* pPage = GetVictim();
+
+	if (!pPage)
+	{
+		return NULL;
+	}
+
+	if (pPage->m_fValid)
+	{
+		if (pPage->m_fDirty)
+		{
+			WritePage(pPage);
+		}
+
+		m_mapPages.erase(pPage->m_idPage);
+		pPage->m_fValid = false;
+	}
+
+	FreeImage(pPage);
+
+	pPage->m_idPage			= idPage;
+	pPage->m_fValid			= true;
+	pPage->m_fDirty			= false;
+	pPage->m_fReferenced	= true;
+	pPage->m_fFailed		= false;
+
+	m_mapPages[idPage] = pPage;
+	return pPage;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::DropFrame
+//
+//  Description:
+//      Release a frame whose page could not be loaded.  Caller must hold the
+//		access lock.
+//
+//  Inputs:
+//      pPage == IN: Frame to release
+// --------------------------------------------------------------------------------
+void CDbBufferManager::DropFrame
+(
+	CDbPage* pPage
+)
+{
+	m_mapPages.erase(pPage->m_idPage);
+
+	pPage->m_fValid			= false;
+	pPage->m_fReferenced	= false;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::ClaimPages
+//
+//  Description:
+//      Assign frames to a run of pages that are not resident, to be loaded by
+//		LoadPages once the access lock is released.  Each frame is returned
+//		pinned with its latch held exclusively, so threads that find the page
+//		meanwhile wait for it to load.  At most half of the frames that are
+//		free to reuse are claimed, so the batch cannot evict itself and
+//		leaves frames for the batches of other readers.  Resident pages in
+//		the run are left alone.  Only the first page waits for a frame; the
+//		batch stops short if the rest are pinned.  Caller must hold the access
+//		lock.
+//
+//  Inputs:
+//      idFirst	== IN:	First page of the run
+//		cPages	== IN:	Count of pages in the run
+//		rgLoad	== OUT:	Frames claimed
+// --------------------------------------------------------------------------------
+void CDbBufferManager::ClaimPages
+(
+	DBPAGEID			idFirst,
+	UINT				cPages,
+	vector<CDbPage*>&	rgLoad
+)
+{
+	if (cPages > 1)
+	{
+		UINT cFree = 0;
+
+		for (UINT idx = 0; idx < m_cPages; idx++)
+		{
+			if (!m_rgPages[idx]->IsPinned() && !(m_pLog && m_rgPages[idx]->IsUnlogged()))
+			{
+				cFree++;
+			}
+		}
+
+		cPages = min(cPages, max(cFree / 2, 1U));
+	}
+
+	try
+	{
+		for (UINT idx = 0; idx < cPages; )
+		{
+			if (m_mapPages.find(idFirst + idx) != m_mapPages.end())
+			{
+				idx++;
+				continue;
+			}
+
+			CDbPage* pPage = GetFrame(idFirst + idx);
+
+			if (!pPage)
+			{
+				if (idx > 0)
+				{
+					break;
+				}
+
+				// Nothing is claimed yet, so waiting holds up no other thread
+				WaitForUnpin();
+				continue;
+			}
+
+			// Pinned until loaded so the batch is never chosen as a victim
+			pPage->m_cPin++;
+			pPage->m_latch.WriteLock();
+			rgLoad.push_back(pPage);
+			idx++;
+		}
+	}
+	catch ( ... )
+	{
+		for (UINT idx = 0; idx < rgLoad.size(); idx++)
+		{
+			rgLoad[idx]->m_latch.Unlock();
+			rgLoad[idx]->m_cPin--;
+			DropFrame(rgLoad[idx]);
+		}
+
+		rgLoad.clear();
+		throw;
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::LoadPages
+//
+//  Description:
+//      Read the frames claimed by ClaimPages with one batch of queued reads,
+//		then release their latches and pins.  Called without the access lock.
+//		If the batch fails, the frames are marked failed and dropped; threads
+//		waiting on them load the pages again.
+//
+//  Inputs:
+//      rgLoad == IN: Frames claimed
+//
+//  Exceptions:
+//		runtime_error == pages could not be read
+// --------------------------------------------------------------------------------
+void CDbBufferManager::LoadPages
+(
+	const vector<CDbPage*>& rgLoad
+)
+{
+	vector<UINT>	rgRead(rgLoad.size(), 0);
+	bool			fFailed = false;
+
+	try
+	{
+		for (UINT idx = 0; idx < rgLoad.size(); idx++)
+		{
+			m_pFile->ReadAtAsync(rgLoad[idx]->GetOffset(), rgLoad[idx]->m_pData, DB_PAGE_SIZE, &rgRead[idx]);
+		}
+
+		m_pFile->WaitAsync();
+	}
+	catch ( ... )
+	{
+		fFailed = true;
+
+		// Requests already queued still write to the frames
+		try
+		{
+			m_pFile->WaitAsync();
+		}
+		catch ( ... )
+		{
+		}
+	}
+
+	for (UINT idx = 0; idx < rgLoad.size(); idx++)
+	{
+		CDbPage* pPage = rgLoad[idx];
+
+		// Bytes past the end of the file read as zero
+		if (!fFailed && rgRead[idx] < DB_PAGE_SIZE)
+		{
+			memset(pPage->m_pData + rgRead[idx], 0, DB_PAGE_SIZE - rgRead[idx]);
+		}
+
+		pPage->m_fFailed = fFailed;
+		pPage->m_latch.Unlock();
+	}
+
+	m_mutex.Lock();
+
+	for (UINT idx = 0; idx < rgLoad.size(); idx++)
+	{
+		CDbPage* pPage = rgLoad[idx];
+
+		// A writer may have loaded the page again meanwhile
+		if (pPage->m_fFailed)
+		{
+			DropFrame(pPage);
+		}
+
+		pPage->m_cPin--;
+	}
+
+	m_evUnpin.Set();
+	m_mutex.Unlock();
+
+	if (fFailed)
+	{
+		throw runtime_error("Pages could not be read");
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::LatchPage
+//
+//  Description:
+//      Take a resident page's latch exclusively, waiting for a load another
+//		thread started.  A page whose load failed is loaded again.  Caller
+//		must hold the access lock and release the latch.
+//
+//  Inputs:
+//      pPage	== IN: Resident page
+//		fLoad	== IN: Read page contents from disk (otherwise zero filled)
+// --------------------------------------------------------------------------------
+void CDbBufferManager::LatchPage
+(
+	CDbPage*	pPage,
+	bool		fLoad
+)
+{
+	pPage->m_latch.WriteLock();
+
+	if (!pPage->m_fFailed)
+	{
+		return;
+	}
+
+	try
+	{
+		if (fLoad)
+		{
+			ReadPage(pPage);
+		}
+		else
+		{
+			memset(pPage->m_pData, 0, DB_PAGE_SIZE);
+		}
+	}
+	catch ( ... )
+	{
+		pPage->m_latch.Unlock();
+		throw;
+	}
+
+	pPage->m_fFailed = false;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::GetVictim
+//
+//  Description:
+//      Select frame to reuse with the clock algorithm.  Referenced frames get a
+//		second chance; pinned frames and frames with unlogged changes are
+//		skipped.  The pool never grows past its memory budget.
+//
+//  Returns:
+//      Pointer to frame; NULL if every frame that could be reused is pinned
+//
+//  Exceptions:
+//		runtime_error == every frame holds changes that are not yet logged
+// --------------------------------------------------------------------------------
+CDbPage* CDbBufferManager::GetVictim()
+{
+	bool fPinned = false;
+
+	// Two sweeps clear every reference bit at most once
+	for (UINT cSweep = 0; cSweep < 2 * m_cPages; cSweep++)
+	{
+		CDbPage* pPage = m_rgPages[m_idxClock];
+		m_idxClock = (m_idxClock + 1) % m_cPages;
+
+		if (m_pLog && pPage->IsUnlogged())
+		{
+			continue;
+		}
+
+		if (pPage->IsPinned())
+		{
+			fPinned = true;
+			continue;
+		}
+
+		if (!pPage->m_fValid)
+		{
+			return pPage;
+		}
+
+		if (pPage->m_fReferenced)
+		{
+			pPage->m_fReferenced = false;
+			continue;
+		}
+
+		return pPage;
+	}
+
+	// Unlogged changes cannot be written until they commit
+	if (!fPinned)
+	{
+		throw runtime_error("Change does not fit in the page cache");
+	}
+
+	return NULL;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::WaitForUnpin
+//
+//  Description:
+//      Wait for a pinned frame to be released.  Pins are only held for the
+//		length of a copy or a page load, so a pool that stays pinned for
+//		DB_PIN_WAIT is taken to be exhausted.  Caller must hold the access
+//		lock, which is released while waiting.
+//
+//  Exceptions:
+//		runtime_error == no frame was released in time
+// --------------------------------------------------------------------------------
+void CDbBufferManager::WaitForUnpin()
+{
+	// Frames are only released under the access lock, so none is missed
+	m_evUnpin.Reset();
+	m_mutex.Unlock();
+
+	bool fReleased = m_evUnpin.Wait(DB_PIN_WAIT);
+
+	m_mutex.Lock();
+
+	if (!fReleased)
+	{
+		throw runtime_error("Every page cache frame is pinned");
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::MarkDirty
+//
+//  Description:
+//      Mark a byte range of a page modified.  With a log attached the range is
+//		added to the changes not yet logged.  Caller must hold the access lock.
+//
+//  Inputs:
+//      pPage	== IN: Modified page
+//		cbStart	== IN: Start of the change within the page
+//		cbEnd	== IN: End of the change within the page
+// --------------------------------------------------------------------------------
+void CDbBufferManager::MarkDirty
+(
+	CDbPage*	pPage,
+	UINT		cbStart,
+	UINT		cbEnd
+)
+{
+	pPage->m_fDirty = true;
+
+	if (!m_pLog)
+	{
+		return;
+	}
+
+	if (pPage->IsUnlogged())
+	{
+		pPage->m_cbLogStart	= min(pPage->m_cbLogStart, cbStart);
+		pPage->m_cbLogEnd	= max(pPage->m_cbLogEnd, cbEnd);
+	}
+	else
+	{
+		pPage->m_cbLogStart	= cbStart;
+		pPage->m_cbLogEnd	= cbEnd;
+		m_rgUnlogged.push_back(pPage);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::SaveImage
+//
+//  Description:
+//      Keep the committed data of a page that is about to be modified, if a
+//		change is in progress and the page holds committed data that is not
+//		yet in the file.  A page that already carries changes of this change
+//		keeps its image.  Caller must hold the access lock.
+//
+//  Inputs:
+//      pPage == IN: Page about to be modified
+// --------------------------------------------------------------------------------
+void CDbBufferManager::SaveImage
+(
+	CDbPage* pPage
+)
+{
+	if (!m_fChange || !pPage->m_fDirty || pPage->IsUnlogged() || pPage->m_pImage)
+	{
+		return;
+	}
+
+	pPage->m_pImage = new BYTE[DB_PAGE_SIZE];
+	memcpy(pPage->m_pImage, pPage->m_pData, DB_PAGE_SIZE);
+
+	m_rgImages.push_back(pPage);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::FreeImage
+//
+//  Description:
+//      Release the committed image of a page, if any.  Caller must hold the
+//		access lock.
+//
+//  Inputs:
+//      pPage == IN: Page
+// --------------------------------------------------------------------------------
+void CDbBufferManager::FreeImage
+(
+	CDbPage* pPage
+)
+{
+	delete[] pPage->m_pImage;
+	pPage->m_pImage = NULL;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::ReadPage
+//
+//  Description:
+//      Load page from disk.  Bytes past the end of the file read as zero.
+//
+//  Inputs:
+//      pPage == IN: Frame to fill
+// --------------------------------------------------------------------------------
+void CDbBufferManager::ReadPage
+(
+	CDbPage* pPage
+)
+{
+	UINT cbRead = m_pFile->ReadAt(pPage->GetOffset(), pPage->m_pData, DB_PAGE_SIZE);
+
+	if (cbRead < DB_PAGE_SIZE)
+	{
+		memset(pPage->m_pData + cbRead, 0, DB_PAGE_SIZE - cbRead);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbBufferManager::WritePage
+//
+//  Description:
+//      Write page to disk and mark it clean.  The log is flushed first if it
+//		holds the latest change to the page.
+//
+//  Inputs:
+//      pPage == IN: Frame to write
+// --------------------------------------------------------------------------------
+void CDbBufferManager::WritePage
+(
+	CDbPage* pPage
+)
+{
+	_ASSERTE(!(m_pLog && pPage->IsUnlogged()));
+
+	if (m_pLog && pPage->m_lsn > m_pLog->GetFlushedLsn())
+	{
+		m_pLog->Flush(pPage->m_lsn);
+	}
+
+	UINT cbWritten = m_pFile->WriteAt(pPage->GetOffset(), pPage->m_pData, DB_PAGE_SIZE);
+	_ASSERTE(cbWritten == DB_PAGE_SIZE);
+
+	pPage->m_fDirty = false;
+}
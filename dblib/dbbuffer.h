@@ -0,0 +1,122 @@
+// ================================================================================
+//
+//	File:
+//      dbbuffer.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Page buffer pool interface
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBBUFFER_H__
+#define __DBBUFFER_H__
+
+// ================================================================================
+// Class:
+//      CDbBufferManager
+//
+//  Description:
+//      Fixed size page cache for a database file.  Pages are DB_PAGE_SIZE bytes
+//		at page aligned file offsets.  Modified pages are held until they are
+//		evicted or flushed.  Victims are chosen with the clock algorithm.
+//
+//		When a log is attached, changes are tracked per page until LogPages
+//		appends them to the log.  Such pages are never written to the file
+//		(no-steal) and a page is only written once the log holding its latest
+//		change is durable (write-ahead).  The pool never grows past its
+//		memory budget: a page that needs a frame while every frame is pinned
+//		waits for a pin to be released, and a change that leaves no frame
+//		free of unlogged changes fails.
+//
+//		Between BeginChange and EndChange the committed data of dirty pages
+//		is kept as they are modified, so a failed change can be rolled back.
+//		Pages that were clean are simply read again.  Pages the changing
+//		thread has pinned may be modified in place at any time, so Flush
+//		leaves them alone until they are unpinned.
+//
+//		Read and Pin hold the access lock only to find and pin pages.  Missing
+//		pages are loaded, and the data copied out, under each frame's latch
+//		after the access lock is released, so readers do not wait on each
+//		other's disk reads.
+// ================================================================================
+class CDbBufferManager : public CObject
+{
+public:
+	CDbBufferManager(CFile* pFile, UINT cbCache = DB_DEFAULT_CACHE_SIZE);
+	~CDbBufferManager();
+
+	// ----------------------------------------------------------------------------
+	//	PAGE OPERATIONS
+	// ----------------------------------------------------------------------------
+
+	CDbPage*	Pin(DBPAGEID idPage);
+	void		Unpin(CDbPage* pPage, bool fDirty = false);
+
+	// ----------------------------------------------------------------------------
+	//	DATA OPERATIONS
+	// ----------------------------------------------------------------------------
+
+	UINT		Read(FILEOFFSET offset, void* pBuffer, UINT cbLen);
+	UINT		Write(FILEOFFSET offset, const void* pBuffer, UINT cbLen);
+
+	void		Flush();
+	void		Invalidate();
+	DBLSN		LogPages();
+	void		BeginChange();
+	void		EndChange(bool fCommit);
+
+	// ----------------------------------------------------------------------------
+	//	PROPERTIES
+	// ----------------------------------------------------------------------------
+
+	UINT		GetPageCount()		{ return m_cPages; }
+	UINT		GetCacheSize()		{ return m_cPages * DB_PAGE_SIZE; }
+
+	// Write modified pages immediately (keeps mapped views of the file current)
+	void		SetWriteThrough(bool fWriteThrough)	{ m_fWriteThrough = fWriteThrough; }
+
+	// Log changes before they reach the file (NULL detaches the log)
+	void		SetLog(CDbLog* pLog)				{ m_pLog = pLog; }
+
+private:
+	CDbPage*	PinPage(DBPAGEID idPage, UINT cPages);
+	CDbPage*	GetPage(DBPAGEID idPage, bool fLoad);
+	CDbPage*	GetFrame(DBPAGEID idPage);
+	void		DropFrame(CDbPage* pPage);
+	void		ClaimPages(DBPAGEID idFirst, UINT cPages, vector<CDbPage*>& rgLoad);
+	void		LoadPages(const vector<CDbPage*>& rgLoad);
+	void		LatchPage(CDbPage* pPage, bool fLoad);
+	CDbPage*	GetVictim();
+	void		WaitForUnpin();
+	void		MarkDirty(CDbPage* pPage, UINT cbStart, UINT cbEnd);
+	void		SaveImage(CDbPage* pPage);
+	void		FreeImage(CDbPage* pPage);
+	void		ReadPage(CDbPage* pPage);
+	void		WritePage(CDbPage* pPage);
+
+private:
+	typedef map<DBPAGEID, CDbPage*> PageMap;
+
+	CMutex				m_mutex;			// Access lock (frame state and page map)
+	CFilePtr			m_pFile;			// Disk file
+	BYTE*				m_pPool;			// Frame memory
+	CDbPage**			m_rgPages;			// Frame descriptors
+	UINT				m_cPages;			// Count of frames
+	UINT				m_idxClock;			// Clock hand
+	bool				m_fWriteThrough;	// Write pages as soon as modified
+	PageMap				m_mapPages;			// Resident pages by page id
+	CDbLogPtr			m_pLog;				// Write-ahead log (optional)
+	vector<CDbPage*>	m_rgUnlogged;		// Pages with changes not yet logged
+	vector<CDbPage*>	m_rgImages;			// Pages that may hold a committed image
+	bool				m_fChange;			// Keep committed images (see BeginChange)
+	UINT				m_idWriter;			// Thread making the current change (zero if none)
+	CEvent				m_evUnpin;			// Set when a frame's last pin is released
+};
+
+#endif // __DBBUFFER_H__
@@ -0,0 +1,360 @@
+// ================================================================================
+//
+//	File:
+//		dbcursor.cpp
+//
+//	Component:
+//		Database Engine
+//
+//	Description:
+//		Implementation of table cursor object.
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::CDbCursor
+//
+//  Description:
+//      Default constructor
+//
+//  Inputs:
+//		pTable		== IN: Table to read
+//		fSnapshot	== IN: Open a snapshot for the cursor
+// --------------------------------------------------------------------------------
+CDbCursor::CDbCursor
+(
+	CDbTable*	pTable,
+	bool		fSnapshot
+)
+{
+	TRACE_INIT("CDbCursor::CDbCursor");
+
+	if (!pTable)
+	{
+		throw invalid_argument("Table invalid");
+	}
+
+	m_pTable		= pTable;
+	m_idxSlot		= 0;
+	m_fSnapshot		= false;
+	m_idxPrefetch	= 0;
+	m_cPrefetch		= 0;
+	m_fPrefetch		= 0;
+	m_tsPrefetch	= 0;
+
+	m_snapshot.Timestamp	= 0;
+	m_snapshot.End			= 0;
+
+	m_rgPrefetch.resize(DB_CURSOR_PREFETCH * m_pTable->m_pTableInfo->Size);
+
+	if (fSnapshot)
+	{
+		OpenSnapshot();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::~CDbCursor
+//
+//  Description:
+//      Default destructor
+// --------------------------------------------------------------------------------
+CDbCursor::~CDbCursor()
+{
+	TRACE_INIT("CDbCursor::~CDbCursor");
+
+	CloseSnapshot();
+}
+
+// ================================================================================
+// NAVIGATION
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::Fetch
+//
+//  Description:
+//      Retrieve next n records (see CDbTable::Fetch).  Requests smaller than
+//		DB_CURSOR_PREFETCH are served from the slots read ahead.
+//
+//  Inputs:
+//		prgRecords	== OUT: Record output buffer
+//      cRecords	== IN:	Count of records to retrieve
+//		fColumns	== IN:	Columns to read (PAX table only)
+//
+//  Returns:
+//      Count of records retrieved
+// --------------------------------------------------------------------------------
+UINT CDbCursor::Fetch
+(
+	DbRecord*	prgRecords,
+	UINT		cRecords,
+	UINT		fColumns
+)
+{
+	UINT	cbRecord	= m_pTable->m_pTableInfo->Size;
+	BYTE*	pOut		= (BYTE*) prgRecords;
+	UINT	cFetched	= 0;
+
+	TRACE_INIT("CDbCursor::Fetch");
+
+	if (!prgRecords)
+	{
+		throw invalid_argument("Record buffer invalid");
+	}
+
+	// Large requests gain nothing from reading ahead
+	if (cRecords >= DB_CURSOR_PREFETCH)
+	{
+		m_cPrefetch = 0;
+		return m_pTable->FetchFrom(&m_idxSlot, GetSnapshot(), prgRecords, cRecords, fColumns);
+	}
+
+	fColumns |= 1;
+
+	while (cFetched < cRecords)
+	{
+		if (!IsPrefetched(fColumns) && Prefetch(fColumns) == 0)
+		{
+			break;
+		}
+
+		UINT	idxFirst	= m_idxSlot - m_idxPrefetch;
+		UINT	cTake		= min(m_cPrefetch - idxFirst, cRecords - cFetched);
+		BYTE*	pTake		= pOut + (cFetched * cbRecord);
+
+		memcpy(pTake, &m_rgPrefetch[idxFirst * cbRecord], cTake * cbRecord);
+
+		// Adjust cursor
+		m_idxSlot += cTake;
+		cFetched  += m_pTable->DropDeleted(pTake, cTake);
+	}
+
+	// Clear the unused part of the output buffer
+	memset(pOut + (cFetched * cbRecord), 0, (cRecords - cFetched) * cbRecord);
+
+	return cFetched;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::Scan
+//
+//  Description:
+//      Retrieve the next n records that satisfy a predicate (see
+//		CDbTable::Scan)
+//
+//  Inputs:
+//		predicate	== IN:	Column comparison
+//		prgRecords	== OUT: Record output buffer
+//      cRecords	== IN:	Count of records to retrieve
+//
+//  Returns:
+//      Count of records retrieved
+//
+//  Exceptions:
+//		invalid_argument == predicate not supported (see CDbScan)
+// --------------------------------------------------------------------------------
+UINT CDbCursor::Scan
+(
+	const DbPredicate&	predicate,
+	DbRecord*			prgRecords,
+	UINT				cRecords
+)
+{
+	return m_pTable->ScanFrom(&m_idxSlot, GetSnapshot(), predicate, prgRecords, cRecords);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::Scan
+//
+//  Description:
+//      Find the slots of every record from the cursor to the end of the table
+//		that satisfies a predicate (see CDbTable::Scan)
+//
+//  Inputs:
+//		predicate	== IN:	Column comparison
+//		rgSlots		== OUT:	Selection vector
+//
+//  Returns:
+//      Count of records found
+//
+//  Exceptions:
+//		invalid_argument == predicate not supported (see CDbScan)
+// --------------------------------------------------------------------------------
+UINT CDbCursor::Scan
+(
+	const DbPredicate&	predicate,
+	vector<DBPOS>&		rgSlots
+)
+{
+	return m_pTable->ScanFrom(&m_idxSlot, GetSnapshot(), predicate, rgSlots);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::Move
+//
+//  Description:
+//      Position cursor by offset amount (see CDbTable::Move)
+//
+//  Inputs:
+//		cSkip	== IN:	Count of records to skip
+//
+//  Returns:
+//      New cursor position
+// --------------------------------------------------------------------------------
+DBPOS CDbCursor::Move
+(
+	UINT cSkip
+)
+{
+	return m_pTable->MoveFrom(&m_idxSlot, GetSnapshot(), cSkip);
+}
+
+// ================================================================================
+// SNAPSHOTS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::OpenSnapshot
+//
+//  Description:
+//      Take a snapshot of the table for the cursor (see
+//		CDbTable::OpenSnapshot).  A snapshot already open is replaced.  The
+//		cursor position is kept.
+// --------------------------------------------------------------------------------
+void CDbCursor::OpenSnapshot()
+{
+	TRACE_INIT("CDbCursor::OpenSnapshot");
+
+	CloseSnapshot();
+	m_pTable->BeginSnapshot(&m_snapshot);
+
+	m_fSnapshot = true;
+	m_cPrefetch = 0;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::CloseSnapshot
+//
+//  Description:
+//      Close the open snapshot (if any); reads see the current table again
+// --------------------------------------------------------------------------------
+void CDbCursor::CloseSnapshot()
+{
+	if (m_fSnapshot)
+	{
+		m_fSnapshot = false;
+		m_cPrefetch = 0;
+		m_pTable->EndSnapshot(&m_snapshot);
+	}
+}
+
+// ================================================================================
+// PREFETCH
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::IsPrefetched
+//
+//  Description:
+//      Check that the cursor slot was read ahead and is still current.  In a
+//		snapshot the slots never change; otherwise no change may have
+//		committed since they were read.
+//
+//  Inputs:
+//		fColumns == IN: Columns needed
+//
+//  Returns:
+//      true if Fetch can copy the slot from the read-ahead buffer
+// --------------------------------------------------------------------------------
+bool CDbCursor::IsPrefetched
+(
+	UINT fColumns
+)
+{
+	if (m_idxSlot < m_idxPrefetch || m_idxSlot >= m_idxPrefetch + m_cPrefetch)
+	{
+		return false;
+	}
+
+	if (fColumns != m_fPrefetch)
+	{
+		return false;
+	}
+
+	return m_fSnapshot || m_tsPrefetch == m_pTable->GetCommitTimestamp();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbCursor::Prefetch
+//
+//  Description:
+//      Read ahead from the cursor slot.  The commit timestamp is taken before
+//		the slots are read, so a change that commits during the read is seen
+//		as newer and the slots are read again.
+//
+//  Inputs:
+//		fColumns == IN: Columns to read
+//
+//  Returns:
+//      Count of slots read ahead
+// --------------------------------------------------------------------------------
+UINT CDbCursor::Prefetch
+(
+	UINT fColumns
+)
+{
+	UINT	cbRecord	= m_pTable->m_pTableInfo->Size;
+	DBPOS	idxEnd		= GetEnd();
+
+	m_cPrefetch		= 0;
+	m_idxPrefetch	= m_idxSlot;
+	m_fPrefetch		= fColumns;
+	m_tsPrefetch	= m_pTable->GetCommitTimestamp();
+
+	if (m_idxSlot >= idxEnd)
+	{
+		return 0;
+	}
+
+	UINT cRead = 0;
+
+	// Mapped records are used in place by ReadBlock
+	m_pTable->BeginView();
+
+	try
+	{
+		const BYTE*	pRecords = m_pTable->ReadBlock(GetSnapshot(), m_idxSlot, min(DB_CURSOR_PREFETCH, idxEnd - m_idxSlot),
+													   fColumns, m_rgPrefetch, &cRead);
+
+		if (cRead > 0 && pRecords != &m_rgPrefetch[0])
+		{
+			m_rgPrefetch.assign(pRecords, pRecords + (cRead * cbRecord));
+		}
+	}
+	catch ( ... )
+	{
+		m_pTable->EndView();
+		throw;
+	}
+
+	m_pTable->EndView();
+
+	m_cPrefetch = cRead;
+	return m_cPrefetch;
+}
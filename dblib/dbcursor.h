@@ -0,0 +1,97 @@
+// ================================================================================
+//
+//	File:
+//      dbcursor.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Table cursor object definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBCURSOR_H__
+#define __DBCURSOR_H__
+
+// Slots a cursor reads ahead for Fetch
+const UINT DB_CURSOR_PREFETCH = 256;
+
+// ================================================================================
+// Class:
+//      CDbCursor
+//
+//  Description:
+//      Cursor over a table (see CDbTable::OpenCursor).  A cursor holds only a
+//		position, a read-ahead buffer and an optional snapshot; the table
+//		object it reads is shared, so many threads may read one table at once,
+//		each through its own cursor, without locking each other out.  A cursor
+//		itself is used by one thread at a time.
+//
+//		Fetch reads up to DB_CURSOR_PREFETCH slots ahead and serves small
+//		requests from them.  Without a snapshot the slots read ahead are
+//		dropped once any change to the file commits, so a cursor never returns
+//		records older than the last change it could have seen.
+// ================================================================================
+class CDbCursor : public CObject
+{
+public:
+	CDbCursor(CDbTable* pTable, bool fSnapshot = false);
+	~CDbCursor();
+
+	// ----------------------------------------------------------------------------
+	// NAVIGATION
+	// ----------------------------------------------------------------------------
+
+	UINT  Fetch(DbRecord* prgRecords, UINT cRecords, UINT fColumns = DB_ALL_COLUMNS);
+	UINT  Scan(const DbPredicate& predicate, DbRecord* prgRecords, UINT cRecords);
+	UINT  Scan(const DbPredicate& predicate, vector<DBPOS>& rgSlots);
+
+	DBPOS Move(UINT cSkip);
+	void  MoveFirst()						{ m_idxSlot = 0; }
+	void  MoveLast()						{ m_idxSlot = GetEnd(); }
+
+	void  SetPosition(DBPOS idxSlot)		{ m_idxSlot = idxSlot; }
+	DBPOS GetPosition()						{ return m_idxSlot; }
+
+	// ----------------------------------------------------------------------------
+	// SNAPSHOTS
+	// ----------------------------------------------------------------------------
+
+	void OpenSnapshot();
+	void CloseSnapshot();
+	bool HasSnapshot()						{ return m_fSnapshot; }
+
+	// ----------------------------------------------------------------------------
+	// PROPERTIES
+	// ----------------------------------------------------------------------------
+
+	bool		IsEOF()						{ return m_idxSlot >= GetEnd(); }
+	CDbTable*	GetTable()					{ return m_pTable; }
+
+private:
+	CDbCursor(const CDbCursor&);
+	CDbCursor& operator=(const CDbCursor&);
+
+	const DbSnapshot*	GetSnapshot()		{ return m_fSnapshot ? &m_snapshot : NULL; }
+	DBPOS				GetEnd()			{ return m_pTable->GetEnd(GetSnapshot()); }
+	bool				IsPrefetched(UINT fColumns);
+	UINT				Prefetch(UINT fColumns);
+
+private:
+	CDbTablePtr		m_pTable;			// Table read
+	DBPOS			m_idxSlot;			// Current cursor slot
+	bool			m_fSnapshot;		// A snapshot is open
+	DbSnapshot		m_snapshot;			// The open snapshot
+
+	vector<BYTE>	m_rgPrefetch;		// Slots read ahead
+	DBPOS			m_idxPrefetch;		// First slot read ahead
+	UINT			m_cPrefetch;		// Count of slots read ahead
+	UINT			m_fPrefetch;		// Columns read ahead
+	DBTS			m_tsPrefetch;		// Last change committed before the read
+};
+
+#endif // __DBCURSOR_H__
@@ -24,7 +24,9 @@
 //      Default constructor
 //
 //  Inputs:
-//      None
+//      strFile		== IN: Database file name
+//		cbBuffer	== IN: Data operations buffer size
+//		cbCache		== IN: Page cache memory budget
 //
 //  Returns:
 //      Nothing
@@ -32,7 +34,8 @@
 CDbFile::CDbFile
 (
 	const string& strFile,
-	UINT cbBuffer
+	UINT cbBuffer,
+	UINT cbCache
 )
 {
     TRACE_INIT("CDbFile::CDbFile");
@@ -41,11 +44,24 @@ CDbFile::CDbFile
 	
 	m_pTableInfo	= NULL;
 	m_pIndexInfo	= NULL;
+	m_pExtentInfo	= NULL;
 	m_pFile			= new CFile(strFile);
+	m_pBufferMgr	= new CDbBufferManager(m_pFile, cbCache);
+	m_pLog			= new CDbLog(strFile + ".log");
 	m_cbBuffer		= cbBuffer;
-	m_pBuffer		= new BYTE[cbBuffer];
-
-
+	m_pBuffer		= CFile::AllocBuffer(cbBuffer);
+	m_fMode			= DB_OPEN_DEFAULT;
+	m_pView			= NULL;
+	m_cbView		= 0;
+	m_cbMapped		= 0;
+	m_cViewUsers	= 0;
+	m_cWriters		= 0;
+	m_fImage		= false;
+	m_tsCommit		= 0;
+	m_pVersions		= new CDbVersionStore();
+	m_pCompactor	= NULL;
+	m_fCompactStop	= false;
+	m_cbCompactRate	= DB_COMPACT_RATE;
 }
 
 // --------------------------------------------------------------------------------
@@ -65,11 +81,20 @@ CDbFile::~CDbFile()
 {
     TRACE_INIT("CDbFile::~CDbFile");
 
+	StopCompaction();
+
+	if (m_pFile->IsOpen())
+	{
+		m_pBufferMgr->Flush();
+	}
+
+	UnmapData();
 	m_pFile->Close();
 
 	delete[] m_pTableInfo;
 	delete[] m_pIndexInfo;
-	delete[] m_pBuffer;
+	delete[] m_pExtentInfo;
+	CFile::FreeBuffer(m_pBuffer);
 }
 
 // --------------------------------------------------------------------------------
@@ -81,13 +106,16 @@ CDbFile::~CDbFile()
 //
 //  Inputs:
 //      cTables == IN: Maximum count of tables in the file
+//		fMode	== IN: Open mode flags (only DB_OPEN_LOGGED and DB_OPEN_DIRECT
+//					   apply until the file is reopened)
 //
 //  Returns:
 //      RESULT code
 // --------------------------------------------------------------------------------
 void CDbFile::Create
 (
-	UINT cTables
+	UINT cTables,
+	UINT fMode
 )
 {
 	RESULT result = SUCCESS;
@@ -98,7 +126,7 @@ void CDbFile::Create
 
 	try
 	{
-		m_pFile->Create();
+		m_pFile->Create((fMode & DB_OPEN_DIRECT) ? FILE_DIRECT : FILE_DEFAULT);
 
 		// Initialize file header
 		m_fileInfo.MajorVersion				= verDbEngine.Major;
@@ -126,8 +154,7 @@ void CDbFile::Create
 		// Intialize index catalog metadata
 		m_fileInfo.Indexes.Size				= sizeof(DbIndexInfo);
 		m_fileInfo.Indexes.Entries			= 0;
-		m_fileInfo.Indexes.Slots			= 0;
-		// m_fileInfo.Indexes.Slots			= DB_DEFAULT_INDEX_CATALOG;
+		m_fileInfo.Indexes.Slots			= DB_DEFAULT_INDEXES;
 		m_fileInfo.Indexes.GrowthFactor		= DB_DEFAULT_GROWTH_FACTOR;
 		m_fileInfo.Indexes.LastId			= 0;
 		m_fileInfo.Indexes.Offset			= m_fileInfo.DataOffsetEnd;
@@ -135,6 +162,38 @@ void CDbFile::Create
 
 		m_pIndexInfo = (DbIndexInfo*) InitCatalog(&m_fileInfo.Indexes);
 
+		// Initialize extent catalog metadata
+		m_fileInfo.Extents.Size				= sizeof(DbExtentInfo);
+		m_fileInfo.Extents.Entries			= 0;
+		m_fileInfo.Extents.Slots			= DB_DEFAULT_EXTENTS;
+		m_fileInfo.Extents.GrowthFactor		= DB_DEFAULT_EXTENTS;
+		m_fileInfo.Extents.LastId			= 0;
+		m_fileInfo.Extents.Offset			= m_fileInfo.DataOffsetEnd;
+		m_fileInfo.DataOffsetEnd		   += m_fileInfo.Extents.Size * m_fileInfo.Extents.Slots;
+
+		m_pExtentInfo = (DbExtentInfo*) InitCatalog(&m_fileInfo.Extents);
+		m_rgFreeExtents.clear();
+
+		m_lockData.WriteLock();
+		m_mapExtents.clear();
+		m_lockData.Unlock();
+
+		// Start a fresh log - the header is logged with the first change
+		m_fMode = fMode & (DB_OPEN_LOGGED | DB_OPEN_DIRECT);
+
+		// File system may not support direct I/O
+		if (!m_pFile->IsDirect())
+		{
+			m_fMode &= ~DB_OPEN_DIRECT;
+		}
+
+		if (IsLogged())
+		{
+			m_pLog->Delete();
+			m_pLog->Open();
+			m_pBufferMgr->SetLog(m_pLog);
+		}
+
 		TRACE_DEBUG_PRINT(ctime(&m_fileInfo.Created));
 	}
 	catch ( ... )
@@ -152,9 +211,18 @@ void CDbFile::Create
 //      CDbFile::Open
 //
 //  Description:
-//      Open database file.
+//      Open database file.  Changes committed to the log but not yet saved
+//		in the file are redone first.
+//
+//	Inputs:
+//		fMode == IN: Open mode flags (DB_OPEN_MAPPED maps the data region,
+//					 DB_OPEN_LOGGED logs every change before it is written,
+//					 DB_OPEN_DIRECT bypasses the system cache)
 // --------------------------------------------------------------------------------
-void CDbFile::Open()
+void CDbFile::Open
+(
+	UINT fMode
+)
 {
 	TRACE_INIT("CDbFile::Open");
 
@@ -162,11 +230,59 @@ void CDbFile::Open()
 
 	try
 	{
-		m_pFile->Open();
+		m_pFile->Open((fMode & DB_OPEN_DIRECT) ? FILE_DIRECT : FILE_DEFAULT);
+		m_fMode = fMode;
+
+		// File system may not support direct I/O
+		if (!m_pFile->IsDirect())
+		{
+			m_fMode &= ~DB_OPEN_DIRECT;
+		}
+
+		// Mapped views must see every write as soon as it is made
+		m_pBufferMgr->SetWriteThrough(IsMapped());
+
+		// Redo committed changes left by a crash
+		if (m_pLog->Exists())
+		{
+			m_pLog->Recover(m_pFile);
+
+			if (!IsLogged())
+			{
+				m_pLog->Delete();
+			}
+		}
+
 		Load();
+
+		if (IsLogged())
+		{
+			// Indexes rebuilt by Load are not in the log - make them durable
+			m_pBufferMgr->Flush();
+			m_pFile->Sync();
+
+			m_pLog->Open();
+			m_pBufferMgr->SetLog(m_pLog);
+		}
+
+		MapData();
 	}
 	catch ( ... )
 	{
+		// A file that cannot be loaded is left closed
+		try
+		{
+			m_pBufferMgr->Invalidate();
+			m_pBufferMgr->SetWriteThrough(false);
+			m_pBufferMgr->SetLog(NULL);
+			m_pLog->Close();
+			m_pFile->Close();
+		}
+		catch ( ... )
+		{
+		}
+
+		m_fMode = DB_OPEN_DEFAULT;
 		m_mutex.Unlock();
 		throw;
 	}
@@ -186,25 +302,49 @@ void CDbFile::Close()
 {
     TRACE_INIT("CDbFile::Close");
 
+	StopCompaction();
+	BeginWrite();
 	m_mutex.Lock();
 
 	try
 	{
 		Save();
+		UnmapData();
 		m_pFile->Close();
+		m_pLog->Close();
+
+		// Cached pages belong to the closed file
+		m_pBufferMgr->Invalidate();
+		m_pBufferMgr->SetWriteThrough(false);
+		m_pBufferMgr->SetLog(NULL);
+		m_fMode = DB_OPEN_DEFAULT;
 
 		// Reset internal file state
+		m_rgIndexes.clear();
+		m_rgFreeExtents.clear();
+		m_pVersions->Clear();
+
+		m_lockData.WriteLock();
+		m_mapExtents.clear();
+		m_lockData.Unlock();
+
 		memset(&m_fileInfo, 0, sizeof(m_fileInfo));
 		delete[] m_pTableInfo;
 		delete[] m_pIndexInfo;
+		delete[] m_pExtentInfo;
+		m_pTableInfo  = NULL;
+		m_pIndexInfo  = NULL;
+		m_pExtentInfo = NULL;
 	}
 	catch ( ... )
 	{
 		m_mutex.Unlock();
+		EndWrite(false);
 		throw;
 	}
 
 	m_mutex.Unlock();
+	EndWrite(true);
 }
 
 // --------------------------------------------------------------------------------
@@ -212,257 +352,207 @@ void CDbFile::Close()
 //      CDbFile::Save
 //
 //  Description:
-//      Save file header, table catalog, and index catalog
+//      Save file header, table catalog, and index catalog.  For a logged file
+//		this is a checkpoint: outstanding changes are committed, every page is
+//		written and synced, and the log is emptied.
 // --------------------------------------------------------------------------------
 void CDbFile::Save()
 {
 	TRACE_INIT("CDbFile::Save");
 
+	BeginWrite();
 	m_mutex.Lock();
 
 	try
 	{
-		UINT cbWritten = 0;
-		
 		// Update timestamp
 		time(&m_fileInfo.LastUpdated);
 
-		// Move to beginning of the file and write file header
-		m_pFile->Seek(0);	
-		cbWritten = m_pFile->Write(&m_fileInfo, sizeof(m_fileInfo));
-		_ASSERTE(cbWritten == sizeof(m_fileInfo));
+		if (IsLogged())
+		{
+			DBLSN lsn = LogChanges();
 
-		// Save table and index catalogs
-		cbWritten = SaveCatalog(m_pFile, &m_fileInfo.Tables,  m_pTableInfo);
-		cbWritten = SaveCatalog(m_pFile, &m_fileInfo.Indexes, m_pIndexInfo);
+			if (lsn)
+			{
+				m_pLog->Flush(lsn);
+			}
+		}
+		else
+		{
+			WriteHeader();
+		}
+
+		// Commit modified pages and buffers to disk
+		m_pBufferMgr->Flush();
+
+		if (IsLogged())
+		{
+			m_pFile->Sync();
+			m_pLog->Truncate();
+		}
 
-		// Commit buffers to disk
-		m_pFile->Flush();
+		FreeRetiredViews();
 
 		TRACE_DEBUG_PRINT(ctime(&m_fileInfo.LastUpdated));
 	}
 	catch ( ... )
 	{
 		m_mutex.Unlock();
+		EndWrite(false);
 		throw;
 	}
 
 	m_mutex.Unlock();
+	EndWrite(true);
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::Compact
+//      CDbFile::WriteHeader
 //
 //  Description:
-//      Compresses empty space in tables.  Re-organizes indexes and metadata tables
-//
-//  Inputs:
-//      None
-//
-//  Returns:
-//      RESULT code
+//      Write file header and catalogs through the page cache.  Catalog pages
+//		may also hold table data, so the cached copy must not go stale.
 // --------------------------------------------------------------------------------
-void CDbFile::Compact()
+void CDbFile::WriteHeader()
 {
-    TRACE_INIT("CDbFile::Compact");
+	UINT cbWritten = m_pBufferMgr->Write(0, &m_fileInfo, sizeof(m_fileInfo));
+	_ASSERTE(cbWritten == sizeof(m_fileInfo));
+
+	m_pBufferMgr->Write(m_fileInfo.Tables.Offset, m_pTableInfo,
+						m_fileInfo.Tables.Size * m_fileInfo.Tables.Slots);
+	m_pBufferMgr->Write(m_fileInfo.Indexes.Offset, m_pIndexInfo,
+						m_fileInfo.Indexes.Size * m_fileInfo.Indexes.Slots);
+	m_pBufferMgr->Write(m_fileInfo.Extents.Offset, m_pExtentInfo,
+						m_fileInfo.Extents.Size * m_fileInfo.Extents.Slots);
+}
 
-	m_mutex.Lock();
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::BeginWrite
+//
+//  Description:
+//      Start a change to the file.  Changes do not overlap, so each commit
+//		logs exactly the pages of one complete change.  Calls nest; the
+//		outermost EndWrite commits.  For a logged file the outermost call
+//		keeps an image of the header and catalogs to roll back to.
+// --------------------------------------------------------------------------------
+void CDbFile::BeginWrite()
+{
+	m_mutexWrite.Lock();
 
 	try
 	{
-		UINT	cbRead		= 0;
-		UINT	cbWritten	= 0;
-
-		_ASSERTE(!m_pFile->IsOpen());
-		
-		// Open the source file
-		if (!m_pFile->IsOpen())
-			Open();
-
-		// Open a temp file for copying
-		string strFile = m_pFile->GetFilename();
-		strFile.append(".tmp");
-		CFilePtr pDest = new CFile(strFile);
-		pDest->Create();
-		
-		// Recalculate file offsets
-		m_fileInfo.Tables.Offset  = m_fileInfo.DataOffsetStart;
-		m_fileInfo.Indexes.Offset = m_fileInfo.Tables.Offset +
-											(m_fileInfo.Tables.Slots * sizeof(DbTableInfo));
-		m_fileInfo.DataOffsetEnd  = m_fileInfo.Indexes.Offset +
-											(m_fileInfo.Indexes.Slots * sizeof(DbIndexInfo));
-
-		// Compress each table data area
-		for (UINT iidx = 0; iidx < m_fileInfo.Tables.Entries; iidx++)
+		if (m_cWriters == 0 && IsLogged())
 		{
-			DbTableInfo* pTableInfo = m_pTableInfo + iidx;
-
-			// Determine offsets
-			FILEOFFSET idxStartOffset = pTableInfo->Offset;
-			FILEOFFSET idxEndOffset	  = idxStartOffset + (pTableInfo->Size * pTableInfo->Slots);
-
-			// Position file pointers
-			m_pFile->Seek(idxStartOffset);
-			pDest->Seek(m_fileInfo.DataOffsetEnd);
-
-			// Read source data to new file and update the info offsets
-			while (idxStartOffset < idxEndOffset)
-			{
-				// Read buffer of data
-				cbRead = m_pFile->Read(m_pBuffer, min(idxEndOffset - idxStartOffset, m_cbBuffer));
-
-				// Write buffer of data to new file
-				cbWritten = pDest->Write(m_pBuffer, cbRead);
-				_ASSERTE(cbRead == cbWritten);
-				idxStartOffset += cbRead;
-			}
-
-			// Adjust offsets
-			pTableInfo->Offset		 = m_fileInfo.DataOffsetEnd;
-			m_fileInfo.DataOffsetEnd = pDest->GetPosition();
+			SaveImage();
 		}
-
-		// Write file header
-		pDest->Seek(0);
-		cbWritten = pDest->Write(&m_fileInfo, sizeof(m_fileInfo));
-		_ASSERTE(cbWritten == sizeof(m_fileInfo));
-
-		// Write table catalog
-		_ASSERTE(pDest->GetPosition() == m_fileInfo.Tables.Offset);
-		SaveCatalog(pDest, &m_fileInfo.Tables, m_pTableInfo);
-
-		// Write index catalog
-		_ASSERTE(pDest->GetPosition() == m_fileInfo.Indexes.Offset);
-		SaveCatalog(pDest, &m_fileInfo.Indexes,	m_pIndexInfo);
-
-		// Close files
-		Close();
-		pDest->Close();
-
-		// Delete source
-		m_pFile->Delete();
-
-		// Rename destination
-		pDest->Rename(m_pFile->GetFilename());
 	}
 	catch ( ... )
 	{
-		m_mutex.Unlock();
+		m_mutexWrite.Unlock();
 		throw;
 	}
 
-	m_mutex.Unlock();
+	m_cWriters++;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::CreateTable
+//      CDbFile::EndWrite
 //
 //  Description:
-//      Create a new table in the database file.  Updates the catalog and allocates
-//		a new data space for the table data.
+//      Finish a change.  For a logged file the outermost call logs the change
+//		and waits for the log to be durable.  The wait happens after the next
+//		change may start, so concurrent committers share a log flush.
 //
-//  Inputs:
-//		pwszTable	== IN:	Table name
-//		cbRowSize	== IN:	Size of table row (in bytes)
-//		cSlots		== IN:	Initial table size (in slots)
-//		iGrowth		== IN:	Growth rate (%)
+//		For a logged file a failed change is rolled back: its pages are
+//		dropped from the cache and the header and catalogs are restored.
+//		Without a log, whatever a failed change modified stays in the file.
 //
-//  Returns:
-//      Pointer to new table object
+//  Inputs:
+//      fCommit == IN: Change completed and should be committed
 // --------------------------------------------------------------------------------
-CDbTable* CDbFile::CreateTable
+void CDbFile::EndWrite
 (
-	const string&	strTable,
-	UINT			cbRowSize,
-	UINT			cSlots,
-	UINT			cGrowthFactor
+	bool fCommit
 )
 {
-	CDbTable* pTable = NULL;
-
-	TRACE_INIT("CDbFile::CreateTable");
-
-	m_mutex.Lock();
+	DBLSN lsn = 0;
 
 	try
 	{
-		// Check to see if a table with this name already exists
-		if (FindTable(strTable) >= 0)
+		if (--m_cWriters == 0)
 		{
-			throw runtime_error("Table already exists");
-		}
+			// Snapshots taken from now on see the change
+			AtomicIncrement((volatile LONG*) &m_tsCommit);
 
-		// Get a free table slot
-		INT idx = GetFreeSlot(&m_fileInfo.Tables, m_pTableInfo);
+			if (fCommit && IsLogged())
+			{
+				lsn = LogChanges();
+			}
 
-		if (idx < 0)
-		{
-			throw runtime_error("No free table slot found");
+			if (m_fImage)
+			{
+				if (fCommit)
+				{
+					m_pBufferMgr->EndChange(true);
+				}
+				else
+				{
+					Rollback();
+				}
+
+				m_fImage = false;
+			}
 		}
-
-		DbTableInfo* pTableInfo = m_pTableInfo + idx;
-
-		// Create table in catalog
-		m_fileInfo.Tables.Entries++;
-		m_fileInfo.Tables.LastId++;
-
-		// Determine the table metadata
-		strncpy(pTableInfo->Name, strTable.c_str(), DB_MAX_OBJECT_NAME);
-
-		pTableInfo->Id				= m_fileInfo.Tables.LastId;
-		pTableInfo->Size			= cbRowSize;
-		pTableInfo->GrowthFactor	= cGrowthFactor;
-		pTableInfo->Slots			= cSlots;
-		pTableInfo->Entries			= 0;
-		pTableInfo->LastRecordId	= 0;
-		
-		// Append table data area
-		AppendTableData(pTableInfo);
-
-		pTable = new CDbTable(this, pTableInfo);
 	}
 	catch ( ... )
 	{
-		m_mutex.Unlock();
+		m_mutexWrite.Unlock();
 		throw;
 	}
 
-	m_mutex.Unlock();
-	return pTable;
+	m_mutexWrite.Unlock();
+
+	if (lsn)
+	{
+		m_pLog->Flush(lsn);
+
+		// Mapped views see committed changes once they are durable
+		if (IsMapped())
+		{
+			m_pBufferMgr->Flush();
+		}
+	}
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::DeleteTable
+//      CDbFile::SaveImage
 //
 //  Description:
-//      Deletes a table from the database file.  Updates the catalog by deleting
-//		the entry.  Space will be reclaimed when database is compacted.
-//
-//  Inputs:
-//      pwszTable == IN: Table name
+//      Keep the header and catalogs as they are before a change, and have the
+//		page cache keep the committed data of the pages the change modifies.
+//		Caller must hold the write lock.
 // --------------------------------------------------------------------------------
-void CDbFile::DeleteTable
-(
-	const string& strTable
-)
+void CDbFile::SaveImage()
 {
-    TRACE_INIT("CDbFile::DeleteTable");
-
 	m_mutex.Lock();
 
 	try
 	{
-		INT idx = FindTable(strTable);
-		if (idx < 0)
-		{
-			throw runtime_error("Table missing - cannot delete");
-		}
+		const BYTE* pTables		= (const BYTE*) m_pTableInfo;
+		const BYTE* pIndexes	= (const BYTE*) m_pIndexInfo;
+		const BYTE* pExtents	= (const BYTE*) m_pExtentInfo;
 
-		memset(m_pTableInfo + idx, 0, sizeof(DbTableInfo));
-		m_fileInfo.Tables.Entries--;
+		m_fileImage = m_fileInfo;
+		m_rgTableImage.assign(pTables, pTables + m_fileInfo.Tables.Size * m_fileInfo.Tables.Slots);
+		m_rgIndexImage.assign(pIndexes, pIndexes + m_fileInfo.Indexes.Size * m_fileInfo.Indexes.Slots);
+		m_rgExtentImage.assign(pExtents, pExtents + m_fileInfo.Extents.Size * m_fileInfo.Extents.Slots);
+
+		m_pBufferMgr->BeginChange();
+		m_fImage = true;
 	}
 	catch ( ... )
 	{
@@ -470,65 +560,59 @@ void CDbFile::DeleteTable
 		throw;
 	}
 
-	m_mutex.Lock();
+	m_mutex.Unlock();
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::ExpandTable
+//      CDbFile::Rollback
 //
 //  Description:
-//      Expands the data space used by the table and updates the catalog.
-//
-//  Inputs:
-//      pwszTable == IN: Table name
+//      Undo a change that failed.  The pages it modified have not been logged,
+//		so they are discarded from the cache; the header, catalogs, extent
+//		chains and open indexes go back to the image taken by SaveImage.
+//		Caller must hold the write lock.
 // --------------------------------------------------------------------------------
-void CDbFile::ExpandTable
-(
-	const string& strTable
-)
+void CDbFile::Rollback()
 {
-    TRACE_INIT("CDbFile::ExpandTable");
+	TRACE_INIT("CDbFile::Rollback");
 
 	m_mutex.Lock();
 
 	try
 	{
-		// Move table data to end of file
-		CDbTable* pTable = GetTable(strTable);
-
-		if (pTable == NULL)
-		{
-			throw runtime_error("Table missing - cannot expand");
-		}
-		
-		DbTableInfo* pTableInfo = pTable->GetTableInfo();
+		m_pBufferMgr->EndChange(false);
 
-		// Get starting/ending points of current data set
-		FILEOFFSET idxStart = pTableInfo->Offset;
-		FILEOFFSET idxEnd   = idxStart + (pTableInfo->Size * pTableInfo->Slots);
+		m_lockData.WriteLock();
 
-		// OPTIMIZATION: Determine if table is already at the end of the file
-		if (idxEnd = m_fileInfo.DataOffsetEnd)
+		try
 		{
-			// No need to copy data since at the end.
-			// Just expand the data area
-			pTableInfo->Slots		+= pTableInfo->GrowthFactor;
-			m_fileInfo.DataOffsetEnd = pTableInfo->Offset + (pTableInfo->Slots * pTableInfo->Size);
+			RestoreCatalog(&m_fileInfo.Tables, (DbObjectInfo**) &m_pTableInfo, &m_fileImage.Tables, m_rgTableImage);
+			RestoreCatalog(&m_fileInfo.Indexes, (DbObjectInfo**) &m_pIndexInfo, &m_fileImage.Indexes, m_rgIndexImage);
+			RestoreCatalog(&m_fileInfo.Extents, (DbObjectInfo**) &m_pExtentInfo, &m_fileImage.Extents, m_rgExtentImage);
 
-			m_pFile->Expand(m_fileInfo.DataOffsetEnd, DB_EOF);
+			m_fileInfo = m_fileImage;
+
+			LoadExtents();
 		}
-		else
+		catch ( ... )
 		{
-			// Recalculate new data area
-			pTableInfo->Slots += pTableInfo->GrowthFactor;
-			pTableInfo->Offset = m_fileInfo.DataOffsetEnd;
+			m_lockData.Unlock();
+			throw;
+		}
+
+		m_lockData.Unlock();
 
-			// Append table data area
-			AppendTableData(pTableInfo);
+		// Indexes may cache pages of the discarded change
+		m_rgIndexes.clear();
+		m_rgIndexes.resize(m_fileInfo.Indexes.Slots);
 
-			// Copy table data from old area to the new area
-			CopyTableData(idxStart, pTableInfo->Offset, idxEnd - idxStart);
+		for (UINT idx = 0; idx < m_fileInfo.Indexes.Slots; idx++)
+		{
+			if (m_pIndexInfo[idx].Id != 0)
+			{
+				m_rgIndexes[idx] = OpenIndex(idx);
+			}
 		}
 	}
 	catch ( ... )
@@ -542,261 +626,2857 @@ void CDbFile::ExpandTable
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::InitCatalog
+//      CDbFile::RestoreCatalog
 //
 //  Description:
-//      Initialize in memory catalog table
-//
-//	Inputs:
-//		pCatalog == IN: Catalog to intialize
+//      Copy a catalog image back.  The catalog is restored in place unless the
+//		change expanded it.  Caller must hold the access lock.
 //
-//	Returns:
-//		Pointer to catalog info buffer
+//  Inputs:
+//      pCatalog	== IN/OUT:	Catalog descriptor
+//		ppInfo		== IN/OUT:	Catalog buffer
+//		pImage		== IN:		Catalog descriptor in the image
+//		rgImage		== IN:		Catalog image
 // --------------------------------------------------------------------------------
-DbObjectInfo* CDbFile::InitCatalog
+void CDbFile::RestoreCatalog
 (
-	DbCatalog* pCatalog
+	DbCatalog*			pCatalog,
+	DbObjectInfo**		ppInfo,
+	DbCatalog*			pImage,
+	const vector<BYTE>&	rgImage
 )
 {
-	UINT  cbBuffer = pCatalog->Size * pCatalog->Slots;
-	BYTE* pBuffer  = new BYTE[cbBuffer];
-	memset(pBuffer, 0 , cbBuffer);
-	return (DbObjectInfo*) pBuffer;
+	_ASSERTE(rgImage.size() == pImage->Size * pImage->Slots);
+
+	// An expanded catalog is replaced, as ExpandCatalog does
+	if (pCatalog->Slots != pImage->Slots)
+	{
+		DbObjectInfo* pBuffer = InitCatalog(pImage);
+
+		delete[] (BYTE*) *ppInfo;
+		*ppInfo = pBuffer;
+	}
+
+	if (!rgImage.empty())
+	{
+		memcpy(*ppInfo, &rgImage[0], rgImage.size());
+	}
+
+	*pCatalog = *pImage;
 }
 
+
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::ExpandCatalog
+//      CDbFile::BeginSnapshot
 //
 //  Description:
-//      Relocate catalog and expand by growth factor
+//      Take a snapshot of a table.  A change in progress finishes first, so
+//		the snapshot sees whole changes only.  Until EndSnapshot, changes save
+//		the slot images they replace.
 //
-//	Inputs:
-//		pCatalog	== IN:		Catalog
-//		pInfo		== IN/OUT:	Catalog buffer pointer
+//  Inputs:
+//      pTableInfo	== IN:	Table descriptor
+//		pidxEnd		== OUT:	End of the table slots the snapshot sees
+//
+//  Returns:
+//      Snapshot timestamp
 // --------------------------------------------------------------------------------
-void CDbFile::ExpandCatalog
+DBTS CDbFile::BeginSnapshot
 (
-	DbCatalog*		pCatalog,
-	DbObjectInfo*	pInfo
+	const DbTableInfo*	pTableInfo,
+	DBPOS*				pidxEnd
 )
 {
-	// Create new catalog data area
-	DbCatalog tmpCatalog = *pCatalog;
-	tmpCatalog.Slots += tmpCatalog.GrowthFactor;
-	DbObjectInfo* pBuffer = InitCatalog(&tmpCatalog);
+	DBTS ts = 0;
 
-	// Copy existing catalog
-	memcpy(pBuffer, pInfo, pCatalog->Size * pCatalog->Slots);
+	m_mutexWrite.Lock();
 
-	// Release old catalog buffer
-	delete[] pInfo;
+	try
+	{
+		ts		 = m_tsCommit;
+		*pidxEnd = pTableInfo->Entries;
 
-	// Set info buffer
-	pInfo = pBuffer;
+		m_pVersions->AddSnapshot(ts);
+	}
+	catch ( ... )
+	{
+		m_mutexWrite.Unlock();
+		throw;
+	}
 
-	// Update catalog
-	pCatalog->Slots			 += pCatalog->GrowthFactor;
-	pCatalog->Offset		  = m_fileInfo.DataOffsetEnd;
-	m_fileInfo.DataOffsetEnd += pCatalog->Size * pCatalog->Slots;
+	m_mutexWrite.Unlock();
+	return ts;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::Load
+//      CDbFile::EndSnapshot
 //
 //  Description:
-//      Load file header, table catalog, and index catalog
+//      Release a snapshot taken by BeginSnapshot
+//
+//  Inputs:
+//      ts == IN: Snapshot timestamp
 // --------------------------------------------------------------------------------
-void CDbFile::Load()
+void CDbFile::EndSnapshot
+(
+	DBTS ts
+)
 {
-	TRACE_INIT("CDbFile::Load");
+	m_pVersions->RemoveSnapshot(ts);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::LogChanges
+//
+//  Description:
+//      Append the changed pages, header and catalogs to the log followed by
+//		a commit record.  Caller must be inside a change.
+//
+//  Returns:
+//      LSN of the commit record (zero if nothing changed)
+// --------------------------------------------------------------------------------
+DBLSN CDbFile::LogChanges()
+{
+	DBLSN lsn = 0;
 
 	m_mutex.Lock();
 
 	try
 	{
-		// Move to the file header and read
-		m_pFile->Seek(0);
-		UINT cbRead = m_pFile->Read(&m_fileInfo, sizeof(m_fileInfo));
-		_ASSERTE(cbRead == sizeof(m_fileInfo));
+		WriteHeader();
 
-		// Initialize catalog buffers
-		m_pTableInfo = (DbTableInfo*) InitCatalog(&m_fileInfo.Tables);
-		m_pIndexInfo = (DbIndexInfo*) InitCatalog(&m_fileInfo.Indexes);
+		if (m_pBufferMgr->LogPages())
+		{
+			lsn = m_pLog->Append(DB_LOG_COMMIT, 0, NULL, 0);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return lsn;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::Compact
+//
+//  Description:
+//      Compresses empty space in tables.  Re-organizes indexes and metadata tables.
+//		The position of every table in the new file is known up front, so the
+//		table data is copied in independent jobs spread over worker threads.
+//
+//  Inputs:
+//      cThreads == IN: Count of copy threads (zero for one per processor)
+// --------------------------------------------------------------------------------
+void CDbFile::Compact
+(
+	UINT cThreads
+)
+{
+    TRACE_INIT("CDbFile::Compact");
+
+	StopCompaction();
+
+	// Close takes the write lock, so it must be held before the file lock
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		UINT		cbWritten = 0;
+		CopyTask	task;
+
+		_ASSERTE(!m_pFile->IsOpen());
+		
+		// Open the source file
+		if (!m_pFile->IsOpen())
+			Open();
+
+		// Open a temp file for copying
+		string strFile = m_pFile->GetFilename();
+		strFile.append(".tmp");
+		CFilePtr pDest = new CFile(strFile);
+		pDest->Create();
+		
+		// Recalculate file offsets
+		m_fileInfo.Tables.Offset  = m_fileInfo.DataOffsetStart;
+		m_fileInfo.Indexes.Offset = m_fileInfo.Tables.Offset +
+											(m_fileInfo.Tables.Slots * sizeof(DbTableInfo));
+		m_fileInfo.Extents.Offset = m_fileInfo.Indexes.Offset +
+											(m_fileInfo.Indexes.Slots * sizeof(DbIndexInfo));
+		m_fileInfo.DataOffsetEnd  = m_fileInfo.Extents.Offset +
+											(m_fileInfo.Extents.Slots * sizeof(DbExtentInfo));
+
+		// Each table is copied into a single extent
+		memset(m_pExtentInfo, 0, m_fileInfo.Extents.Size * m_fileInfo.Extents.Slots);
+		m_fileInfo.Extents.Entries = 0;
+
+		// Compress each table data area
+		for (UINT iidx = 0; iidx < m_fileInfo.Tables.Slots; iidx++)
+		{
+			DbTableInfo* pTableInfo = m_pTableInfo + iidx;
+
+			if (pTableInfo->Id == 0)
+			{
+				continue;
+			}
+
+			DbExtentList&	rgExtents		= m_mapExtents[pTableInfo->Id];
+			FILEOFFSET		idxDestOffset	= m_fileInfo.DataOffsetEnd;
+
+			// Plan the copy of the extents in slot order
+			for (UINT idxExtent = 0; idxExtent < rgExtents.size(); idxExtent++)
+			{
+				FILEOFFSET	idxStartOffset	= rgExtents[idxExtent].Offset;
+				FILEOFFSET	idxEndOffset	= idxStartOffset + (pTableInfo->Size * rgExtents[idxExtent].Slots);
+
+				// Large extents are split so one table does not hold up the rest
+				while (idxStartOffset < idxEndOffset)
+				{
+					CopyJob job;
+
+					job.Source	= idxStartOffset;
+					job.Dest	= idxDestOffset;
+					job.Length	= min(idxEndOffset - idxStartOffset, DB_COPY_CHUNK);
+
+					task.Jobs.push_back(job);
+
+					idxStartOffset	+= job.Length;
+					idxDestOffset	+= job.Length;
+				}
+			}
+
+			// Adjust offsets
+			pTableInfo->Offset		 = m_fileInfo.DataOffsetEnd;
+			m_fileInfo.DataOffsetEnd = idxDestOffset;
+
+			// Record the single extent
+			DbExtentInfo* pExtent = m_pExtentInfo + m_fileInfo.Extents.Entries++;
+
+			pExtent->Id			= ++m_fileInfo.Extents.LastId;
+			pExtent->TableId	= pTableInfo->Id;
+			pExtent->Offset		= pTableInfo->Offset;
+			pExtent->Size		= pTableInfo->Size;
+			pExtent->Slots		= pTableInfo->Slots;
+			pExtent->FirstSlot	= 0;
+		}
+
+		// Copy the table data
+		if (cThreads == 0)
+		{
+			cThreads = CThreadPool::GetDefault()->GetWorkerCount();
+		}
+
+		cThreads = max(1U, min(cThreads, (UINT) task.Jobs.size()));
+
+		task.Source	= m_pFile;
+		task.Dest	= pDest;
+		task.Next	= 0;
+		task.Failed	= false;
+
+		// Workers write at their own offsets of the allocated destination
+		pDest->Expand(m_fileInfo.DataOffsetEnd);
+
+		vector<CTask*>	rgTasks;
+		CThreadPool*	pPool = CThreadPool::GetDefault();
+
+		try
+		{
+			for (UINT idx = 1; idx < cThreads; idx++)
+			{
+				rgTasks.push_back(new CTask(CopyWorkerTask, &task));
+				pPool->Submit(rgTasks.back());
+			}
+		}
+		catch ( ... )
+		{
+			// Run with the workers submitted
+		}
+
+		// This thread works too
+		CopyWorkerTask(&task);
+
+		// Failures are recorded in the copy task, so the tasks cannot throw
+		for (UINT idx = 0; idx < rgTasks.size(); idx++)
+		{
+			delete rgTasks[idx];
+		}
+
+		if (task.Failed)
+		{
+			throw runtime_error("Table data could not be copied");
+		}
+
+		// Index pages are not copied - indexes are rebuilt when the file is opened
+		for (UINT iidx = 0; iidx < m_fileInfo.Indexes.Slots; iidx++)
+		{
+			DbIndexInfo* pIndexInfo = m_pIndexInfo + iidx;
+
+			pIndexInfo->Offset	= 0;
+			pIndexInfo->Entries	= 0;
+			pIndexInfo->Slots	= 0;
+			pIndexInfo->Height	= 0;
+		}
+
+		// Write file header
+		cbWritten = pDest->WriteAt(0, &m_fileInfo, sizeof(m_fileInfo));
+		_ASSERTE(cbWritten == sizeof(m_fileInfo));
+
+		// Write table, index and extent catalogs
+		SaveCatalog(pDest, &m_fileInfo.Tables, m_pTableInfo);
+		SaveCatalog(pDest, &m_fileInfo.Indexes,	m_pIndexInfo);
+		SaveCatalog(pDest, &m_fileInfo.Extents, m_pExtentInfo);
+
+		// Close files
+		Close();
+		pDest->Close();
+
+		// Delete source
+		m_pFile->Delete();
 
-		// Read catalogs
-		LoadCatalog(m_pFile, &m_fileInfo.Tables,  m_pTableInfo);
-		LoadCatalog(m_pFile, &m_fileInfo.Indexes, m_pIndexInfo);
+		// Rename destination
+		pDest->Rename(m_pFile->GetFilename());
 	}
 	catch ( ... )
 	{
 		m_mutex.Unlock();
+		EndWrite(false);
 		throw;
 	}
 
 	m_mutex.Unlock();
+	EndWrite(true);
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::LoadCatalog
+//      CDbFile::CopyWorkerTask
 //
 //  Description:
-//      Load catalog
+//      Compact worker.  Takes copy jobs until none are left or one fails.
+//
+//  Inputs:
+//      pArg == IN: Shared copy task
+// --------------------------------------------------------------------------------
+void CDbFile::CopyWorkerTask
+(
+	void* pArg
+)
+{
+	CopyTask* pTask = (CopyTask*) pArg;
+
+	while (true)
+	{
+		pTask->Lock.Lock();
+
+		if (pTask->Failed || pTask->Next == pTask->Jobs.size())
+		{
+			pTask->Lock.Unlock();
+			break;
+		}
+
+		CopyJob job = pTask->Jobs[pTask->Next++];
+
+		pTask->Lock.Unlock();
+
+		try
+		{
+			if (pTask->Source->CopyRange(job.Source, pTask->Dest, job.Dest, job.Length) != job.Length)
+			{
+				throw runtime_error("Table data truncated");
+			}
+		}
+		catch ( ... )
+		{
+			pTask->Lock.Lock();
+			pTask->Failed = true;
+			pTask->Lock.Unlock();
+			break;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::CompactStep
+//
+//  Description:
+//      Perform one bounded unit of online compaction while the file stays
+//		open.  Unused slots at the end of oversized tables are released, one
+//		run of slots is moved into free space nearer the start of the file,
+//		and free space at the end of the data area is cut from the file.
+//		Slot numbers never change so indexes are not touched.  The step is a
+//		single change: it excludes other writers only for its duration and is
+//		logged as one commit for a logged file.
+//
+//  Inputs:
+//      cbBudget == IN: Most bytes of table data to relocate
 //
-//	Inputs:
-//		pFile		== IN:	Source file
-//		pCatalog	== IN:	Metadata catalog
-//		pBuffer		== IN:	Catalog buffer
-//		
 //  Returns:
-//		Count of catalog metadata records loaded
+//      true if anything was reclaimed; false if the file is compact
+//
+//  Exceptions:
+//		runtime_error == file not open
 // --------------------------------------------------------------------------------
-UINT CDbFile::LoadCatalog
+bool CDbFile::CompactStep
 (
-	CFile*			pFile,
-	DbCatalog*		pCatalog,
-	DbObjectInfo*	pBuffer
+	UINT cbBudget
+)
+{
+	bool fWork	 = false;
+	bool fShrunk = false;
+
+	TRACE_INIT("CDbFile::CompactStep");
+
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_pFile->IsOpen())
+		{
+			throw runtime_error("File not open");
+		}
+
+		// Readers see the extent chains before or after the step
+		m_lockData.WriteLock();
+
+		try
+		{
+			for (UINT idx = 0; idx < m_fileInfo.Tables.Slots; idx++)
+			{
+				if (m_pTableInfo[idx].Id != 0 && TrimTable(m_pTableInfo + idx))
+				{
+					fWork = true;
+				}
+			}
+
+			if (RelocateExtent(cbBudget))
+			{
+				fWork = true;
+			}
+		}
+		catch ( ... )
+		{
+			m_lockData.Unlock();
+			throw;
+		}
+
+		m_lockData.Unlock();
+
+		while (ShrinkFile())
+		{
+			fShrunk = true;
+		}
+
+		// A mapped file keeps its length so outstanding views stay valid
+		if (fShrunk && !IsMapped())
+		{
+			// The shorter data area must be durable before the file is cut
+			if (IsLogged())
+			{
+				DBLSN lsn = LogChanges();
+
+				if (lsn)
+				{
+					m_pLog->Flush(lsn);
+				}
+			}
+
+			m_pBufferMgr->Flush();
+			m_pFile->Truncate(m_fileInfo.DataOffsetEnd);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		EndWrite(false);
+		throw;
+	}
+
+	m_mutex.Unlock();
+	EndWrite(true);
+
+	return fWork || fShrunk;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::StartCompaction
+//
+//  Description:
+//      Start compacting the open file on a background thread.  Steps are
+//		paced so table data is relocated at no more than the given rate.  A
+//		running compaction is restarted with the new rate.
+//
+//  Inputs:
+//      cbPerSecond == IN: I/O budget (bytes of table data per second)
+//
+//  Exceptions:
+//		invalid_argument == rate is zero
+//		runtime_error	 == file not open or thread could not be created
+// --------------------------------------------------------------------------------
+void CDbFile::StartCompaction
+(
+	UINT cbPerSecond
 )
 {
-	// Find catalog
-	pFile->Seek(pCatalog->Offset);
+	TRACE_INIT("CDbFile::StartCompaction");
+
+	if (cbPerSecond == 0)
+	{
+		throw invalid_argument("Compaction rate invalid");
+	}
+
+	if (!m_pFile->IsOpen())
+	{
+		throw runtime_error("File not open");
+	}
+
+	StopCompaction();
+
+	m_cbCompactRate	= cbPerSecond;
+	m_fCompactStop	= false;
+	m_evCompact.Reset();
+
+	m_pCompactor = new CThread();
+
+	try
+	{
+		m_pCompactor->Init(CompactThread, this);
+	}
+	catch ( ... )
+	{
+		delete m_pCompactor;
+		m_pCompactor = NULL;
+		throw;
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::StopCompaction
+//
+//  Description:
+//      Stop background compaction and wait for the running step to finish
+// --------------------------------------------------------------------------------
+void CDbFile::StopCompaction()
+{
+	if (!m_pCompactor)
+	{
+		return;
+	}
+
+	m_fCompactStop = true;
+	m_evCompact.Set();
+	m_pCompactor->Join();
+
+	delete m_pCompactor;
+	m_pCompactor = NULL;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::CompactThread
+//
+//  Description:
+//      Background compaction thread function
+//
+//  Inputs:
+//      pArg == IN: Database file
+// --------------------------------------------------------------------------------
+THREAD_RESULT THREAD_CALL CDbFile::CompactThread
+(
+	void* pArg
+)
+{
+	((CDbFile*) pArg)->RunCompaction();
+	return 0;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::RunCompaction
+//
+//  Description:
+//      Run compaction steps until stopped.  After a step that did work the
+//		thread waits long enough to hold the I/O rate; when the file is compact
+//		it polls for new free space.  An error ends background compaction.
+// --------------------------------------------------------------------------------
+void CDbFile::RunCompaction()
+{
+	UINT cbStep	 = min(DB_COMPACT_STEP, m_cbCompactRate);
+	UINT cmsStep = (cbStep * 1000) / m_cbCompactRate;
+
+	while (!m_fCompactStop)
+	{
+		bool fWork = false;
+
+		try
+		{
+			fWork = CompactStep(cbStep);
+		}
+		catch ( ... )
+		{
+			break;
+		}
+
+		m_evCompact.Wait(fWork ? cmsStep : DB_COMPACT_IDLE);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::CreateTable
+//
+//  Description:
+//      Create a new table in the database file.  Updates the catalog and allocates
+//		a new data space for the table data.
+//
+//  Inputs:
+//		pwszTable	== IN:	Table name
+//		cbRowSize	== IN:	Size of table row (in bytes)
+//		cSlots		== IN:	Initial table size (in slots)
+//		iGrowth		== IN:	Growth rate (%)
+//		fFlags		== IN:	Table flags (DB_TABLE_STABLE keeps rows in their
+//							slots and reuses deleted slots; DB_TABLE_PAX
+//							stores the values of each column together)
+//		rgColumns	== IN:	Offset of each column in the record, ascending
+//							from zero (DB_TABLE_PAX)
+//		cColumns	== IN:	Count of columns
+//
+//  Returns:
+//      Pointer to new table object
+//
+//  Exceptions:
+//		invalid_argument == row too small for the table flags or column layout
+//							not valid
+// --------------------------------------------------------------------------------
+CDbTable* CDbFile::CreateTable
+(
+	const string&	strTable,
+	UINT			cbRowSize,
+	UINT			cSlots,
+	UINT			cGrowthFactor,
+	UINT			fFlags,
+	const UINT*		rgColumns,
+	UINT			cColumns
+)
+{
+	CDbTable* pTable = NULL;
+
+	TRACE_INIT("CDbFile::CreateTable");
+
+	// A deleted slot holds the link to the next one
+	if ((fFlags & DB_TABLE_STABLE) && cbRowSize < sizeof(DbFreeSlot))
+	{
+		throw invalid_argument("Row size too small for a stable-slot table");
+	}
+
+	// Columns cover the record and the first one holds the record id
+	if (fFlags & DB_TABLE_PAX)
+	{
+		if (!rgColumns || cColumns == 0 || cColumns > DB_MAX_COLUMNS || rgColumns[0] != 0)
+		{
+			throw invalid_argument("Column layout invalid");
+		}
+
+		for (UINT idx = 1; idx < cColumns; idx++)
+		{
+			if (rgColumns[idx] <= rgColumns[idx - 1] || rgColumns[idx] >= cbRowSize ||
+				rgColumns[idx] < sizeof(DBRECID))
+			{
+				throw invalid_argument("Column layout invalid");
+			}
+		}
+	}
+
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		// Check to see if a table with this name already exists
+		if (FindTable(strTable) >= 0)
+		{
+			throw runtime_error("Table already exists");
+		}
+
+		// Get a free table slot
+		INT idx = GetFreeSlot(&m_fileInfo.Tables, (DbObjectInfo**) &m_pTableInfo);
+
+		if (idx < 0)
+		{
+			throw runtime_error("No free table slot found");
+		}
+
+		DbTableInfo* pTableInfo = m_pTableInfo + idx;
+
+		// Create table in catalog
+		m_fileInfo.Tables.Entries++;
+		m_fileInfo.Tables.LastId++;
+
+		// Determine the table metadata
+		strncpy(pTableInfo->Name, strTable.c_str(), DB_MAX_OBJECT_NAME);
+
+		pTableInfo->Id				= m_fileInfo.Tables.LastId;
+		pTableInfo->Size			= cbRowSize;
+		pTableInfo->GrowthFactor	= cGrowthFactor;
+		pTableInfo->Slots			= 0;
+		pTableInfo->Entries			= 0;
+		pTableInfo->LastRecordId	= 0;
+		pTableInfo->Flags			= fFlags;
+		pTableInfo->FreeSlot		= DB_INVALID_POS;
+		pTableInfo->Deleted			= 0;
+		pTableInfo->BlockSlots		= 1;
+		pTableInfo->Columns			= 1;
+
+		memset(pTableInfo->ColumnOffset, 0, sizeof(pTableInfo->ColumnOffset));
+
+		// Enough rows per block that each column spans whole pages
+		if (fFlags & DB_TABLE_PAX)
+		{
+			pTableInfo->BlockSlots	= max(1U, DB_PAX_BLOCK_SIZE / cbRowSize);
+			pTableInfo->Columns		= cColumns;
+
+			memcpy(pTableInfo->ColumnOffset, rgColumns, cColumns * sizeof(UINT));
+		}
+		
+		// Append table data area
+		m_lockData.WriteLock();
+
+		try
+		{
+			AddExtent(pTableInfo, cSlots);
+		}
+		catch ( ... )
+		{
+			m_lockData.Unlock();
+			throw;
+		}
+
+		m_lockData.Unlock();
+
+		// Records are located by id through the RID index
+		CreateIndex(pTableInfo, 0, sizeof(DBRECID), DB_KEY_UINT, DB_INDEX_BTREE, DB_INDEX_RID);
+
+		pTable = new CDbTable(this, pTableInfo);
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		EndWrite(false);
+		throw;
+	}
+
+	m_mutex.Unlock();
+	EndWrite(true);
+	return pTable;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::DeleteTable
+//
+//  Description:
+//      Deletes a table from the database file.  Updates the catalog by deleting
+//		the entry.  Its data and index pages become free space.
+//
+//  Inputs:
+//      pwszTable == IN: Table name
+// --------------------------------------------------------------------------------
+void CDbFile::DeleteTable
+(
+	const string& strTable
+)
+{
+    TRACE_INIT("CDbFile::DeleteTable");
+
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		INT idx = FindTable(strTable);
+		if (idx < 0)
+		{
+			throw runtime_error("Table missing - cannot delete");
+		}
+
+		DropIndexes(m_pTableInfo[idx].Id);
+
+		m_lockData.WriteLock();
+
+		try
+		{
+			DropExtents(m_pTableInfo[idx].Id);
+		}
+		catch ( ... )
+		{
+			m_lockData.Unlock();
+			throw;
+		}
+
+		m_lockData.Unlock();
+
+		memset(m_pTableInfo + idx, 0, sizeof(DbTableInfo));
+		m_fileInfo.Tables.Entries--;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		EndWrite(false);
+		throw;
+	}
+
+	m_mutex.Unlock();
+	EndWrite(true);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::ExpandTable
+//
+//  Description:
+//      Expands the data space used by the table and updates the catalog.  A
+//		new extent at least as large as the table is chained on (or the last
+//		extent is grown when it ends the file); existing rows never move.
+//
+//  Inputs:
+//      pwszTable == IN: Table name
+// --------------------------------------------------------------------------------
+void CDbFile::ExpandTable
+(
+	const string& strTable
+)
+{
+    TRACE_INIT("CDbFile::ExpandTable");
+
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		INT idx = FindTable(strTable);
+
+		if (idx < 0)
+		{
+			throw runtime_error("Table missing - cannot expand");
+		}
+		
+		DbTableInfo* pTableInfo = m_pTableInfo + idx;
+
+		// Grow geometrically so appending rows costs amortized O(1)
+		m_lockData.WriteLock();
+
+		try
+		{
+			AddExtent(pTableInfo, max(pTableInfo->GrowthFactor, pTableInfo->Slots));
+		}
+		catch ( ... )
+		{
+			m_lockData.Unlock();
+			throw;
+		}
+
+		m_lockData.Unlock();
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		EndWrite(false);
+		throw;
+	}
+
+	m_mutex.Unlock();
+	EndWrite(true);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::CreateIndex
+//
+//  Description:
+//      Create a secondary index on a fixed position column of the table
+//		records.  The index is built from the existing records and maintained
+//		by every later table modification.
+//
+//  Inputs:
+//      strTable	== IN: Table name
+//		offKey		== IN: Offset of the key column in the record
+//		cbKey		== IN: Key width (bytes)
+//		keyType		== IN: Key data type
+//		kind		== IN: Index structure (DB_INDEX_HASH supports equality lookups only)
+//
+//  Returns:
+//      Index id
+//
+//  Exceptions:
+//		runtime_error	 == table missing
+//		invalid_argument == key width not valid for the key type
+//		out_of_range	 == key outside of the record
+// --------------------------------------------------------------------------------
+UINT CDbFile::CreateIndex
+(
+	const string&	strTable,
+	UINT			offKey,
+	UINT			cbKey,
+	DB_KEY_TYPE		keyType,
+	DB_INDEX_KIND	kind
+)
+{
+	UINT idIndex = 0;
+
+	TRACE_INIT("CDbFile::CreateIndex");
+
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		INT idxTable = FindTable(strTable);
+
+		if (idxTable < 0)
+		{
+			throw runtime_error("Table missing - cannot create index");
+		}
+
+		INT idx = CreateIndex(m_pTableInfo + idxTable, offKey, cbKey, keyType, kind, 0);
+		idIndex = m_pIndexInfo[idx].Id;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		EndWrite(false);
+		throw;
+	}
+
+	m_mutex.Unlock();
+	EndWrite(true);
+	return idIndex;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::DeleteIndex
+//
+//  Description:
+//      Remove a secondary index from the index catalog.  Index pages become
+//		free space.
+//
+//  Inputs:
+//      idIndex == IN: Index id
+//
+//  Exceptions:
+//		runtime_error == index missing or index is a record id index
+// --------------------------------------------------------------------------------
+void CDbFile::DeleteIndex
+(
+	UINT idIndex
+)
+{
+	TRACE_INIT("CDbFile::DeleteIndex");
+
+	BeginWrite();
+	m_mutex.Lock();
+
+	try
+	{
+		INT idx = -1;
+
+		for (UINT iidx = 0; idIndex != 0 && iidx < m_fileInfo.Indexes.Slots; iidx++)
+		{
+			if (m_pIndexInfo[iidx].Id == idIndex)
+			{
+				idx = iidx;
+				break;
+			}
+		}
+
+		if (idx < 0)
+		{
+			throw runtime_error("Index missing - cannot delete");
+		}
+
+		if (m_pIndexInfo[idx].Flags & DB_INDEX_RID)
+		{
+			throw runtime_error("Record id index cannot be deleted");
+		}
+
+		FreeIndexPages(idx);
+
+		m_rgIndexes[idx] = NULL;
+		memset(m_pIndexInfo + idx, 0, sizeof(DbIndexInfo));
+		m_fileInfo.Indexes.Entries--;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		EndWrite(false);
+		throw;
+	}
+
+	m_mutex.Unlock();
+	EndWrite(true);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::FindIndex
+//
+//  Description:
+//      Find the secondary index on a column of a table
+//
+//  Inputs:
+//      strTable	== IN: Table name
+//		offKey		== IN: Offset of the key column in the record
+//
+//  Returns:
+//      Index id; 0 if the column is not indexed
+// --------------------------------------------------------------------------------
+UINT CDbFile::FindIndex
+(
+	const string&	strTable,
+	UINT			offKey
+)
+{
+	UINT idIndex = 0;
+
+	m_mutex.Lock();
+
+	INT idxTable = FindTable(strTable);
+
+	for (UINT idx = 0; idxTable >= 0 && idx < m_fileInfo.Indexes.Slots; idx++)
+	{
+		DbIndexInfo* pIndexInfo = m_pIndexInfo + idx;
+
+		if (pIndexInfo->Id != 0 &&
+			pIndexInfo->TableId == m_pTableInfo[idxTable].Id &&
+			pIndexInfo->KeyOffset == offKey &&
+			!(pIndexInfo->Flags & DB_INDEX_RID))
+		{
+			idIndex = pIndexInfo->Id;
+			break;
+		}
+	}
+
+	m_mutex.Unlock();
+	return idIndex;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::CreateIndex
+//
+//  Description:
+//      Add an index on a fixed position key of the table records to the index
+//		catalog.  The index is built from the existing table records.
+//
+//  Inputs:
+//      pTableInfo	== IN: Table descriptor
+//		offKey		== IN: Offset of the key in the record
+//		cbKey		== IN: Key width (bytes)
+//		keyType		== IN: Key data type
+//		kind		== IN: Index structure
+//		fFlags		== IN: Index flags
+//
+//  Returns:
+//		Index catalog slot
+// --------------------------------------------------------------------------------
+INT CDbFile::CreateIndex
+(
+	DbTableInfo*	pTableInfo,
+	UINT			offKey,
+	UINT			cbKey,
+	DB_KEY_TYPE		keyType,
+	DB_INDEX_KIND	kind,
+	UINT			fFlags
+)
+{
+	TRACE_INIT("CDbFile::CreateIndex");
+
+	if (kind != DB_INDEX_BTREE && kind != DB_INDEX_HASH)
+	{
+		throw invalid_argument("Index kind invalid");
+	}
+
+	if (keyType < DB_KEY_UINT || keyType > DB_KEY_BINARY)
+	{
+		throw invalid_argument("Index key type invalid");
+	}
+
+	if (cbKey == 0 || cbKey > DB_MAX_KEY_SIZE)
+	{
+		throw invalid_argument("Index key width invalid");
+	}
+
+	if ((keyType == DB_KEY_UINT || keyType == DB_KEY_INT) && cbKey != sizeof(UINT))
+	{
+		throw invalid_argument("Integer index key must be 4 bytes");
+	}
+
+	if (offKey + cbKey > pTableInfo->Size)
+	{
+		throw out_of_range("Index key outside of record");
+	}
+
+	INT idx = GetFreeSlot(&m_fileInfo.Indexes, (DbObjectInfo**) &m_pIndexInfo);
+
+	if (idx < 0)
+	{
+		throw runtime_error("No free index slot found");
+	}
+
+	DbIndexInfo* pIndexInfo = m_pIndexInfo + idx;
+
+	m_fileInfo.Indexes.Entries++;
+	m_fileInfo.Indexes.LastId++;
+
+	strncpy(pIndexInfo->Name, pTableInfo->Name, DB_MAX_OBJECT_NAME);
+
+	pIndexInfo->Id				= m_fileInfo.Indexes.LastId;
+	pIndexInfo->TableId			= pTableInfo->Id;
+	pIndexInfo->Kind			= kind;
+	pIndexInfo->KeyType			= keyType;
+	pIndexInfo->KeyOffset		= offKey;
+	pIndexInfo->Size			= cbKey;
+	pIndexInfo->Flags			= fFlags;
+	pIndexInfo->Offset			= 0;
+	pIndexInfo->Entries			= 0;
+	pIndexInfo->Slots			= 0;
+	pIndexInfo->Height			= 0;
+
+	if (m_rgIndexes.size() < m_fileInfo.Indexes.Slots)
+	{
+		m_rgIndexes.resize(m_fileInfo.Indexes.Slots);
+	}
+
+	m_rgIndexes[idx] = OpenIndex(idx);
+
+	try
+	{
+		BuildIndex(m_rgIndexes[idx], pTableInfo);
+	}
+	catch ( ... )
+	{
+		// Leave no partial index in the catalog
+		m_rgIndexes[idx] = NULL;
+		memset(pIndexInfo, 0, sizeof(DbIndexInfo));
+		m_fileInfo.Indexes.Entries--;
+		throw;
+	}
+
+	return idx;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::OpenIndex
+//
+//  Description:
+//      Create the index object for an index catalog entry
+//
+//  Inputs:
+//      idxCatalog == IN: Index catalog slot
+//
+//  Returns:
+//		Pointer to index object
+// --------------------------------------------------------------------------------
+CDbIndex* CDbFile::OpenIndex
+(
+	UINT idxCatalog
+)
+{
+	switch (m_pIndexInfo[idxCatalog].Kind)
+	{
+	case DB_INDEX_BTREE:
+		return new CDbBTree(this, idxCatalog);
+
+	case DB_INDEX_HASH:
+		return new CDbHashIndex(this, idxCatalog);
+
+	default:
+		throw runtime_error("Unknown index kind");
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetIndexes
+//
+//  Description:
+//      Collect the indexes of a table
+//
+//  Inputs:
+//      idTable		== IN:	Table id
+//		rgIndexes	== OUT:	Table indexes
+// --------------------------------------------------------------------------------
+void CDbFile::GetIndexes
+(
+	UINT					idTable,
+	vector<CDbIndexPtr>&	rgIndexes
+)
+{
+	m_mutex.Lock();
+
+	rgIndexes.clear();
+
+	for (UINT idx = 0; idx < m_rgIndexes.size(); idx++)
+	{
+		if (m_rgIndexes[idx] != NULL && m_pIndexInfo[idx].TableId == idTable)
+		{
+			rgIndexes.push_back(m_rgIndexes[idx]);
+		}
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetRidIndex
+//
+//  Description:
+//      Get the record id index of a table
+//
+//  Inputs:
+//      idTable == IN: Table id
+//
+//  Returns:
+//		Pointer to index object; NULL if the table has no RID index
+// --------------------------------------------------------------------------------
+CDbIndex* CDbFile::GetRidIndex
+(
+	UINT idTable
+)
+{
+	CDbIndex* pIndex = NULL;
+
+	m_mutex.Lock();
+
+	for (UINT idx = 0; idx < m_rgIndexes.size(); idx++)
+	{
+		DbIndexInfo* pIndexInfo = m_pIndexInfo + idx;
+
+		if (m_rgIndexes[idx] != NULL &&
+			pIndexInfo->TableId == idTable &&
+			(pIndexInfo->Flags & DB_INDEX_RID))
+		{
+			pIndex = m_rgIndexes[idx];
+			break;
+		}
+	}
+
+	m_mutex.Unlock();
+	return pIndex;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetIndex
+//
+//  Description:
+//      Get an open index by id
+//
+//  Inputs:
+//      idIndex == IN: Index id
+//
+//  Returns:
+//		Pointer to index object; NULL if not found
+// --------------------------------------------------------------------------------
+CDbIndex* CDbFile::GetIndex
+(
+	UINT idIndex
+)
+{
+	CDbIndex* pIndex = NULL;
+
+	m_mutex.Lock();
+
+	for (UINT idx = 0; idIndex != 0 && idx < m_rgIndexes.size(); idx++)
+	{
+		if (m_rgIndexes[idx] != NULL && m_pIndexInfo[idx].Id == idIndex)
+		{
+			pIndex = m_rgIndexes[idx];
+			break;
+		}
+	}
+
+	m_mutex.Unlock();
+	return pIndex;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::BuildIndex
+//
+//  Description:
+//      Add every record of a table to an index
+//
+//  Inputs:
+//      pIndex		== IN: Index object
+//		pTableInfo	== IN: Table descriptor
+// --------------------------------------------------------------------------------
+void CDbFile::BuildIndex
+(
+	CDbIndex*		pIndex,
+	DbTableInfo*	pTableInfo
+)
+{
+	TRACE_INIT("CDbFile::BuildIndex");
+
+	UINT			cPerRead = max(1U, m_cbBuffer / pTableInfo->Size);
+	vector<BYTE>	rgBuffer(cPerRead * pTableInfo->Size);
+
+	for (DBPOS idxSlot = 0; idxSlot < pTableInfo->Entries; )
+	{
+		UINT		cRun	= 0;
+		FILEOFFSET	offset	= GetSlotOffset(pTableInfo, idxSlot, &cRun);
+		UINT		cRecords = min(min(cPerRead, cRun), pTableInfo->Entries - idxSlot);
+
+		if (pTableInfo->Flags & DB_TABLE_PAX)
+		{
+			UINT cRead = ReadColumns(pTableInfo, idxSlot, &rgBuffer[0], cRecords, DB_ALL_COLUMNS);
+			_ASSERTE(cRead == cRecords);
+		}
+		else
+		{
+			UINT cbRead = m_pBufferMgr->Read(offset, &rgBuffer[0], cRecords * pTableInfo->Size);
+			_ASSERTE(cbRead == cRecords * pTableInfo->Size);
+		}
+
+		for (UINT idx = 0; idx < cRecords; idx++)
+		{
+			const DbRecord* pRecord = (const DbRecord*) &rgBuffer[idx * pTableInfo->Size];
+
+			// Deleted slot of a stable-slot table
+			if (pRecord->RID == 0)
+			{
+				continue;
+			}
+
+			pIndex->Insert(pIndex->GetKey(pRecord), idxSlot + idx);
+		}
+
+		idxSlot += cRecords;
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::DropIndexes
+//
+//  Description:
+//      Remove the indexes of a table from the index catalog.  Index pages
+//		become free space.
+//
+//  Inputs:
+//      idTable == IN: Table id
+// --------------------------------------------------------------------------------
+void CDbFile::DropIndexes
+(
+	UINT idTable
+)
+{
+	for (UINT idx = 0; idx < m_fileInfo.Indexes.Slots; idx++)
+	{
+		DbIndexInfo* pIndexInfo = m_pIndexInfo + idx;
+
+		if (pIndexInfo->Id != 0 && pIndexInfo->TableId == idTable)
+		{
+			if (idx < m_rgIndexes.size())
+			{
+				FreeIndexPages(idx);
+				m_rgIndexes[idx] = NULL;
+			}
+
+			memset(pIndexInfo, 0, sizeof(DbIndexInfo));
+			m_fileInfo.Indexes.Entries--;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::FreeIndexPages
+//
+//  Description:
+//      Return the pages of an index that is being dropped to free space
+//
+//  Inputs:
+//      idxCatalog == IN: Slot in the index catalog
+// --------------------------------------------------------------------------------
+void CDbFile::FreeIndexPages
+(
+	UINT idxCatalog
+)
+{
+	vector<FILEOFFSET> rgPages;
+
+	if (m_rgIndexes[idxCatalog] == NULL)
+	{
+		return;
+	}
+
+	m_rgIndexes[idxCatalog]->GetPages(rgPages);
+
+	for (UINT idx = 0; idx < rgPages.size(); idx++)
+	{
+		FreeSpace(rgPages[idx], DB_PAGE_SIZE);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::AllocatePage
+//
+//  Description:
+//      Allocate a page aligned page from free space or the end of the data
+//		area
+//
+//  Returns:
+//		File offset of the page
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbFile::AllocatePage()
+{
+	FILEOFFSET offPage = 0;
+
+	m_mutex.Lock();
+
+	try
+	{
+		// Align so a page never spans two cache frames
+		offPage = AllocateSpace(DB_PAGE_SIZE, DB_PAGE_SIZE, m_fileInfo.DataOffsetEnd);
+
+		if (offPage == 0)
+		{
+			offPage = ((m_fileInfo.DataOffsetEnd + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE) * DB_PAGE_SIZE;
+			m_fileInfo.DataOffsetEnd = offPage + DB_PAGE_SIZE;
+
+			// Mark end of data area in the disk file
+			m_pFile->Expand(m_fileInfo.DataOffsetEnd);
+			MapData();
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return offPage;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::InitCatalog
+//
+//  Description:
+//      Initialize in memory catalog table
+//
+//	Inputs:
+//		pCatalog == IN: Catalog to intialize
+//
+//	Returns:
+//		Pointer to catalog info buffer
+// --------------------------------------------------------------------------------
+DbObjectInfo* CDbFile::InitCatalog
+(
+	DbCatalog* pCatalog
+)
+{
+	UINT  cbBuffer = pCatalog->Size * pCatalog->Slots;
+	BYTE* pBuffer  = new BYTE[cbBuffer];
+	memset(pBuffer, 0 , cbBuffer);
+	return (DbObjectInfo*) pBuffer;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::ExpandCatalog
+//
+//  Description:
+//      Relocate catalog and expand by growth factor
+//
+//	Inputs:
+//		pCatalog	== IN:		Catalog
+//		ppInfo		== IN/OUT:	Catalog buffer pointer
+// --------------------------------------------------------------------------------
+void CDbFile::ExpandCatalog
+(
+	DbCatalog*		pCatalog,
+	DbObjectInfo**	ppInfo
+)
+{
+	// Create new catalog data area
+	DbCatalog tmpCatalog = *pCatalog;
+	tmpCatalog.Slots += tmpCatalog.GrowthFactor;
+	DbObjectInfo* pBuffer = InitCatalog(&tmpCatalog);
+
+	// Copy existing catalog
+	memcpy(pBuffer, *ppInfo, pCatalog->Size * pCatalog->Slots);
+
+	// Release old catalog buffer
+	delete[] (BYTE*) *ppInfo;
+
+	// Set info buffer
+	*ppInfo = pBuffer;
+
+	// Update catalog
+	pCatalog->Slots			 += pCatalog->GrowthFactor;
+	pCatalog->Offset		  = m_fileInfo.DataOffsetEnd;
+	m_fileInfo.DataOffsetEnd += pCatalog->Size * pCatalog->Slots;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::Load
+//
+//  Description:
+//      Load file header, table catalog, index catalog and extent catalog.  A
+//		version 1 file is upgraded as it is loaded.
+//
+//  Exceptions:
+//		runtime_error == file version not supported or catalogs do not match it
+// --------------------------------------------------------------------------------
+void CDbFile::Load()
+{
+	TRACE_INIT("CDbFile::Load");
+
+	m_mutex.Lock();
+
+	try
+	{
+		// Read the file header
+		UINT cbRead = m_pFile->ReadAt(0, &m_fileInfo, sizeof(m_fileInfo));
+
+		// Version 1 files are converted as they are loaded
+		if (cbRead >= sizeof(UINT) && m_fileInfo.MajorVersion == 1)
+		{
+			Upgrade();
+		}
+		else
+		{
+			if (cbRead < sizeof(m_fileInfo))
+			{
+				throw runtime_error("File header truncated");
+			}
+
+			if (m_fileInfo.MajorVersion != verDbEngine.Major)
+			{
+				throw runtime_error("File version not supported");
+			}
+
+			CheckCatalog(&m_fileInfo.Tables,  sizeof(DbTableInfo));
+			CheckCatalog(&m_fileInfo.Indexes, sizeof(DbIndexInfo));
+			CheckCatalog(&m_fileInfo.Extents, sizeof(DbExtentInfo));
+
+			// Initialize catalog buffers
+			m_pTableInfo = (DbTableInfo*) InitCatalog(&m_fileInfo.Tables);
+			m_pIndexInfo = (DbIndexInfo*) InitCatalog(&m_fileInfo.Indexes);
+			m_pExtentInfo = (DbExtentInfo*) InitCatalog(&m_fileInfo.Extents);
+
+			// Read catalogs
+			LoadCatalog(m_pFile, &m_fileInfo.Tables,  m_pTableInfo);
+			LoadCatalog(m_pFile, &m_fileInfo.Indexes, m_pIndexInfo);
+			LoadCatalog(m_pFile, &m_fileInfo.Extents, m_pExtentInfo);
+
+			m_lockData.WriteLock();
+
+			try
+			{
+				LoadExtents();
+			}
+			catch ( ... )
+			{
+				m_lockData.Unlock();
+				throw;
+			}
+
+			m_lockData.Unlock();
+
+			// Open indexes and rebuild any discarded by a compaction
+			m_rgIndexes.clear();
+			m_rgIndexes.resize(m_fileInfo.Indexes.Slots);
+
+			for (UINT idx = 0; idx < m_fileInfo.Indexes.Slots; idx++)
+			{
+				DbIndexInfo* pIndexInfo = m_pIndexInfo + idx;
+
+				if (pIndexInfo->Id == 0)
+				{
+					continue;
+				}
+
+				m_rgIndexes[idx] = OpenIndex(idx);
+
+				if (pIndexInfo->Offset == 0)
+				{
+					INT idxTable = FindTable(pIndexInfo->TableId);
+
+					if (idxTable < 0)
+					{
+						throw runtime_error("Index refers to missing table");
+					}
+
+					BuildIndex(m_rgIndexes[idx], m_pTableInfo + idxTable);
+				}
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::Upgrade
+//
+//  Description:
+//      Load a version 1 file and convert it to the current format.  Each table
+//		gets one extent covering its data area and a record id index built
+//		from its records.  Version 1 index entries do not describe their key,
+//		so they are dropped.  The new catalogs are appended to the data
+//		region; the old ones are left as unused space until the file is
+//		compacted.  The converted header and catalogs are written through
+//		the page cache.  Caller must hold the access lock.
+//
+//  Exceptions:
+//		runtime_error == catalogs do not match version 1 or the new header
+//						 would overwrite table data
+// --------------------------------------------------------------------------------
+void CDbFile::Upgrade()
+{
+	TRACE_INIT("CDbFile::Upgrade");
+
+	DbFileInfoV1 fileInfo;
+
+	UINT cbRead = m_pFile->ReadAt(0, &fileInfo, sizeof(fileInfo));
+
+	if (cbRead < sizeof(fileInfo))
+	{
+		throw runtime_error("File header truncated");
+	}
+
+	CheckCatalog(&fileInfo.Tables,  sizeof(DbTableInfoV1));
+	CheckCatalog(&fileInfo.Indexes, sizeof(DbIndexInfoV1));
+
+	vector<DbTableInfoV1> rgTables(fileInfo.Tables.Slots);
+
+	if (!rgTables.empty())
+	{
+		LoadCatalog(m_pFile, &fileInfo.Tables, &rgTables[0]);
+	}
+
+	// The header grows over the old catalogs, never over table data
+	for (UINT idx = 0; idx < rgTables.size(); idx++)
+	{
+		if (rgTables[idx].Id != 0 && rgTables[idx].Slots > 0 && rgTables[idx].Offset < sizeof(m_fileInfo))
+		{
+			throw runtime_error("File cannot be upgraded in place");
+		}
+	}
+
+	memset(&m_fileInfo, 0, sizeof(m_fileInfo));
+
+	m_fileInfo.MajorVersion		= verDbEngine.Major;
+	m_fileInfo.MinorVersion		= verDbEngine.Minor;
+	m_fileInfo.Created			= fileInfo.Created;
+	m_fileInfo.LastUpdated		= fileInfo.LastUpdated;
+	m_fileInfo.DataOffsetStart	= sizeof(m_fileInfo);
+	m_fileInfo.DataOffsetEnd	= max(fileInfo.DataOffsetEnd, (FILEOFFSET) sizeof(m_fileInfo));
+
+	// Table catalog keeps its slots
+	m_fileInfo.Tables			= fileInfo.Tables;
+	m_fileInfo.Tables.Size		= sizeof(DbTableInfo);
+	m_fileInfo.Tables.Offset	= m_fileInfo.DataOffsetEnd;
+	m_fileInfo.DataOffsetEnd   += m_fileInfo.Tables.Size * m_fileInfo.Tables.Slots;
+
+	m_pTableInfo = (DbTableInfo*) InitCatalog(&m_fileInfo.Tables);
+
+	// Index catalog starts empty; ids stay unique
+	m_fileInfo.Indexes.Size			= sizeof(DbIndexInfo);
+	m_fileInfo.Indexes.Entries		= 0;
+	m_fileInfo.Indexes.Slots		= max(DB_DEFAULT_INDEXES, m_fileInfo.Tables.Slots);
+	m_fileInfo.Indexes.GrowthFactor	= DB_DEFAULT_GROWTH_FACTOR;
+	m_fileInfo.Indexes.LastId		= fileInfo.Indexes.LastId;
+	m_fileInfo.Indexes.Offset		= m_fileInfo.DataOffsetEnd;
+	m_fileInfo.DataOffsetEnd	   += m_fileInfo.Indexes.Size * m_fileInfo.Indexes.Slots;
+
+	m_pIndexInfo = (DbIndexInfo*) InitCatalog(&m_fileInfo.Indexes);
+
+	// One extent per table
+	m_fileInfo.Extents.Size			= sizeof(DbExtentInfo);
+	m_fileInfo.Extents.Entries		= 0;
+	m_fileInfo.Extents.Slots		= max(DB_DEFAULT_EXTENTS, m_fileInfo.Tables.Slots);
+	m_fileInfo.Extents.GrowthFactor	= DB_DEFAULT_EXTENTS;
+	m_fileInfo.Extents.LastId		= 0;
+	m_fileInfo.Extents.Offset		= m_fileInfo.DataOffsetEnd;
+	m_fileInfo.DataOffsetEnd	   += m_fileInfo.Extents.Size * m_fileInfo.Extents.Slots;
+
+	m_pExtentInfo = (DbExtentInfo*) InitCatalog(&m_fileInfo.Extents);
+
+	for (UINT idx = 0; idx < rgTables.size(); idx++)
+	{
+		DbTableInfo* pTableInfo = m_pTableInfo + idx;
+
+		if (rgTables[idx].Id == 0)
+		{
+			continue;
+		}
+
+		*(DbObjectInfo*) pTableInfo	= rgTables[idx];
+		pTableInfo->LastRecordId	= rgTables[idx].LastRecordId;
+		pTableInfo->Flags			= DB_TABLE_DEFAULT;
+		pTableInfo->FreeSlot		= DB_INVALID_POS;
+		pTableInfo->Deleted			= 0;
+		pTableInfo->BlockSlots		= 1;
+		pTableInfo->Columns			= 1;
+
+		if (pTableInfo->Slots == 0)
+		{
+			continue;
+		}
+
+		DbExtentInfo* pExtent = m_pExtentInfo + m_fileInfo.Extents.Entries;
+
+		m_fileInfo.Extents.Entries++;
+		m_fileInfo.Extents.LastId++;
+
+		pExtent->Id			= m_fileInfo.Extents.LastId;
+		pExtent->TableId	= pTableInfo->Id;
+		pExtent->Offset		= pTableInfo->Offset;
+		pExtent->Size		= pTableInfo->Size;
+		pExtent->Slots		= pTableInfo->Slots;
+		pExtent->FirstSlot	= 0;
+	}
+
+	m_lockData.WriteLock();
+
+	try
+	{
+		LoadExtents();
+	}
+	catch ( ... )
+	{
+		m_lockData.Unlock();
+		throw;
+	}
+
+	m_lockData.Unlock();
+
+	// Records are located by id through the RID index
+	m_rgIndexes.clear();
+	m_rgIndexes.resize(m_fileInfo.Indexes.Slots);
+
+	for (UINT idx = 0; idx < m_fileInfo.Tables.Slots; idx++)
+	{
+		if (m_pTableInfo[idx].Id != 0)
+		{
+			CreateIndex(m_pTableInfo + idx, 0, sizeof(DBRECID), DB_KEY_UINT, DB_INDEX_BTREE, DB_INDEX_RID);
+		}
+	}
+
+	m_pFile->Expand(m_fileInfo.DataOffsetEnd);
+	WriteHeader();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::CheckCatalog
+//
+//  Description:
+//      Verify that a catalog read from the file holds entries of the expected
+//		size
+//
+//  Inputs:
+//      pCatalog	== IN: Catalog descriptor
+//		cbEntry		== IN: Size of a catalog entry in this version
+//
+//  Exceptions:
+//		runtime_error == catalog entry size does not match
+// --------------------------------------------------------------------------------
+void CDbFile::CheckCatalog
+(
+	const DbCatalog*	pCatalog,
+	UINT				cbEntry
+)
+{
+	if (pCatalog->Size != cbEntry)
+	{
+		throw runtime_error("Catalog does not match the file version");
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::LoadCatalog
+//
+//  Description:
+//      Load catalog
+//
+//	Inputs:
+//		pFile		== IN:	Source file
+//		pCatalog	== IN:	Metadata catalog
+//		pBuffer		== IN:	Catalog buffer
+//		
+//  Returns:
+//		Count of catalog metadata records loaded
+// --------------------------------------------------------------------------------
+UINT CDbFile::LoadCatalog
+(
+	CFile*			pFile,
+	DbCatalog*		pCatalog,
+	DbObjectInfo*	pBuffer
+)
+{
+	// Read catalog
+	UINT cbRead = pFile->ReadAt(pCatalog->Offset, pBuffer, pCatalog->Size * pCatalog->Slots);
+
+	if (cbRead < pCatalog->Size * pCatalog->Slots)
+	{
+		throw runtime_error("Catalog truncated");
+	}
+
+	return (cbRead / pCatalog->Size);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::SaveCatalog
+//
+//  Description:
+//      Save catalog
+//
+//	Inputs:
+//		pFile		== IN:	Destination file
+//		pCatalog	== IN:	Metadata catalog
+//		pBuffer		== IN:	Catalog buffer
+//
+//  Returns:
+//		Count of catalog metadata records saved
+// --------------------------------------------------------------------------------
+UINT CDbFile::SaveCatalog
+(
+	CFile*			pFile,
+	DbCatalog*		pCatalog,
+	DbObjectInfo*	pBuffer
+)
+{
+	// Write catalog to file
+	UINT cbWritten = pFile->WriteAt(pCatalog->Offset, pBuffer, pCatalog->Size * pCatalog->Slots);
+	_ASSERTE(cbWritten == (pCatalog->Size * pCatalog->Slots));
+
+	return (cbWritten / pCatalog->Size);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetTable
+//
+//  Description:
+//      Access database table by requesting the table by name
+//
+//  Inputs:
+//      strTable == IN: Table name
+//
+//  Returns:
+//		Pointer to the table object
+// --------------------------------------------------------------------------------
+CDbTable* CDbFile::GetTable
+(
+	const string& strTable
+)
+{
+	CDbTable* pTable = NULL;
+
+	m_mutex.Lock();
+
+	try
+	{
+		// Search the table catalog for the tableinfo
+		INT idx = FindTable(strTable);
+
+		if (idx >= 0)
+		{
+			pTable = new CDbTable(this, m_pTableInfo + idx);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+	
+	m_mutex.Unlock();
+	return pTable;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::FindTable
+//
+//  Description:
+//      Find slot for specified table
+//
+//  Inputs:
+//      strTable == IN: Table name
+//
+//  Returns:
+//		Table slot
+// --------------------------------------------------------------------------------
+INT CDbFile::FindTable
+(
+	const string& strTable
+)
+{
+	// Search the table catalog for the tableinfo.  Deleted tables leave free
+	// slots anywhere in the catalog.
+	for (UINT idx = 0; idx < m_fileInfo.Tables.Slots; idx++)
+	{
+		DbTableInfo* pTableInfo = m_pTableInfo + idx;
+
+		if (pTableInfo->Id != 0 &&
+			strncmp(strTable.c_str(), pTableInfo->Name, DB_MAX_OBJECT_NAME) == 0)
+		{
+			return idx;
+		}
+	}
+
+	return -1;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::FindTable
+//
+//  Description:
+//      Find slot for specified table id
+//
+//  Inputs:
+//      idTable == IN: Table id
+//
+//  Returns:
+//		Table slot; -1 if not found
+// --------------------------------------------------------------------------------
+INT CDbFile::FindTable
+(
+	UINT idTable
+)
+{
+	for (UINT idx = 0; idx < m_fileInfo.Tables.Slots; idx++)
+	{
+		if (idTable != 0 && m_pTableInfo[idx].Id == idTable)
+		{
+			return idx;
+		}
+	}
+
+	return -1;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::AddExtent
+//
+//  Description:
+//      Add slots to a table.  When the last extent of the table ends the data
+//		area it is grown in place; otherwise a new extent is placed in free
+//		space or appended to the end of the file.  In direct mode a new extent
+//		starts on a page boundary so record transfers need no bounce buffer.
+//		The count of slots is rounded up to whole blocks.
+//
+//  Inputs:
+//      pTableInfo	== IN: Table descriptor
+//		cSlots		== IN: Count of slots to add
+// --------------------------------------------------------------------------------
+void CDbFile::AddExtent
+(
+	DbTableInfo*	pTableInfo,
+	UINT			cSlots
+)
+{
+	DbExtentList&	rgExtents	= m_mapExtents[pTableInfo->Id];
+	UINT			cBlock		= max(1U, pTableInfo->BlockSlots);
+
+	cSlots = ((cSlots + cBlock - 1) / cBlock) * cBlock;
+
+	if (!rgExtents.empty())
+	{
+		DbExtentInfo& rLast = rgExtents.back();
+
+		if (rLast.Offset + (rLast.Slots * rLast.Size) == m_fileInfo.DataOffsetEnd)
+		{
+			for (UINT idx = 0; idx < m_fileInfo.Extents.Slots; idx++)
+			{
+				if (m_pExtentInfo[idx].Id == rLast.Id)
+				{
+					m_pExtentInfo[idx].Slots += cSlots;
+					break;
+				}
+			}
+
+			rLast.Slots				 += cSlots;
+			pTableInfo->Slots		 += cSlots;
+			m_fileInfo.DataOffsetEnd += cSlots * pTableInfo->Size;
+
+			m_pFile->Expand(m_fileInfo.DataOffsetEnd);
+			MapData();
+			return;
+		}
+	}
+
+	UINT		cbAlign	= IsDirect() ? DB_PAGE_SIZE : 1;
+	FILEOFFSET	offset	= AllocateSpace(cSlots * pTableInfo->Size, cbAlign, m_fileInfo.DataOffsetEnd);
+
+	// The catalog may itself move to the end of the file
+	INT idx = GetFreeSlot(&m_fileInfo.Extents, (DbObjectInfo**) &m_pExtentInfo);
+
+	if (idx < 0)
+	{
+		throw runtime_error("No free extent slot found");
+	}
+
+	if (offset == 0)
+	{
+		offset = ((m_fileInfo.DataOffsetEnd + cbAlign - 1) / cbAlign) * cbAlign;
+		m_fileInfo.DataOffsetEnd = offset + (cSlots * pTableInfo->Size);
+
+		// Allocate the extent in the disk file
+		m_pFile->Expand(m_fileInfo.DataOffsetEnd);
+		MapData();
+	}
+
+	DbExtentInfo* pExtent = m_pExtentInfo + idx;
+
+	m_fileInfo.Extents.Entries++;
+	m_fileInfo.Extents.LastId++;
+
+	pExtent->Id			= m_fileInfo.Extents.LastId;
+	pExtent->TableId	= pTableInfo->Id;
+	pExtent->Offset		= offset;
+	pExtent->Size		= pTableInfo->Size;
+	pExtent->Slots		= cSlots;
+	pExtent->FirstSlot	= pTableInfo->Slots;
+
+	// Table offset is the start of its first extent
+	if (rgExtents.empty())
+	{
+		pTableInfo->Offset = pExtent->Offset;
+	}
+
+	rgExtents.push_back(*pExtent);
+	pTableInfo->Slots += cSlots;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::DropExtents
+//
+//  Description:
+//      Remove the extents of a table from the extent catalog.  Their space is
+//		free for new extents and index pages.
+//
+//  Inputs:
+//      idTable == IN: Table id
+// --------------------------------------------------------------------------------
+void CDbFile::DropExtents
+(
+	UINT idTable
+)
+{
+	for (UINT idx = 0; idx < m_fileInfo.Extents.Slots; idx++)
+	{
+		DbExtentInfo* pExtent = m_pExtentInfo + idx;
+
+		if (pExtent->Id != 0 && pExtent->TableId == idTable)
+		{
+			memset(pExtent, 0, sizeof(DbExtentInfo));
+			m_fileInfo.Extents.Entries--;
+		}
+	}
+
+	DbExtentList rgExtents = m_mapExtents[idTable];
+	m_mapExtents.erase(idTable);
+
+	for (UINT idx = 0; idx < rgExtents.size(); idx++)
+	{
+		FreeSpace(rgExtents[idx].Offset, rgExtents[idx].Slots * rgExtents[idx].Size);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      CompareFirstSlot
+//
+//  Description:
+//      Orders extents by their first table slot
+// --------------------------------------------------------------------------------
+static bool CompareFirstSlot
+(
+	const DbExtentInfo& rLeft,
+	const DbExtentInfo& rRight
+)
+{
+	return rLeft.FirstSlot < rRight.FirstSlot;
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      CompareOffset
+//
+//  Description:
+//      Orders extents by file offset
+// --------------------------------------------------------------------------------
+static bool CompareOffset
+(
+	const DbExtentInfo& rLeft,
+	const DbExtentInfo& rRight
+)
+{
+	return rLeft.Offset < rRight.Offset;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::LoadExtents
+//
+//  Description:
+//      Build the extent chain of each table and the free space list from the
+//		extent catalog
+// --------------------------------------------------------------------------------
+void CDbFile::LoadExtents()
+{
+	m_mapExtents.clear();
+	m_rgFreeExtents.clear();
+
+	for (UINT idx = 0; idx < m_fileInfo.Extents.Slots; idx++)
+	{
+		if (m_pExtentInfo[idx].Id == 0)
+		{
+			continue;
+		}
+
+		if (m_pExtentInfo[idx].TableId == 0)
+		{
+			m_rgFreeExtents.push_back(m_pExtentInfo[idx]);
+		}
+		else
+		{
+			m_mapExtents[m_pExtentInfo[idx].TableId].push_back(m_pExtentInfo[idx]);
+		}
+	}
+
+	sort(m_rgFreeExtents.begin(), m_rgFreeExtents.end(), CompareOffset);
+
+	map<UINT, DbExtentList>::iterator it;
+
+	for (it = m_mapExtents.begin(); it != m_mapExtents.end(); it++)
+	{
+		sort(it->second.begin(), it->second.end(), CompareFirstSlot);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetSlotOffset
+//
+//  Description:
+//      Locate a table slot in the file.  Lookups share the data lock, so
+//		readers on many threads do not queue behind each other.
+//
+//  Inputs:
+//      pTableInfo	== IN:	Table descriptor
+//		idxSlot		== IN:	Table slot
+//		pcRun		== OUT:	Count of slots from idxSlot to the end of its
+//							extent, which are contiguous in the file (optional)
+//
+//  Returns:
+//		File offset of the slot
+//
+//  Exceptions:
+//		out_of_range == slot beyond the table data area
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbFile::GetSlotOffset
+(
+	DbTableInfo*	pTableInfo,
+	DBPOS			idxSlot,
+	UINT*			pcRun
+)
+{
+	FILEOFFSET offset = 0;
+
+	m_lockData.ReadLock();
+
+	try
+	{
+		map<UINT, DbExtentList>::iterator it = m_mapExtents.find(pTableInfo->Id);
+
+		if (it == m_mapExtents.end() || idxSlot >= pTableInfo->Slots)
+		{
+			throw out_of_range("Table slot out of range");
+		}
+
+		// Last extent starting at or before the slot
+		const DbExtentList&	rgExtents	= it->second;
+		UINT				idxLow		= 0;
+		UINT				idxHigh		= rgExtents.size();
+
+		while (idxHigh - idxLow > 1)
+		{
+			UINT idxMid = (idxLow + idxHigh) / 2;
+
+			if (rgExtents[idxMid].FirstSlot <= idxSlot)
+			{
+				idxLow = idxMid;
+			}
+			else
+			{
+				idxHigh = idxMid;
+			}
+		}
+
+		const DbExtentInfo& rExtent = rgExtents[idxLow];
+
+		offset = rExtent.Offset + ((idxSlot - rExtent.FirstSlot) * rExtent.Size);
+
+		if (pcRun)
+		{
+			*pcRun = rExtent.FirstSlot + rExtent.Slots - idxSlot;
+		}
+	}
+	catch ( ... )
+	{
+		m_lockData.Unlock();
+		throw;
+	}
+
+	m_lockData.Unlock();
+	return offset;
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      GetColumnSize
+//
+//  Description:
+//      Width of a column of a PAX table (bytes)
+// --------------------------------------------------------------------------------
+static UINT GetColumnSize
+(
+	const DbTableInfo*	pTableInfo,
+	UINT				idxColumn
+)
+{
+	UINT offEnd = (idxColumn + 1 < pTableInfo->Columns) ?
+						pTableInfo->ColumnOffset[idxColumn + 1] : pTableInfo->Size;
+
+	return offEnd - pTableInfo->ColumnOffset[idxColumn];
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::ReadColumns
+//
+//  Description:
+//      Read consecutive rows of a PAX table through the page cache.  Each
+//		selected column is read with one request per block and its values are
+//		spread into the row buffer, so columns that are not selected are never
+//		read.  Their bytes in the row buffer are zero.
+//
+//  Inputs:
+//      pTableInfo	== IN:	Table descriptor
+//		idxSlot		== IN:	First slot
+//		pBuffer		== OUT:	Row buffer
+//		cRecords	== IN:	Count of slots
+//		fColumns	== IN:	Columns to read (bit n selects column n)
+//
+//  Returns:
+//		Count of records read
+// --------------------------------------------------------------------------------
+UINT CDbFile::ReadColumns
+(
+	DbTableInfo*	pTableInfo,
+	DBPOS			idxSlot,
+	void*			pBuffer,
+	UINT			cRecords,
+	UINT			fColumns
+)
+{
+	BYTE*			pRows	= (BYTE*) pBuffer;
+	UINT			cBlock	= pTableInfo->BlockSlots;
+	UINT			cDone	= 0;
+	UINT			fAll	= (pTableInfo->Columns < DB_MAX_COLUMNS) ?
+								((1U << pTableInfo->Columns) - 1) : DB_ALL_COLUMNS;
+	vector<BYTE>	rgValues;
+
+	if ((fColumns & fAll) != fAll)
+	{
+		memset(pBuffer, 0, cRecords * pTableInfo->Size);
+	}
+
+	while (cDone < cRecords)
+	{
+		// Extents hold whole blocks, so blocks start at multiples of cBlock
+		UINT		idxRow		= (idxSlot + cDone) % cBlock;
+		FILEOFFSET	offBlock	= GetSlotOffset(pTableInfo, idxSlot + cDone - idxRow);
+		UINT		cRows		= min(cBlock - idxRow, cRecords - cDone);
+
+		for (UINT idxColumn = 0; idxColumn < pTableInfo->Columns; idxColumn++)
+		{
+			if (!(fColumns & (1U << idxColumn)))
+			{
+				continue;
+			}
+
+			UINT		cbColumn	= GetColumnSize(pTableInfo, idxColumn);
+			UINT		offColumn	= pTableInfo->ColumnOffset[idxColumn];
+			UINT		cbValues	= cRows * cbColumn;
+			FILEOFFSET	offValues	= offBlock + (cBlock * offColumn) + (idxRow * cbColumn);
+
+			rgValues.resize(cbValues);
+
+			if (m_pBufferMgr->Read(offValues, &rgValues[0], cbValues) != cbValues)
+			{
+				return cDone;
+			}
+
+			BYTE* pRow = pRows + (cDone * pTableInfo->Size) + offColumn;
+
+			for (UINT idx = 0; idx < cRows; idx++, pRow += pTableInfo->Size)
+			{
+				memcpy(pRow, &rgValues[idx * cbColumn], cbColumn);
+			}
+		}
+
+		cDone += cRows;
+	}
+
+	return cDone;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::WriteColumns
+//
+//  Description:
+//      Write consecutive rows of a PAX table through the page cache.  The
+//		values of each column are gathered from the row buffer and written
+//		with one request per block.
+//
+//  Inputs:
+//      pTableInfo	== IN:	Table descriptor
+//		idxSlot		== IN:	First slot
+//		pBuffer		== IN:	Row buffer
+//		cRecords	== IN:	Count of slots
+//
+//  Returns:
+//		Count of records written
+// --------------------------------------------------------------------------------
+UINT CDbFile::WriteColumns
+(
+	DbTableInfo*	pTableInfo,
+	DBPOS			idxSlot,
+	const void*		pBuffer,
+	UINT			cRecords
+)
+{
+	const BYTE*		pRows	= (const BYTE*) pBuffer;
+	UINT			cBlock	= pTableInfo->BlockSlots;
+	UINT			cDone	= 0;
+	vector<BYTE>	rgValues;
+
+	while (cDone < cRecords)
+	{
+		UINT		idxRow		= (idxSlot + cDone) % cBlock;
+		FILEOFFSET	offBlock	= GetSlotOffset(pTableInfo, idxSlot + cDone - idxRow);
+		UINT		cRows		= min(cBlock - idxRow, cRecords - cDone);
+
+		for (UINT idxColumn = 0; idxColumn < pTableInfo->Columns; idxColumn++)
+		{
+			UINT		cbColumn	= GetColumnSize(pTableInfo, idxColumn);
+			UINT		offColumn	= pTableInfo->ColumnOffset[idxColumn];
+			UINT		cbValues	= cRows * cbColumn;
+			FILEOFFSET	offValues	= offBlock + (cBlock * offColumn) + (idxRow * cbColumn);
+			const BYTE*	pRow		= pRows + (cDone * pTableInfo->Size) + offColumn;
+
+			rgValues.resize(cbValues);
+
+			for (UINT idx = 0; idx < cRows; idx++, pRow += pTableInfo->Size)
+			{
+				memcpy(&rgValues[idx * cbColumn], pRow, cbColumn);
+			}
+
+			m_pBufferMgr->Write(offValues, &rgValues[0], cbValues);
+		}
+
+		cDone += cRows;
+	}
+
+	return cDone;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetExtentInfo
+//
+//  Description:
+//      Find an extent in the extent catalog
+//
+//  Inputs:
+//      idExtent == IN: Extent id
+//
+//  Returns:
+//      Pointer to the catalog entry
+//
+//  Exceptions:
+//		logic_error == extent missing from the catalog
+// --------------------------------------------------------------------------------
+DbExtentInfo* CDbFile::GetExtentInfo
+(
+	UINT idExtent
+)
+{
+	for (UINT idx = 0; idx < m_fileInfo.Extents.Slots; idx++)
+	{
+		if (m_pExtentInfo[idx].Id == idExtent)
+		{
+			return m_pExtentInfo + idx;
+		}
+	}
+
+	throw logic_error("Extent missing from catalog");
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::AllocateSpace
+//
+//  Description:
+//      Take space from the lowest free extent that can hold it.  Whatever is
+//		left of the free extent before and after the allocation stays free.
+//
+//  Inputs:
+//      cbLen		== IN: Count of bytes
+//		cbAlign		== IN: Required alignment of the start offset
+//		offLimit	== IN: Space must end at or before this offset
+//
+//  Returns:
+//      File offset of the space; zero if no free extent is large enough
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbFile::AllocateSpace
+(
+	UINT		cbLen,
+	UINT		cbAlign,
+	FILEOFFSET	offLimit
+)
+{
+	for (UINT idx = 0; idx < m_rgFreeExtents.size(); idx++)
+	{
+		FILEOFFSET offFree	  = m_rgFreeExtents[idx].Offset;
+		FILEOFFSET offFreeEnd = m_rgFreeExtents[idx].Offset + m_rgFreeExtents[idx].Slots;
+		FILEOFFSET offStart	  = ((offFree + cbAlign - 1) / cbAlign) * cbAlign;
+
+		if (offFree >= offLimit)
+		{
+			break;
+		}
+
+		if (offStart + cbLen > min(offFreeEnd, offLimit))
+		{
+			continue;
+		}
+
+		DropFreeExtent(idx);
+		FreeSpace(offFree, offStart - offFree);
+		FreeSpace(offStart + cbLen, offFreeEnd - (offStart + cbLen));
+
+		return offStart;
+	}
+
+	return 0;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::FreeSpace
+//
+//  Description:
+//      Return a byte range of the data area to free space.  The range is
+//		merged with free extents on either side and recorded in the extent
+//		catalog with a table id of zero.
+//
+//  Inputs:
+//      offset	== IN: File offset
+//		cbLen	== IN: Count of bytes
+// --------------------------------------------------------------------------------
+void CDbFile::FreeSpace
+(
+	FILEOFFSET	offset,
+	UINT		cbLen
+)
+{
+	FILEOFFSET offEnd = offset + cbLen;
+
+	if (cbLen == 0)
+	{
+		return;
+	}
+
+	// Merge with adjacent free extents
+	for (UINT idx = 0; idx < m_rgFreeExtents.size(); )
+	{
+		FILEOFFSET offFree	  = m_rgFreeExtents[idx].Offset;
+		FILEOFFSET offFreeEnd = m_rgFreeExtents[idx].Offset + m_rgFreeExtents[idx].Slots;
+
+		if (offFreeEnd == offset || offFree == offEnd)
+		{
+			offset = min(offset, offFree);
+			offEnd = max(offEnd, offFreeEnd);
+			DropFreeExtent(idx);
+			continue;
+		}
 
-	// Read catalog
-	UINT cbRead = pFile->Read(pBuffer, pCatalog->Size * pCatalog->Slots);
-	_ASSERTE(cbRead == (pCatalog->Size * pCatalog->Slots));	
+		idx++;
+	}
 
-	return (cbRead / pCatalog->Size);
+	INT idx = GetFreeSlot(&m_fileInfo.Extents, (DbObjectInfo**) &m_pExtentInfo);
+
+	if (idx < 0)
+	{
+		throw runtime_error("No free extent slot found");
+	}
+
+	DbExtentInfo* pExtent = m_pExtentInfo + idx;
+
+	m_fileInfo.Extents.Entries++;
+	m_fileInfo.Extents.LastId++;
+
+	pExtent->Id			= m_fileInfo.Extents.LastId;
+	pExtent->TableId	= 0;
+	pExtent->Offset		= offset;
+	pExtent->Size		= 1;
+	pExtent->Slots		= offEnd - offset;
+	pExtent->FirstSlot	= 0;
+
+	m_rgFreeExtents.insert(upper_bound(m_rgFreeExtents.begin(), m_rgFreeExtents.end(),
+									   *pExtent, CompareOffset),
+						   *pExtent);
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::SaveCatalog
+//      CDbFile::DropFreeExtent
 //
 //  Description:
-//      Save catalog
-//
-//	Inputs:
-//		pFile		== IN:	Destination file
-//		pCatalog	== IN:	Metadata catalog
-//		pBuffer		== IN:	Catalog buffer
+//      Remove a free extent from the free space list and the extent catalog
 //
-//  Returns:
-//		Count of catalog metadata records saved
+//  Inputs:
+//      idxFree == IN: Position in the free space list
 // --------------------------------------------------------------------------------
-UINT CDbFile::SaveCatalog
+void CDbFile::DropFreeExtent
 (
-	CFile*			pFile,
-	DbCatalog*		pCatalog,
-	DbObjectInfo*	pBuffer
+	UINT idxFree
 )
 {
-	// Move to file position
-	pFile->Seek(pCatalog->Offset);
-
-	// Write catalog to file
-	UINT cbWritten = pFile->Write(pBuffer, pCatalog->Size * pCatalog->Slots);
-	_ASSERTE(cbWritten == (pCatalog->Size * pCatalog->Slots));
+	memset(GetExtentInfo(m_rgFreeExtents[idxFree].Id), 0, sizeof(DbExtentInfo));
+	m_fileInfo.Extents.Entries--;
 
-	return (cbWritten / pCatalog->Size);
+	m_rgFreeExtents.erase(m_rgFreeExtents.begin() + idxFree);
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::GetTable
+//      CDbFile::TrimTable
 //
 //  Description:
-//      Access database table by requesting the table by name
+//      Release unused slots at the end of a table that has shrunk to well
+//		under its capacity.  Room for twice the rows (and at least one growth
+//		step) is kept so the table does not immediately grow again, and the
+//		first extent is never trimmed so the created size is preserved.  Slots
+//		are released in whole blocks.
 //
 //  Inputs:
-//      strTable == IN: Table name
+//      pTableInfo == IN: Table
 //
 //  Returns:
-//		Pointer to the table object
+//      true if slots were released
 // --------------------------------------------------------------------------------
-CDbTable* CDbFile::GetTable
+bool CDbFile::TrimTable
 (
-	const string& strTable
+	DbTableInfo* pTableInfo
 )
 {
-	CDbTable* pTable = NULL;
+	DbExtentList&	rgExtents	= m_mapExtents[pTableInfo->Id];
+	UINT			cBlock		= max(1U, pTableInfo->BlockSlots);
+	UINT			cKeep		= max(max(1U, 2 * pTableInfo->Entries),
+									  pTableInfo->Entries + pTableInfo->GrowthFactor);
+	bool			fTrimmed	= false;
 
-	m_mutex.Lock();
+	if (pTableInfo->Slots <= 2 * cKeep)
+	{
+		return false;
+	}
 
-	try
+	while (rgExtents.size() > 1 && pTableInfo->Slots > cKeep)
 	{
-		// Search the table catalog for the tableinfo
-		INT idx = FindTable(strTable);
+		DbExtentInfo&	rLast	= rgExtents.back();
+		DbExtentInfo*	pExtent	= GetExtentInfo(rLast.Id);
+		UINT			cTrim	= min(rLast.Slots, pTableInfo->Slots - cKeep);
 
-		if (idx >= 0)
+		cTrim -= cTrim % cBlock;
+
+		if (cTrim == 0)
 		{
-			pTable = new CDbTable(this, m_pTableInfo + idx);
+			break;
 		}
+
+		rLast.Slots			-= cTrim;
+		pTableInfo->Slots	-= cTrim;
+		fTrimmed			 = true;
+
+		FILEOFFSET	offFree	= rLast.Offset + (rLast.Slots * rLast.Size);
+		UINT		cbFree	= cTrim * rLast.Size;
+
+		if (rLast.Slots == 0)
+		{
+			memset(pExtent, 0, sizeof(DbExtentInfo));
+			m_fileInfo.Extents.Entries--;
+			rgExtents.pop_back();
+		}
+		else
+		{
+			pExtent->Slots = rLast.Slots;
+		}
+
+		FreeSpace(offFree, cbFree);
 	}
-	catch ( ... )
-	{
-		m_mutex.Unlock();
-		throw;
-	}
-	
-	m_mutex.Unlock();
-	return pTable;
+
+	return fTrimmed;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::FindTable
+//      CDbFile::RelocateExtent
 //
 //  Description:
-//      Find slot for specified table
+//      Move the leading slots of the highest table extent that has free
+//		space below it into that space.  Slots move in whole blocks and only
+//		blocks with rows in use are copied.  The moved slots are merged into
+//		the preceding extent of the chain when they land right after it.
 //
 //  Inputs:
-//      strTable == IN: Table name
+//      cbBudget == IN: Most bytes to move
 //
 //  Returns:
-//		Table slot
+//      true if slots were moved
 // --------------------------------------------------------------------------------
-INT CDbFile::FindTable
+bool CDbFile::RelocateExtent
 (
-	const string& strTable
+	UINT cbBudget
 )
 {
-	// Search the table catalog for the tableinfo
-	for (UINT idx = 0; idx < m_fileInfo.Tables.Entries; idx++)
+	UINT			cbAlign		= IsDirect() ? DB_PAGE_SIZE : 1;
+	DbTableInfo*	pTableInfo	= NULL;
+	UINT			idxExtent	= 0;
+	UINT			cbHole		= 0;
+
+	// Highest extent with a hole below it that can hold a block
+	for (UINT iidx = 0; iidx < m_fileInfo.Tables.Slots; iidx++)
 	{
-		DbTableInfo* pTableInfo = m_pTableInfo + idx;
+		if (m_pTableInfo[iidx].Id == 0)
+		{
+			continue;
+		}
 
-		if (strncmp(strTable.c_str(), pTableInfo->Name, DB_MAX_OBJECT_NAME) == 0)
+		const DbExtentList&	rgExtents	= m_mapExtents[m_pTableInfo[iidx].Id];
+		UINT				cbBlock		= max(1U, m_pTableInfo[iidx].BlockSlots) * m_pTableInfo[iidx].Size;
+
+		for (UINT idx = 0; idx < rgExtents.size(); idx++)
 		{
-			return idx;
+			const DbExtentInfo& rExtent = rgExtents[idx];
+
+			if (pTableInfo && rExtent.Offset <= m_mapExtents[pTableInfo->Id][idxExtent].Offset)
+			{
+				continue;
+			}
+
+			UINT cbLargest = 0;
+
+			for (UINT idxFree = 0; idxFree < m_rgFreeExtents.size(); idxFree++)
+			{
+				const DbExtentInfo& rFree	 = m_rgFreeExtents[idxFree];
+				FILEOFFSET			offStart = ((rFree.Offset + cbAlign - 1) / cbAlign) * cbAlign;
+
+				if (rFree.Offset >= rExtent.Offset)
+				{
+					break;
+				}
+
+				if (offStart < rFree.Offset + rFree.Slots)
+				{
+					cbLargest = max(cbLargest, rFree.Offset + rFree.Slots - offStart);
+				}
+			}
+
+			if (cbLargest >= cbBlock)
+			{
+				pTableInfo	= m_pTableInfo + iidx;
+				idxExtent	= idx;
+				cbHole		= cbLargest;
+			}
 		}
 	}
 
-	return -1;
+	if (!pTableInfo)
+	{
+		return false;
+	}
+
+	DbExtentList&	rgExtents	= m_mapExtents[pTableInfo->Id];
+	DbExtentInfo	extent		= rgExtents[idxExtent];
+	UINT			cBlock		= max(1U, pTableInfo->BlockSlots);
+	UINT			cSlots		= min(extent.Slots, min(max(cBlock, cbBudget / extent.Size),
+															cbHole / extent.Size));
+
+	cSlots -= cSlots % cBlock;
+
+	UINT			cbMove		= cSlots * extent.Size;
+	FILEOFFSET		offMove		= AllocateSpace(cbMove, cbAlign, extent.Offset);
+
+	_ASSERTE(offMove != 0);
+
+	// Copy the blocks with rows in use
+	UINT cbLive = 0;
+
+	if (pTableInfo->Entries > extent.FirstSlot)
+	{
+		UINT cLive = ((pTableInfo->Entries - extent.FirstSlot + cBlock - 1) / cBlock) * cBlock;
+		cbLive = min(cLive, cSlots) * extent.Size;
+	}
+
+	for (UINT cbDone = 0; cbDone < cbLive; )
+	{
+		UINT cbChunk = min(m_cbBuffer, cbLive - cbDone);
+
+		if (m_pBufferMgr->Read(extent.Offset + cbDone, m_pBuffer, cbChunk) != cbChunk)
+		{
+			throw runtime_error("Table data truncated");
+		}
+
+		m_pBufferMgr->Write(offMove + cbDone, m_pBuffer, cbChunk);
+		cbDone += cbChunk;
+	}
+
+	// Mapped readers use the new location as soon as the chain changes
+	if (IsLogged() && IsMapped())
+	{
+		DBLSN lsn = LogChanges();
+
+		if (lsn)
+		{
+			m_pLog->Flush(lsn);
+		}
+
+		m_pBufferMgr->Flush();
+	}
+
+	// Moved slots join the previous extent or get an entry of their own
+	if (idxExtent > 0 &&
+		rgExtents[idxExtent - 1].Offset + (rgExtents[idxExtent - 1].Slots * extent.Size) == offMove)
+	{
+		rgExtents[idxExtent - 1].Slots += cSlots;
+		GetExtentInfo(rgExtents[idxExtent - 1].Id)->Slots += cSlots;
+	}
+	else
+	{
+		INT idx = GetFreeSlot(&m_fileInfo.Extents, (DbObjectInfo**) &m_pExtentInfo);
+
+		if (idx < 0)
+		{
+			throw runtime_error("No free extent slot found");
+		}
+
+		DbExtentInfo* pExtent = m_pExtentInfo + idx;
+
+		m_fileInfo.Extents.Entries++;
+		m_fileInfo.Extents.LastId++;
+
+		pExtent->Id			= m_fileInfo.Extents.LastId;
+		pExtent->TableId	= pTableInfo->Id;
+		pExtent->Offset		= offMove;
+		pExtent->Size		= extent.Size;
+		pExtent->Slots		= cSlots;
+		pExtent->FirstSlot	= extent.FirstSlot;
+
+		rgExtents.insert(rgExtents.begin() + idxExtent, *pExtent);
+		idxExtent++;
+	}
+
+	// The rest of the extent stays in place
+	DbExtentInfo* pExtent = GetExtentInfo(extent.Id);
+
+	if (cSlots == extent.Slots)
+	{
+		memset(pExtent, 0, sizeof(DbExtentInfo));
+		m_fileInfo.Extents.Entries--;
+		rgExtents.erase(rgExtents.begin() + idxExtent);
+	}
+	else
+	{
+		pExtent->Offset		+= cbMove;
+		pExtent->FirstSlot	+= cSlots;
+		pExtent->Slots		-= cSlots;
+		rgExtents[idxExtent] = *pExtent;
+	}
+
+	pTableInfo->Offset = rgExtents[0].Offset;
+	FreeSpace(extent.Offset, cbMove);
+
+	return true;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::AppendTableData
+//      CDbFile::ShrinkFile
 //
 //  Description:
-//      Add table data area to end of the file
+//      Cut a free extent that ends the data area from the data area
 //
-//  Inputs:
-//      pTableInfo == IN: Table descriptor
+//  Returns:
+//      true if the data area shrank
 // --------------------------------------------------------------------------------
-void CDbFile::AppendTableData
-(
-	DbTableInfo* pTableInfo
-)
+bool CDbFile::ShrinkFile()
 {
-	// Calculate data position
-	pTableInfo->Offset		 = m_fileInfo.DataOffsetEnd;
-	m_fileInfo.DataOffsetEnd = m_fileInfo.DataOffsetEnd + (pTableInfo->Size * pTableInfo->Slots);
+	if (m_rgFreeExtents.empty())
+	{
+		return false;
+	}
+
+	const DbExtentInfo& rLast = m_rgFreeExtents.back();
+
+	if (rLast.Offset + rLast.Slots != m_fileInfo.DataOffsetEnd)
+	{
+		return false;
+	}
+
+	m_fileInfo.DataOffsetEnd = rLast.Offset;
+	DropFreeExtent(m_rgFreeExtents.size() - 1);
 
-	// Mark end of data area in the disk file
-	m_pFile->Expand(m_fileInfo.DataOffsetEnd, DB_EOF);
+	return true;
 }
 
 // --------------------------------------------------------------------------------
@@ -807,8 +3487,8 @@ void CDbFile::AppendTableData
 //      Search catalog for a free slot
 //
 //	Inputs:
-//		pCatalog	== IN:	Metadata catalog to search
-//		pInfo		== IN:	Catalog info buffer
+//		pCatalog	== IN:		Metadata catalog to search
+//		ppInfo		== IN/OUT:	Catalog info buffer (reallocated if the catalog grows)
 //
 //	Returns:
 //		Index of free slot; -1 if not found
@@ -816,22 +3496,23 @@ void CDbFile::AppendTableData
 INT CDbFile::GetFreeSlot
 (
 	DbCatalog*		pCatalog,
-	DbObjectInfo*	pInfo
+	DbObjectInfo**	ppInfo
 )
 {
 	// Walk the catalog for empty slots
 	for (UINT idxSlot = 0; idxSlot < pCatalog->Slots; idxSlot++)
 	{
-		DbObjectInfo* pRec = (DbObjectInfo*) (((BYTE*)pInfo) + (idxSlot * pCatalog->Size));
+		DbObjectInfo* pRec = (DbObjectInfo*) (((BYTE*) *ppInfo) + (idxSlot * pCatalog->Size));
 		if (pRec->Id == 0)
 		{
 			return idxSlot;
 		}
 	}
 
-	// Catalog is full - expand
-	ExpandCatalog(pCatalog, pInfo);
-	return (idxSlot + 1);
+	// Catalog is full - expand.  First new slot follows the old slots.
+	INT idxFree = pCatalog->Slots;
+	ExpandCatalog(pCatalog, ppInfo);
+	return idxFree;
 }
 
 // --------------------------------------------------------------------------------
@@ -872,44 +3553,235 @@ void CDbFile::SwapTableInfo
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbFile::CopyTableData
+//      CDbFile::MapData
+//
+//  Description:
+//      Map the data region when the file is opened in mapped mode.  The view
+//		reserves room for the region to grow (twice the last view, at least
+//		DB_MAP_RESERVE), so growth within the view only extends the readable
+//		range.  A region that outgrows the view is remapped; the old view is
+//		retired until FreeRetiredViews finds it unused.  A read-only view
+//		cannot reach past the end of the file on Windows, so there the view
+//		covers the data region only.
+// --------------------------------------------------------------------------------
+void CDbFile::MapData()
+{
+	TRACE_INIT("CDbFile::MapData");
+
+	if (!IsMapped() || m_fileInfo.DataOffsetEnd <= m_cbView)
+	{
+		return;
+	}
+
+	if (m_fileInfo.DataOffsetEnd <= m_cbMapped)
+	{
+		m_lockData.WriteLock();
+		m_cbView = m_fileInfo.DataOffsetEnd;
+		m_lockData.Unlock();
+		return;
+	}
+
+	UINT		cbMap	= m_fileInfo.DataOffsetEnd;
+	const BYTE*	pView	= NULL;
+
+#if !defined (__WIN32__)
+	UINT cbReserve = max(m_cbMapped, DB_MAP_RESERVE / 2);
+
+	cbReserve = (cbReserve <= UINT_MAX / 2) ? cbReserve * 2 : UINT_MAX - (DB_PAGE_SIZE - 1);
+	cbReserve = max(cbReserve, cbMap);
+
+	// Without the address space for the reserve, map just the data region
+	try
+	{
+		pView = m_pFile->Map(cbReserve);
+		cbMap = cbReserve;
+	}
+	catch (runtime_error&)
+	{
+		pView = NULL;
+	}
+#endif
+
+	if (!pView)
+	{
+		pView = m_pFile->Map(cbMap);
+	}
+
+	m_lockData.WriteLock();
+
+	try
+	{
+		if (m_pView)
+		{
+			m_rgRetiredViews.push_back(DbView(m_pView, m_cbMapped));
+		}
+	}
+	catch ( ... )
+	{
+		m_lockData.Unlock();
+		m_pFile->Unmap(pView, cbMap);
+		throw;
+	}
+
+	m_pView		= pView;
+	m_cbView	= m_fileInfo.DataOffsetEnd;
+	m_cbMapped	= cbMap;
+
+	m_lockData.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::UnmapData
+//
+//  Description:
+//      Release the current and all retired data views
+// --------------------------------------------------------------------------------
+void CDbFile::UnmapData()
+{
+	m_lockData.WriteLock();
+
+	for (UINT idx = 0; idx < m_rgRetiredViews.size(); idx++)
+	{
+		m_pFile->Unmap(m_rgRetiredViews[idx].first, m_rgRetiredViews[idx].second);
+	}
+
+	m_rgRetiredViews.clear();
+
+	if (m_pView)
+	{
+		m_pFile->Unmap(m_pView, m_cbMapped);
+	}
+
+	m_pView		= NULL;
+	m_cbView	= 0;
+	m_cbMapped	= 0;
+
+	m_lockData.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::FreeRetiredViews
+//
+//  Description:
+//      Release the views replaced by a remap, unless a reader is still using
+//		mapped data (see BeginView).  Called at a checkpoint; record views
+//		returned to the application are documented to last until then.
+// --------------------------------------------------------------------------------
+void CDbFile::FreeRetiredViews()
+{
+	m_lockData.WriteLock();
+
+	// Readers that start from now on get the current view
+	if (AtomicLoad(&m_cViewUsers) == 0)
+	{
+		for (UINT idx = 0; idx < m_rgRetiredViews.size(); idx++)
+		{
+			m_pFile->Unmap(m_rgRetiredViews[idx].first, m_rgRetiredViews[idx].second);
+		}
+
+		m_rgRetiredViews.clear();
+	}
+
+	m_lockData.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::GetView
 //
 //  Description:
-//      Copies table data from source offset to destination offset
+//      Get pointer into the mapped data region
 //
 //  Inputs:
-//      idxSrc	== IN:	Source offset
-//		idxDest	== IN:	Destination offset
-//		cbLen	== IN:	Bytes to copy
+//      offset	== IN: File offset
+//		cbLen	== IN: Count of bytes the caller will access
+//
+//  Returns:
+//		Pointer to mapped data
+//
+//  Exceptions:
+//		runtime_error == file not mapped or range outside of the view
 // --------------------------------------------------------------------------------
-void CDbFile::CopyTableData
+const BYTE* CDbFile::GetView
 (
-	FILEOFFSET	idxSrc,
-	FILEOFFSET	idxDest,
+	FILEOFFSET	offset,
 	UINT		cbLen
 )
 {
-	FILEOFFSET	idxEnd		= idxSrc + cbLen;
-	UINT		cbRead		= 0;
-	UINT		cbWritten	= 0;
+	const BYTE* pView = NULL;
 
-	TRACE_INIT("CDbFile::CopyTableData");
+	m_lockData.ReadLock();
 
-	while (idxSrc < idxEnd)
+	try
 	{
-		// Read source data
-		m_pFile->Seek(idxSrc);
-		cbRead = m_pFile->Read(m_pBuffer, min(m_cbBuffer, (idxEnd - idxSrc)));
-		_ASSERTE(cbRead == min(m_cbBuffer, (idxEnd - idxSrc)));
+		if (!m_pView)
+		{
+			throw runtime_error("File not opened for mapped access");
+		}
 
-		// Write to destination
-		m_pFile->Seek(idxDest);
-		cbWritten = m_pFile->Write(m_pBuffer, cbRead);
-		_ASSERTE(cbWritten == cbRead);
+		if (offset + cbLen > m_cbView)
+		{
+			throw out_of_range("View outside of mapped region");
+		}
 
-		// Update offsets
-		idxSrc	+= cbRead;
-		idxDest	+= cbWritten;
+		pView = m_pView + offset;
+	}
+	catch ( ... )
+	{
+		m_lockData.Unlock();
+		throw;
 	}
+
+	m_lockData.Unlock();
+	return pView;
 }
 
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbFile::ReadView
+//
+//  Description:
+//      Copy bytes out of the mapped data region.  The copy is made under the
+//		data lock, so the view cannot be released meanwhile.
+//
+//  Inputs:
+//      offset	== IN:	File offset
+//		pBuffer	== OUT:	Output buffer
+//		cbLen	== IN:	Count of bytes to copy
+//
+//  Exceptions:
+//		runtime_error == file not mapped or range outside of the view
+// --------------------------------------------------------------------------------
+void CDbFile::ReadView
+(
+	FILEOFFSET	offset,
+	void*		pBuffer,
+	UINT		cbLen
+)
+{
+	m_lockData.ReadLock();
+
+	try
+	{
+		if (!m_pView)
+		{
+			throw runtime_error("File not opened for mapped access");
+		}
+
+		if (offset + cbLen > m_cbView)
+		{
+			throw out_of_range("View outside of mapped region");
+		}
+
+		memcpy(pBuffer, m_pView + offset, cbLen);
+	}
+	catch ( ... )
+	{
+		m_lockData.Unlock();
+		throw;
+	}
+
+	m_lockData.Unlock();
+}
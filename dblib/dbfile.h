@@ -19,9 +19,26 @@
 
 // Data operations buffer size (default)
 const UINT DB_DATA_BUFFER	= 4096;
-const UINT DB_EOF			= 0xFFFFFFFF;
+
+// Offline compaction
+const UINT DB_COPY_CHUNK	= 16 * 1024 * 1024;		// Most bytes per copy job
+
+// Online compaction
+const UINT DB_COMPACT_STEP	= 256 * 1024;			// Bytes relocated per step (default)
+const UINT DB_COMPACT_RATE	= 4 * 1024 * 1024;		// Background I/O budget (bytes per second)
+const UINT DB_COMPACT_IDLE	= 1000;					// Wait when there is nothing to do (ms)
+
+// Mapped access
+const UINT DB_MAP_RESERVE	= 256 * 1024 * 1024;	// Smallest data view (room to grow)
+
+// Open modes
+const UINT DB_OPEN_DEFAULT	= 0x0000;
+const UINT DB_OPEN_MAPPED	= 0x0001;		// Map data region for zero-copy reads
+const UINT DB_OPEN_LOGGED	= 0x0002;		// Write-ahead log every change (durable commits)
+const UINT DB_OPEN_DIRECT	= 0x0004;		// Bypass the system cache (page aligned table data)
 
 class CDbTable;
+class CDbIndex;
 class CFile;
 
 // ================================================================================
@@ -34,21 +51,31 @@ class CFile;
 class CDbFile : public CObject
 {
 public:
-	CDbFile(const string& strFile, UINT cbBuffer = DB_DATA_BUFFER);
+	CDbFile(
+		const string&	strFile,
+		UINT			cbBuffer	= DB_DATA_BUFFER,
+		UINT			cbCache		= DB_DEFAULT_CACHE_SIZE
+		);
 	~CDbFile();
 
 	// ----------------------------------------------------------------------------
 	//	DATA FILE OPERATIONS
 	// ----------------------------------------------------------------------------
 
-	void Create(UINT cTables = DB_DEFAULT_TABLES);
-	void Open();
+	void Create(UINT cTables = DB_DEFAULT_TABLES, UINT fMode = DB_OPEN_DEFAULT);
+	void Open(UINT fMode = DB_OPEN_DEFAULT);
 	void Close();
 	void Save();
-	void Compact();
+	void Compact(UINT cThreads = 0);
+	bool CompactStep(UINT cbBudget = DB_COMPACT_STEP);
+	void StartCompaction(UINT cbPerSecond = DB_COMPACT_RATE);
+	void StopCompaction();
 	bool Exists()				{ return m_pFile->Exists(); }
-	void Delete()				{ m_pFile->Delete(); }
+	void Delete()				{ m_pFile->Delete(); m_pLog->Delete(); }
 	UINT GetFileSize()			{ return m_pFile->GetFileSize(); }
+	bool IsMapped()				{ return (m_fMode & DB_OPEN_MAPPED) != 0; }
+	bool IsLogged()				{ return (m_fMode & DB_OPEN_LOGGED) != 0; }
+	bool IsDirect()				{ return (m_fMode & DB_OPEN_DIRECT) != 0; }
 
 	// ----------------------------------------------------------------------------
 	//	TABLE OPERATIONS
@@ -58,39 +85,160 @@ public:
 							const string&	strTable,
 							UINT			cbRowSize,
 							UINT			cSlots			= DB_DEFAULT_SLOTS,
-							UINT			cGrowthFactor	= DB_DEFAULT_GROWTH_FACTOR
+							UINT			cGrowthFactor	= DB_DEFAULT_GROWTH_FACTOR,
+							UINT			fFlags			= DB_TABLE_DEFAULT,
+							const UINT*		rgColumns		= NULL,
+							UINT			cColumns		= 0
 							);
 
 	void		DeleteTable(const string& strTable);
 	void		ExpandTable(const string& strTable);
 	CDbTable*	GetTable(const string& strTable);
 
+	// ----------------------------------------------------------------------------
+	//	INDEX OPERATIONS
+	// ----------------------------------------------------------------------------
+
+	UINT		CreateIndex	(
+							const string&	strTable,
+							UINT			offKey,
+							UINT			cbKey,
+							DB_KEY_TYPE		keyType = DB_KEY_UINT,
+							DB_INDEX_KIND	kind	= DB_INDEX_BTREE
+							);
+
+	void		DeleteIndex(UINT idIndex);
+	UINT		FindIndex(const string& strTable, UINT offKey);
 
 private:
 	void Load();
+	void Upgrade();
+	void CheckCatalog(const DbCatalog* pCatalog, UINT cbEntry);
+	void WriteHeader();
 	UINT LoadCatalog(CFile*	pFile, DbCatalog* pCatalog,	DbObjectInfo* pBuffer);
 	UINT SaveCatalog(CFile* pFile, DbCatalog* pCatalog, DbObjectInfo* pBuffer);
 
 	DbObjectInfo*	InitCatalog(DbCatalog* pCatalog);
-	void			ExpandCatalog(DbCatalog* pCatalog, DbObjectInfo* pInfo);
+	void			ExpandCatalog(DbCatalog* pCatalog, DbObjectInfo** ppInfo);
 
 	INT	 FindTable(const string& strTable);
-	INT	 GetFreeSlot(DbCatalog* pCatalog, DbObjectInfo* pInfo);
-	void AppendTableData(DbTableInfo* pTableInfo);
-	void CopyTableData(FILEOFFSET idxSrc, FILEOFFSET idxDest, UINT cbLen);
+	INT	 FindTable(UINT idTable);
+	INT	 GetFreeSlot(DbCatalog* pCatalog, DbObjectInfo** ppInfo);
 	void SwapTableInfo(UINT idxSrc, UINT idxDest);
 
+	void		AddExtent(DbTableInfo* pTableInfo, UINT cSlots);
+	void		DropExtents(UINT idTable);
+	void		LoadExtents();
+	FILEOFFSET	GetSlotOffset(DbTableInfo* pTableInfo, DBPOS idxSlot, UINT* pcRun = NULL);
+	UINT		ReadColumns(DbTableInfo* pTableInfo, DBPOS idxSlot, void* pBuffer, UINT cRecords, UINT fColumns);
+	UINT		WriteColumns(DbTableInfo* pTableInfo, DBPOS idxSlot, const void* pBuffer, UINT cRecords);
+	DbExtentInfo* GetExtentInfo(UINT idExtent);
+
+	FILEOFFSET	AllocateSpace(UINT cbLen, UINT cbAlign, FILEOFFSET offLimit);
+	void		FreeSpace(FILEOFFSET offset, UINT cbLen);
+	void		DropFreeExtent(UINT idxFree);
+	bool		TrimTable(DbTableInfo* pTableInfo);
+	bool		RelocateExtent(UINT cbBudget);
+	bool		ShrinkFile();
+	void		RunCompaction();
+
+	static THREAD_RESULT THREAD_CALL CompactThread(void* pArg);
+	static void CopyWorkerTask(void* pArg);
+
+	INT			CreateIndex(DbTableInfo* pTableInfo, UINT offKey, UINT cbKey, DB_KEY_TYPE keyType, DB_INDEX_KIND kind, UINT fFlags);
+	CDbIndex*	OpenIndex(UINT idxCatalog);
+	void		GetIndexes(UINT idTable, vector<CDbIndexPtr>& rgIndexes);
+	CDbIndex*	GetRidIndex(UINT idTable);
+	CDbIndex*	GetIndex(UINT idIndex);
+	void		BuildIndex(CDbIndex* pIndex, DbTableInfo* pTableInfo);
+	void		DropIndexes(UINT idTable);
+	void		FreeIndexPages(UINT idxCatalog);
+	FILEOFFSET	AllocatePage();
+
+	void		BeginWrite();
+	void		EndWrite(bool fCommit);
+	DBLSN		LogChanges();
+	void		SaveImage();
+	void		Rollback();
+	void		RestoreCatalog(DbCatalog* pCatalog, DbObjectInfo** ppInfo, DbCatalog* pImage, const vector<BYTE>& rgImage);
+
+	DBTS		BeginSnapshot(const DbTableInfo* pTableInfo, DBPOS* pidxEnd);
+	void		EndSnapshot(DBTS ts);
+	DBTS		GetWriteTimestamp()		{ return m_tsCommit + 1; }
+	DBTS		GetCommitTimestamp()	{ return (DBTS) AtomicLoad((volatile LONG*) &m_tsCommit); }
+
+	void		MapData();
+	void		UnmapData();
+	void		FreeRetiredViews();
+	const BYTE*	GetView(FILEOFFSET offset, UINT cbLen);
+	void		ReadView(FILEOFFSET offset, void* pBuffer, UINT cbLen);
+	void		BeginView()				{ AtomicIncrement(&m_cViewUsers); }
+	void		EndView()				{ AtomicDecrement(&m_cViewUsers); }
+
 private:
+	// ----------------------------------------------------------------------------
+	//	Range of table data copied by Compact
+	// ----------------------------------------------------------------------------
+	struct CopyJob
+	{
+		FILEOFFSET	Source;			// Offset in the source file
+		FILEOFFSET	Dest;			// Offset in the destination file
+		UINT		Length;			// Count of bytes
+	};
+
+	// ----------------------------------------------------------------------------
+	//	Copy jobs shared by the Compact workers
+	// ----------------------------------------------------------------------------
+	struct CopyTask
+	{
+		CMutex			Lock;		// Access lock
+		CFile*			Source;		// Source file
+		CFile*			Dest;		// Destination file
+		vector<CopyJob>	Jobs;		// Ranges to copy
+		UINT			Next;		// Next job to take
+		bool			Failed;		// A copy failed; remaining jobs are dropped
+	};
+
+	typedef pair<const BYTE*, UINT> DbView;
+	typedef vector<DbExtentInfo>	DbExtentList;
+
 	CMutex				m_mutex;			// Access lock
+	CDistRWLock			m_lockData;			// Guards the extent chains, slot counts and view
 	CFilePtr			m_pFile;			// File object
+	CDbBufferManagerPtr	m_pBufferMgr;		// Page cache
+	CDbLogPtr			m_pLog;				// Write-ahead log
+	CMutex				m_mutexWrite;		// Serializes changes (see BeginWrite)
+	UINT				m_cWriters;			// Nesting depth of BeginWrite
+	bool				m_fImage;			// Catalog image taken for the change in progress
+	DbFileInfo			m_fileImage;		// File info header when the change started
+	vector<BYTE>		m_rgTableImage;		// Table catalog when the change started
+	vector<BYTE>		m_rgIndexImage;		// Index catalog when the change started
+	vector<BYTE>		m_rgExtentImage;	// Extent catalog when the change started
+	volatile DBTS		m_tsCommit;			// Timestamp of the last change (read without the lock)
+	CDbVersionStorePtr	m_pVersions;		// Slot images kept for snapshots
 	DbFileInfo			m_fileInfo;			// File info header
 	DbTableInfo*		m_pTableInfo;		// Table catalog
 	DbIndexInfo*		m_pIndexInfo;		// Index catalog
+	DbExtentInfo*		m_pExtentInfo;		// Extent catalog
+	map<UINT, DbExtentList>	m_mapExtents;	// Extent chain of each table (by table id) in slot order
+	DbExtentList		m_rgFreeExtents;	// Free space in offset order
+	CThread*			m_pCompactor;		// Background compaction thread
+	CEvent				m_evCompact;		// Set to stop background compaction
+	volatile bool		m_fCompactStop;		// Background compaction should stop
+	UINT				m_cbCompactRate;	// Background compaction budget (bytes per second)
 	UINT				m_cbBuffer;			// Data operations buffer size
 	BYTE*				m_pBuffer;			// Data operations buffer
+	UINT				m_fMode;			// Open mode flags
+	const BYTE*			m_pView;			// Mapped data region
+	UINT				m_cbView;			// Size of mapped region that may be read
+	UINT				m_cbMapped;			// Size of the view (may reach past the data region)
+	vector<DbView>		m_rgRetiredViews;	// Views replaced by a remap
+	volatile LONG		m_cViewUsers;		// Readers using mapped data (see BeginView)
+	vector<CDbIndexPtr>	m_rgIndexes;		// Open indexes by index catalog slot
 
 	// Special access to the base class to avoid exposing file functions
 	friend class CDbTable;
+	friend class CDbIndex;
 };
 
 #endif // __DBFILE_H__
@@ -0,0 +1,654 @@
+// ================================================================================
+//
+//	File:
+//		dbhash.cpp
+//
+//	Component:
+//		Database Engine
+//
+//	Description:
+//		Linear hash index implementation
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// Bucket offsets held by one directory page
+const UINT DB_HASH_DIR_ENTRIES	= DB_PAGE_SIZE / sizeof(FILEOFFSET);
+
+// Directory page offsets held by the header page
+const UINT DB_HASH_MAX_DIR		= (DB_PAGE_SIZE - sizeof(DbHashHeader)) / sizeof(FILEOFFSET);
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::CDbHashIndex
+//
+//  Description:
+//      Default constructor
+//
+//  Inputs:
+//		pdbFile		== IN: Owning database file
+//      idxCatalog	== IN: Slot of the index in the index catalog
+// --------------------------------------------------------------------------------
+CDbHashIndex::CDbHashIndex
+(
+	CDbFile*	pdbFile,
+	UINT		idxCatalog
+) : CDbIndex(pdbFile, idxCatalog)
+{
+	TRACE_INIT("CDbHashIndex::CDbHashIndex");
+
+	m_cbKey		= GetIndexInfo()->Size;
+	m_cbEntry	= m_cbKey + sizeof(DBPOS);
+	m_fLoaded	= false;
+
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::~CDbHashIndex
+//
+//  Description:
+//      Default destructor
+// --------------------------------------------------------------------------------
+CDbHashIndex::~CDbHashIndex()
+{
+	TRACE_INIT("CDbHashIndex::~CDbHashIndex");
+}
+
+// ================================================================================
+// INDEX OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Insert
+//
+//  Description:
+//      Add entry to the index.  Splits one bucket when the average fill of the
+//		buckets passes DB_HASH_FILL_PERCENT.
+//
+//  Inputs:
+//      pKey	== IN: Key value
+//		idxSlot	== IN: Table slot holding the record
+// --------------------------------------------------------------------------------
+void CDbHashIndex::Insert
+(
+	const BYTE*	pKey,
+	DBPOS		idxSlot
+)
+{
+	TRACE_INIT("CDbHashIndex::Insert");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (GetIndexInfo()->Offset == 0)
+		{
+			Init();
+		}
+		else
+		{
+			Load();
+		}
+
+		vector<BYTE> rgEntry(m_cbEntry);
+
+		memcpy(&rgEntry[0], pKey, m_cbKey);
+		memcpy(&rgEntry[m_cbKey], &idxSlot, sizeof(DBPOS));
+
+		AppendEntry(m_rgBuckets[GetBucket(pKey)], &rgEntry[0]);
+		GetIndexInfo()->Entries++;
+
+		if ((GetIndexInfo()->Entries * 100) > (m_header.Buckets * GetMaxEntries() * DB_HASH_FILL_PERCENT))
+		{
+			Split();
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Remove
+//
+//  Description:
+//      Remove entry from the index.  The last entry of the page takes the
+//		place of the removed entry.
+//
+//  Inputs:
+//      pKey	== IN: Key value
+//		idxSlot	== IN: Table slot holding the record
+// --------------------------------------------------------------------------------
+void CDbHashIndex::Remove
+(
+	const BYTE*	pKey,
+	DBPOS		idxSlot
+)
+{
+	TRACE_INIT("CDbHashIndex::Remove");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (GetIndexInfo()->Offset != 0)
+		{
+			Load();
+
+			FILEOFFSET	offPage	= m_rgBuckets[GetBucket(pKey)];
+			bool		fFound	= false;
+
+			while (offPage != 0 && !fFound)
+			{
+				CDbPage*		pPage	= m_pBufferMgr->Pin(offPage / DB_PAGE_SIZE);
+				DbHashBucket*	pBucket	= (DbHashBucket*) pPage->GetData();
+
+				for (UINT idx = 0; idx < pBucket->Count; idx++)
+				{
+					BYTE*	pEntry = GetEntry(pBucket, idx);
+					DBPOS	idxEntrySlot;
+
+					memcpy(&idxEntrySlot, pEntry + m_cbKey, sizeof(DBPOS));
+
+					if (idxEntrySlot == idxSlot && CompareKey(pEntry, pKey) == 0)
+					{
+						pBucket->Count--;
+						memcpy(pEntry, GetEntry(pBucket, pBucket->Count), m_cbEntry);
+
+						GetIndexInfo()->Entries--;
+						fFound = true;
+						break;
+					}
+				}
+
+				offPage = pBucket->Overflow;
+				m_pBufferMgr->Unpin(pPage, fFound);
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Find
+//
+//  Description:
+//      Find an entry with the key
+//
+//  Inputs:
+//      pKey		== IN:	Key value
+//		pidxSlot	== OUT:	Table slot holding the record
+//
+//  Returns:
+//      true if the key was found
+// --------------------------------------------------------------------------------
+bool CDbHashIndex::Find
+(
+	const BYTE*	pKey,
+	DBPOS*		pidxSlot
+)
+{
+	bool fFound = false;
+
+	TRACE_INIT("CDbHashIndex::Find");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (GetIndexInfo()->Offset != 0)
+		{
+			Load();
+
+			FILEOFFSET offPage = m_rgBuckets[GetBucket(pKey)];
+
+			while (offPage != 0 && !fFound)
+			{
+				CDbPage*		pPage	= m_pBufferMgr->Pin(offPage / DB_PAGE_SIZE);
+				DbHashBucket*	pBucket	= (DbHashBucket*) pPage->GetData();
+
+				for (UINT idx = 0; idx < pBucket->Count; idx++)
+				{
+					BYTE* pEntry = GetEntry(pBucket, idx);
+
+					if (CompareKey(pEntry, pKey) == 0)
+					{
+						memcpy(pidxSlot, pEntry + m_cbKey, sizeof(DBPOS));
+						fFound = true;
+						break;
+					}
+				}
+
+				offPage = pBucket->Overflow;
+				m_pBufferMgr->Unpin(pPage);
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return fFound;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::GetPages
+//
+//  Description:
+//      List the header, directory and bucket pages (with overflow pages)
+//
+//  Inputs:
+//      rgPages == OUT: File offsets of the pages
+// --------------------------------------------------------------------------------
+void CDbHashIndex::GetPages
+(
+	vector<FILEOFFSET>& rgPages
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		if (GetIndexInfo()->Offset != 0)
+		{
+			Load();
+
+			rgPages.push_back(GetIndexInfo()->Offset);
+			rgPages.insert(rgPages.end(), m_rgDirPages.begin(), m_rgDirPages.end());
+
+			for (UINT idx = 0; idx < m_rgBuckets.size(); idx++)
+			{
+				FILEOFFSET offPage = m_rgBuckets[idx];
+
+				while (offPage != 0)
+				{
+					CDbPage* pPage = m_pBufferMgr->Pin(offPage / DB_PAGE_SIZE);
+
+					rgPages.push_back(offPage);
+					offPage = ((DbHashBucket*) pPage->GetData())->Overflow;
+
+					m_pBufferMgr->Unpin(pPage);
+				}
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// ================================================================================
+// STRUCTURE
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Init
+//
+//  Description:
+//      Create the header page and the initial buckets
+// --------------------------------------------------------------------------------
+void CDbHashIndex::Init()
+{
+	m_rgDirPages.clear();
+	m_rgBuckets.clear();
+
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.Level = DB_HASH_INITIAL_LEVEL;
+
+	GetIndexInfo()->Offset = NewPage();
+	GetIndexInfo()->Height = m_header.Level;
+	m_fLoaded = true;
+
+	for (UINT idx = 0; idx < (1U << DB_HASH_INITIAL_LEVEL); idx++)
+	{
+		NewBucket();
+	}
+
+	SaveHeader();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Load
+//
+//  Description:
+//      Read the header and the bucket directory on first use
+// --------------------------------------------------------------------------------
+void CDbHashIndex::Load()
+{
+	if (m_fLoaded)
+	{
+		return;
+	}
+
+	FILEOFFSET offHeader = GetIndexInfo()->Offset;
+
+	m_pBufferMgr->Read(offHeader, &m_header, sizeof(m_header));
+
+	m_rgDirPages.resize(m_header.DirPages);
+	m_rgBuckets.resize(m_header.Buckets);
+
+	if (m_header.DirPages > 0)
+	{
+		m_pBufferMgr->Read(offHeader + sizeof(m_header), &m_rgDirPages[0],
+						   m_header.DirPages * sizeof(FILEOFFSET));
+	}
+
+	for (UINT idx = 0; idx < m_header.Buckets; idx += DB_HASH_DIR_ENTRIES)
+	{
+		UINT cBuckets = min(DB_HASH_DIR_ENTRIES, m_header.Buckets - idx);
+
+		m_pBufferMgr->Read(m_rgDirPages[idx / DB_HASH_DIR_ENTRIES], &m_rgBuckets[idx],
+						   cBuckets * sizeof(FILEOFFSET));
+	}
+
+	m_fLoaded = true;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Split
+//
+//  Description:
+//      Split the bucket at the split pointer.  Its entries are divided between
+//		the bucket and a new bucket using one more bit of the hash value.
+// --------------------------------------------------------------------------------
+void CDbHashIndex::Split()
+{
+	UINT			idxOld	= m_header.Split;
+	UINT			cMax	= GetMaxEntries();
+	vector<BYTE>	rgEntries;
+	vector<FILEOFFSET>	rgChain;
+
+	FILEOFFSET offNew = NewBucket();
+
+	// Collect the entries of the bucket being split
+	for (FILEOFFSET offPage = m_rgBuckets[idxOld]; offPage != 0; )
+	{
+		CDbPage*		pPage	= m_pBufferMgr->Pin(offPage / DB_PAGE_SIZE);
+		DbHashBucket*	pBucket	= (DbHashBucket*) pPage->GetData();
+
+		rgEntries.insert(rgEntries.end(), GetEntry(pBucket, 0), GetEntry(pBucket, pBucket->Count));
+		rgChain.push_back(offPage);
+
+		offPage = pBucket->Overflow;
+		m_pBufferMgr->Unpin(pPage);
+	}
+
+	// Advance the split pointer so the bucket address uses the next level
+	m_header.Split++;
+
+	if (m_header.Split == (1U << m_header.Level))
+	{
+		m_header.Level++;
+		m_header.Split = 0;
+		GetIndexInfo()->Height = m_header.Level;
+	}
+
+	// Rewrite the old chain in place with the entries that stay; emptied
+	// overflow pages remain linked for reuse
+	UINT cEntries	= rgEntries.size() / m_cbEntry;
+	UINT idxEntry	= 0;
+
+	for (UINT idxPage = 0; idxPage < rgChain.size(); idxPage++)
+	{
+		CDbPage*		pPage	= m_pBufferMgr->Pin(rgChain[idxPage] / DB_PAGE_SIZE);
+		DbHashBucket*	pBucket	= (DbHashBucket*) pPage->GetData();
+
+		pBucket->Count = 0;
+
+		while (idxEntry < cEntries && pBucket->Count < cMax)
+		{
+			const BYTE* pEntry = &rgEntries[idxEntry * m_cbEntry];
+
+			if (GetBucket(pEntry) == idxOld)
+			{
+				memcpy(GetEntry(pBucket, pBucket->Count), pEntry, m_cbEntry);
+				pBucket->Count++;
+			}
+			else
+			{
+				AppendEntry(offNew, pEntry);
+			}
+
+			idxEntry++;
+		}
+
+		m_pBufferMgr->Unpin(pPage, true);
+	}
+
+	SaveHeader();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::AppendEntry
+//
+//  Description:
+//      Add entry to the first page of a bucket chain with room.  Extends the
+//		chain with an overflow page when every page is full.
+//
+//  Inputs:
+//      offBucket	== IN: Primary page of the bucket
+//		pEntry		== IN: Entry (key, slot)
+// --------------------------------------------------------------------------------
+void CDbHashIndex::AppendEntry
+(
+	FILEOFFSET	offBucket,
+	const BYTE*	pEntry
+)
+{
+	FILEOFFSET offPage = offBucket;
+
+	while (true)
+	{
+		CDbPage*		pPage	= m_pBufferMgr->Pin(offPage / DB_PAGE_SIZE);
+		DbHashBucket*	pBucket	= (DbHashBucket*) pPage->GetData();
+
+		if (pBucket->Count < GetMaxEntries())
+		{
+			memcpy(GetEntry(pBucket, pBucket->Count), pEntry, m_cbEntry);
+			pBucket->Count++;
+
+			m_pBufferMgr->Unpin(pPage, true);
+			return;
+		}
+
+		if (pBucket->Overflow == 0)
+		{
+			FILEOFFSET offOverflow;
+
+			try
+			{
+				offOverflow = NewPage();
+			}
+			catch ( ... )
+			{
+				m_pBufferMgr->Unpin(pPage);
+				throw;
+			}
+
+			pBucket->Overflow = offOverflow;
+			m_pBufferMgr->Unpin(pPage, true);
+			offPage = offOverflow;
+		}
+		else
+		{
+			offPage = pBucket->Overflow;
+			m_pBufferMgr->Unpin(pPage);
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::NewBucket
+//
+//  Description:
+//      Allocate the primary page of the next bucket and record it in the
+//		directory
+//
+//  Returns:
+//      Primary page offset
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbHashIndex::NewBucket()
+{
+	UINT idxBucket	= m_header.Buckets;
+	UINT idxDir		= idxBucket / DB_HASH_DIR_ENTRIES;
+
+	if (idxDir >= m_header.DirPages)
+	{
+		if (idxDir >= DB_HASH_MAX_DIR)
+		{
+			throw runtime_error("Hash directory full");
+		}
+
+		FILEOFFSET offDir = NewPage();
+
+		m_rgDirPages.push_back(offDir);
+		m_pBufferMgr->Write(GetIndexInfo()->Offset + sizeof(m_header) + (idxDir * sizeof(FILEOFFSET)),
+							&offDir, sizeof(FILEOFFSET));
+		m_header.DirPages++;
+	}
+
+	FILEOFFSET offBucket = NewPage();
+
+	m_rgBuckets.push_back(offBucket);
+	m_pBufferMgr->Write(m_rgDirPages[idxDir] + ((idxBucket % DB_HASH_DIR_ENTRIES) * sizeof(FILEOFFSET)),
+						&offBucket, sizeof(FILEOFFSET));
+	m_header.Buckets++;
+
+	return offBucket;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::NewPage
+//
+//  Description:
+//      Allocate a cleared page for the index
+//
+//  Returns:
+//      Page offset
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbHashIndex::NewPage()
+{
+	FILEOFFSET	offPage	= AllocatePage();
+	CDbPage*	pPage	= m_pBufferMgr->Pin(offPage / DB_PAGE_SIZE);
+
+	memset(pPage->GetData(), 0, DB_PAGE_SIZE);
+	m_pBufferMgr->Unpin(pPage, true);
+
+	return offPage;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::SaveHeader
+//
+//  Description:
+//      Write the header fields to the header page
+// --------------------------------------------------------------------------------
+void CDbHashIndex::SaveHeader()
+{
+	m_pBufferMgr->Write(GetIndexInfo()->Offset, &m_header, sizeof(m_header));
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::Hash
+//
+//  Description:
+//      FNV-1a hash of a key.  String keys are hashed up to the terminator so
+//		keys that compare equal hash equal.
+//
+//  Inputs:
+//      pKey == IN: Key value
+//
+//  Returns:
+//      Hash value
+// --------------------------------------------------------------------------------
+UINT CDbHashIndex::Hash
+(
+	const BYTE* pKey
+)
+{
+	UINT cbKey = m_cbKey;
+	UINT uiHash = 2166136261U;
+
+	if (GetKeyType() == DB_KEY_STRING)
+	{
+		cbKey = 0;
+
+		while (cbKey < m_cbKey && pKey[cbKey] != 0)
+		{
+			cbKey++;
+		}
+	}
+
+	for (UINT idx = 0; idx < cbKey; idx++)
+	{
+		uiHash ^= pKey[idx];
+		uiHash *= 16777619U;
+	}
+
+	return uiHash;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbHashIndex::GetBucket
+//
+//  Description:
+//      Bucket holding a key.  Buckets before the split pointer have already
+//		been split and use one more bit of the hash value.
+//
+//  Inputs:
+//      pKey == IN: Key value
+//
+//  Returns:
+//      Bucket number
+// --------------------------------------------------------------------------------
+UINT CDbHashIndex::GetBucket
+(
+	const BYTE* pKey
+)
+{
+	UINT uiHash		= Hash(pKey);
+	UINT idxBucket	= uiHash & ((1U << m_header.Level) - 1);
+
+	if (idxBucket < m_header.Split)
+	{
+		idxBucket = uiHash & ((1U << (m_header.Level + 1)) - 1);
+	}
+
+	return idxBucket;
+}
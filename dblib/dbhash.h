@@ -0,0 +1,102 @@
+// ================================================================================
+//
+//	File:
+//      dbhash.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Linear hash index definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBHASH_H__
+#define __DBHASH_H__
+
+// Hash growth
+const UINT DB_HASH_INITIAL_LEVEL	= 2;		// Start with 2^level buckets
+const UINT DB_HASH_FILL_PERCENT		= 75;		// Split a bucket above this average fill
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbHashHeader
+//
+//  Description:
+//      Linear hash header page.  Followed by the offsets of the directory pages;
+//		each directory page holds the offsets of the primary pages of the next
+//		DB_PAGE_SIZE / sizeof(FILEOFFSET) buckets.
+//
+//		Bucket for a hash value h:	b = h mod 2^Level
+//									b = h mod 2^(Level + 1) if b < Split
+// --------------------------------------------------------------------------------
+struct DbHashHeader
+{
+	UINT	Level;				// Doubling round
+	UINT	Split;				// Next bucket to split
+	UINT	Buckets;			// Count of buckets
+	UINT	DirPages;			// Count of directory pages
+};
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbHashBucket
+//
+//  Description:
+//      Bucket page header.  Followed by the entries (key, slot) in no order.
+//		Full buckets continue in a chain of overflow pages.
+// --------------------------------------------------------------------------------
+struct DbHashBucket
+{
+	UINT		Count;			// Count of entries in the page
+	FILEOFFSET	Overflow;		// Next page of the bucket
+};
+
+// ================================================================================
+// Class:
+//      CDbHashIndex
+//
+//  Description:
+//      Linear hash index for equality lookups.  The table grows one bucket at a
+//		time: each split rehashes only the bucket at the split pointer, so the
+//		structure is never rebuilt as a whole.  The bucket directory is held in
+//		memory so a probe touches only the bucket pages.
+// ================================================================================
+class CDbHashIndex : public CDbIndex
+{
+public:
+	CDbHashIndex(CDbFile* pdbFile, UINT idxCatalog);
+	~CDbHashIndex();
+
+	void Insert(const BYTE* pKey, DBPOS idxSlot);
+	void Remove(const BYTE* pKey, DBPOS idxSlot);
+	bool Find(const BYTE* pKey, DBPOS* pidxSlot);
+	void GetPages(vector<FILEOFFSET>& rgPages);
+
+private:
+	void		Init();
+	void		Load();
+	void		Split();
+	void		AppendEntry(FILEOFFSET offBucket, const BYTE* pEntry);
+	FILEOFFSET	NewBucket();
+	FILEOFFSET	NewPage();
+	void		SaveHeader();
+
+	UINT		Hash(const BYTE* pKey);
+	UINT		GetBucket(const BYTE* pKey);
+	BYTE*		GetEntry(DbHashBucket* pBucket, UINT idx)	{ return ((BYTE*) (pBucket + 1)) + (idx * m_cbEntry); }
+	UINT		GetMaxEntries()								{ return (DB_PAGE_SIZE - sizeof(DbHashBucket)) / m_cbEntry; }
+
+private:
+	UINT				m_cbKey;		// Key width
+	UINT				m_cbEntry;		// Entry size (key, slot)
+	bool				m_fLoaded;		// Directory read from the file
+	DbHashHeader		m_header;		// Header page contents
+	vector<FILEOFFSET>	m_rgDirPages;	// Directory pages
+	vector<FILEOFFSET>	m_rgBuckets;	// Primary page of each bucket
+};
+
+#endif // __DBHASH_H__
@@ -0,0 +1,142 @@
+// ================================================================================
+//
+//	File:
+//		dbindex.cpp
+//
+//	Component:
+//		Database Engine
+//
+//	Description:
+//		Index object implementation (common to all index structures)
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbIndex::CDbIndex
+//
+//  Description:
+//      Default constructor
+//
+//  Inputs:
+//		pdbFile		== IN: Owning database file
+//      idxCatalog	== IN: Slot of the index in the index catalog
+// --------------------------------------------------------------------------------
+CDbIndex::CDbIndex
+(
+	CDbFile*	pdbFile,
+	UINT		idxCatalog
+)
+{
+	TRACE_INIT("CDbIndex::CDbIndex");
+
+	m_pdbFile		= pdbFile;
+	m_pBufferMgr	= pdbFile->m_pBufferMgr;
+	m_idxCatalog	= idxCatalog;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbIndex::~CDbIndex
+//
+//  Description:
+//      Default destructor
+// --------------------------------------------------------------------------------
+CDbIndex::~CDbIndex()
+{
+	TRACE_INIT("CDbIndex::~CDbIndex");
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbIndex::GetIndexInfo
+//
+//  Description:
+//      Catalog entry of the index.  Looked up on every call because the
+//		catalog buffer is reallocated when the catalog grows.
+//
+//  Returns:
+//      Pointer to index info
+// --------------------------------------------------------------------------------
+DbIndexInfo* CDbIndex::GetIndexInfo()
+{
+	return m_pdbFile->m_pIndexInfo + m_idxCatalog;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbIndex::AllocatePage
+//
+//  Description:
+//      Allocate a new page for the index structure
+//
+//  Returns:
+//      File offset of the page
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbIndex::AllocatePage()
+{
+	GetIndexInfo()->Slots++;
+	return m_pdbFile->AllocatePage();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbIndex::CompareKey
+//
+//  Description:
+//      Compare two keys by the key type of the index
+//
+//  Inputs:
+//      pKey1 == IN: First key
+//		pKey2 == IN: Second key
+//
+//  Returns:
+//      < 0, 0, > 0 as first key is less than, equal to or greater than second
+// --------------------------------------------------------------------------------
+INT CDbIndex::CompareKey
+(
+	const BYTE* pKey1,
+	const BYTE* pKey2
+)
+{
+	DbIndexInfo* pIndexInfo = GetIndexInfo();
+
+	switch (pIndexInfo->KeyType)
+	{
+	case DB_KEY_UINT:
+		{
+			UINT uiKey1;
+			UINT uiKey2;
+
+			memcpy(&uiKey1, pKey1, sizeof(UINT));
+			memcpy(&uiKey2, pKey2, sizeof(UINT));
+
+			return (uiKey1 < uiKey2) ? -1 : (uiKey1 > uiKey2) ? 1 : 0;
+		}
+
+	case DB_KEY_INT:
+		{
+			INT iKey1;
+			INT iKey2;
+
+			memcpy(&iKey1, pKey1, sizeof(INT));
+			memcpy(&iKey2, pKey2, sizeof(INT));
+
+			return (iKey1 < iKey2) ? -1 : (iKey1 > iKey2) ? 1 : 0;
+		}
+
+	case DB_KEY_STRING:
+		return strncmp((const char*) pKey1, (const char*) pKey2, pIndexInfo->Size);
+
+	case DB_KEY_BINARY:
+		return memcmp(pKey1, pKey2, pIndexInfo->Size);
+
+	default:
+		throw logic_error("Unknown index key type");
+	}
+}
@@ -0,0 +1,71 @@
+// ================================================================================
+//
+//	File:
+//      dbindex.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Index object definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBINDEX_H__
+#define __DBINDEX_H__
+
+class CDbFile;
+
+// ================================================================================
+// Class:
+//      CDbIndex
+//
+//  Description:
+//      Database index object.  Maps the key of a record to the table slot that
+//		holds it.  Each entry is the pair (key, slot), so duplicate keys are
+//		allowed and every entry can be removed exactly.  Index structures derive
+//		from this class and are stored in pages of the database file.
+// ================================================================================
+class CDbIndex : public CObject
+{
+public:
+	CDbIndex(CDbFile* pdbFile, UINT idxCatalog);
+	virtual ~CDbIndex();
+
+	// ----------------------------------------------------------------------------
+	//	INDEX OPERATIONS
+	// ----------------------------------------------------------------------------
+
+	virtual void Insert(const BYTE* pKey, DBPOS idxSlot) = 0;
+	virtual void Remove(const BYTE* pKey, DBPOS idxSlot) = 0;
+	virtual bool Find(const BYTE* pKey, DBPOS* pidxSlot) = 0;
+	virtual void GetPages(vector<FILEOFFSET>& rgPages) = 0;
+
+	// ----------------------------------------------------------------------------
+	//	PROPERTIES
+	// ----------------------------------------------------------------------------
+
+	const BYTE*		GetKey(const DbRecord* pRecord)	{ return (const BYTE*) pRecord + GetIndexInfo()->KeyOffset; }
+	UINT			GetKeySize()					{ return GetIndexInfo()->Size; }
+	DB_KEY_TYPE		GetKeyType()					{ return (DB_KEY_TYPE) GetIndexInfo()->KeyType; }
+	UINT			GetIndexId()					{ return GetIndexInfo()->Id; }
+	UINT			GetTableId()					{ return GetIndexInfo()->TableId; }
+	UINT			GetFlags()						{ return GetIndexInfo()->Flags; }
+	UINT			GetEntryCount()					{ return GetIndexInfo()->Entries; }
+
+protected:
+	DbIndexInfo*	GetIndexInfo();
+	FILEOFFSET		AllocatePage();
+	INT				CompareKey(const BYTE* pKey1, const BYTE* pKey2);
+
+protected:
+	CMutex				m_mutex;		// Access lock
+	CDbFile*			m_pdbFile;		// Owning database file
+	CDbBufferManagerPtr	m_pBufferMgr;	// File page cache
+	UINT				m_idxCatalog;	// Slot in the index catalog
+};
+
+#endif // __DBINDEX_H__
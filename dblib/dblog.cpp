@@ -0,0 +1,494 @@
+// ================================================================================
+//
+//	File:
+//      dblog.cpp
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Write-ahead log implementation
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::CDbLog
+//
+//  Description:
+//      Default constructor.  The log file is not opened until Open or Recover.
+//
+//  Inputs:
+//      strFile == IN: Log file name
+// --------------------------------------------------------------------------------
+CDbLog::CDbLog
+(
+	const string& strFile
+)
+{
+	TRACE_INIT("CDbLog::CDbLog");
+
+	m_pFile			= new CFile(strFile);
+	m_lsnBase		= 0;
+	m_lsnEnd		= 0;
+	m_lsnFlushed	= 0;
+	m_fFlushing		= false;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::~CDbLog
+//
+//  Description:
+//      Default destructor.  Records that were never flushed are discarded.
+// --------------------------------------------------------------------------------
+CDbLog::~CDbLog()
+{
+	TRACE_INIT("CDbLog::~CDbLog");
+
+	m_pFile->Close();
+}
+
+// ================================================================================
+// LOG FILE OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Open
+//
+//  Description:
+//      Open the log for appending, creating it if it does not exist.  An
+//		existing log must have been emptied by Recover.
+//
+//  Exceptions:
+//		logic_error == log holds records that were not recovered
+// --------------------------------------------------------------------------------
+void CDbLog::Open()
+{
+	TRACE_INIT("CDbLog::Open");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_pFile->IsOpen())
+		{
+			if (m_pFile->Exists())
+			{
+				m_pFile->Open();
+			}
+			else
+			{
+				m_pFile->Create();
+			}
+		}
+
+		if (m_pFile->GetFileSize() != 0)
+		{
+			throw logic_error("Log must be recovered before it is opened");
+		}
+
+		m_rgTail.clear();
+		m_lsnBase = m_lsnFlushed = m_lsnEnd;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Close
+//
+//  Description:
+//      Flush outstanding records and close the log file
+// --------------------------------------------------------------------------------
+void CDbLog::Close()
+{
+	TRACE_INIT("CDbLog::Close");
+
+	if (m_pFile->IsOpen())
+	{
+		Flush(m_lsnEnd);
+		m_pFile->Close();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Delete
+//
+//  Description:
+//      Close and remove the log file if it exists
+// --------------------------------------------------------------------------------
+void CDbLog::Delete()
+{
+	TRACE_INIT("CDbLog::Delete");
+
+	m_pFile->Close();
+
+	if (m_pFile->Exists())
+	{
+		m_pFile->Delete();
+	}
+
+	m_rgTail.clear();
+	m_lsnBase = m_lsnFlushed = m_lsnEnd;
+}
+
+// ================================================================================
+// LOG OPERATIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Append
+//
+//  Description:
+//      Append a record to the log tail.  The record is not durable until the
+//		returned LSN has been flushed.
+//
+//  Inputs:
+//		uiType	== IN:	Record type
+//		offset	== IN:	Data file offset of the image
+//      pData	== IN:	Record data (may be NULL when cbLen is zero)
+//		cbLen	== IN:	Count of data bytes
+//
+//  Returns:
+//      LSN of the end of the record
+//
+//  Exceptions:
+//		runtime_error	 == log not open
+//		invalid_argument == data buffer invalid
+// --------------------------------------------------------------------------------
+DBLSN CDbLog::Append
+(
+	UINT		uiType,
+	FILEOFFSET	offset,
+	const void*	pData,
+	UINT		cbLen
+)
+{
+	DBLSN lsn = 0;
+
+	if (cbLen > 0 && !pData)
+	{
+		throw invalid_argument("Log data invalid");
+	}
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_pFile->IsOpen())
+		{
+			throw runtime_error("Log not open");
+		}
+
+		DbLogRecord record;
+
+		record.Type		= uiType;
+		record.Offset	= offset;
+		record.Length	= cbLen;
+		record.Checksum	= Checksum(&record, (const BYTE*) pData);
+
+		const BYTE* pHeader = (const BYTE*) &record;
+
+		m_rgTail.insert(m_rgTail.end(), pHeader, pHeader + sizeof(record));
+
+		if (cbLen > 0)
+		{
+			m_rgTail.insert(m_rgTail.end(), (const BYTE*) pData, (const BYTE*) pData + cbLen);
+		}
+
+		m_lsnEnd += sizeof(record) + cbLen;
+		lsn = m_lsnEnd;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return lsn;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Flush
+//
+//  Description:
+//      Make every record up to an LSN durable.  If no flush is running the
+//		caller becomes the leader: it takes the whole tail, writes and syncs
+//		it without holding the lock, then wakes the followers.  Callers that
+//		arrive while a flush is running wait for it and either find their
+//		records durable or lead the next group.
+//
+//  Inputs:
+//      lsn == IN: LSN that must be durable
+// --------------------------------------------------------------------------------
+void CDbLog::Flush
+(
+	DBLSN lsn
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		while (m_lsnFlushed < lsn)
+		{
+			if (m_fFlushing)
+			{
+				// Follower - wait for the running group
+				m_mutex.Unlock();
+				m_evFlushed.Wait();
+				m_mutex.Lock();
+				continue;
+			}
+
+			// Leader - take everything appended so far
+			vector<BYTE>	rgGroup;
+			FILEOFFSET		offWrite = m_lsnFlushed - m_lsnBase;
+			DBLSN			lsnGroup = m_lsnEnd;
+
+			rgGroup.swap(m_rgTail);
+			m_fFlushing = true;
+			m_evFlushed.Reset();
+			m_mutex.Unlock();
+
+			try
+			{
+				if (!rgGroup.empty())
+				{
+					m_pFile->WriteAt(offWrite, &rgGroup[0], (UINT) rgGroup.size());
+				}
+
+				m_pFile->Sync();
+			}
+			catch ( ... )
+			{
+				// Put the group back so a later flush retries it
+				m_mutex.Lock();
+				m_rgTail.insert(m_rgTail.begin(), rgGroup.begin(), rgGroup.end());
+				m_fFlushing = false;
+				m_evFlushed.Set();
+				throw;
+			}
+
+			m_mutex.Lock();
+			m_lsnFlushed = lsnGroup;
+			m_fFlushing	 = false;
+			m_evFlushed.Set();
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Truncate
+//
+//  Description:
+//      Discard the log once its changes are durable in the data file.  The log
+//		is left alone if records are appended while it is being truncated; they
+//		are discarded by the next truncation.  LSNs keep increasing so callers
+//		waiting on an earlier LSN are not confused.
+// --------------------------------------------------------------------------------
+void CDbLog::Truncate()
+{
+	TRACE_INIT("CDbLog::Truncate");
+
+	Flush(m_lsnEnd);
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_fFlushing && m_rgTail.empty())
+		{
+			m_pFile->Truncate(0);
+			m_pFile->Sync();
+
+			m_lsnBase = m_lsnFlushed = m_lsnEnd;
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Recover
+//
+//  Description:
+//      Redo committed changes in the data file.  Records are read in order
+//		and the data images of each change are applied when its commit record
+//		is reached.  The log ends at the first torn or corrupt record; changes
+//		without a commit record are ignored.  The data file is synced and the
+//		log emptied before returning.
+//
+//  Inputs:
+//      pDataFile == IN: Open data file
+//
+//  Returns:
+//      Count of changes applied
+// --------------------------------------------------------------------------------
+UINT CDbLog::Recover
+(
+	CFile* pDataFile
+)
+{
+	UINT cChanges = 0;
+
+	TRACE_INIT("CDbLog::Recover");
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_pFile->IsOpen())
+		{
+			m_pFile->Open();
+		}
+
+		UINT				cbLog	= m_pFile->GetFileSize();
+		FILEOFFSET			offLog	= 0;
+		vector<DbLogRecord>	rgPending;
+		vector<BYTE>		rgImages;
+		vector<BYTE>		rgData;
+		DbLogRecord			record;
+
+		while (cbLog - offLog >= sizeof(record))
+		{
+			m_pFile->ReadAt(offLog, &record, sizeof(record));
+			offLog += sizeof(record);
+
+			if (record.Length > cbLog - offLog)
+			{
+				break;
+			}
+
+			rgData.resize(record.Length);
+
+			if (record.Length > 0)
+			{
+				m_pFile->ReadAt(offLog, &rgData[0], record.Length);
+			}
+
+			if (Checksum(&record, rgData.empty() ? NULL : &rgData[0]) != record.Checksum)
+			{
+				break;
+			}
+
+			offLog += record.Length;
+
+			if (record.Type == DB_LOG_DATA)
+			{
+				rgPending.push_back(record);
+				rgImages.insert(rgImages.end(), rgData.begin(), rgData.end());
+			}
+			else if (record.Type == DB_LOG_COMMIT)
+			{
+				// Change is complete - redo its images in log order
+				UINT cbImage = 0;
+
+				for (UINT idx = 0; idx < rgPending.size(); idx++)
+				{
+					pDataFile->WriteAt(rgPending[idx].Offset, &rgImages[cbImage], rgPending[idx].Length);
+					cbImage += rgPending[idx].Length;
+				}
+
+				rgPending.clear();
+				rgImages.clear();
+				cChanges++;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (cChanges > 0)
+		{
+			pDataFile->Sync();
+		}
+
+		m_pFile->Truncate(0);
+		m_pFile->Sync();
+
+		m_rgTail.clear();
+		m_lsnBase = m_lsnFlushed = m_lsnEnd;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return cChanges;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbLog::Checksum
+//
+//  Description:
+//      FNV-1a checksum of a record header (with Checksum zero) and its data
+//
+//  Inputs:
+//      pRecord	== IN: Record header
+//		pData	== IN: Record data
+//
+//  Returns:
+//      Checksum value
+// --------------------------------------------------------------------------------
+UINT CDbLog::Checksum
+(
+	const DbLogRecord*	pRecord,
+	const BYTE*			pData
+)
+{
+	DbLogRecord	header	= *pRecord;
+	const BYTE*	pHeader	= (const BYTE*) &header;
+	UINT		uiHash	= 2166136261U;
+
+	header.Checksum = 0;
+
+	for (UINT idx = 0; idx < sizeof(header); idx++)
+	{
+		uiHash ^= pHeader[idx];
+		uiHash *= 16777619U;
+	}
+
+	for (UINT idx = 0; idx < pRecord->Length; idx++)
+	{
+		uiHash ^= pData[idx];
+		uiHash *= 16777619U;
+	}
+
+	return uiHash;
+}
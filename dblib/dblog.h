@@ -0,0 +1,101 @@
+// ================================================================================
+//
+//	File:
+//      dblog.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Write-ahead log definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBLOG_H__
+#define __DBLOG_H__
+
+// Log sequence number - position just past a record in the log stream
+typedef UINT DBLSN;
+
+// Log record types
+const UINT DB_LOG_DATA		= 1;		// After image of a byte range of the data file
+const UINT DB_LOG_COMMIT	= 2;		// Preceding data records form a complete change
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbLogRecord
+//
+//  Description:
+//      Log record header.  Followed by Length bytes of data.  The checksum
+//		covers the header (with Checksum zero) and the data, so a record torn by
+//		a crash is detected and ends the log.
+// --------------------------------------------------------------------------------
+struct DbLogRecord
+{
+	UINT		Type;			// Record type
+	FILEOFFSET	Offset;			// Data file offset of the image
+	UINT		Length;			// Count of data bytes
+	UINT		Checksum;		// FNV-1a of header and data
+};
+
+// ================================================================================
+// Class:
+//      CDbLog
+//
+//  Description:
+//      Write-ahead log.  Changes are appended to an in-memory tail and made
+//		durable by Flush.  Concurrent flushes are grouped: the first caller
+//		becomes the leader and writes and syncs everything appended so far,
+//		while later callers wait for it and return without touching the disk
+//		when their records were part of the group.
+// ================================================================================
+class CDbLog : public CObject
+{
+public:
+	CDbLog(const string& strFile);
+	~CDbLog();
+
+	// ----------------------------------------------------------------------------
+	//	LOG FILE OPERATIONS
+	// ----------------------------------------------------------------------------
+
+	void	Open();
+	void	Close();
+	void	Delete();
+	bool	Exists()			{ return m_pFile->Exists(); }
+	bool	IsOpen()			{ return m_pFile->IsOpen(); }
+
+	// ----------------------------------------------------------------------------
+	//	LOG OPERATIONS
+	// ----------------------------------------------------------------------------
+
+	DBLSN	Append(UINT uiType, FILEOFFSET offset, const void* pData, UINT cbLen);
+	void	Flush(DBLSN lsn);
+	void	Truncate();
+	UINT	Recover(CFile* pDataFile);
+
+	// ----------------------------------------------------------------------------
+	//	PROPERTIES
+	// ----------------------------------------------------------------------------
+
+	DBLSN	GetEndLsn()			{ return m_lsnEnd; }
+	DBLSN	GetFlushedLsn()		{ return m_lsnFlushed; }
+
+private:
+	UINT	Checksum(const DbLogRecord* pRecord, const BYTE* pData);
+
+private:
+	CMutex			m_mutex;		// Access lock
+	CEvent			m_evFlushed;	// Set when the leader finishes a flush
+	CFilePtr		m_pFile;		// Log file
+	vector<BYTE>	m_rgTail;		// Records appended but not yet written
+	DBLSN			m_lsnBase;		// LSN of log file offset zero
+	DBLSN			m_lsnEnd;		// End of appended records
+	DBLSN			m_lsnFlushed;	// End of durable records
+	bool			m_fFlushing;	// A leader is writing the log
+};
+
+#endif // __DBLOG_H__
@@ -17,36 +17,69 @@
 #ifndef __DBPAGE_H__
 #define __DBPAGE_H__
 
+class CDbBufferManager;
+
 // ================================================================================
 // Class:
 //      CDbPage
 //
 //  Description:
-//      Database page object.  Controls page manipulation and is used to signal
-//		next page requests.
+//      Database page object.  Describes one frame of the buffer pool and the
+//		file page currently held in it.  Page state is owned by the buffer
+//		manager; callers only touch the data of a page while it is pinned.
+//		The latch guards the data of a frame that is being loaded or copied
+//		without the buffer manager's access lock.
 // ================================================================================
 class CDbPage : public CObject
 {
 public:
-	CDbPage(const CDbBufferManager* pBufferMgr, DbPage* pdbPage);
-	~CDbPage();
+	CDbPage(CDbBufferManager* pBufferMgr, BYTE* pData)
+	{
+		m_pBufferMgr	= pBufferMgr;
+		m_pData			= pData;
+		m_idPage		= 0;
+		m_cPin			= 0;
+		m_cWritePin		= 0;
+		m_fValid		= false;
+		m_fDirty		= false;
+		m_fReferenced	= false;
+		m_fFailed		= false;
+		m_cbLogStart	= 0;
+		m_cbLogEnd		= 0;
+		m_lsn			= 0;
+		m_pImage		= NULL;
+	}
 
-	AddRecord(const DbRecord* pRecord);
-	EraseRecord(const RECID rid);
-	GetRecord(const RECID rid);
+	~CDbPage()					{ }
 
-	GetPageID()					{ return m_pdbPage->PageID;     }
-	GetNextPageID()				{ return m_pdbPage->NextPageID; }
+	BYTE*		GetData()		{ return m_pData;						}
+	DBPAGEID	GetPageID()		{ return m_idPage;						}
+	FILEOFFSET	GetOffset()		{ return m_idPage * DB_PAGE_SIZE;		}
+	UINT		GetPinCount()	{ return m_cPin;						}
 
-private:
-	Read();
-	Write();
+	bool		IsValid()		{ return m_fValid;						}
+	bool		IsDirty()		{ return m_fDirty;						}
+	bool		IsPinned()		{ return (m_cPin > 0);					}
+	bool		IsUnlogged()	{ return (m_cbLogStart < m_cbLogEnd);	}
 
 private:
-	CMutex		m_mutex;		// Access lock
-	DbPage*		m_pdbPage;		// Data page
-};
-
-#endif // __DBFILE_H__
+	CDbBufferManager*	m_pBufferMgr;		// Owning buffer manager
+	BYTE*				m_pData;			// Frame data (DB_PAGE_SIZE bytes)
+	DBPAGEID			m_idPage;			// File page held in the frame
+	UINT				m_cPin;				// Count of active pins
+	UINT				m_cWritePin;		// Pins held by the thread making the current change
+	bool				m_fValid;			// Frame holds a file page
+	bool				m_fDirty;			// Frame modified since last write
+	bool				m_fReferenced;		// Clock reference bit
+	bool				m_fFailed;			// The read loading the frame failed
+	CRWLock				m_latch;			// Guards the frame data
+	UINT				m_cbLogStart;		// Start of changes not yet logged
+	UINT				m_cbLogEnd;			// End of changes not yet logged
+	DBLSN				m_lsn;				// Log record holding the latest change
+	BYTE*				m_pImage;			// Committed data to roll back to (dirty pages only)
 
+	// Page state is managed exclusively by the buffer manager
+	friend class CDbBufferManager;
+};
 
+#endif // __DBPAGE_H__
@@ -0,0 +1,344 @@
+// ================================================================================
+//
+//	File:
+//      dbscan.cpp
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Predicate scan implementation
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// --------------------------------------------------------------------------------
+//	SIMD SUPPORT
+//
+//	GCC builds the SSE2 and AVX2 kernels for their own target and picks one at
+//	run time, so the library still runs on processors without AVX2.
+// --------------------------------------------------------------------------------
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define DB_SCAN_SSE2
+#define DB_SCAN_AVX2
+#define DB_SCAN_TARGET(x)	__attribute__((target(x)))
+#elif defined (_M_IX86) || defined (_M_X64)
+#include <emmintrin.h>
+#define DB_SCAN_SSE2
+#define DB_SCAN_TARGET(x)
+#endif
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      SelectScalar
+//
+//  Description:
+//      Comparison kernel for any processor.  Every position is written to the
+//		selection vector and kept only if it matches, so there is no branch
+//		per value.
+//
+//  Inputs:
+//		uiKind		== IN:	Basic comparison (DB_SCAN_EQ, DB_SCAN_LT or DB_SCAN_GT)
+//		uiInvert	== IN:	1 to select the values that do not compare
+//		iValue		== IN:	Value compared with
+//		rgValues	== IN:	Column values
+//		cValues		== IN:	Count of values
+//		rgSelect	== OUT:	Positions of the matching values (room for cValues)
+//
+//  Returns:
+//      Count of matching values
+// --------------------------------------------------------------------------------
+static UINT SelectScalar
+(
+	UINT		uiKind,
+	UINT		uiInvert,
+	INT			iValue,
+	const INT*	rgValues,
+	UINT		cValues,
+	UINT*		rgSelect
+)
+{
+	UINT cSelected = 0;
+
+	switch (uiKind)
+	{
+		case DB_SCAN_EQ:
+			for (UINT idx = 0; idx < cValues; idx++)
+			{
+				rgSelect[cSelected]	 = idx;
+				cSelected			+= (rgValues[idx] == iValue) ^ uiInvert;
+			}
+			break;
+
+		case DB_SCAN_LT:
+			for (UINT idx = 0; idx < cValues; idx++)
+			{
+				rgSelect[cSelected]	 = idx;
+				cSelected			+= (rgValues[idx] < iValue) ^ uiInvert;
+			}
+			break;
+
+		default:
+			for (UINT idx = 0; idx < cValues; idx++)
+			{
+				rgSelect[cSelected]	 = idx;
+				cSelected			+= (rgValues[idx] > iValue) ^ uiInvert;
+			}
+			break;
+	}
+
+	return cSelected;
+}
+
+#if defined (DB_SCAN_SSE2)
+// --------------------------------------------------------------------------------
+//  Function:
+//      SelectSse2
+//
+//  Description:
+//      Comparison kernel comparing four values per instruction.  The values
+//		left over at the end are compared by SelectScalar.
+//
+//  Inputs:
+//		(see SelectScalar)
+//
+//  Returns:
+//      Count of matching values
+// --------------------------------------------------------------------------------
+DB_SCAN_TARGET("sse2") static UINT SelectSse2
+(
+	UINT		uiKind,
+	UINT		uiInvert,
+	INT			iValue,
+	const INT*	rgValues,
+	UINT		cValues,
+	UINT*		rgSelect
+)
+{
+	__m128i	vValue		= _mm_set1_epi32(iValue);
+	UINT	fInvert		= uiInvert ? 0xFFFF : 0;
+	UINT	cSelected	= 0;
+	UINT	idx			= 0;
+
+	for ( ; idx + 4 <= cValues; idx += 4)
+	{
+		__m128i vData = _mm_loadu_si128((const __m128i*) (rgValues + idx));
+		__m128i vMatch;
+
+		switch (uiKind)
+		{
+			case DB_SCAN_EQ:	vMatch = _mm_cmpeq_epi32(vData, vValue);	break;
+			case DB_SCAN_LT:	vMatch = _mm_cmplt_epi32(vData, vValue);	break;
+			default:			vMatch = _mm_cmpgt_epi32(vData, vValue);	break;
+		}
+
+		// Four mask bits per value
+		UINT fMatch = _mm_movemask_epi8(vMatch) ^ fInvert;
+
+		for (UINT iidx = 0; iidx < 4; iidx++)
+		{
+			rgSelect[cSelected]	 = idx + iidx;
+			cSelected			+= (fMatch >> (iidx * 4)) & 1;
+		}
+	}
+
+	UINT cTail = SelectScalar(uiKind, uiInvert, iValue, rgValues + idx, cValues - idx, rgSelect + cSelected);
+
+	for (UINT iidx = 0; iidx < cTail; iidx++)
+	{
+		rgSelect[cSelected++] += idx;
+	}
+
+	return cSelected;
+}
+#endif
+
+#if defined (DB_SCAN_AVX2)
+// --------------------------------------------------------------------------------
+//  Function:
+//      SelectAvx2
+//
+//  Description:
+//      Comparison kernel comparing eight values per instruction.  The values
+//		left over at the end are compared by SelectScalar.
+//
+//  Inputs:
+//		(see SelectScalar)
+//
+//  Returns:
+//      Count of matching values
+// --------------------------------------------------------------------------------
+DB_SCAN_TARGET("avx2") static UINT SelectAvx2
+(
+	UINT		uiKind,
+	UINT		uiInvert,
+	INT			iValue,
+	const INT*	rgValues,
+	UINT		cValues,
+	UINT*		rgSelect
+)
+{
+	__m256i	vValue		= _mm256_set1_epi32(iValue);
+	UINT	fInvert		= uiInvert ? 0xFF : 0;
+	UINT	cSelected	= 0;
+	UINT	idx			= 0;
+
+	for ( ; idx + 8 <= cValues; idx += 8)
+	{
+		__m256i vData = _mm256_loadu_si256((const __m256i*) (rgValues + idx));
+		__m256i vMatch;
+
+		switch (uiKind)
+		{
+			case DB_SCAN_EQ:	vMatch = _mm256_cmpeq_epi32(vData, vValue);	break;
+			case DB_SCAN_LT:	vMatch = _mm256_cmpgt_epi32(vValue, vData);	break;
+			default:			vMatch = _mm256_cmpgt_epi32(vData, vValue);	break;
+		}
+
+		// One mask bit per value
+		UINT fMatch = _mm256_movemask_ps(_mm256_castsi256_ps(vMatch)) ^ fInvert;
+
+		for (UINT iidx = 0; iidx < 8; iidx++)
+		{
+			rgSelect[cSelected]	 = idx + iidx;
+			cSelected			+= (fMatch >> iidx) & 1;
+		}
+	}
+
+	UINT cTail = SelectScalar(uiKind, uiInvert, iValue, rgValues + idx, cValues - idx, rgSelect + cSelected);
+
+	for (UINT iidx = 0; iidx < cTail; iidx++)
+	{
+		rgSelect[cSelected++] += idx;
+	}
+
+	return cSelected;
+}
+#endif
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbScan::CDbScan
+//
+//  Description:
+//      Default constructor.  Picks the widest comparison kernel the processor
+//		supports.
+//
+//  Inputs:
+//      predicate	== IN: Predicate to evaluate
+//		cbRecord	== IN: Record size (bytes)
+//
+//  Exceptions:
+//		invalid_argument == column type or comparison not supported
+//		out_of_range	 == column outside of the record
+// --------------------------------------------------------------------------------
+CDbScan::CDbScan
+(
+	const DbPredicate&	predicate,
+	UINT				cbRecord
+)
+{
+	TRACE_INIT("CDbScan::CDbScan");
+
+	if (predicate.Type != DB_KEY_UINT && predicate.Type != DB_KEY_INT)
+	{
+		throw invalid_argument("Scan column type not supported");
+	}
+
+	if (predicate.Offset > cbRecord || cbRecord - predicate.Offset < sizeof(UINT))
+	{
+		throw out_of_range("Scan column outside of record");
+	}
+
+	m_predicate	= predicate;
+	m_cbRecord	= cbRecord;
+	m_uiBias	= (predicate.Type == DB_KEY_UINT) ? 0x80000000 : 0;
+
+	// Each comparison is equal, less or greater, or the inverse of one
+	switch (predicate.Op)
+	{
+		case DB_SCAN_EQ:	m_uiKind = DB_SCAN_EQ;	m_uiInvert = 0;	break;
+		case DB_SCAN_NE:	m_uiKind = DB_SCAN_EQ;	m_uiInvert = 1;	break;
+		case DB_SCAN_LT:	m_uiKind = DB_SCAN_LT;	m_uiInvert = 0;	break;
+		case DB_SCAN_GE:	m_uiKind = DB_SCAN_LT;	m_uiInvert = 1;	break;
+		case DB_SCAN_GT:	m_uiKind = DB_SCAN_GT;	m_uiInvert = 0;	break;
+		case DB_SCAN_LE:	m_uiKind = DB_SCAN_GT;	m_uiInvert = 1;	break;
+
+		default:
+			throw invalid_argument("Scan comparison not supported");
+	}
+
+	m_pfnSelect = SelectScalar;
+
+#if defined (DB_SCAN_AVX2)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		m_pfnSelect = SelectAvx2;
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		m_pfnSelect = SelectSse2;
+	}
+#elif defined (DB_SCAN_SSE2)
+	if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+	{
+		m_pfnSelect = SelectSse2;
+	}
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbScan::Select
+//
+//  Description:
+//      Evaluate the predicate over a block of records.  The column values are
+//		copied into a contiguous array first so the comparison kernel reads
+//		them with full width loads.
+//
+//  Inputs:
+//      pRecords	== IN:	Records
+//		cRecords	== IN:	Count of records
+//		rgSelect	== OUT:	Position of every matching record (room for
+//							cRecords)
+//
+//  Returns:
+//      Count of matching records
+// --------------------------------------------------------------------------------
+UINT CDbScan::Select
+(
+	const BYTE*	pRecords,
+	UINT		cRecords,
+	UINT*		rgSelect
+)
+{
+	if (cRecords == 0)
+	{
+		return 0;
+	}
+
+	if (m_rgValues.size() < cRecords)
+	{
+		m_rgValues.resize(cRecords);
+	}
+
+	const BYTE* pValue = pRecords + m_predicate.Offset;
+
+	for (UINT idx = 0; idx < cRecords; idx++, pValue += m_cbRecord)
+	{
+		UINT uiValue;
+
+		memcpy(&uiValue, pValue, sizeof(uiValue));
+		m_rgValues[idx] = (INT) (uiValue ^ m_uiBias);
+	}
+
+	return m_pfnSelect(m_uiKind, m_uiInvert, (INT) (m_predicate.Value ^ m_uiBias),
+					   &m_rgValues[0], cRecords, rgSelect);
+}
@@ -0,0 +1,108 @@
+// ================================================================================
+//
+//	File:
+//      dbscan.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Predicate scan definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBSCAN_H__
+#define __DBSCAN_H__
+
+// Rows evaluated per block
+const UINT DB_SCAN_ROWS		= 1024;
+
+// Slots handed to a parallel scan worker at a time
+const UINT DB_SCAN_MORSEL	= 16 * DB_SCAN_ROWS;
+
+// Comparison operators
+enum DB_SCAN_OP
+{
+	DB_SCAN_EQ		= 1,		// Column == value
+	DB_SCAN_NE		= 2,		// Column != value
+	DB_SCAN_LT		= 3,		// Column <  value
+	DB_SCAN_LE		= 4,		// Column <= value
+	DB_SCAN_GT		= 5,		// Column >  value
+	DB_SCAN_GE		= 6			// Column >= value
+};
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbPredicate
+//
+//  Description:
+//      Comparison of a fixed position column with a constant.  The column is
+//		a 32 bit integer (DB_KEY_UINT or DB_KEY_INT); a signed value is passed
+//		as its bit pattern.
+// --------------------------------------------------------------------------------
+struct DbPredicate
+{
+	UINT		Offset;			// Offset of the column in the record
+	DB_KEY_TYPE	Type;			// Column data type
+	DB_SCAN_OP	Op;				// Comparison
+	UINT		Value;			// Value compared with
+};
+
+// ================================================================================
+// Class:
+//      CDbScan
+//
+//  Description:
+//      Evaluates a predicate over blocks of records.  The column values of a
+//		block are copied into a contiguous array and compared several at a
+//		time with SSE2 or AVX2, as the processor allows, without a branch per
+//		row.  The result is a selection vector: the position in the block of
+//		every matching record.
+// ================================================================================
+class CDbScan
+{
+public:
+	CDbScan(const DbPredicate& predicate, UINT cbRecord);
+
+	UINT Select(const BYTE* pRecords, UINT cRecords, UINT* rgSelect);
+
+	const DbPredicate& GetPredicate()	{ return m_predicate; }
+
+private:
+	// Comparison kernel (see dbscan.cpp)
+	typedef UINT (*SelectFn)(UINT uiKind, UINT uiInvert, INT iValue, const INT* rgValues, UINT cValues, UINT* rgSelect);
+
+private:
+	DbPredicate		m_predicate;	// Predicate evaluated
+	UINT			m_cbRecord;		// Record size (bytes)
+	UINT			m_uiKind;		// Basic comparison (DB_SCAN_EQ, DB_SCAN_LT or DB_SCAN_GT)
+	UINT			m_uiInvert;		// 1 if the result of the basic comparison is inverted
+	UINT			m_uiBias;		// Flips the sign bit of unsigned values so they compare signed
+	SelectFn		m_pfnSelect;	// Comparison kernel
+	vector<INT>		m_rgValues;		// Column values of the current block
+};
+
+// ================================================================================
+// Class:
+//      CDbScanConsumer
+//
+//  Description:
+//      Receives the records of a parallel table scan (CDbTable::ParallelScan).
+//		Each worker thread passes its records with its own worker index, so a
+//		consumer can keep separate state per worker and combine it once the
+//		scan returns.  Consume is called by several threads at once, but never
+//		by two threads with the same worker index.
+// ================================================================================
+class CDbScanConsumer
+{
+public:
+	virtual ~CDbScanConsumer()	{}
+
+	virtual void Start(UINT /*cWorkers*/)	{}
+	virtual void Consume(UINT idxWorker, const DbRecord* prgRecords, UINT cRecords) = 0;
+};
+
+#endif // __DBSCAN_H__
@@ -22,6 +22,11 @@
 // --------------------------------------------------------------------------------
 SmartPointer(CDbFile);
 SmartPointer(CDbTable);
+SmartPointer(CDbCursor);
+SmartPointer(CDbBufferManager);
+SmartPointer(CDbIndex);
+SmartPointer(CDbLog);
+SmartPointer(CDbVersionStore);
 
 // --------------------------------------------------------------------------------
 // CONSTANTS
@@ -29,14 +34,58 @@ SmartPointer(CDbTable);
 const int	DB_MAX_OBJECT_NAME			= 10;
 const UINT	DB_DEFAULT_TABLES			= 10;
 const UINT	DB_DEFAULT_INDEXES			= 2 * DB_DEFAULT_TABLES;
+const UINT	DB_DEFAULT_EXTENTS			= 4 * DB_DEFAULT_TABLES;
 const UINT	DB_DEFAULT_SLOTS			= 1000;
 const UINT	DB_DEFAULT_GROWTH_FACTOR	= 500;
 const UINT	DB_DEFAULT_REC_BUFFER_SIZE	= 100;
+const UINT	DB_PAGE_SIZE				= 4096;
+const UINT	DB_DEFAULT_CACHE_SIZE		= 256 * DB_PAGE_SIZE;
 
 // --------------------------------------------------------------------------------
 //	TYPEDEFS
 // --------------------------------------------------------------------------------
 typedef UINT DBRECID;
+typedef UINT DBPAGEID;
+typedef UINT DBPOS;
+
+// Position returned when no record matches
+const DBPOS DB_INVALID_POS = 0xFFFFFFFF;
+
+// --------------------------------------------------------------------------------
+//	ENUMERATIONS
+// --------------------------------------------------------------------------------
+
+// Index structures
+enum DB_INDEX_KIND
+{
+	DB_INDEX_BTREE	= 1,		// Ordered B+tree
+	DB_INDEX_HASH	= 2			// Linear hash (equality lookups only)
+};
+
+// Index key data types
+enum DB_KEY_TYPE
+{
+	DB_KEY_UINT		= 1,		// Unsigned 32 bit integer
+	DB_KEY_INT		= 2,		// Signed 32 bit integer
+	DB_KEY_STRING	= 3,		// Fixed width character array (null terminated if shorter)
+	DB_KEY_BINARY	= 4			// Fixed width byte array
+};
+
+// Widest key that leaves room for several entries in an index page
+const UINT	DB_MAX_KEY_SIZE				= 256;
+
+// Index flags
+const UINT	DB_INDEX_RID				= 0x0001;	// Record id index of the table
+
+// Table flags
+const UINT	DB_TABLE_DEFAULT			= 0x0000;
+const UINT	DB_TABLE_STABLE				= 0x0001;	// Rows never move; deleted slots are reused
+const UINT	DB_TABLE_PAX				= 0x0002;	// Column values grouped in blocks of rows
+
+// Column layout (DB_TABLE_PAX)
+const UINT	DB_MAX_COLUMNS				= 32;
+const UINT	DB_ALL_COLUMNS				= 0xFFFFFFFF;		// Column mask selecting every column
+const UINT	DB_PAX_BLOCK_SIZE			= 16 * DB_PAGE_SIZE;	// Target size of a block of rows
 
 // --------------------------------------------------------------------------------
 // Structure:
@@ -72,6 +121,7 @@ struct DbFileInfo
 	// CATALOGS
 	DbCatalog	Tables;				// Table catalog
 	DbCatalog	Indexes;			// Index catalog
+	DbCatalog	Extents;			// Table extent catalog
 
 	// FILE OFFSET INFORMATION
 	FILEOFFSET	DataOffsetStart;	// Offset to beginning of data (incl. catalog)
@@ -110,10 +160,26 @@ struct DbObjectInfo
 //      Table information.  Used for tracking the table catalog in a CDbFile object
 //
 //		TableId == 0 -> unused table slot
+//		Offset		 -> start of the first extent
+//		Slots		 -> count of slots in all extents
+//		Entries		 -> slots in use, including the deleted slots of a
+//						stable-slot table
+//		BlockSlots	 -> rows per block; every extent holds whole blocks
+//
+//		A PAX table (DB_TABLE_PAX) stores each block of BlockSlots rows column
+//		by column: the values of column n for the rows of the block are
+//		contiguous, starting BlockSlots * ColumnOffset[n] bytes into the block.
+//		Other tables store whole rows and have one row per block.
 // --------------------------------------------------------------------------------
 struct DbTableInfo : public DbObjectInfo
 {
 	UINT	LastRecordId;							// Last unique record id used
+	UINT	Flags;									// Table flags
+	DBPOS	FreeSlot;								// First deleted slot (DB_TABLE_STABLE)
+	UINT	Deleted;								// Count of deleted slots (DB_TABLE_STABLE)
+	UINT	BlockSlots;								// Rows per block
+	UINT	Columns;								// Count of columns
+	UINT	ColumnOffset[DB_MAX_COLUMNS];			// Offset of each column in the record
 };
 
 // --------------------------------------------------------------------------------
@@ -124,10 +190,40 @@ struct DbTableInfo : public DbObjectInfo
 //      Index information.  Used for tracking the index catalog in a CDbFile object
 //
 //		IndexId == 0 -> unused index slot
+//		Offset  == 0 -> index structure not built yet
+//		Size		 -> key width (bytes)
+//		Entries		 -> count of keys
+//		Slots		 -> count of pages allocated to the index
 // --------------------------------------------------------------------------------
 struct DbIndexInfo : public DbObjectInfo
 {
 	UINT	TableId;								// Corresponding table id
+	UINT	Kind;									// Index structure (DB_INDEX_KIND)
+	UINT	KeyType;								// Key data type (DB_KEY_TYPE)
+	UINT	KeyOffset;								// Offset of key in the record
+	UINT	Flags;									// Index flags
+	UINT	Height;									// Levels in the index structure
+};
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbExtentInfo
+//
+//  Description:
+//      Extent information.  A table's data is a chain of extents, each a run
+//		of contiguous slots somewhere in the file.  The table slots are
+//		numbered across the chain in FirstSlot order.
+//
+//		Id == 0		 -> unused extent slot
+//		TableId == 0 -> free space (Size is 1 and Slots is the length in bytes)
+//		Offset		 -> file offset of the first slot
+//		Size		 -> record size (bytes)
+//		Slots		 -> count of slots in the extent
+// --------------------------------------------------------------------------------
+struct DbExtentInfo : public DbObjectInfo
+{
+	UINT	TableId;								// Owning table id
+	UINT	FirstSlot;								// Table slot of the first record
 };
 
 // --------------------------------------------------------------------------------
@@ -143,6 +239,65 @@ struct DbRecord
 	DBRECID	RID;									// Record id
 };
 
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbFileInfoV1
+//
+//  Description:
+//      File information of a version 1 file.  Version 1 files have no extent
+//		catalog: each table's data is a single run of Slots slots at Offset.
+//		Read only to upgrade the file (see CDbFile::Upgrade).
+// --------------------------------------------------------------------------------
+struct DbFileInfoV1
+{
+	UINT		MajorVersion;		// Major version (1)
+	UINT		MinorVersion;		// Minor version
+	DbCatalog	Tables;				// Table catalog
+	DbCatalog	Indexes;			// Index catalog
+	FILEOFFSET	DataOffsetStart;	// Offset to beginning of data (incl. catalog)
+	FILEOFFSET	DataOffsetEnd;		// Offset to end of data (including catalog)
+	time_t		Created;			// Date/time created
+	time_t		LastUpdated;		// Date/time of last update
+};
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbTableInfoV1
+//
+//  Description:
+//      Table information of a version 1 file
+// --------------------------------------------------------------------------------
+struct DbTableInfoV1 : public DbObjectInfo
+{
+	UINT	LastRecordId;							// Last unique record id used
+};
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbIndexInfoV1
+//
+//  Description:
+//      Index information of a version 1 file.  Only the catalog entry existed;
+//		it does not describe the key, so it cannot be carried forward.
+// --------------------------------------------------------------------------------
+struct DbIndexInfoV1 : public DbObjectInfo
+{
+	UINT	TableId;								// Corresponding table id
+};
+
+// --------------------------------------------------------------------------------
+// Structure:
+//      DbFreeSlot
+//
+//  Description:
+//      Deleted slot of a stable-slot table.  The record id is zero and the
+//		deleted slots form a list that ends with DB_INVALID_POS.
+// --------------------------------------------------------------------------------
+struct DbFreeSlot : public DbRecord
+{
+	DBPOS	Next;									// Next deleted slot
+};
+
 #endif // __DBSTRUCT_H__
 
 
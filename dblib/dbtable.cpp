@@ -37,11 +37,15 @@ CDbTable::CDbTable
 
 	m_pdbFile		= pdbFile;
 	m_pTableInfo	= pTableInfo;
-	m_pFile			= m_pdbFile->m_pFile;
+	m_pBufferMgr	= m_pdbFile->m_pBufferMgr;
 	m_idxSlot		= 0;
+	m_fSnapshot		= false;
+
+	m_snapshot.Timestamp	= 0;
+	m_snapshot.End			= 0;
 
 	m_cbBuffer	= m_pTableInfo->Size;
-	m_pBuffer	= (DbRecord*) new BYTE[m_cbBuffer];
+	m_pBuffer	= (DbRecord*) CFile::AllocBuffer(m_cbBuffer);
 }
 
 // --------------------------------------------------------------------------------
@@ -63,11 +67,15 @@ CDbTable::CDbTable
 
 	m_pdbFile		= rTable.m_pdbFile;
 	m_pTableInfo	= rTable.m_pTableInfo;
-	m_pFile			= m_pdbFile->m_pFile;
+	m_pBufferMgr	= m_pdbFile->m_pBufferMgr;
 	m_idxSlot		= 0;
+	m_fSnapshot		= false;
+
+	m_snapshot.Timestamp	= 0;
+	m_snapshot.End			= 0;
 
 	m_cbBuffer	= m_pTableInfo->Size;
-	m_pBuffer	= (DbRecord*) new BYTE[m_cbBuffer];
+	m_pBuffer	= (DbRecord*) CFile::AllocBuffer(m_cbBuffer);
 }
 
 // --------------------------------------------------------------------------------
@@ -85,13 +93,17 @@ CDbTable& CDbTable::operator=
 	const CDbTable& rTable
 )
 {
+	CloseSnapshot();
+
 	m_pdbFile		= rTable.m_pdbFile;
 	m_pTableInfo	= rTable.m_pTableInfo;
-	m_pFile			= m_pdbFile->m_pFile;
+	m_pBufferMgr	= m_pdbFile->m_pBufferMgr;
 	m_idxSlot		= 0;
 
+	CFile::FreeBuffer((BYTE*) m_pBuffer);
+
 	m_cbBuffer	= m_pTableInfo->Size;
-	m_pBuffer	= (DbRecord*) new BYTE[m_cbBuffer];
+	m_pBuffer	= (DbRecord*) CFile::AllocBuffer(m_cbBuffer);
 
 	return *this;
 }
@@ -107,9 +119,11 @@ CDbTable::~CDbTable()
 {
 	TRACE_INIT("CDbTable::~CDbTable");
 
+	CloseSnapshot();
+
 	if (m_pBuffer)
 	{
-		delete[] m_pBuffer;
+		CFile::FreeBuffer((BYTE*) m_pBuffer);
 	}
 }
 
@@ -122,36 +136,94 @@ CDbTable::~CDbTable()
 //      CDbTable::Find
 //
 //  Description:
-//      Retrieve record by id
+//      Position cursor on record by id.  The next Fetch returns the record.
 //
 //  Inputs:
 //      id == IN: Record id
 //
 //  Returns:
-//      Position of matching record
+//      Position of matching record; DB_INVALID_POS if not found
 // --------------------------------------------------------------------------------
 DBPOS CDbTable::Find
 (
 	DBRECID		id
 )
 {
-	DbRecord record;
+	TRACE_INIT("CDbTable::Find");
 
-	TRACE_INIT("CDbTable::FindRecord");
+	DBPOS idxSlot = FindRecordSlot(id);
 
-	// Scan table records for id
-	// TODO: Use indexed table scan	
-	MoveFirst();
-	while (Fetch(&record, 1) == 1)
+	if (idxSlot != DB_INVALID_POS)
 	{
-		if (record.RID == id)
-		{
-			return true;
-		}
+		m_idxSlot = idxSlot;
+	}
+
+	return idxSlot;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::Seek
+//
+//  Description:
+//      Position cursor on the first record with a key in a secondary index.
+//		The next Fetch returns the record.  String keys may be shorter than
+//		the key width.
+//
+//  Inputs:
+//      idIndex	== IN: Index id (from CDbFile::CreateIndex)
+//		pKey	== IN: Key value
+//
+//  Returns:
+//      Position of matching record; DB_INVALID_POS if not found
+//
+//  Exceptions:
+//		invalid_argument == index missing or not an index of this table
+// --------------------------------------------------------------------------------
+DBPOS CDbTable::Seek
+(
+	UINT		idIndex,
+	const void*	pKey
+)
+{
+	DBPOS idxSlot = DB_INVALID_POS;
+
+	TRACE_INIT("CDbTable::Seek");
+
+	if (!pKey)
+	{
+		throw invalid_argument("Key invalid");
+	}
+
+	CDbIndex* pIndex = m_pdbFile->GetIndex(idIndex);
+
+	if (!pIndex || pIndex->GetTableId() != m_pTableInfo->Id)
+	{
+		throw invalid_argument("Index not defined for table");
+	}
+
+	// Copy key into a full width buffer
+	vector<BYTE> rgKey(pIndex->GetKeySize(), 0);
+
+	if (pIndex->GetKeyType() == DB_KEY_STRING)
+	{
+		strncpy((char*) &rgKey[0], (const char*) pKey, rgKey.size());
+	}
+	else
+	{
+		memcpy(&rgKey[0], pKey, rgKey.size());
+	}
+
+	if (pIndex->Find(&rgKey[0], &idxSlot))
+	{
+		m_idxSlot = idxSlot;
+	}
+	else
+	{
+		idxSlot = DB_INVALID_POS;
 	}
 
-	// Record not found
-	return 0;
+	return idxSlot;
 }
 
 // --------------------------------------------------------------------------------
@@ -160,11 +232,15 @@ DBPOS CDbTable::Find
 //
 //  Description:
 //      Retrieve next n records from table.  Client is responsible for creating
-//		record buffer of cRecords * RowSize
+//		record buffer of cRecords * RowSize.  Deleted slots of a stable-slot
+//		table are skipped.  A PAX table reads only the selected columns and
+//		leaves the others zero; other tables always read whole records.
 //
 //  Inputs:
 //		prgRecords	== OUT: Record output buffer
 //      cRecords	== IN:	Count of records to retrieve
+//		fColumns	== IN:	Columns to read (bit n selects column n).  Column
+//							0 holds the record id and is always read.
 //
 //  Returns:
 //      Count of records retrieved
@@ -172,273 +248,1820 @@ DBPOS CDbTable::Find
 UINT CDbTable::Fetch
 (
 	DbRecord*	prgRecords,
-	UINT		cRecords
+	UINT		cRecords,
+	UINT		fColumns
 )
 {
-	UINT cbRead = 0;
+	return FetchFrom(&m_idxSlot, GetSnapshot(), prgRecords, cRecords, fColumns);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::FetchFrom
+//
+//  Description:
+//      Fetch for a cursor: retrieve the next n records from a position as a
+//		snapshot sees them (see Fetch).  The table cursor is not used, so any
+//		number of cursors (see CDbCursor) may fetch at once.
+//
+//  Inputs:
+//		pidxSlot	== IN/OUT:	Cursor position
+//		pSnapshot	== IN:		Snapshot (NULL for the current table)
+//		prgRecords	== OUT:		Record output buffer
+//      cRecords	== IN:		Count of records to retrieve
+//		fColumns	== IN:		Columns to read
+//
+//  Returns:
+//      Count of records retrieved
+// --------------------------------------------------------------------------------
+UINT CDbTable::FetchFrom
+(
+	DBPOS*				pidxSlot,
+	const DbSnapshot*	pSnapshot,
+	DbRecord*			prgRecords,
+	UINT				cRecords,
+	UINT				fColumns
+)
+{
+	UINT cbRead		= 0;
+	UINT cbBuffer	= m_pTableInfo->Size * cRecords;
 
-	TRACE_INIT("CDbTable::Fetch");
+	TRACE_INIT("CDbTable::FetchFrom");
 
 	if (!prgRecords)
 	{
 		throw invalid_argument("Record buffer invalid");
 	}
 
-	// Initialize output buffer
-	memset(prgRecords, 0, m_pTableInfo->Size * cRecords);
-
-	// Determine starting/ending points
-	FILEOFFSET idxStart = m_pTableInfo->Offset + (m_idxSlot * m_pTableInfo->Size);
-	FILEOFFSET idxEnd	= m_pTableInfo->Offset + (m_pTableInfo->Entries * m_pTableInfo->Size);
-
-	// Determine if end of table
-	if (idxEnd > idxStart)
+	// Determine if end of table (deleted slots leave room for another pass)
+	while (cbRead < cbBuffer && GetEnd(pSnapshot) > *pidxSlot)
 	{
+		BYTE* pOut	= (BYTE*) prgRecords + cbRead;
+		UINT  cRead	= 0;
+
 		// Adjust record count to request based on remaining rows
-		cRecords = min(cRecords, (idxEnd - idxStart) / m_pTableInfo->Size);
+		cRecords = min((cbBuffer - cbRead) / m_pTableInfo->Size, GetEnd(pSnapshot) - *pidxSlot);
 
 		// Read next n records
-		m_pFile->Seek(idxStart);
-		cbRead = m_pFile->Read(prgRecords, cRecords * m_pTableInfo->Size);
+		if (pSnapshot)
+		{
+			cRead = ReadVisible(pSnapshot, *pidxSlot, pOut, cRecords, fColumns | 1);
+		}
+		else if (IsPax())
+		{
+			cRead = ReadSlots(*pidxSlot, pOut, cRecords, fColumns | 1);
+		}
+		else if (m_pdbFile->IsMapped())
+		{
+			// Copy each contiguous run of an extent
+			while (cRead < cRecords)
+			{
+				UINT		cRun		= 0;
+				FILEOFFSET	idxStart	= GetSlotOffset(*pidxSlot + cRead, &cRun);
+				UINT		cbRun		= min(cRun, cRecords - cRead) * m_pTableInfo->Size;
+
+				m_pdbFile->ReadView(idxStart, pOut + (cRead * m_pTableInfo->Size), cbRun);
+				cRead += cbRun / m_pTableInfo->Size;
+			}
+		}
+		else
+		{
+			cRead = ReadSlots(*pidxSlot, pOut, cRecords);
+		}
 
 		// Adjust cursor
-		m_idxSlot += cbRead / m_pTableInfo->Size;
+		*pidxSlot += cRead;
+		cbRead	  += DropDeleted(pOut, cRead) * m_pTableInfo->Size;
+
+		if (cRead < cRecords)
+		{
+			break;
+		}
 	}
 
+	// Clear the unused part of the output buffer
+	memset((BYTE*) prgRecords + cbRead, 0, cbBuffer - cbRead);
+
 	return cbRead / m_pTableInfo->Size;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbTable::Move
+//      CDbTable::FetchView
 //
 //  Description:
-//      Position cursor by offset amount (skip next n records)
+//      Retrieve next n records without copying them.  Returns a pointer into
+//		the mapped data region of a file opened with DB_OPEN_MAPPED.  The view
+//		stays readable until the file is saved or closed; it reflects later
+//		changes to the rows it covers.  A view ends at the end of a table
+//		extent, so it may hold fewer records than remain.  A view of a
+//		stable-slot table may include deleted slots; their record id is zero.
+//		The records of a PAX table are not stored whole, so it has no views.
 //
 //  Inputs:
-//		cSkip	== IN:	Count of records to skip
+//		pprgRecords	== OUT: Pointer to first record
+//      cRecords	== IN:	Maximum count of records to retrieve
 //
 //  Returns:
-//      New cursor position
+//      Count of records in the view
+//
+//  Exceptions:
+//		runtime_error == file is not opened for mapped access or PAX table
 // --------------------------------------------------------------------------------
-DBPOS CDbTable::Move
+UINT CDbTable::FetchView
 (
-	UINT cSkip
+	const DbRecord**	pprgRecords,
+	UINT				cRecords
 )
 {
-	m_idxSlot = min(m_idxSlot + cSkip, m_pTableInfo->Entries);
-	return m_idxSlot;
+	TRACE_INIT("CDbTable::FetchView");
+
+	if (!pprgRecords)
+	{
+		throw invalid_argument("Record view pointer invalid");
+	}
+
+	*pprgRecords = NULL;
+
+	if (IsPax())
+	{
+		throw runtime_error("Record views not available for a PAX table");
+	}
+
+	if (m_fSnapshot)
+	{
+		throw runtime_error("Record views not available in a snapshot");
+	}
+
+	DBPOS idxEntries = GetEntries();
+
+	if (m_idxSlot >= idxEntries)
+	{
+		return 0;
+	}
+
+	// Adjust record count to request based on remaining rows in the extent
+	UINT		cRun		= 0;
+	FILEOFFSET	idxStart	= GetSlotOffset(m_idxSlot, &cRun);
+
+	cRecords = min(cRecords, min(cRun, idxEntries - m_idxSlot));
+
+	*pprgRecords = (const DbRecord*) m_pdbFile->GetView(idxStart, cRecords * m_pTableInfo->Size);
+
+	// Adjust cursor
+	m_idxSlot += cRecords;
+
+	return cRecords;
 }
 
-// ================================================================================
-// MODIFICATION
-// ================================================================================
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::Scan
+//
+//  Description:
+//      Retrieve the next n records that satisfy a predicate.  The records are
+//		read and evaluated a block at a time; the cursor is left after the
+//		last record returned.  Client is responsible for creating record buffer
+//		of cRecords * RowSize.
+//
+//  Inputs:
+//		predicate	== IN:	Column comparison
+//		prgRecords	== OUT: Record output buffer
+//      cRecords	== IN:	Count of records to retrieve
+//
+//  Returns:
+//      Count of records retrieved
+//
+//  Exceptions:
+//		invalid_argument == predicate not supported (see CDbScan)
+// --------------------------------------------------------------------------------
+UINT CDbTable::Scan
+(
+	const DbPredicate&	predicate,
+	DbRecord*			prgRecords,
+	UINT				cRecords
+)
+{
+	return ScanFrom(&m_idxSlot, GetSnapshot(), predicate, prgRecords, cRecords);
+}
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbTable::Insert
+//      CDbTable::ScanFrom
 //
 //  Description:
-//      Insert new records to table
+//      Scan for a cursor: retrieve the next n records from a position that
+//		satisfy a predicate, as a snapshot sees them (see Scan)
 //
-//	Inputs:
-//		prgRecords == IN: New record collection
-//		cRecords == IN: Count of new records
+//  Inputs:
+//		pidxSlot	== IN/OUT:	Cursor position
+//		pSnapshot	== IN:		Snapshot (NULL for the current table)
+//		predicate	== IN:		Column comparison
+//		prgRecords	== OUT:		Record output buffer
+//      cRecords	== IN:		Count of records to retrieve
 //
 //  Returns:
-//      Count of inserted records
+//      Count of records retrieved
 // --------------------------------------------------------------------------------
-UINT CDbTable::Insert
+UINT CDbTable::ScanFrom
 (
-	DbRecord*	prgRecords,
-	UINT		cRecords
+	DBPOS*				pidxSlot,
+	const DbSnapshot*	pSnapshot,
+	const DbPredicate&	predicate,
+	DbRecord*			prgRecords,
+	UINT				cRecords
 )
 {
-	TRACE_INIT("CDbTable::Insert");
+	CDbScan			scan(predicate, m_pTableInfo->Size);
+	vector<BYTE>	rgBuffer;
+	vector<UINT>	rgSelect(DB_SCAN_ROWS);
+	BYTE*			pOut	= (BYTE*) prgRecords;
+	UINT			cFound	= 0;
 
-	MoveFirst();
+	TRACE_INIT("CDbTable::ScanFrom");
 
-	// Test to see if there is room in the table data area
-	if ((m_pTableInfo->Entries + cRecords) > m_pTableInfo->Slots)
+	if (!prgRecords)
 	{
-		// OVERFLOW -- move table to a new data area
-		m_pdbFile->ExpandTable(m_pTableInfo->Name);
+		throw invalid_argument("Record buffer invalid");
 	}
 
-	// Calculate row position and new file offsets
-	UINT		cbToWrite		 = cRecords * m_pTableInfo->Size;
-	FILEOFFSET	posStartOffset	 = m_pTableInfo->Offset + (m_pTableInfo->Entries * m_pTableInfo->Size);
+	// Mapped records are used in place until the scan is done
+	m_pdbFile->BeginView();
 
-	m_pTableInfo->Entries += cRecords;
+	try
+	{
+		while (cFound < cRecords && *pidxSlot < GetEnd(pSnapshot))
+		{
+			UINT		cRead		= 0;
+			UINT		cBlock		= min(DB_SCAN_ROWS, GetEnd(pSnapshot) - *pidxSlot);
+			const BYTE*	pRecords	= ReadBlock(pSnapshot, *pidxSlot, cBlock, DB_ALL_COLUMNS, rgBuffer, &cRead);
 
-	// Set row id's
-	for (UINT idx = 0; idx < cRecords; idx++)
+			if (cRead == 0)
+			{
+				break;
+			}
+
+			UINT cSelected	= scan.Select(pRecords, cRead, &rgSelect[0]);
+			UINT idx		= 0;
+
+			for ( ; idx < cSelected && cFound < cRecords; idx++)
+			{
+				const BYTE* pRecord = pRecords + (rgSelect[idx] * m_pTableInfo->Size);
+
+				// Deleted slot of a stable-slot table
+				if (((const DbRecord*) pRecord)->RID == 0)
+				{
+					continue;
+				}
+
+				memcpy(pOut + (cFound * m_pTableInfo->Size), pRecord, m_pTableInfo->Size);
+				cFound++;
+			}
+
+			// Output is full - resume after the last record returned
+			if (idx < cSelected)
+			{
+				*pidxSlot += rgSelect[idx - 1] + 1;
+			}
+			else
+			{
+				*pidxSlot += cRead;
+			}
+		}
+	}
+	catch ( ... )
 	{
-		DbRecord* pRecord = (DbRecord*) ((BYTE*) prgRecords + (idx * m_pTableInfo->Size));
-		m_pTableInfo->LastRecordId += 1;
-		pRecord->RID = m_pTableInfo->LastRecordId;
+		m_pdbFile->EndView();
+		throw;
 	}
 
-	// Append rows to the file
-	m_pFile->Seek(posStartOffset);
-	UINT cbWritten = m_pFile->Write(prgRecords, cbToWrite);
+	m_pdbFile->EndView();
 
-	return cbWritten / m_pTableInfo->Size;
+	// Clear the unused part of the output buffer
+	memset(pOut + (cFound * m_pTableInfo->Size), 0, (cRecords - cFound) * m_pTableInfo->Size);
+
+	return cFound;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbTable::Update
+//      CDbTable::Scan
 //
 //  Description:
-//      Update existing records
+//      Find the slots of every record from the cursor to the end of the table
+//		that satisfies a predicate.  Only the record id and predicate columns
+//		of a PAX table are read.  The cursor is left at the end of the table.
 //
-//	Inputs:
-//		prgRecords == IN: Updated record collection
-//		cRecords   == IN: Count of updated records
+//  Inputs:
+//		predicate	== IN:	Column comparison
+//		rgSlots		== OUT:	Selection vector; slots of the matching records
+//							are appended in slot order
 //
 //  Returns:
-//      Count of updated records
+//      Count of records found
+//
+//  Exceptions:
+//		invalid_argument == predicate not supported (see CDbScan)
 // --------------------------------------------------------------------------------
-UINT CDbTable::Update
+UINT CDbTable::Scan
 (
-	DbRecord*	prgRecords,
-	UINT		cRecords
+	const DbPredicate&	predicate,
+	vector<DBPOS>&		rgSlots
 )
 {
-	UINT cUpdated = 0;
+	return ScanFrom(&m_idxSlot, GetSnapshot(), predicate, rgSlots);
+}
 
-	TRACE_INIT("CDbTable::Update");
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ScanFrom
+//
+//  Description:
+//      Scan for a cursor: find the slots of every record from a position to
+//		the end of the table that satisfies a predicate, as a snapshot sees
+//		them (see Scan)
+//
+//  Inputs:
+//		pidxSlot	== IN/OUT:	Cursor position
+//		pSnapshot	== IN:		Snapshot (NULL for the current table)
+//		predicate	== IN:		Column comparison
+//		rgSlots		== OUT:		Selection vector
+//
+//  Returns:
+//      Count of records found
+// --------------------------------------------------------------------------------
+UINT CDbTable::ScanFrom
+(
+	DBPOS*				pidxSlot,
+	const DbSnapshot*	pSnapshot,
+	const DbPredicate&	predicate,
+	vector<DBPOS>&		rgSlots
+)
+{
+	CDbScan			scan(predicate, m_pTableInfo->Size);
+	vector<BYTE>	rgBuffer;
+	vector<UINT>	rgSelect(DB_SCAN_ROWS);
+	UINT			fColumns	= GetColumnMask(predicate.Offset, sizeof(UINT)) | 1;
+	UINT			cFound		= 0;
 
-	MoveFirst();
-	
-	// Loop through records and update the record in the database
-	for (UINT idx = 0; idx < cRecords; idx++)
-	{
-		DbRecord* pRecord = (DbRecord*) ((BYTE*) prgRecords + (idx * m_pTableInfo->Size));
-		FILEOFFSET posRec = FindRecordOffset(pRecord->RID);
+	TRACE_INIT("CDbTable::ScanFrom");
 
-		if (posRec != 0)
+	// Mapped records are used in place until the scan is done
+	m_pdbFile->BeginView();
+
+	try
+	{
+		while (*pidxSlot < GetEnd(pSnapshot))
 		{
-			m_pFile->Seek(posRec);
-			UINT cbWritten = m_pFile->Write(pRecord, m_pTableInfo->Size);
-			_ASSERTE(cbWritten == m_pTableInfo->Size);
-			cUpdated++;
+			UINT		cRead		= 0;
+			UINT		cBlock		= min(DB_SCAN_ROWS, GetEnd(pSnapshot) - *pidxSlot);
+			const BYTE*	pRecords	= ReadBlock(pSnapshot, *pidxSlot, cBlock, fColumns, rgBuffer, &cRead);
+
+			if (cRead == 0)
+			{
+				break;
+			}
+
+			UINT cSelected = scan.Select(pRecords, cRead, &rgSelect[0]);
+
+			for (UINT idx = 0; idx < cSelected; idx++)
+			{
+				// Deleted slot of a stable-slot table
+				if (((const DbRecord*) (pRecords + (rgSelect[idx] * m_pTableInfo->Size)))->RID != 0)
+				{
+					rgSlots.push_back(*pidxSlot + rgSelect[idx]);
+					cFound++;
+				}
+			}
+
+			*pidxSlot += cRead;
 		}
 	}
+	catch ( ... )
+	{
+		m_pdbFile->EndView();
+		throw;
+	}
 
-	return cUpdated;
+	m_pdbFile->EndView();
+
+	return cFound;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbTable::Delete
+//      CDbTable::ParallelScan
 //
 //  Description:
-//      Remove records from the table.  Copies last record in the table to the
-//		slots vacated by the deleted records.
+//      Pass every record of the table to a consumer using several threads.
+//		The slots are split into morsels of DB_SCAN_MORSEL slots and each
+//		worker starts with an equal share; a worker that runs out takes
+//		morsels from the end of the largest share left.  Records arrive in
+//		blocks, in no particular order across workers.  Deleted slots of a
+//		stable-slot table are skipped.  The cursor is not used or moved, and
+//		as with Fetch the table should not be changed during the scan.
 //
-//	Inputs:
-//		prgRecords == IN: Records to delete (can be ID's only)
-//		cRecords   == IN: Count of records to delete
+//  Inputs:
+//		pConsumer	== IN:	Record consumer
+//		cThreads	== IN:	Count of worker threads (zero for one per processor)
 //
 //  Returns:
-//      Count of deleted records
+//      Count of records scanned
+//
+//  Exceptions:
+//		runtime_error == a worker failed (the consumer threw or a read failed)
 // --------------------------------------------------------------------------------
-UINT CDbTable::Delete
+UINT CDbTable::ParallelScan
 (
-	DbRecord*	prgRecords,
-	UINT		cRecords
+	CDbScanConsumer*	pConsumer,
+	UINT				cThreads
 )
 {
-	UINT cDeleted = 0;
-		
-	TRACE_INIT("CDbTable::DeleteRecord");
+	ScanTask task;
 
-	MoveFirst();
+	TRACE_INIT("CDbTable::ParallelScan");
 
-	for (UINT idx = 0; idx < cRecords; idx++)
+	if (!pConsumer)
 	{
-		DbRecord* pRecord = (DbRecord*) ((BYTE*) prgRecords + (idx * m_pTableInfo->Size));
+		throw invalid_argument("Scan consumer invalid");
+	}
 
-		// Get record offset
-		FILEOFFSET posDel = FindRecordOffset(pRecord->RID);
+	task.Snapshot	= GetSnapshot();
+	task.Consumer	= pConsumer;
+	task.Predicate	= NULL;
 
-		if (posDel)
-		{
-			// Find record to move
-			FILEOFFSET posMove = ((m_pTableInfo->Entries - 1) * m_pTableInfo->Size) + m_pTableInfo->Offset;
-			m_pFile->Seek(posMove);
+	return RunScan(&task, cThreads);
+}
 
-			// Copy record
-			UINT cbRead = m_pFile->Read(m_pBuffer, m_cbBuffer);
-			_ASSERTE(cbRead == m_cbBuffer);
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ParallelScan
+//
+//  Description:
+//      Find the slots of every record that satisfies a predicate using several
+//		threads (see ParallelScan above).  Each morsel builds its own selection
+//		vector and they are merged in slot order.
+//
+//  Inputs:
+//		predicate	== IN:	Column comparison
+//		rgSlots		== OUT:	Selection vector; slots of the matching records
+//							are appended in slot order
+//		cThreads	== IN:	Count of worker threads (zero for one per processor)
+//
+//  Returns:
+//      Count of records found
+//
+//  Exceptions:
+//		invalid_argument == predicate not supported (see CDbScan)
+//		runtime_error	 == a worker failed
+// --------------------------------------------------------------------------------
+UINT CDbTable::ParallelScan
+(
+	const DbPredicate&	predicate,
+	vector<DBPOS>&		rgSlots,
+	UINT				cThreads
+)
+{
+	ScanTask task;
 
-			// Write record into empty slot
-			m_pFile->Seek(posDel);
-			UINT cbWritten = m_pFile->Write(m_pBuffer, m_cbBuffer);
-			_ASSERTE(cbWritten == cbRead);
+	TRACE_INIT("CDbTable::ParallelScan");
 
-			// Clear slot for old record
-			m_pFile->Seek(posMove);
-			memset(m_pBuffer, 0, m_cbBuffer);
-			cbWritten = m_pFile->Write(m_pBuffer, m_cbBuffer);
-			_ASSERTE(cbWritten == m_cbBuffer);
+	// Report a bad predicate before any thread starts
+	CDbScan scan(predicate, m_pTableInfo->Size);
 
-			// Update table metadata
-			m_pTableInfo->Entries--;
-			cDeleted++;
-		}
+	task.Snapshot	= GetSnapshot();
+	task.Consumer	= NULL;
+	task.Predicate	= &predicate;
+
+	UINT cFound = RunScan(&task, cThreads);
+
+	rgSlots.reserve(rgSlots.size() + cFound);
+
+	for (UINT idx = 0; idx < task.Results.size(); idx++)
+	{
+		rgSlots.insert(rgSlots.end(), task.Results[idx].begin(), task.Results[idx].end());
 	}
 
-	return cDeleted;
+	return cFound;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CDbTable::FindRecordOffset
+//      CDbTable::Move
 //
 //  Description:
-//      Retrieves offset of record by doing a table scan for the specified record
-//		id.  Returns the offset in the data file.  Use GetRecord to actually
-//		retrieve the record data.
+//      Position cursor by offset amount (skip next n records).  Deleted slots
+//		of a stable-slot table are not counted.
 //
-//	Inputs:
-//		id == IN: Record id to find
+//  Inputs:
+//		cSkip	== IN:	Count of records to skip
 //
 //  Returns:
-//      Disk offset
+//      New cursor position
 // --------------------------------------------------------------------------------
-UINT CDbTable::FindRecordOffset
+DBPOS CDbTable::Move
 (
-	DBRECID id
+	UINT cSkip
 )
 {
-	RESULT		result	= SUCCESS;
-	UINT		cbRead	= 0;
-	UINT		idx		= m_pTableInfo->Offset;
-	DbRecord	record;
-
-	TRACE_INIT("CDbTable::FindRecord");
+	return MoveFrom(&m_idxSlot, GetSnapshot(), cSkip);
+}
 
-	FILEOFFSET idxEnd = m_pTableInfo->Offset + (m_pTableInfo->Size * m_pTableInfo->Entries);
-	while(idx < idxEnd)
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::MoveFrom
+//
+//  Description:
+//      Move for a cursor: skip the next n records from a position, as a
+//		snapshot sees them (see Move)
+//
+//  Inputs:
+//		pidxSlot	== IN/OUT:	Cursor position
+//		pSnapshot	== IN:		Snapshot (NULL for the current table)
+//		cSkip		== IN:		Count of records to skip
+//
+//  Returns:
+//      New cursor position
+// --------------------------------------------------------------------------------
+DBPOS CDbTable::MoveFrom
+(
+	DBPOS*				pidxSlot,
+	const DbSnapshot*	pSnapshot,
+	UINT				cSkip
+)
+{
+	if (!IsStable())
 	{
-		// Position to next record
-		m_pFile->Seek(idx);
+		*pidxSlot = min(*pidxSlot + cSkip, GetEnd(pSnapshot));
+		return *pidxSlot;
+	}
+
+	UINT			cPerRead = DB_DEFAULT_REC_BUFFER_SIZE;
+	vector<BYTE>	rgBuffer(cPerRead * m_pTableInfo->Size);
 
-		// Read record
-		cbRead = m_pFile->Read(&record, sizeof(record));
+	while (cSkip > 0 && *pidxSlot < GetEnd(pSnapshot))
+	{
+		UINT cRead = ReadVisible(pSnapshot, *pidxSlot, &rgBuffer[0], min(cPerRead, GetEnd(pSnapshot) - *pidxSlot));
 
-		if (record.RID == id)
+		if (cRead == 0)
 		{
-			return idx;
+			break;
 		}
 
-		idx += m_pTableInfo->Size;
+		for (UINT idx = 0; idx < cRead && cSkip > 0; idx++)
+		{
+			if (((const DbRecord*) &rgBuffer[idx * m_pTableInfo->Size])->RID != 0)
+			{
+				cSkip--;
+			}
+
+			(*pidxSlot)++;
+		}
+	}
+
+	return *pidxSlot;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::OpenCursor
+//
+//  Description:
+//      Create a cursor over the table.  Each cursor has its own position,
+//		read-ahead buffer and snapshot, so one table object can serve many
+//		threads reading at once, each through its own cursor.  The cursor
+//		keeps the table object alive.
+//
+//  Inputs:
+//		fSnapshot == IN: Open a snapshot for the cursor
+//
+//  Returns:
+//      Pointer to the cursor object
+// --------------------------------------------------------------------------------
+CDbCursor* CDbTable::OpenCursor
+(
+	bool fSnapshot
+)
+{
+	return new CDbCursor(this, fSnapshot);
+}
+
+// ================================================================================
+// MODIFICATION
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::Insert
+//
+//  Description:
+//      Insert new records to table.  A stable-slot table fills deleted slots
+//		before appending.
+//
+//	Inputs:
+//		prgRecords == IN: New record collection
+//		cRecords == IN: Count of new records
+//
+//  Returns:
+//      Count of inserted records
+// --------------------------------------------------------------------------------
+UINT CDbTable::Insert
+(
+	DbRecord*	prgRecords,
+	UINT		cRecords
+)
+{
+	UINT			cWritten = 0;
+	vector<DBPOS>	rgSlots(cRecords);
+
+	TRACE_INIT("CDbTable::Insert");
+
+	m_pdbFile->BeginWrite();
+
+	try
+	{
+		MoveFirst();
+
+		UINT cReuse = IsStable() ? min(cRecords, m_pTableInfo->Deleted) : 0;
+
+		// Test to see if there is room in the table data area
+		while ((m_pTableInfo->Entries + cRecords - cReuse) > m_pTableInfo->Slots)
+		{
+			// OVERFLOW -- move table to a new data area
+			m_pdbFile->ExpandTable(m_pTableInfo->Name);
+		}
+
+		// Set row id's
+		for (UINT idx = 0; idx < cRecords; idx++)
+		{
+			DbRecord* pRecord = (DbRecord*) ((BYTE*) prgRecords + (idx * m_pTableInfo->Size));
+			m_pTableInfo->LastRecordId += 1;
+			pRecord->RID = m_pTableInfo->LastRecordId;
+		}
+
+		// Fill deleted slots
+		for (UINT idx = 0; idx < cReuse; idx++)
+		{
+			DBPOS idxSlot = m_pTableInfo->FreeSlot;
+
+			ReadSlots(idxSlot, m_pBuffer, 1);
+
+			m_pTableInfo->FreeSlot = ((DbFreeSlot*) m_pBuffer)->Next;
+			m_pTableInfo->Deleted--;
+
+			cWritten += WriteSlots(idxSlot, (BYTE*) prgRecords + (idx * m_pTableInfo->Size), 1);
+			rgSlots[idx] = idxSlot;
+		}
+
+		// Calculate row position
+		DBPOS idxFirst = m_pTableInfo->Entries;
+
+		for (UINT idx = cReuse; idx < cRecords; idx++)
+		{
+			rgSlots[idx] = idxFirst + (idx - cReuse);
+		}
+
+		// Append rows to the file; readers see them once they are written
+		cWritten += WriteSlots(idxFirst, (BYTE*) prgRecords + (cReuse * m_pTableInfo->Size), cRecords - cReuse);
+		SetEntries(idxFirst + (cRecords - cReuse));
+
+		// Add rows to the table indexes
+		vector<CDbIndexPtr> rgIndexes;
+		m_pdbFile->GetIndexes(m_pTableInfo->Id, rgIndexes);
+
+		for (UINT idx = 0; idx < cRecords; idx++)
+		{
+			DbRecord* pRecord = (DbRecord*) ((BYTE*) prgRecords + (idx * m_pTableInfo->Size));
+
+			for (UINT iidx = 0; iidx < rgIndexes.size(); iidx++)
+			{
+				rgIndexes[iidx]->Insert(rgIndexes[iidx]->GetKey(pRecord), rgSlots[idx]);
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_pdbFile->EndWrite(false);
+		throw;
+	}
+
+	m_pdbFile->EndWrite(true);
+	return cWritten;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::Update
+//
+//  Description:
+//      Update existing records.  All record ids are resolved in one pass and
+//		the records are written in file order.
+//
+//	Inputs:
+//		prgRecords == IN: Updated record collection
+//		cRecords   == IN: Count of updated records
+//
+//  Returns:
+//      Count of updated records
+// --------------------------------------------------------------------------------
+UINT CDbTable::Update
+(
+	DbRecord*	prgRecords,
+	UINT		cRecords
+)
+{
+	UINT				cUpdated = 0;
+	vector<CDbIndexPtr>	rgIndexes;
+	vector<DbSlotRef>	rgSlots;
+
+	TRACE_INIT("CDbTable::Update");
+
+	m_pdbFile->BeginWrite();
+
+	try
+	{
+		MoveFirst();
+
+		// Record ids never change, so only secondary indexes need maintenance
+		m_pdbFile->GetIndexes(m_pTableInfo->Id, rgIndexes);
+
+		for (UINT iidx = 0; iidx < rgIndexes.size(); )
+		{
+			if (rgIndexes[iidx]->GetFlags() & DB_INDEX_RID)
+			{
+				rgIndexes.erase(rgIndexes.begin() + iidx);
+			}
+			else
+			{
+				iidx++;
+			}
+		}
+
+		ResolveSlots(prgRecords, cRecords, rgSlots);
+	
+		// Update the records in file order
+		for (UINT idx = 0; idx < rgSlots.size(); idx++)
+		{
+			DBPOS		idxSlot	= rgSlots[idx].first;
+			DbRecord*	pRecord	= (DbRecord*) ((BYTE*) prgRecords + (rgSlots[idx].second * m_pTableInfo->Size));
+
+			// Re-key indexes whose column changed
+			if (!rgIndexes.empty())
+			{
+				UINT cRead = ReadSlots(idxSlot, m_pBuffer, 1);
+				_ASSERTE(cRead == 1);
+
+				for (UINT iidx = 0; iidx < rgIndexes.size(); iidx++)
+				{
+					CDbIndex* pIndex = rgIndexes[iidx];
+
+					if (memcmp(pIndex->GetKey(m_pBuffer), pIndex->GetKey(pRecord), pIndex->GetKeySize()) != 0)
+					{
+						pIndex->Remove(pIndex->GetKey(m_pBuffer), idxSlot);
+						pIndex->Insert(pIndex->GetKey(pRecord), idxSlot);
+					}
+				}
+			}
+
+			UINT cWritten = WriteSlots(idxSlot, pRecord, 1);
+			_ASSERTE(cWritten == 1);
+			cUpdated++;
+		}
+	}
+	catch ( ... )
+	{
+		m_pdbFile->EndWrite(false);
+		throw;
+	}
+
+	m_pdbFile->EndWrite(true);
+	return cUpdated;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::Delete
+//
+//  Description:
+//      Remove records from the table.  Copies last record in the table to the
+//		slots vacated by the deleted records.  All record ids are resolved in
+//		one pass; slots are vacated from the end of the table down so a record
+//		still to be deleted is never the one moved.  A stable-slot table moves
+//		nothing: the slot is marked deleted and put on the free slot list.
+//
+//	Inputs:
+//		prgRecords == IN: Records to delete (can be ID's only)
+//		cRecords   == IN: Count of records to delete
+//
+//  Returns:
+//      Count of deleted records
+// --------------------------------------------------------------------------------
+UINT CDbTable::Delete
+(
+	DbRecord*	prgRecords,
+	UINT		cRecords
+)
+{
+	UINT				cDeleted = 0;
+	vector<CDbIndexPtr>	rgIndexes;
+	vector<BYTE>		rgDeleted(m_cbBuffer);
+	vector<DbSlotRef>	rgSlots;
+		
+	TRACE_INIT("CDbTable::DeleteRecord");
+
+	m_pdbFile->BeginWrite();
+
+	try
+	{
+		MoveFirst();
+		m_pdbFile->GetIndexes(m_pTableInfo->Id, rgIndexes);
+
+		ResolveSlots(prgRecords, cRecords, rgSlots);
+
+		for (UINT idx = rgSlots.size(); idx-- > 0; )
+		{
+			DBPOS idxDel = rgSlots[idx].first;
+
+			// Same record listed more than once
+			if (idx > 0 && rgSlots[idx - 1].first == idxDel)
+			{
+				continue;
+			}
+
+			// Remove deleted record from the indexes
+			UINT cRead = ReadSlots(idxDel, &rgDeleted[0], 1);
+			_ASSERTE(cRead == 1);
+
+			for (UINT iidx = 0; iidx < rgIndexes.size(); iidx++)
+			{
+				CDbIndex* pIndex = rgIndexes[iidx];
+				pIndex->Remove(pIndex->GetKey((DbRecord*) &rgDeleted[0]), idxDel);
+			}
+
+			// Mark the slot deleted and make it the head of the free slot list
+			if (IsStable())
+			{
+				DbFreeSlot* pSlot = (DbFreeSlot*) &rgDeleted[0];
+
+				pSlot->RID	= 0;
+				pSlot->Next	= m_pTableInfo->FreeSlot;
+
+				UINT cWritten = WriteSlots(idxDel, pSlot, 1);
+				_ASSERTE(cWritten == 1);
+
+				m_pTableInfo->FreeSlot = idxDel;
+				m_pTableInfo->Deleted++;
+				cDeleted++;
+				continue;
+			}
+
+			// Find record to move
+			DBPOS idxMove = m_pTableInfo->Entries - 1;
+
+			// Copy record
+			cRead = ReadSlots(idxMove, m_pBuffer, 1);
+			_ASSERTE(cRead == 1);
+
+			// Moved record now lives in the vacated slot
+			if (idxMove != idxDel)
+			{
+				for (UINT iidx = 0; iidx < rgIndexes.size(); iidx++)
+				{
+					CDbIndex* pIndex = rgIndexes[iidx];
+					pIndex->Remove(pIndex->GetKey(m_pBuffer), idxMove);
+					pIndex->Insert(pIndex->GetKey(m_pBuffer), idxDel);
+				}
+			}
+
+			// Write record into empty slot
+			UINT cWritten = WriteSlots(idxDel, m_pBuffer, 1);
+			_ASSERTE(cWritten == 1);
+
+			// Clear slot for old record
+			memset(m_pBuffer, 0, m_cbBuffer);
+			cWritten = WriteSlots(idxMove, m_pBuffer, 1);
+			_ASSERTE(cWritten == 1);
+
+			// Update table metadata
+			SetEntries(idxMove);
+			cDeleted++;
+		}
+	}
+	catch ( ... )
+	{
+		m_pdbFile->EndWrite(false);
+		throw;
+	}
+
+	m_pdbFile->EndWrite(true);
+	return cDeleted;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ResolveSlots
+//
+//  Description:
+//      Find the slots of a batch of records.  Each record id is probed in the
+//		RID index; tables without one are read once from start to end and every
+//		record is matched against the sorted batch.
+//
+//	Inputs:
+//		prgRecords	== IN:	Records to find
+//		cRecords	== IN:	Count of records
+//		rgSlots		== OUT:	(slot, batch position) of each record found, in
+//							slot order
+// --------------------------------------------------------------------------------
+void CDbTable::ResolveSlots
+(
+	const DbRecord*		prgRecords,
+	UINT				cRecords,
+	vector<DbSlotRef>&	rgSlots
+)
+{
+	TRACE_INIT("CDbTable::ResolveSlots");
+
+	rgSlots.clear();
+	rgSlots.reserve(cRecords);
+
+	CDbIndex* pIndex = m_pdbFile->GetRidIndex(m_pTableInfo->Id);
+
+	if (pIndex)
+	{
+		for (UINT idx = 0; idx < cRecords; idx++)
+		{
+			const DbRecord* pRecord = (const DbRecord*) ((const BYTE*) prgRecords + (idx * m_pTableInfo->Size));
+			DBPOS			idxSlot;
+
+			if (pIndex->Find((const BYTE*) &pRecord->RID, &idxSlot))
+			{
+				rgSlots.push_back(DbSlotRef(idxSlot, idx));
+			}
+		}
+	}
+	else
+	{
+		// Sorted (record id, batch position) pairs
+		vector< pair<DBRECID, UINT> > rgIds(cRecords);
+
+		for (UINT idx = 0; idx < cRecords; idx++)
+		{
+			const DbRecord* pRecord = (const DbRecord*) ((const BYTE*) prgRecords + (idx * m_pTableInfo->Size));
+			rgIds[idx] = pair<DBRECID, UINT>(pRecord->RID, idx);
+		}
+
+		sort(rgIds.begin(), rgIds.end());
+
+		// Read the table in blocks of records
+		UINT			cPerRead = DB_DEFAULT_REC_BUFFER_SIZE;
+		vector<BYTE>	rgBuffer(cPerRead * m_pTableInfo->Size);
+
+		for (DBPOS idxSlot = 0; idxSlot < m_pTableInfo->Entries; idxSlot += cPerRead)
+		{
+			UINT cRead = min(cPerRead, m_pTableInfo->Entries - idxSlot);
+
+			ReadSlots(idxSlot, &rgBuffer[0], cRead);
+
+			for (UINT idx = 0; idx < cRead; idx++)
+			{
+				DBRECID id = ((const DbRecord*) &rgBuffer[idx * m_pTableInfo->Size])->RID;
+
+				// Deleted slot of a stable-slot table
+				if (id == 0)
+				{
+					continue;
+				}
+
+				vector< pair<DBRECID, UINT> >::iterator it =
+					lower_bound(rgIds.begin(), rgIds.end(), pair<DBRECID, UINT>(id, 0));
+
+				for ( ; it != rgIds.end() && it->first == id; it++)
+				{
+					rgSlots.push_back(DbSlotRef(idxSlot + idx, it->second));
+				}
+			}
+		}
+	}
+
+	// Apply changes in file order
+	sort(rgSlots.begin(), rgSlots.end());
+}
+
+// ================================================================================
+// SNAPSHOTS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::OpenSnapshot
+//
+//  Description:
+//      Take a snapshot of the table for the cursor.  Until it is closed, reads
+//		see only the changes committed before it was taken, and writers are
+//		never held up by it.  A snapshot already open is replaced.  The cursor
+//		position is kept.
+// --------------------------------------------------------------------------------
+void CDbTable::OpenSnapshot()
+{
+	TRACE_INIT("CDbTable::OpenSnapshot");
+
+	CloseSnapshot();
+	BeginSnapshot(&m_snapshot);
+
+	m_fSnapshot = true;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::CloseSnapshot
+//
+//  Description:
+//      Close the open snapshot (if any); reads see the current table again
+// --------------------------------------------------------------------------------
+void CDbTable::CloseSnapshot()
+{
+	if (m_fSnapshot)
+	{
+		m_fSnapshot = false;
+		EndSnapshot(&m_snapshot);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::BeginSnapshot
+//
+//  Description:
+//      Take a snapshot of the table for a cursor
+//
+//  Inputs:
+//		pSnapshot == OUT: Snapshot
+// --------------------------------------------------------------------------------
+void CDbTable::BeginSnapshot
+(
+	DbSnapshot* pSnapshot
+)
+{
+	pSnapshot->Timestamp = m_pdbFile->BeginSnapshot(m_pTableInfo, &pSnapshot->End);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::EndSnapshot
+//
+//  Description:
+//      Release a snapshot taken by BeginSnapshot
+//
+//  Inputs:
+//		pSnapshot == IN: Snapshot
+// --------------------------------------------------------------------------------
+void CDbTable::EndSnapshot
+(
+	const DbSnapshot* pSnapshot
+)
+{
+	m_pdbFile->EndSnapshot(pSnapshot->Timestamp);
+}
+
+// ================================================================================
+// PROPERTIES
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::GetRecordCount
+//
+//  Description:
+//      Count of records in the table
+// --------------------------------------------------------------------------------
+UINT CDbTable::GetRecordCount()
+{
+	return m_pTableInfo->Entries - m_pTableInfo->Deleted;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::GetSlotCount
+//
+//  Description:
+//      Count of slots allocated to the table
+// --------------------------------------------------------------------------------
+UINT CDbTable::GetSlotCount()
+{
+	return m_pTableInfo->Slots;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::GetFreeSlotCount
+//
+//  Description:
+//      Count of slots an insert can fill without growing the table
+// --------------------------------------------------------------------------------
+UINT CDbTable::GetFreeSlotCount()
+{
+	return m_pTableInfo->Slots - m_pTableInfo->Entries + m_pTableInfo->Deleted;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::GetSlotOffset
+//
+//  Description:
+//      Locate a slot of the table in the file
+//
+//	Inputs:
+//		idxSlot	== IN:	Table slot
+//		pcRun	== OUT:	Count of contiguous slots from idxSlot (optional)
+//
+//  Returns:
+//      Disk offset
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbTable::GetSlotOffset
+(
+	DBPOS	idxSlot,
+	UINT*	pcRun
+)
+{
+	return m_pdbFile->GetSlotOffset(m_pTableInfo, idxSlot, pcRun);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ReadSlots
+//
+//  Description:
+//      Read consecutive slots through the page cache.  The slots may span
+//		several extents; each contiguous run is read with one request.  The
+//		columns of a PAX table are read by CDbFile::ReadColumns.
+//
+//	Inputs:
+//		idxSlot		== IN:	First slot
+//		pBuffer		== OUT:	Record buffer
+//		cRecords	== IN:	Count of slots
+//		fColumns	== IN:	Columns to read (PAX table only)
+//
+//  Returns:
+//      Count of records read
+// --------------------------------------------------------------------------------
+UINT CDbTable::ReadSlots
+(
+	DBPOS	idxSlot,
+	void*	pBuffer,
+	UINT	cRecords,
+	UINT	fColumns
+)
+{
+	UINT cbRead = 0;
+
+	if (IsPax())
+	{
+		return m_pdbFile->ReadColumns(m_pTableInfo, idxSlot, pBuffer, cRecords, fColumns);
+	}
+
+	for (UINT cDone = 0; cDone < cRecords; )
+	{
+		UINT		cRun	= 0;
+		FILEOFFSET	offset	= GetSlotOffset(idxSlot + cDone, &cRun);
+		UINT		cbRun	= min(cRun, cRecords - cDone) * m_pTableInfo->Size;
+
+		UINT cbDone = m_pBufferMgr->Read(offset, (BYTE*) pBuffer + cbRead, cbRun);
+		cbRead += cbDone;
+
+		if (cbDone != cbRun)
+		{
+			break;
+		}
+
+		cDone += cbRun / m_pTableInfo->Size;
+	}
+
+	return cbRead / m_pTableInfo->Size;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ReadVisible
+//
+//  Description:
+//      Read consecutive slots as a snapshot sees them.  Without a snapshot
+//		this is ReadSlots.  In a snapshot, slots changed since it was taken are
+//		replaced by their saved images; slots a delete has since cut from the
+//		end of the table are read from the saved images alone.
+//
+//	Inputs:
+//		pSnapshot	== IN:	Snapshot (NULL for the current table)
+//		idxSlot		== IN:	First slot
+//		pBuffer		== OUT:	Record buffer
+//		cRecords	== IN:	Count of slots (within the snapshot)
+//		fColumns	== IN:	Columns to read (PAX table only)
+//
+//  Returns:
+//      Count of records read
+// --------------------------------------------------------------------------------
+UINT CDbTable::ReadVisible
+(
+	const DbSnapshot*	pSnapshot,
+	DBPOS				idxSlot,
+	void*				pBuffer,
+	UINT				cRecords,
+	UINT				fColumns
+)
+{
+	if (!pSnapshot)
+	{
+		return ReadSlots(idxSlot, pBuffer, cRecords, fColumns);
+	}
+
+	// A change may be moving the end of the table
+	DBPOS	idxEntries	= GetEntries();
+	UINT	cCurrent	= (idxSlot < idxEntries) ? min(cRecords, idxEntries - idxSlot) : 0;
+
+	if (cCurrent > 0)
+	{
+		cCurrent = ReadSlots(idxSlot, pBuffer, cCurrent, fColumns);
+	}
+
+	memset((BYTE*) pBuffer + (cCurrent * m_pTableInfo->Size), 0, (cRecords - cCurrent) * m_pTableInfo->Size);
+
+	// Images are read after the slots, so a slot changed meanwhile is replaced
+	m_pdbFile->m_pVersions->Apply(m_pTableInfo->Id, idxSlot, pBuffer, cRecords, m_pTableInfo->Size, pSnapshot->Timestamp);
+
+	return cRecords;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::WriteSlots
+//
+//  Description:
+//      Write consecutive slots through the page cache.  The slots may span
+//		several extents; each contiguous run is written with one request.  The
+//		columns of a PAX table are written by CDbFile::WriteColumns.  While
+//		any snapshot of the file is open the replaced images are saved first.
+//		Caller must be inside a change (see CDbFile::BeginWrite).
+//
+//	Inputs:
+//		idxSlot		== IN:	First slot
+//		pBuffer		== IN:	Record buffer
+//		cRecords	== IN:	Count of slots
+//
+//  Returns:
+//      Count of records written
+// --------------------------------------------------------------------------------
+UINT CDbTable::WriteSlots
+(
+	DBPOS		idxSlot,
+	const void*	pBuffer,
+	UINT		cRecords
+)
+{
+	UINT cbWritten = 0;
+
+	if (cRecords == 0)
+	{
+		return 0;
+	}
+
+	// Keep the images open snapshots still see
+	if (m_pdbFile->m_pVersions->HasSnapshots())
+	{
+		vector<BYTE>	rgBefore(cRecords * m_pTableInfo->Size);
+		UINT			cRead = ReadSlots(idxSlot, &rgBefore[0], cRecords);
+
+		m_pdbFile->m_pVersions->Save(m_pTableInfo->Id, idxSlot, &rgBefore[0], cRead,
+									 m_pTableInfo->Size, m_pdbFile->GetWriteTimestamp());
+	}
+
+	if (IsPax())
+	{
+		return m_pdbFile->WriteColumns(m_pTableInfo, idxSlot, pBuffer, cRecords);
+	}
+
+	for (UINT cDone = 0; cDone < cRecords; )
+	{
+		UINT		cRun	= 0;
+		FILEOFFSET	offset	= GetSlotOffset(idxSlot + cDone, &cRun);
+		UINT		cbRun	= min(cRun, cRecords - cDone) * m_pTableInfo->Size;
+
+		cbWritten += m_pBufferMgr->Write(offset, (const BYTE*) pBuffer + cbWritten, cbRun);
+		cDone	  += cbRun / m_pTableInfo->Size;
+	}
+
+	return cbWritten / m_pTableInfo->Size;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::DropDeleted
+//
+//  Description:
+//      Remove the deleted slots of a stable-slot table from a record buffer.
+//		Records in use are moved to the front in order.
+//
+//	Inputs:
+//		pRecords	== IN/OUT:	Record buffer
+//		cRecords	== IN:		Count of slots in the buffer
+//
+//  Returns:
+//      Count of records left in the buffer
+// --------------------------------------------------------------------------------
+UINT CDbTable::DropDeleted
+(
+	void*	pRecords,
+	UINT	cRecords
+)
+{
+	BYTE*	pBuffer	= (BYTE*) pRecords;
+	UINT	cKept	= 0;
+
+	if (!IsStable())
+	{
+		return cRecords;
+	}
+
+	for (UINT idx = 0; idx < cRecords; idx++)
+	{
+		BYTE* pRecord = pBuffer + (idx * m_pTableInfo->Size);
+
+		if (((const DbRecord*) pRecord)->RID == 0)
+		{
+			continue;
+		}
+
+		if (cKept != idx)
+		{
+			memcpy(pBuffer + (cKept * m_pTableInfo->Size), pRecord, m_pTableInfo->Size);
+		}
+
+		cKept++;
+	}
+
+	return cKept;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ReadBlock
+//
+//  Description:
+//      Read a block of records for a scan.  Records of a file opened for
+//		mapped access are used in place; a block then ends at the end of a
+//		table extent.  Records are read as a snapshot sees them.  The cursor
+//		is not used, so parallel scan workers and cursors share this method.
+//
+//	Inputs:
+//		pSnapshot	== IN:	Snapshot (NULL for the current table)
+//		idxSlot		== IN:	First slot
+//		cRecords	== IN:	Most records to read
+//		fColumns	== IN:	Columns to read (PAX table only)
+//		rgBuffer	== IN:	Buffer for records that are copied
+//		pcRecords	== OUT:	Count of records in the block
+//
+//  Returns:
+//      Pointer to the first record
+// --------------------------------------------------------------------------------
+const BYTE* CDbTable::ReadBlock
+(
+	const DbSnapshot*	pSnapshot,
+	DBPOS				idxSlot,
+	UINT				cRecords,
+	UINT				fColumns,
+	vector<BYTE>&		rgBuffer,
+	UINT*				pcRecords
+)
+{
+	if (m_pdbFile->IsMapped() && !IsPax() && !pSnapshot)
+	{
+		UINT		cRun	= 0;
+		FILEOFFSET	offset	= GetSlotOffset(idxSlot, &cRun);
+
+		*pcRecords = min(cRecords, cRun);
+		return m_pdbFile->GetView(offset, *pcRecords * m_pTableInfo->Size);
+	}
+
+	rgBuffer.resize(cRecords * m_pTableInfo->Size);
+
+	*pcRecords = ReadVisible(pSnapshot, idxSlot, &rgBuffer[0], cRecords, fColumns);
+	return &rgBuffer[0];
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::RunScan
+//
+//  Description:
+//      Run a parallel scan.  The morsels are shared out, the workers submitted
+//		to the shared thread pool and the calling thread works as worker zero
+//		until every morsel is done.
+//
+//	Inputs:
+//		pTask		== IN:	Scan with its consumer or predicate set
+//		cThreads	== IN:	Count of worker threads (zero for one per processor)
+//
+//  Returns:
+//      Count of records scanned or found
+// --------------------------------------------------------------------------------
+UINT CDbTable::RunScan
+(
+	ScanTask*	pTask,
+	UINT		cThreads
+)
+{
+	UINT cMorsels = (GetEnd(pTask->Snapshot) + DB_SCAN_MORSEL - 1) / DB_SCAN_MORSEL;
+
+	if (cThreads == 0)
+	{
+		cThreads = CThreadPool::GetDefault()->GetWorkerCount();
+	}
+
+	cThreads = max(1U, min(cThreads, cMorsels));
+
+	pTask->Table	= this;
+	pTask->Entries	= GetEnd(pTask->Snapshot);
+	pTask->Found	= 0;
+	pTask->Failed	= false;
+
+	pTask->Results.resize(pTask->Predicate ? cMorsels : 0);
+	pTask->Ranges.resize(cThreads);
+
+	// Each worker starts with a contiguous share
+	for (UINT idx = 0; idx < cThreads; idx++)
+	{
+		pTask->Ranges[idx].Next	= (cMorsels * idx) / cThreads;
+		pTask->Ranges[idx].End	= (cMorsels * (idx + 1)) / cThreads;
+	}
+
+	vector<ScanWorker>	rgWorkers(cThreads);
+	vector<CTask*>		rgTasks;
+	CThreadPool*		pPool = CThreadPool::GetDefault();
+
+	for (UINT idx = 0; idx < cThreads; idx++)
+	{
+		rgWorkers[idx].Task		= pTask;
+		rgWorkers[idx].Index	= idx;
+	}
+
+	if (pTask->Consumer)
+	{
+		pTask->Consumer->Start(cThreads);
+	}
+
+	// Mapped records are used in place until every worker is done
+	m_pdbFile->BeginView();
+
+	try
+	{
+		for (UINT idx = 1; idx < cThreads; idx++)
+		{
+			rgTasks.push_back(new CTask(ScanWorkerTask, &rgWorkers[idx]));
+			pPool->Submit(rgTasks.back());
+		}
+	}
+	catch ( ... )
+	{
+		// The submitted workers steal the morsels of the rest
+	}
+
+	// This thread works too
+	ScanWorkerTask(&rgWorkers[0]);
+
+	// Failures are recorded in the scan, so the tasks cannot throw
+	for (UINT idx = 0; idx < rgTasks.size(); idx++)
+	{
+		delete rgTasks[idx];
+	}
+
+	m_pdbFile->EndView();
+
+	if (pTask->Failed)
+	{
+		throw runtime_error("Parallel scan failed");
+	}
+
+	return pTask->Found;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::TakeMorsel
+//
+//  Description:
+//      Take the next morsel of a worker's share, or steal the last morsel of
+//		the largest share left when its own is done
+//
+//	Inputs:
+//		pTask		== IN:	Shared scan
+//		idxWorker	== IN:	Worker index
+//		pidxMorsel	== OUT:	Morsel to scan
+//
+//  Returns:
+//      false when no morsels are left
+// --------------------------------------------------------------------------------
+bool CDbTable::TakeMorsel
+(
+	ScanTask*	pTask,
+	UINT		idxWorker,
+	UINT*		pidxMorsel
+)
+{
+	bool fTaken = false;
+
+	pTask->Lock.Lock();
+
+	ScanRange& rOwn = pTask->Ranges[idxWorker];
+
+	if (pTask->Failed)
+	{
+		// Drop the remaining morsels
+	}
+	else if (rOwn.Next < rOwn.End)
+	{
+		*pidxMorsel	= rOwn.Next++;
+		fTaken		= true;
+	}
+	else
+	{
+		UINT idxVictim	= idxWorker;
+		UINT cLeft		= 0;
+
+		for (UINT idx = 0; idx < pTask->Ranges.size(); idx++)
+		{
+			if (pTask->Ranges[idx].End - pTask->Ranges[idx].Next > cLeft)
+			{
+				idxVictim	= idx;
+				cLeft		= pTask->Ranges[idx].End - pTask->Ranges[idx].Next;
+			}
+		}
+
+		if (cLeft > 0)
+		{
+			*pidxMorsel	= --pTask->Ranges[idxVictim].End;
+			fTaken		= true;
+		}
+	}
+
+	pTask->Lock.Unlock();
+	return fTaken;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ScanWorkerTask
+//
+//  Description:
+//      Parallel scan worker.  Scans morsels until none are left or a worker
+//		fails.
+//
+//  Inputs:
+//      pArg == IN: Scan worker
+// --------------------------------------------------------------------------------
+void CDbTable::ScanWorkerTask
+(
+	void* pArg
+)
+{
+	ScanWorker*	pWorker	= (ScanWorker*) pArg;
+	ScanTask*	pTask	= pWorker->Task;
+	CDbScan*	pScan	= NULL;
+	UINT		idxMorsel;
+
+	try
+	{
+		if (pTask->Predicate)
+		{
+			pScan = new CDbScan(*pTask->Predicate, pTask->Table->m_pTableInfo->Size);
+		}
+
+		while (TakeMorsel(pTask, pWorker->Index, &idxMorsel))
+		{
+			pTask->Table->ScanMorsel(pTask, pWorker->Index, idxMorsel, pScan);
+		}
+	}
+	catch ( ... )
+	{
+		pTask->Lock.Lock();
+		pTask->Failed = true;
+		pTask->Lock.Unlock();
+	}
+
+	delete pScan;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::ScanMorsel
+//
+//  Description:
+//      Scan the slots of one morsel a block at a time.  The records go to the
+//		consumer, or the slots of the matching records to the morsel's
+//		selection vector.
+//
+//	Inputs:
+//		pTask		== IN:	Shared scan
+//		idxWorker	== IN:	Worker index
+//		idxMorsel	== IN:	Morsel to scan
+//		pScan		== IN:	Predicate evaluator of the worker (selection scan)
+// --------------------------------------------------------------------------------
+void CDbTable::ScanMorsel
+(
+	ScanTask*	pTask,
+	UINT		idxWorker,
+	UINT		idxMorsel,
+	CDbScan*	pScan
+)
+{
+	DBPOS			idxSlot		= idxMorsel * DB_SCAN_MORSEL;
+	DBPOS			idxEnd		= min(idxSlot + DB_SCAN_MORSEL, pTask->Entries);
+	UINT			fColumns	= DB_ALL_COLUMNS;
+	UINT			cFound		= 0;
+	vector<BYTE>	rgBuffer;
+	vector<UINT>	rgSelect(DB_SCAN_ROWS);
+
+	if (pScan)
+	{
+		fColumns = GetColumnMask(pScan->GetPredicate().Offset, sizeof(UINT)) | 1;
+	}
+
+	while (idxSlot < idxEnd)
+	{
+		UINT		cRead		= 0;
+		const BYTE*	pRecords	= ReadBlock(pTask->Snapshot, idxSlot, min(DB_SCAN_ROWS, idxEnd - idxSlot), fColumns, rgBuffer, &cRead);
+
+		if (cRead == 0)
+		{
+			throw runtime_error("Table data truncated");
+		}
+
+		if (pScan)
+		{
+			vector<DBPOS>&	rgSlots		= pTask->Results[idxMorsel];
+			UINT			cSelected	= pScan->Select(pRecords, cRead, &rgSelect[0]);
+
+			for (UINT idx = 0; idx < cSelected; idx++)
+			{
+				// Deleted slot of a stable-slot table
+				if (((const DbRecord*) (pRecords + (rgSelect[idx] * m_pTableInfo->Size)))->RID != 0)
+				{
+					rgSlots.push_back(idxSlot + rgSelect[idx]);
+				}
+			}
+		}
+		else
+		{
+			UINT cRecords = cRead;
+
+			if (IsStable())
+			{
+				// Mapped records are copied before deleted slots are dropped
+				if (rgBuffer.empty() || pRecords != &rgBuffer[0])
+				{
+					rgBuffer.assign(pRecords, pRecords + (cRead * m_pTableInfo->Size));
+				}
+
+				cRecords = DropDeleted(&rgBuffer[0], cRead);
+				pRecords = &rgBuffer[0];
+			}
+
+			if (cRecords > 0)
+			{
+				pTask->Consumer->Consume(idxWorker, (const DbRecord*) pRecords, cRecords);
+			}
+
+			cFound += cRecords;
+		}
+
+		idxSlot += cRead;
+	}
+
+	if (pScan)
+	{
+		cFound = pTask->Results[idxMorsel].size();
+	}
+
+	pTask->Lock.Lock();
+	pTask->Found += cFound;
+	pTask->Lock.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::GetColumnMask
+//
+//  Description:
+//      Columns of a PAX table that hold part of a field
+//
+//	Inputs:
+//		offField	== IN: Offset of the field in the record
+//		cbField		== IN: Field width (bytes)
+//
+//  Returns:
+//      Column mask (every column for other tables)
+// --------------------------------------------------------------------------------
+UINT CDbTable::GetColumnMask
+(
+	UINT offField,
+	UINT cbField
+)
+{
+	UINT fColumns = 0;
+
+	if (!IsPax())
+	{
+		return DB_ALL_COLUMNS;
+	}
+
+	for (UINT idx = 0; idx < m_pTableInfo->Columns; idx++)
+	{
+		UINT offEnd = (idx + 1 < m_pTableInfo->Columns) ?
+							m_pTableInfo->ColumnOffset[idx + 1] : m_pTableInfo->Size;
+
+		if (m_pTableInfo->ColumnOffset[idx] < offField + cbField && offEnd > offField)
+		{
+			fColumns |= 1U << idx;
+		}
+	}
+
+	return fColumns;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::FindRecordOffset
+//
+//  Description:
+//      Retrieves offset of record with the specified record id.  Returns the
+//		offset in the data file.  Use GetRecord to actually retrieve the record
+//		data.
+//
+//	Inputs:
+//		id == IN: Record id to find
+//
+//  Returns:
+//      Disk offset; 0 if not found
+// --------------------------------------------------------------------------------
+FILEOFFSET CDbTable::FindRecordOffset
+(
+	DBRECID id
+)
+{
+	DBPOS idxSlot = FindRecordSlot(id);
+
+	if (idxSlot == DB_INVALID_POS)
+	{
+		return 0;
+	}
+
+	return GetSlotOffset(idxSlot);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbTable::FindRecordSlot
+//
+//  Description:
+//      Retrieves slot of record with the specified record id.  Uses the RID
+//		index of the table; tables without one are scanned.
+//
+//	Inputs:
+//		id == IN: Record id to find
+//
+//  Returns:
+//      Table slot; DB_INVALID_POS if not found
+// --------------------------------------------------------------------------------
+DBPOS CDbTable::FindRecordSlot
+(
+	DBRECID id
+)
+{
+	DBPOS idxSlot = DB_INVALID_POS;
+
+	TRACE_INIT("CDbTable::FindRecordSlot");
+
+	CDbIndex* pIndex = m_pdbFile->GetRidIndex(m_pTableInfo->Id);
+
+	if (pIndex)
+	{
+		if (!pIndex->Find((const BYTE*) &id, &idxSlot))
+		{
+			idxSlot = DB_INVALID_POS;
+		}
+
+		return idxSlot;
+	}
+
+	for (DBPOS idx = 0; idx < m_pTableInfo->Entries; idx++)
+	{
+		// Read the record id column
+		ReadSlots(idx, m_pBuffer, 1, 1);
+
+		if (m_pBuffer->RID == id && id != 0)
+		{
+			return idx;
+		}
 	}
 
-	return 0;
+	return DB_INVALID_POS;
 }
 
 
@@ -17,13 +17,12 @@
 #ifndef __DBTABLE_H__
 #define __DBTABLE_H__
 
-// --------------------------------------------------------------------------------
-//	TYPEDEFS
-// --------------------------------------------------------------------------------
-typedef UINT DBPOS;
-
 class CDbRecord;
 class CDbFile;
+class CDbCursor;
+
+// Slot of a record and its position in a batch
+typedef pair<DBPOS, UINT> DbSlotRef;
 
 // ================================================================================
 // Class:
@@ -31,7 +30,20 @@ class CDbFile;
 //
 //  Description:
 //      Database table object.  Defines interface to table and access methods to
-//		retrieve records.
+//		retrieve records.  Deleting from a table fills the hole with the last
+//		record; a stable-slot table (DB_TABLE_STABLE) instead leaves a deleted
+//		slot that a later insert reuses, so records never change position.  A
+//		PAX table (DB_TABLE_PAX) can fetch a subset of its columns without
+//		reading the others.  Scan filters the table by a predicate a block of
+//		records at a time (see CDbScan); ParallelScan spreads a full table pass
+//		over worker threads.
+//
+//		While a snapshot is open (OpenSnapshot), Fetch, Move and Scan see the
+//		table as it was when the snapshot was taken; changes made meanwhile by
+//		this or other table objects stay hidden until the snapshot is closed.
+//
+//		The table object's own cursor is not thread-safe.  Threads reading the
+//		same table at once each open a cursor (OpenCursor) on one table object.
 // ================================================================================
 class CDbTable : public CObject
 {
@@ -47,15 +59,23 @@ public:
 	// ----------------------------------------------------------------------------
 
 	DBPOS Find(DBRECID id);
-	UINT  Fetch(DbRecord* prgRecords, UINT cRecords);
+	DBPOS Seek(UINT idIndex, const void* pKey);
+	UINT  Fetch(DbRecord* prgRecords, UINT cRecords, UINT fColumns = DB_ALL_COLUMNS);
+	UINT  FetchView(const DbRecord** pprgRecords, UINT cRecords);
+	UINT  Scan(const DbPredicate& predicate, DbRecord* prgRecords, UINT cRecords);
+	UINT  Scan(const DbPredicate& predicate, vector<DBPOS>& rgSlots);
+	UINT  ParallelScan(CDbScanConsumer* pConsumer, UINT cThreads = 0);
+	UINT  ParallelScan(const DbPredicate& predicate, vector<DBPOS>& rgSlots, UINT cThreads = 0);
 
 	DBPOS Move(UINT cSkip);
 	void  MoveFirst()						{ m_idxSlot = 0; }
-	void  MoveLast()						{ m_idxSlot = m_pTableInfo->Entries; }
+	void  MoveLast()						{ m_idxSlot = GetEnd(GetSnapshot()); }
 
 	void  SetPosition(DBPOS idxSlot)		{ m_idxSlot = idxSlot; }
 	DBPOS GetPosition()						{ return m_idxSlot; }
 
+	CDbCursor* OpenCursor(bool fSnapshot = false);
+
 	// ----------------------------------------------------------------------------
 	// MODIFICATION
 	// ----------------------------------------------------------------------------
@@ -64,11 +84,21 @@ public:
 	UINT Update(DbRecord* prgRecords, UINT cRecords = 1);
 	UINT Delete(DbRecord* prgRecords, UINT cRecords = 1);
 
+	// ----------------------------------------------------------------------------
+	// SNAPSHOTS
+	// ----------------------------------------------------------------------------
+
+	void OpenSnapshot();
+	void CloseSnapshot();
+	bool HasSnapshot()								{ return m_fSnapshot; }
+
     // ----------------------------------------------------------------------------
     // PROPERTIES
     // ----------------------------------------------------------------------------
     
-	bool IsEOF()									{ return m_pFile->IsEOF(); }
+	bool IsEOF()									{ return m_idxSlot >= GetEnd(GetSnapshot()); }
+	bool IsStable()									{ return (m_pTableInfo->Flags & DB_TABLE_STABLE) != 0; }
+	bool IsPax()									{ return (m_pTableInfo->Flags & DB_TABLE_PAX) != 0; }
 
 	UINT GetRecordCount();
 	UINT GetSlotCount();
@@ -79,18 +109,84 @@ public:
 private:
 	DbTableInfo*	GetTableInfo()						{ return m_pTableInfo; }
 	void			SetTableInfo(DbTableInfo* pTblInfo)	{ m_pTableInfo = pTblInfo; }
+	FILEOFFSET		GetSlotOffset(DBPOS idxSlot, UINT* pcRun = NULL);
+	const DbSnapshot*	GetSnapshot()					{ return m_fSnapshot ? &m_snapshot : NULL; }
+	DBPOS			GetEnd(const DbSnapshot* pSnapshot)	{ return pSnapshot ? pSnapshot->End : GetEntries(); }
+	DBPOS			GetEntries()						{ return (DBPOS) AtomicLoad((volatile LONG*) &m_pTableInfo->Entries); }
+	void			SetEntries(DBPOS idxEnd)			{ AtomicStore((volatile LONG*) &m_pTableInfo->Entries, (LONG) idxEnd); }
+	void			BeginSnapshot(DbSnapshot* pSnapshot);
+	void			EndSnapshot(const DbSnapshot* pSnapshot);
+	DBTS			GetCommitTimestamp()				{ return m_pdbFile->GetCommitTimestamp(); }
+	void			BeginView()							{ m_pdbFile->BeginView(); }
+	void			EndView()							{ m_pdbFile->EndView(); }
+	UINT			FetchFrom(DBPOS* pidxSlot, const DbSnapshot* pSnapshot, DbRecord* prgRecords, UINT cRecords, UINT fColumns);
+	UINT			ScanFrom(DBPOS* pidxSlot, const DbSnapshot* pSnapshot, const DbPredicate& predicate, DbRecord* prgRecords, UINT cRecords);
+	UINT			ScanFrom(DBPOS* pidxSlot, const DbSnapshot* pSnapshot, const DbPredicate& predicate, vector<DBPOS>& rgSlots);
+	DBPOS			MoveFrom(DBPOS* pidxSlot, const DbSnapshot* pSnapshot, UINT cSkip);
+	UINT			ReadSlots(DBPOS idxSlot, void* pBuffer, UINT cRecords, UINT fColumns = DB_ALL_COLUMNS);
+	UINT			ReadVisible(const DbSnapshot* pSnapshot, DBPOS idxSlot, void* pBuffer, UINT cRecords, UINT fColumns = DB_ALL_COLUMNS);
+	UINT			WriteSlots(DBPOS idxSlot, const void* pBuffer, UINT cRecords);
+	UINT			DropDeleted(void* pRecords, UINT cRecords);
+	const BYTE*		ReadBlock(const DbSnapshot* pSnapshot, DBPOS idxSlot, UINT cRecords, UINT fColumns, vector<BYTE>& rgBuffer, UINT* pcRecords);
+	UINT			GetColumnMask(UINT offField, UINT cbField);
 	FILEOFFSET		FindRecordOffset(DBRECID id);
+	DBPOS			FindRecordSlot(DBRECID id);
+	void			ResolveSlots(const DbRecord* prgRecords, UINT cRecords, vector<DbSlotRef>& rgSlots);
+
+	// ----------------------------------------------------------------------------
+	//	Morsels owned by a parallel scan worker
+	// ----------------------------------------------------------------------------
+	struct ScanRange
+	{
+		UINT		Next;			// Next morsel to take from the front
+		UINT		End;			// End of the range; thieves take from here
+	};
+
+	// ----------------------------------------------------------------------------
+	//	Parallel scan shared by the workers
+	// ----------------------------------------------------------------------------
+	struct ScanTask
+	{
+		CMutex				Lock;		// Access lock
+		CDbTable*			Table;		// Table scanned
+		const DbSnapshot*	Snapshot;	// Snapshot scanned (NULL for the current table)
+		CDbScanConsumer*	Consumer;	// Record consumer (record scan)
+		const DbPredicate*	Predicate;	// Predicate (selection scan)
+		DBPOS				Entries;	// End of the slots scanned
+		vector<ScanRange>	Ranges;		// Morsels of each worker
+		vector< vector<DBPOS> >	Results;	// Selection vector of each morsel
+		UINT				Found;		// Count of records found
+		bool				Failed;		// A worker failed; remaining morsels are dropped
+	};
+
+	// ----------------------------------------------------------------------------
+	//	Parallel scan worker
+	// ----------------------------------------------------------------------------
+	struct ScanWorker
+	{
+		ScanTask*	Task;			// Shared scan
+		UINT		Index;			// Worker index
+	};
+
+	UINT			RunScan(ScanTask* pTask, UINT cThreads);
+	void			ScanMorsel(ScanTask* pTask, UINT idxWorker, UINT idxMorsel, CDbScan* pScan);
+
+	static bool		TakeMorsel(ScanTask* pTask, UINT idxWorker, UINT* pidxMorsel);
+	static void		ScanWorkerTask(void* pArg);
 
 private:
 	CDbFilePtr		m_pdbFile;			// Pointer to data file
-	CFilePtr		m_pFile;			// Pointer to disk file
+	CDbBufferManagerPtr	m_pBufferMgr;	// Pointer to file page cache
 	DbTableInfo*	m_pTableInfo;		// Table metadata
 	DBPOS			m_idxSlot;			// Current cursor slot
+	bool			m_fSnapshot;		// A snapshot is open
+	DbSnapshot		m_snapshot;			// The open snapshot
 
 	DbRecord*		m_pBuffer;			// Record handling buffer
 	UINT			m_cbBuffer;			// Record handler buffer size
 
 	friend class CDbFile;
+	friend class CDbCursor;
 };
 
 #endif // __DBTABLE_H__
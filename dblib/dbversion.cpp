@@ -0,0 +1,306 @@
+// ================================================================================
+//
+//	File:
+//      dbversion.cpp
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Record version store implementation
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "db.h"
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::CDbVersionStore
+//
+//  Description:
+//      Default constructor
+// --------------------------------------------------------------------------------
+CDbVersionStore::CDbVersionStore()
+{
+	TRACE_INIT("CDbVersionStore::CDbVersionStore");
+
+	m_cVersions = 0;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::~CDbVersionStore
+//
+//  Description:
+//      Default destructor
+// --------------------------------------------------------------------------------
+CDbVersionStore::~CDbVersionStore()
+{
+	TRACE_INIT("CDbVersionStore::~CDbVersionStore");
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::AddSnapshot
+//
+//  Description:
+//      Register an open snapshot.  Images saved after its timestamp are kept
+//		until it is removed.
+//
+//  Inputs:
+//      ts == IN: Snapshot timestamp (last change the snapshot sees)
+// --------------------------------------------------------------------------------
+void CDbVersionStore::AddSnapshot
+(
+	DBTS ts
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		m_setSnapshots.insert(ts);
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::RemoveSnapshot
+//
+//  Description:
+//      Unregister a snapshot and drop the images no open snapshot can see
+//
+//  Inputs:
+//      ts == IN: Snapshot timestamp
+// --------------------------------------------------------------------------------
+void CDbVersionStore::RemoveSnapshot
+(
+	DBTS ts
+)
+{
+	m_mutex.Lock();
+
+	multiset<DBTS>::iterator it = m_setSnapshots.find(ts);
+
+	if (it != m_setSnapshots.end())
+	{
+		m_setSnapshots.erase(it);
+		Collect();
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::HasSnapshots
+//
+//  Description:
+//      Check for open snapshots
+//
+//  Returns:
+//      true if a change must save the images it replaces
+// --------------------------------------------------------------------------------
+bool CDbVersionStore::HasSnapshots()
+{
+	m_mutex.Lock();
+	bool fSnapshots = !m_setSnapshots.empty();
+	m_mutex.Unlock();
+
+	return fSnapshots;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::Save
+//
+//  Description:
+//      Save the images of consecutive slots before a change overwrites them.
+//		A slot changed more than once by one change keeps only the image it
+//		had before the change.  Nothing is saved while no snapshot is open.
+//
+//  Inputs:
+//      idTable		== IN: Table id
+//		idxSlot		== IN: First slot
+//		pRecords	== IN: Current slot images
+//		cRecords	== IN: Count of slots
+//		cbRecord	== IN: Slot size
+//		ts			== IN: Timestamp the change commits at
+// --------------------------------------------------------------------------------
+void CDbVersionStore::Save
+(
+	UINT		idTable,
+	DBPOS		idxSlot,
+	const void*	pRecords,
+	UINT		cRecords,
+	UINT		cbRecord,
+	DBTS		ts
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		for (UINT idx = 0; idx < cRecords && !m_setSnapshots.empty(); idx++)
+		{
+			DbVersionList& rgVersions = m_mapVersions[DbSlotKey(idTable, idxSlot + idx)];
+
+			if (!rgVersions.empty() && rgVersions.back().Timestamp == ts)
+			{
+				continue;
+			}
+
+			const BYTE* pImage = (const BYTE*) pRecords + (idx * cbRecord);
+
+			rgVersions.push_back(Version());
+			rgVersions.back().Timestamp = ts;
+			rgVersions.back().Image.assign(pImage, pImage + cbRecord);
+			m_cVersions++;
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::Apply
+//
+//  Description:
+//      Turn current slot images into the images a snapshot sees.  Each slot
+//		changed since the snapshot was taken is replaced by the oldest image
+//		saved after it.
+//
+//  Inputs:
+//      idTable		== IN:		Table id
+//		idxSlot		== IN:		First slot
+//		pRecords	== IN/OUT:	Slot images
+//		cRecords	== IN:		Count of slots
+//		cbRecord	== IN:		Slot size
+//		ts			== IN:		Snapshot timestamp
+// --------------------------------------------------------------------------------
+void CDbVersionStore::Apply
+(
+	UINT	idTable,
+	DBPOS	idxSlot,
+	void*	pRecords,
+	UINT	cRecords,
+	UINT	cbRecord,
+	DBTS	ts
+)
+{
+	m_mutex.Lock();
+
+	map<DbSlotKey, DbVersionList>::iterator it	= m_mapVersions.lower_bound(DbSlotKey(idTable, idxSlot));
+	map<DbSlotKey, DbVersionList>::iterator end	= m_mapVersions.lower_bound(DbSlotKey(idTable, idxSlot + cRecords));
+
+	for ( ; it != end; it++)
+	{
+		const DbVersionList& rgVersions = it->second;
+
+		for (UINT idx = 0; idx < rgVersions.size(); idx++)
+		{
+			if (rgVersions[idx].Timestamp > ts)
+			{
+				memcpy((BYTE*) pRecords + ((it->first.second - idxSlot) * cbRecord), &rgVersions[idx].Image[0], cbRecord);
+				break;
+			}
+		}
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::Clear
+//
+//  Description:
+//      Drop every saved image (the file they belong to was closed)
+// --------------------------------------------------------------------------------
+void CDbVersionStore::Clear()
+{
+	m_mutex.Lock();
+
+	m_mapVersions.clear();
+	m_cVersions = 0;
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::GetVersionCount
+//
+//  Description:
+//      Count of saved images
+// --------------------------------------------------------------------------------
+UINT CDbVersionStore::GetVersionCount()
+{
+	m_mutex.Lock();
+	UINT cVersions = m_cVersions;
+	m_mutex.Unlock();
+
+	return cVersions;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDbVersionStore::Collect
+//
+//  Description:
+//      Drop the images no open snapshot can see.  An image saved at timestamp
+//		T is seen only by snapshots older than T.  Caller holds the lock.
+// --------------------------------------------------------------------------------
+void CDbVersionStore::Collect()
+{
+	if (m_setSnapshots.empty())
+	{
+		m_mapVersions.clear();
+		m_cVersions = 0;
+		return;
+	}
+
+	DBTS tsOldest = *m_setSnapshots.begin();
+
+	map<DbSlotKey, DbVersionList>::iterator it = m_mapVersions.begin();
+
+	while (it != m_mapVersions.end())
+	{
+		DbVersionList&	rgVersions	= it->second;
+		UINT			cDrop		= 0;
+
+		// Images are in timestamp order
+		while (cDrop < rgVersions.size() && rgVersions[cDrop].Timestamp <= tsOldest)
+		{
+			cDrop++;
+		}
+
+		rgVersions.erase(rgVersions.begin(), rgVersions.begin() + cDrop);
+		m_cVersions -= cDrop;
+
+		if (rgVersions.empty())
+		{
+			m_mapVersions.erase(it++);
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
@@ -0,0 +1,90 @@
+// ================================================================================
+//
+//	File:
+//      dbversion.h
+//
+//	Component:
+//      Database Engine
+//
+//	Description:
+//      Record version store definition
+//
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DBVERSION_H__
+#define __DBVERSION_H__
+
+// Commit timestamp - count of changes committed since the file object was created
+typedef UINT DBTS;
+
+// --------------------------------------------------------------------------------
+//	Snapshot a table is read in
+// --------------------------------------------------------------------------------
+struct DbSnapshot
+{
+	DBTS	Timestamp;		// Last change the snapshot sees
+	DBPOS	End;			// End of the table slots the snapshot sees
+};
+
+// ================================================================================
+// Class:
+//      CDbVersionStore
+//
+//  Description:
+//      Undo images of table slots kept for open snapshots.  Before a change
+//		overwrites a slot, the slot's image is saved with the timestamp the
+//		change will commit at.  A snapshot taken at timestamp S sees, for each
+//		slot, the oldest image saved after S; slots with no such image are
+//		unchanged since S.  Images no open snapshot can see are dropped when a
+//		snapshot ends, and none are saved while no snapshot is open.  The
+//		store lives in memory only.
+// ================================================================================
+class CDbVersionStore : public CObject
+{
+public:
+	CDbVersionStore();
+	~CDbVersionStore();
+
+	// ----------------------------------------------------------------------------
+	//	SNAPSHOTS
+	// ----------------------------------------------------------------------------
+
+	void	AddSnapshot(DBTS ts);
+	void	RemoveSnapshot(DBTS ts);
+	bool	HasSnapshots();
+
+	// ----------------------------------------------------------------------------
+	//	VERSIONS
+	// ----------------------------------------------------------------------------
+
+	void	Save(UINT idTable, DBPOS idxSlot, const void* pRecords, UINT cRecords, UINT cbRecord, DBTS ts);
+	void	Apply(UINT idTable, DBPOS idxSlot, void* pRecords, UINT cRecords, UINT cbRecord, DBTS ts);
+	void	Clear();
+	UINT	GetVersionCount();
+
+private:
+	void	Collect();
+
+	// ----------------------------------------------------------------------------
+	//	Image of a slot before a change
+	// ----------------------------------------------------------------------------
+	struct Version
+	{
+		DBTS			Timestamp;	// Commit timestamp of the change that replaced it
+		vector<BYTE>	Image;		// Slot contents
+	};
+
+	typedef pair<UINT, DBPOS>	DbSlotKey;		// (table id, slot)
+	typedef vector<Version>		DbVersionList;	// Oldest first
+
+private:
+	CMutex							m_mutex;		// Access lock
+	multiset<DBTS>					m_setSnapshots;	// Timestamps of the open snapshots
+	map<DbSlotKey, DbVersionList>	m_mapVersions;	// Saved images of each slot
+	UINT							m_cVersions;	// Count of saved images
+};
+
+#endif // __DBVERSION_H__
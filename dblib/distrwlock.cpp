@@ -0,0 +1,207 @@
+// ================================================================================
+//
+//	File:
+//      distrwlock.cpp
+//
+//	Component:
+//      Photon System
+//
+//	Description:
+//      Reader/Writer lock with distributed reader counts implementation
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "sys.h"
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::CDistRWLock
+//
+//  Description:
+//      Constructor
+// --------------------------------------------------------------------------------
+CDistRWLock::CDistRWLock()
+{
+	memset((void*) m_rgReaders, 0, sizeof(m_rgReaders));
+
+	m_fWriter		= 0;
+	m_cBlocked		= 0;
+	m_idWriter		= 0;
+	m_cWriteDepth	= 0;
+
+	m_evNoWriter.Set();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::ReadLock
+//
+//  Description:
+//      Acquire read lock.  The reader counts itself in first and then looks
+//		for a writer; a writer raises its flag first and then looks for
+//		readers, so at least one of the two always sees the other.
+// --------------------------------------------------------------------------------
+void CDistRWLock::ReadLock()
+{
+	UINT idThread = CThread::GetCurrentId();
+
+	// The writer reads through its own lock
+	if ((UINT) AtomicLoad(&m_idWriter) == idThread)
+	{
+		m_cWriteDepth++;
+		return;
+	}
+
+	volatile LONG*	plCount		= GetReaderCount(idThread);
+	bool			fBlocked	= false;
+
+	while (true)
+	{
+		AtomicIncrement(plCount);
+
+		if (AtomicLoad(&m_fWriter) == 0)
+		{
+			break;
+		}
+
+		// Back out and wait for the writer to finish
+		ReleaseReader(plCount);
+
+		if (!fBlocked)
+		{
+			AtomicIncrement(&m_cBlocked);
+			fBlocked = true;
+		}
+
+		m_evNoWriter.Wait();
+	}
+
+	// The next writer waits for every turned away reader to get in
+	if (fBlocked && AtomicDecrement(&m_cBlocked) == 0)
+	{
+		m_evDrained.Set();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::WriteLock
+//
+//  Description:
+//      Acquire exclusive write lock.  Writers queue on a mutex; each lets in
+//		the readers its predecessor turned away before raising the writer flag,
+//		then waits for the readers holding the lock to leave.
+// --------------------------------------------------------------------------------
+void CDistRWLock::WriteLock()
+{
+	UINT idThread = CThread::GetCurrentId();
+
+	if ((UINT) AtomicLoad(&m_idWriter) == idThread)
+	{
+		m_cWriteDepth++;
+		return;
+	}
+
+	m_mutexWriters.Lock();
+
+	WaitForZero(&m_cBlocked);
+
+	m_evNoWriter.Reset();
+	AtomicStore(&m_fWriter, 1);
+
+	for (UINT idx = 0; idx < RWLOCK_READER_SLOTS; idx++)
+	{
+		WaitForZero(&m_rgReaders[idx].Count);
+	}
+
+	AtomicStore(&m_idWriter, (LONG) idThread);
+	m_cWriteDepth = 1;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::Unlock
+//
+//  Description:
+//      Release lock (reader or writer)
+// --------------------------------------------------------------------------------
+void CDistRWLock::Unlock()
+{
+	UINT idThread = CThread::GetCurrentId();
+
+	if ((UINT) AtomicLoad(&m_idWriter) != idThread)
+	{
+		ReleaseReader(GetReaderCount(idThread));
+		return;
+	}
+
+	if (--m_cWriteDepth > 0)
+	{
+		return;
+	}
+
+	AtomicStore(&m_idWriter, 0);
+	AtomicStore(&m_fWriter, 0);
+	m_evNoWriter.Set();
+
+	m_mutexWriters.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::ReleaseReader
+//
+//  Description:
+//      Take a reader out of its count.  The reader that empties a count while
+//		a writer is draining the readers wakes the writer.  The writer raises
+//		its flag before it reads the counts, so either it sees the count at
+//		zero or the reader sees the flag.
+//
+//  Inputs:
+//		plCount == IN: Reader count
+// --------------------------------------------------------------------------------
+void CDistRWLock::ReleaseReader
+(
+	volatile LONG* plCount
+)
+{
+	if (AtomicDecrement(plCount) == 0 && AtomicLoad(&m_fWriter) != 0)
+	{
+		m_evDrained.Set();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::WaitForZero
+//
+//  Description:
+//      Sleep until a count the writer waits on reaches zero.  The event is
+//		reset before the count is read, so a wake-up after the read is never
+//		lost.
+//
+//  Inputs:
+//		plCount == IN: Count of readers or of turned away readers
+// --------------------------------------------------------------------------------
+void CDistRWLock::WaitForZero
+(
+	volatile LONG* plCount
+)
+{
+	while (true)
+	{
+		m_evDrained.Reset();
+
+		if (AtomicLoad(plCount) == 0)
+		{
+			break;
+		}
+
+		m_evDrained.Wait();
+	}
+}
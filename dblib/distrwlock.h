@@ -0,0 +1,111 @@
+// ================================================================================
+//
+//	File:
+//      distrwlock.h
+//
+//	Component:
+//      Photon System
+//
+//	Description:
+//      Reader/Writer lock with distributed reader counts
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __DISTRWLOCK_H__
+#define __DISTRWLOCK_H__
+
+#include "types.h"
+#include "atomic.h"
+#include "mutex.h"
+#include "event.h"
+
+// --------------------------------------------------------------------------------
+//	Constants
+// --------------------------------------------------------------------------------
+const UINT RWLOCK_READER_SLOTS	= 64;		// Reader counts
+const UINT RWLOCK_CACHE_LINE	= 64;		// Bytes each reader count occupies
+
+// ================================================================================
+//  Class:
+//      CDistRWLock
+//
+//  Description:
+//      Reader/writer lock for read-mostly data; a drop-in for CRWLock.  Each
+//		reader counts itself in one of several cache-line sized slots chosen
+//		by its thread id, so readers on different processors do not write to
+//		a shared word.  A writer raises the writer flag, which turns new readers
+//		away, and sleeps until every slot drains; the reader that empties a
+//		slot wakes it.  Readers turned away by one writer get in before the
+//		next writer starts, so neither side starves.
+//
+//		The writer may take the lock again (read or write) while it holds it;
+//		a reader must not.
+// ================================================================================
+class CDistRWLock
+{
+public:
+	CDistRWLock();
+	void ReadLock();
+	void WriteLock();
+	void Unlock();
+
+private:
+	CDistRWLock(const CDistRWLock&);
+	CDistRWLock& operator=(const CDistRWLock&);
+
+	volatile LONG* GetReaderCount(UINT idThread);
+	void ReleaseReader(volatile LONG* plCount);
+	void WaitForZero(volatile LONG* plCount);
+
+	// ----------------------------------------------------------------------------
+	//	Reader count padded to its own cache line
+	// ----------------------------------------------------------------------------
+	struct ReaderSlot
+	{
+		volatile LONG	Count;										// Readers holding the lock
+		BYTE			Pad[RWLOCK_CACHE_LINE - sizeof(LONG)];		// Unused
+	};
+
+private:
+	ReaderSlot		m_rgReaders[RWLOCK_READER_SLOTS];	// Reader counts
+	volatile LONG	m_fWriter;			// A writer holds or is draining the readers
+	volatile LONG	m_cBlocked;			// Readers turned away by the writer flag
+	volatile LONG	m_idWriter;			// Thread holding the write lock (0 for none)
+	UINT			m_cWriteDepth;		// Times the writer holds the lock
+	CMutex			m_mutexWriters;		// Queues the writers
+	CEvent			m_evNoWriter;		// Set while no writer holds the lock
+	CEvent			m_evDrained;		// Set when a count the writer waits on reaches zero
+};
+
+// ================================================================================
+//	INLINE FUNCTIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CDistRWLock::GetReaderCount
+//
+//  Description:
+//      Reader count used by a thread
+//
+//  Inputs:
+//		idThread == IN: Thread id
+//
+//  Returns:
+//      Pointer to the count
+// --------------------------------------------------------------------------------
+inline volatile LONG* CDistRWLock::GetReaderCount
+(
+	UINT idThread
+)
+{
+	// Spread neighbouring thread ids across the slots
+	return &m_rgReaders[((idThread * 2654435761U) >> 16) % RWLOCK_READER_SLOTS].Count;
+}
+
+#endif // __DISTRWLOCK_H__
@@ -18,6 +18,79 @@
 
 #include "sys.h"
 
+#if defined (__LINUX__)
+// Event state word
+const UINT EVENT_SIGNALED	= 0x00000001;	// Event is set
+const UINT EVENT_WAITERS	= 0x00000002;	// Threads may be sleeping on the word
+const UINT EVENT_GENERATION	= 0x00000004;	// Added by each Set and Signal
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      WaitEvent
+//
+//  Description:
+//      Wait until the event is set or signaled.  The waiters flag is raised
+//		before sleeping; Set and Signal clear it and wake every sleeper, and
+//		those still waiting raise it again.
+//
+//  Inputs:
+//		puiState	== IN: Event state word
+//		ptsLimit	== IN: Absolute time limit (NULL for none)
+//
+//  Returns:
+//      true if the event was set or signaled; false on time out
+// --------------------------------------------------------------------------------
+static bool WaitEvent
+(
+	UINT*					puiState,
+	const struct timespec*	ptsLimit
+)
+{
+	UINT uiState = __atomic_load_n(puiState, __ATOMIC_ACQUIRE);
+
+	if (uiState & EVENT_SIGNALED)
+	{
+		return true;
+	}
+
+	// Any Set or Signal changes the generation
+	UINT uiGeneration = uiState & ~(EVENT_SIGNALED | EVENT_WAITERS);
+
+	while (true)
+	{
+		if (!(uiState & EVENT_WAITERS))
+		{
+			if (!__atomic_compare_exchange_n(puiState, &uiState, uiState | EVENT_WAITERS,
+											 false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			{
+				if ((uiState & ~(EVENT_SIGNALED | EVENT_WAITERS)) != uiGeneration)
+				{
+					return true;
+				}
+
+				continue;
+			}
+
+			uiState |= EVENT_WAITERS;
+		}
+
+		bool fTimedOut = !FutexWait(puiState, uiState, ptsLimit);
+
+		uiState = __atomic_load_n(puiState, __ATOMIC_ACQUIRE);
+
+		if ((uiState & ~(EVENT_SIGNALED | EVENT_WAITERS)) != uiGeneration)
+		{
+			return true;
+		}
+
+		if (fTimedOut)
+		{
+			return false;
+		}
+	}
+}
+#endif
+
 // --------------------------------------------------------------------------------
 //  Method:
 //      CEvent::CEvent
@@ -30,7 +103,7 @@ CEvent::CEvent()
 #if defined (__WIN32__)
 	m_hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 #elif defined (__LINUX__)
-
+	m_uiState = 0;
 #endif
 }
 
@@ -45,8 +118,6 @@ CEvent::~CEvent()
 {
 #if defined (__WIN32__)
 	CloseHandle(m_hEvent);
-#elif defined (__LINUX__)
-
 #endif
 }
 
@@ -63,7 +134,22 @@ void CEvent::Set()
 #if defined (__WIN32__)
 	SetEvent(m_hEvent);
 #elif defined (__LINUX__)
+	UINT uiState = __atomic_load_n(&m_uiState, __ATOMIC_RELAXED);
+
+	do
+	{
+		if (uiState & EVENT_SIGNALED)
+		{
+			return;
+		}
+	}
+	while (!__atomic_compare_exchange_n(&m_uiState, &uiState, ((uiState + EVENT_GENERATION) | EVENT_SIGNALED) & ~EVENT_WAITERS,
+										true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 
+	if (uiState & EVENT_WAITERS)
+	{
+		FutexWake(&m_uiState, INT_MAX);
+	}
 #endif
 }
 	
@@ -79,7 +165,7 @@ void CEvent::Reset()
 #if defined (__WIN32__)
 	ResetEvent(m_hEvent);
 #elif defined (__LINUX__)
-
+	__atomic_and_fetch(&m_uiState, ~EVENT_SIGNALED, __ATOMIC_RELAXED);
 #endif
 }
 
@@ -95,7 +181,17 @@ void CEvent::Signal()
 #if defined (__WIN32__)
 	PulseEvent(m_hEvent);
 #elif defined (__LINUX__)
+	UINT uiState = __atomic_load_n(&m_uiState, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&m_uiState, &uiState, (uiState + EVENT_GENERATION) & ~(EVENT_SIGNALED | EVENT_WAITERS),
+										true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+	}
 
+	if (uiState & EVENT_WAITERS)
+	{
+		FutexWake(&m_uiState, INT_MAX);
+	}
 #endif
 }
 
@@ -111,7 +207,39 @@ void CEvent::Wait()
 #if defined (__WIN32__)
 	WaitForSingleObject(m_hEvent, INFINITE);
 #elif defined (__LINUX__)
-
+	WaitEvent(&m_uiState, NULL);
 #endif
 }
 
+// --------------------------------------------------------------------------------
+//  Method:
+//      CEvent::Wait
+//
+//  Description:
+//      Wait for event to be signaled or for a time limit to pass
+//
+//  Inputs:
+//		cMilliseconds == IN: Time limit
+//
+//  Returns:
+//		true if the event was signaled; false on time out
+// --------------------------------------------------------------------------------
+bool CEvent::Wait
+(
+	UINT cMilliseconds
+)
+{
+#if defined (__WIN32__)
+	return (WaitForSingleObject(m_hEvent, cMilliseconds) == WAIT_OBJECT_0);
+#elif defined (__LINUX__)
+	if (cMilliseconds == 0)
+	{
+		return (__atomic_load_n(&m_uiState, __ATOMIC_ACQUIRE) & EVENT_SIGNALED) != 0;
+	}
+
+	struct timespec tsLimit;
+
+	FutexLimit(cMilliseconds, &tsLimit);
+	return WaitEvent(&m_uiState, &tsLimit);
+#endif
+}
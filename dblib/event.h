@@ -24,7 +24,12 @@
 //      CEvent
 //
 //  Description:
-//      Event class.  Can be customized per platform
+//      Manual reset event.  Can be customized per platform.  On Linux the event
+//		is a single futex word holding the signaled state, a flag for sleeping
+//		waiters and a count of Set and Signal calls; a waiter sleeps until the
+//		count changes.  Set, Reset and Wait stay in user space unless a thread
+//		has to sleep or be woken, and Set touches nothing but the word, so a
+//		waiter may destroy the event as soon as it wakes.
 // ================================================================================
 class CEvent
 {
@@ -36,12 +41,13 @@ public:
 	void Reset();
 	void Signal();
 	void Wait();
+	bool Wait(UINT cMilliseconds);
 
 private:
 #if defined (__WIN32__)
 	HANDLE	m_hEvent;
 #elif defined (__LINUX__)
-
+	UINT	m_uiState;		// Futex word (see event.cpp)
 #endif
 };
 
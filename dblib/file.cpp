@@ -17,6 +17,7 @@
 #include "sys.h"
 #include "trace.h"
 #include "file.h"
+#include "ioring.h"
 
 // --------------------------------------------------------------------------------
 //  Method:
@@ -29,6 +30,9 @@ CFile::CFile(const string& strName)
 {
 	m_hFile		= NULL;
 	m_strFile	= strName;
+	m_pRing		= NULL;
+	m_fDirect	= false;
+	m_cbSize	= 0;
 }
 
 // --------------------------------------------------------------------------------
@@ -41,6 +45,8 @@ CFile::CFile(const string& strName)
 CFile::~CFile()
 {
 	Close();
+
+	delete m_pRing;
 }
 
 // --------------------------------------------------------------------------------
@@ -50,10 +56,16 @@ CFile::~CFile()
 //  Description:
 //      Create file for binary read/write
 //
+//	Inputs:
+//		fFlags == IN: FILE_DIRECT bypasses the system cache where supported
+//
 //	Exceptions:
 //		runtime_error == File already opened or file exists
 // --------------------------------------------------------------------------------
-void CFile::Create()
+void CFile::Create
+(
+	UINT fFlags
+)
 {
 	m_mutex.Lock();
 
@@ -69,12 +81,25 @@ void CFile::Create()
 			throw runtime_error("File already exists");
 		}
 
-		m_hFile = fopen(m_strFile.c_str(), "w+bc");
+		m_fDirect = false;
+
+		if (fFlags & FILE_DIRECT)
+		{
+			m_hFile	  = OpenDirect(true);
+			m_fDirect = (m_hFile != NULL);
+		}
+
+		if (!m_hFile)
+		{
+			m_hFile = fopen(m_strFile.c_str(), "w+bc");
+		}
 
 		if (!m_hFile)
 		{
 			throw runtime_error("File creation failed");
 		}
+
+		m_cbSize = 0;
 	}
 	catch ( ... )
 	{
@@ -90,12 +115,19 @@ void CFile::Create()
 //      CFile::Open
 //
 //  Description:
-//      Open file for binary read/write
+//      Open file for binary read/write.  A direct open falls back to a cached
+//		one on file systems without direct I/O; see IsDirect.
+//
+//	Inputs:
+//		fFlags == IN: FILE_DIRECT bypasses the system cache where supported
 //
 //	Exceptions:
 //		runtime_error == File already opened
 // --------------------------------------------------------------------------------
-void CFile::Open()
+void CFile::Open
+(
+	UINT fFlags
+)
 {
     TRACE_INIT("CFile::Open");
 
@@ -108,12 +140,39 @@ void CFile::Open()
 			throw runtime_error("File already open");
 		}
 
-		m_hFile = fopen(m_strFile.c_str(), "r+bc");
+		m_fDirect = false;
+
+		if (fFlags & FILE_DIRECT)
+		{
+			m_hFile	  = OpenDirect(false);
+			m_fDirect = (m_hFile != NULL);
+		}
+
+		if (!m_hFile)
+		{
+			m_hFile = fopen(m_strFile.c_str(), "r+bc");
+		}
 
 		if (!m_hFile)
 		{
 			throw runtime_error("File open failed");
 		}
+
+		// Size is tracked from here on so it is never queried again
+#if defined (__WIN32__)
+		m_cbSize = (UINT) _filelength(_fileno(m_hFile));
+#elif defined (__LINUX__)
+		struct stat st;
+
+		if (fstat(fileno(m_hFile), &st))
+		{
+			fclose(m_hFile);
+			m_hFile = NULL;
+			throw runtime_error("File size could not be read");
+		}
+
+		m_cbSize = (UINT) st.st_size;
+#endif
 	}
 	catch ( ... )
 	{
@@ -139,6 +198,12 @@ void CFile::Close()
 	{
 		if (m_hFile)
 		{
+			// Requests in flight still use the descriptor
+			if (m_pRing)
+			{
+				m_pRing->Drain();
+			}
+
 			fflush(m_hFile);
 			
 			if (fclose(m_hFile))
@@ -146,7 +211,8 @@ void CFile::Close()
 				throw runtime_error("File could not be closed");
 			}
 
-			m_hFile = NULL;
+			m_hFile	  = NULL;
+			m_fDirect = false;
 		}
 	}
 	catch( ... )
@@ -193,9 +259,8 @@ UINT CFile::Read
 			throw invalid_argument("Read buffer invalid");
 		}
 
-		// Read up to next cbLen bytes
+		// Read up to next cbLen bytes (short count at end of file)
 		cbRead =  (UINT) fread(pBuffer, 1, cbLen, m_hFile);
-		_ASSERTE(cbLen == cbRead);
 
 		if (ferror(m_hFile))
 		{
@@ -251,10 +316,18 @@ UINT CFile::Write
 		cbWritten = (UINT) fwrite(pBuffer, 1, cbLen, m_hFile);
 		_ASSERTE(cbLen == cbWritten);
 
+		// Keep the descriptor current for positional readers
+		fflush(m_hFile);
+
 		if (ferror(m_hFile))
 		{
 			throw runtime_error("Write failed");
 		}
+
+		if ((UINT) ftell(m_hFile) > m_cbSize)
+		{
+			m_cbSize = (UINT) ftell(m_hFile);
+		}
 	}
 	catch( ... )
 	{
@@ -304,120 +377,313 @@ void CFile::Seek
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CFile::Rename
+//      CFile::ReadAt
 //
 //  Description:
-//      Rename file to new name
+//      Read n bytes from an absolute file offset.  Does not use or move the
+//		shared stream position, so concurrent callers need no file lock.
 //
 //  Inputs:
-//		strName	== IN:	New filename
+//		position	== IN:	Absolute file offset
+//      pBuffer		== OUT: Output buffer
+//		cbLen		== IN:	Count of bytes to read
+//
+//	Returns:
+//		Count of bytes read (short count at end of file)
 //
 //  Exceptions:
-//      runtime_error == rename op failed
+//		invalid_argument == read buffer is invalid
+//		runtime_error	 == read fails
 // --------------------------------------------------------------------------------
-void CFile::Rename
+UINT CFile::ReadAt
 (
-	const string& strName
+	FILEOFFSET	position,
+	void*		pBuffer,
+	UINT		cbLen
 )
 {
-	m_mutex.Lock();
+	BYTE*	pOut	= (BYTE*) pBuffer;
+	UINT	cbRead	= 0;
 
-	try
+	if (!pBuffer)
 	{
-		if (rename(m_strFile.c_str(), strName.c_str()) != 0)
-		{
-			throw runtime_error("Rename operation failed");
-		}
+		throw invalid_argument("Read buffer invalid");
+	}
 
-		m_strFile = strName;
+	if (m_fDirect && !IsAligned(position, pBuffer, cbLen))
+	{
+		return ReadAtUnaligned(position, pBuffer, cbLen);
 	}
-	catch ( ... )
+
+	while (cbRead < cbLen)
 	{
-		m_mutex.Unlock();
-		throw;
+#if defined (__WIN32__)
+		HANDLE		hFile	= (HANDLE) _get_osfhandle(_fileno(m_hFile));
+		DWORD		cbDone	= 0;
+		OVERLAPPED	ov;
+
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = position + cbRead;
+
+		if (!ReadFile(hFile, pOut + cbRead, cbLen - cbRead, &cbDone, &ov))
+		{
+			if (GetLastError() != ERROR_HANDLE_EOF)
+			{
+				throw runtime_error("Read failed");
+			}
+
+			cbDone = 0;
+		}
+#elif defined (__LINUX__)
+		ssize_t cbDone = pread(fileno(m_hFile), pOut + cbRead, cbLen - cbRead, position + cbRead);
+
+		if (cbDone < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			throw runtime_error("Read failed");
+		}
+#endif
+		// End of file
+		if (cbDone == 0)
+		{
+			break;
+		}
+
+		cbRead += (UINT) cbDone;
+
+		// A short direct read ends at the end of file (the rest is unaligned)
+		if (m_fDirect && (cbDone % FILE_ALIGNMENT) != 0)
+		{
+			break;
+		}
 	}
 
-	m_mutex.Unlock();
+	return cbRead;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CFile::Delete
+//      CFile::WriteAt
 //
 //  Description:
-//      Delete file
+//      Write n bytes at an absolute file offset.  Does not use or move the
+//		shared stream position, so concurrent callers need no file lock.
+//
+//  Inputs:
+//		position	== IN:	Absolute file offset
+//      pBuffer		== IN:	Input buffer
+//		cbLen		== IN:	Count of bytes to write
 //
+//	Returns:
+//		Count of bytes written
+//
+//  Exceptions:
+//		invalid_argument == input buffer is invalid
+//		runtime_error	 == write fails
 // --------------------------------------------------------------------------------
-void CFile::Delete()
+UINT CFile::WriteAt
+(
+	FILEOFFSET	position,
+	const void*	pBuffer,
+	UINT		cbLen
+)
 {
-	m_mutex.Lock();
+	const BYTE*	pIn			= (const BYTE*) pBuffer;
+	UINT		cbWritten	= 0;
 
-	try
+	if (!pBuffer)
 	{
-		if (remove(m_strFile.c_str()) != 0)
+		throw invalid_argument("Input buffer invalid");
+	}
+
+	if (m_fDirect && !IsAligned(position, pBuffer, cbLen))
+	{
+		return WriteAtUnaligned(position, pBuffer, cbLen);
+	}
+
+	while (cbWritten < cbLen)
+	{
+#if defined (__WIN32__)
+		HANDLE		hFile	= (HANDLE) _get_osfhandle(_fileno(m_hFile));
+		DWORD		cbDone	= 0;
+		OVERLAPPED	ov;
+
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = position + cbWritten;
+
+		if (!WriteFile(hFile, pIn + cbWritten, cbLen - cbWritten, &cbDone, &ov))
 		{
-			throw runtime_error("Delete operation failed");
+			throw runtime_error("Write failed");
+		}
+#elif defined (__LINUX__)
+		ssize_t cbDone = pwrite(fileno(m_hFile), pIn + cbWritten, cbLen - cbWritten, position + cbWritten);
+
+		if (cbDone < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			throw runtime_error("Write failed");
 		}
+#endif
+		cbWritten += (UINT) cbDone;
 	}
-	catch ( ... )
+
+	if (position + cbWritten > m_cbSize)
 	{
-		m_mutex.Unlock();
-		throw;
+		SetEndOfFile(position + cbWritten);
 	}
 
-	m_mutex.Unlock();
+	return cbWritten;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CFile::Copy
+//      CFile::ReadAtAsync
 //
 //  Description:
-//      Copy to destination file
+//      Queue a read at an absolute file offset.  The buffer and count must stay
+//		valid until WaitAsync returns.  Without an asynchronous I/O queue the
+//		read completes before returning.
 //
 //  Inputs:
-//		pszName	== IN:	Destination file name
+//		position	== IN:	Absolute file offset
+//      pBuffer		== OUT: Output buffer
+//		cbLen		== IN:	Count of bytes to read
+//		pcbRead		== OUT: Count of bytes read, set on completion (optional)
 //
 //  Exceptions:
-//      runtime_error == Write to destination failed
+//		runtime_error == read fails (may be reported by WaitAsync)
 // --------------------------------------------------------------------------------
-void CFile::Copy
+void CFile::ReadAtAsync
 (
-	const string& strName
+	FILEOFFSET	position,
+	void*		pBuffer,
+	UINT		cbLen,
+	UINT*		pcbRead
 )
 {
-	m_mutex.Lock();
+	CIoRing* pRing = GetRing();
 
-	try
+	if (!pBuffer)
 	{
-		CFile	fileDest(strName);
-		auto_ptr<BYTE>	pBuffer(new BYTE[4096]);
+		throw invalid_argument("Read buffer invalid");
+	}
 
-		// Open destination stream
-		fileDest.Open();
+	if (pRing->IsAvailable() && !(m_fDirect && !IsAligned(position, pBuffer, cbLen)))
+	{
+		pRing->Read(fileno(m_hFile), position, pBuffer, cbLen, pcbRead);
+	}
+	else
+	{
+		UINT cbRead = ReadAt(position, pBuffer, cbLen);
 
-		if (!IsOpen())
+		if (pcbRead)
 		{
-			Open();
+			*pcbRead = cbRead;
 		}
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::WriteAtAsync
+//
+//  Description:
+//      Queue a write at an absolute file offset.  The buffer must stay valid
+//		until WaitAsync returns.  Without an asynchronous I/O queue the write
+//		completes before returning.
+//
+//  Inputs:
+//		position	== IN:	Absolute file offset
+//      pBuffer		== IN:	Input buffer
+//		cbLen		== IN:	Count of bytes to write
+//
+//  Exceptions:
+//		runtime_error == write fails (may be reported by WaitAsync)
+// --------------------------------------------------------------------------------
+void CFile::WriteAtAsync
+(
+	FILEOFFSET	position,
+	const void*	pBuffer,
+	UINT		cbLen
+)
+{
+	CIoRing* pRing = GetRing();
+
+	if (!pBuffer)
+	{
+		throw invalid_argument("Input buffer invalid");
+	}
 
-		// Seek read to beginning
-		Seek(0);
-		fileDest.Seek(0);
+	if (pRing->IsAvailable() && !(m_fDirect && !IsAligned(position, pBuffer, cbLen)))
+	{
+		pRing->Write(fileno(m_hFile), position, pBuffer, cbLen, NULL);
 
-		// Copy file in blocks
-		while (!IsEOF())
+		if (position + cbLen > m_cbSize)
 		{
-			// Read from source file
-			UINT cbRead = Read(pBuffer.get(), 4096);
+			SetEndOfFile(position + cbLen);
+		}
+	}
+	else
+	{
+		WriteAt(position, pBuffer, cbLen);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::WaitAsync
+//
+//  Description:
+//      Wait for every asynchronous request the calling thread queued to
+//		complete
+//
+//  Exceptions:
+//		runtime_error == a request of the calling thread failed
+// --------------------------------------------------------------------------------
+void CFile::WaitAsync()
+{
+	if (m_pRing)
+	{
+		m_pRing->Wait();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::GetRing
+//
+//  Description:
+//      Asynchronous I/O queue of the file, created on first use
+//
+//  Returns:
+//      Pointer to queue
+//
+//  Exceptions:
+//		runtime_error == file not open
+// --------------------------------------------------------------------------------
+CIoRing* CFile::GetRing()
+{
+	m_mutex.Lock();
 
-			// Output to destination file
-			UINT cbWritten = fileDest.Write(pBuffer.get(), cbRead);
-			_ASSERTE(cbRead == cbWritten);
+	try
+	{
+		if (!m_hFile)
+		{
+			throw runtime_error("File not open");
 		}
 
-		// Commit and close destination file
-		fileDest.Close();
+		if (!m_pRing)
+		{
+			m_pRing = new CIoRing();
+		}
 	}
 	catch ( ... )
 	{
@@ -426,102 +692,841 @@ void CFile::Copy
 	}
 
 	m_mutex.Unlock();
+	return m_pRing;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CFile::Expand
+//      CFile::ReadAtUnaligned
 //
 //  Description:
-//      Mark value at specified offset in order to expand the file on disk.
-//		The value mark causes file to be physically expanded.
+//      Direct read of a range that is not aligned.  The aligned blocks around
+//		the range are read into a bounce buffer.
 //
 //  Inputs:
-//      position	== IN:	Absolution position to mark file
-//		uiValue		== IN:	Dummy value to mark at expansion point
+//		position	== IN:	Absolute file offset
+//      pBuffer		== OUT: Output buffer
+//		cbLen		== IN:	Count of bytes to read
 //
-//  Returns:
-//      RESULT code
+//	Returns:
+//		Count of bytes read (short count at end of file)
 // --------------------------------------------------------------------------------
-void CFile::Expand
+UINT CFile::ReadAtUnaligned
 (
 	FILEOFFSET	position,
-	UINT		uiValue
+	void*		pBuffer,
+	UINT		cbLen
 )
 {
-	m_mutex.Lock();
+	FILEOFFSET	posStart	= position - (position % FILE_ALIGNMENT);
+	UINT		cbSkip		= position - posStart;
+	UINT		cbSpan		= ((cbSkip + cbLen + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT) * FILE_ALIGNMENT;
+	BYTE*		pBounce		= AllocBuffer(cbSpan);
+	UINT		cbRead		= 0;
 
 	try
 	{
-		// Verify that mark is beyond end of file
-		if (GetFileSize() < position)
+		UINT cbSpanRead = ReadAt(posStart, pBounce, cbSpan);
+
+		if (cbSpanRead > cbSkip)
 		{
-			// Expand file and mark
-			Seek(position);
-			UINT cbWritten = Write(&uiValue, sizeof(uiValue));
-			_ASSERTE(cbWritten == sizeof(uiValue));
+			cbRead = min(cbSpanRead - cbSkip, cbLen);
+			memcpy(pBuffer, pBounce + cbSkip, cbRead);
 		}
 	}
 	catch ( ... )
 	{
-		m_mutex.Unlock();
+		FreeBuffer(pBounce);
 		throw;
 	}
 
-	m_mutex.Unlock();
+	FreeBuffer(pBounce);
+	return cbRead;
 }
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CFile::GetFileSize
+//      CFile::WriteAtUnaligned
 //
 //  Description:
-//      Returns size of file in bytes
+//      Direct write of a range that is not aligned.  The aligned blocks around
+//		the range are read, patched and written back.  A write that extends
+//		the file is trimmed back to its true end, so the file size is the same
+//		as for a cached write.
 //
-//  Returns:
-//      File size in bytes
+//  Inputs:
+//		position	== IN:	Absolute file offset
+//      pBuffer		== IN:	Input buffer
+//		cbLen		== IN:	Count of bytes to write
+//
+//	Returns:
+//		Count of bytes written
 // --------------------------------------------------------------------------------
-UINT CFile::GetFileSize()
+UINT CFile::WriteAtUnaligned
+(
+	FILEOFFSET	position,
+	const void*	pBuffer,
+	UINT		cbLen
+)
 {
-	FILE*	hFile	= NULL;
-	UINT	cbSize	= 0;
+	FILEOFFSET	posStart	= position - (position % FILE_ALIGNMENT);
+	UINT		cbSkip		= position - posStart;
+	UINT		cbSpan		= ((cbSkip + cbLen + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT) * FILE_ALIGNMENT;
+	BYTE*		pBounce		= AllocBuffer(cbSpan);
 
+	// Read-modify-write of the edge blocks must not interleave
 	m_mutex.Lock();
 
 	try
 	{
-		hFile = fopen(m_strFile.c_str(), "rb");		
-		
-		if (!hFile)
-		{
-			throw runtime_error("File could not be opened");
-		}
+		UINT cbSize = GetFileSize();
+		UINT cbRead = ReadAt(posStart, pBounce, cbSpan);
 
-		if (fseek(hFile, 0, SEEK_END))
-		{
-			throw runtime_error("Seek failed");
-		}
+		memset(pBounce + cbRead, 0, cbSpan - cbRead);
+		memcpy(pBounce + cbSkip, pBuffer, cbLen);
 
-		cbSize = ftell(hFile);
+		WriteAt(posStart, pBounce, cbSpan);
 
-		if (hFile)
+		if (posStart + cbSpan > max(cbSize, position + cbLen))
 		{
-			fclose(hFile);
+			Truncate(max(cbSize, position + cbLen));
 		}
 	}
 	catch ( ... )
 	{
-		if (hFile)
-		{
-			fclose(hFile);
-		}
-
 		m_mutex.Unlock();
+		FreeBuffer(pBounce);
 		throw;
 	}
 
 	m_mutex.Unlock();
-	return cbSize;
+	FreeBuffer(pBounce);
+	return cbLen;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::IsAligned
+//
+//  Description:
+//      Tests whether a transfer meets the alignment rules of direct I/O
+//
+//  Inputs:
+//		position	== IN:	Absolute file offset
+//      pBuffer		== IN:	Data buffer
+//		cbLen		== IN:	Count of bytes
+//
+//	Returns:
+//		true/false for if offset, buffer and length are aligned
+// --------------------------------------------------------------------------------
+bool CFile::IsAligned
+(
+	FILEOFFSET	position,
+	const void*	pBuffer,
+	UINT		cbLen
+)
+{
+	return ((position % FILE_ALIGNMENT) == 0 &&
+			(cbLen % FILE_ALIGNMENT) == 0 &&
+			((size_t) pBuffer % FILE_ALIGNMENT) == 0);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::OpenDirect
+//
+//  Description:
+//      Open the file bypassing the system cache
+//
+//  Inputs:
+//		fCreate == IN: Create a new file
+//
+//	Returns:
+//		Stream for the file; NULL if the file system does not support direct
+//		I/O or the file cannot be opened
+// --------------------------------------------------------------------------------
+FILE* CFile::OpenDirect
+(
+	bool fCreate
+)
+{
+	FILE* hFile = NULL;
+
+#if defined (__WIN32__)
+	HANDLE hOsFile = CreateFile(m_strFile.c_str(), GENERIC_READ | GENERIC_WRITE,
+								FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+								fCreate ? CREATE_NEW : OPEN_EXISTING,
+								FILE_FLAG_NO_BUFFERING, NULL);
+
+	if (hOsFile != INVALID_HANDLE_VALUE)
+	{
+		int fd = _open_osfhandle((intptr_t) hOsFile, _O_RDWR | _O_BINARY);
+
+		if (fd >= 0)
+		{
+			hFile = _fdopen(fd, "r+b");
+
+			if (!hFile)
+			{
+				_close(fd);
+			}
+		}
+		else
+		{
+			CloseHandle(hOsFile);
+		}
+	}
+#elif defined (__LINUX__)
+	int fd = open(m_strFile.c_str(), O_RDWR | O_DIRECT | (fCreate ? O_CREAT | O_EXCL : 0), 0644);
+
+	if (fd >= 0)
+	{
+		hFile = fdopen(fd, "r+b");
+
+		if (!hFile)
+		{
+			close(fd);
+		}
+	}
+	else if (errno == EINVAL && fCreate)
+	{
+		// File system refused direct I/O after creating the file
+		remove(m_strFile.c_str());
+	}
+#endif
+
+	return hFile;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Rename
+//
+//  Description:
+//      Rename file to new name
+//
+//  Inputs:
+//		strName	== IN:	New filename
+//
+//  Exceptions:
+//      runtime_error == rename op failed
+// --------------------------------------------------------------------------------
+void CFile::Rename
+(
+	const string& strName
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		if (rename(m_strFile.c_str(), strName.c_str()) != 0)
+		{
+			throw runtime_error("Rename operation failed");
+		}
+
+		m_strFile = strName;
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Delete
+//
+//  Description:
+//      Delete file
+//
+// --------------------------------------------------------------------------------
+void CFile::Delete()
+{
+	m_mutex.Lock();
+
+	try
+	{
+		if (remove(m_strFile.c_str()) != 0)
+		{
+			throw runtime_error("Delete operation failed");
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Copy
+//
+//  Description:
+//      Copy to destination file.  An existing destination is replaced.
+//
+//  Inputs:
+//		pszName	== IN:	Destination file name
+//
+//  Exceptions:
+//      runtime_error == Write to destination failed
+// --------------------------------------------------------------------------------
+void CFile::Copy
+(
+	const string& strName
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		CFile fileDest(strName);
+
+		// Replace an existing destination
+		if (fileDest.Exists())
+		{
+			fileDest.Delete();
+		}
+
+		// Create destination stream
+		fileDest.Create();
+
+		if (!IsOpen())
+		{
+			Open();
+		}
+
+		UINT cbCopied = CopyRange(0, &fileDest, 0, GetFileSize());
+		_ASSERTE(cbCopied == GetFileSize());
+
+		// Commit and close destination file
+		fileDest.Close();
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::CopyRange
+//
+//  Description:
+//      Copy a byte range to another open file without passing the data
+//		through the caller.  On Linux the range is first cloned (the files
+//		share blocks until either is written) on file systems that support
+//		it, then copied inside the kernel with copy_file_range.  Whatever the
+//		kernel cannot copy is moved in large buffers.
+//
+//  Inputs:
+//		posSrc	== IN:	Source file offset
+//		pDest	== IN:	Open destination file (may be this file if the ranges
+//						do not overlap)
+//		posDest	== IN:	Destination file offset
+//		cbLen	== IN:	Count of bytes to copy
+//
+//	Returns:
+//		Count of bytes copied (short count at end of the source file)
+//
+//  Exceptions:
+//		invalid_argument == destination invalid
+//		runtime_error	 == file not open or copy fails
+// --------------------------------------------------------------------------------
+UINT CFile::CopyRange
+(
+	FILEOFFSET	posSrc,
+	CFile*		pDest,
+	FILEOFFSET	posDest,
+	UINT		cbLen
+)
+{
+	UINT cbCopied	= 0;
+	bool fEOF		= false;
+
+	if (!pDest)
+	{
+		throw invalid_argument("Destination file invalid");
+	}
+
+	if (!IsOpen() || !pDest->IsOpen())
+	{
+		throw runtime_error("File not open");
+	}
+
+	if (cbLen == 0)
+	{
+		return 0;
+	}
+
+#if defined (__LINUX__)
+	INT fdSrc	= fileno(m_hFile);
+	INT fdDest	= fileno(pDest->m_hFile);
+
+	// Stream writes must reach the descriptors first
+	fflush(m_hFile);
+	fflush(pDest->m_hFile);
+
+	// Clone the blocks when the file system can share them between files
+	struct file_clone_range clone;
+
+	clone.src_fd		= fdSrc;
+	clone.src_offset	= posSrc;
+	clone.src_length	= cbLen;
+	clone.dest_offset	= posDest;
+
+	if (ioctl(fdDest, FICLONERANGE, &clone) == 0)
+	{
+		cbCopied = cbLen;
+	}
+
+	// Copy inside the kernel
+	while (cbCopied < cbLen)
+	{
+		loff_t	offSrc	= posSrc + cbCopied;
+		loff_t	offDest	= posDest + cbCopied;
+		ssize_t	cbDone	= copy_file_range(fdSrc, &offSrc, fdDest, &offDest, cbLen - cbCopied, 0);
+
+		if (cbDone < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			// Not supported for these files - copy the rest in buffers
+			if (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+				errno == EOPNOTSUPP || errno == EBADF)
+			{
+				break;
+			}
+
+			throw runtime_error("Copy failed");
+		}
+
+		if (cbDone == 0)
+		{
+			fEOF = true;
+			break;
+		}
+
+		cbCopied += (UINT) cbDone;
+	}
+#endif
+
+	if (!fEOF && cbCopied < cbLen)
+	{
+		BYTE* pBuffer = AllocBuffer(FILE_COPY_BUFFER);
+
+		try
+		{
+			while (cbCopied < cbLen)
+			{
+				UINT cbChunk = min(cbLen - cbCopied, FILE_COPY_BUFFER);
+				UINT cbRead	 = ReadAt(posSrc + cbCopied, pBuffer, cbChunk);
+
+				if (cbRead == 0)
+				{
+					break;
+				}
+
+				pDest->WriteAt(posDest + cbCopied, pBuffer, cbRead);
+				cbCopied += cbRead;
+
+				if (cbRead < cbChunk)
+				{
+					break;
+				}
+			}
+		}
+		catch ( ... )
+		{
+			FreeBuffer(pBuffer);
+			throw;
+		}
+
+		FreeBuffer(pBuffer);
+	}
+
+	pDest->SetEndOfFile(posDest + cbCopied);
+	return cbCopied;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Expand
+//
+//  Description:
+//      Grow the file to a new size.  The added range is allocated on disk
+//		(not left sparse) so later writes into it need no block allocation and
+//		land in contiguous extents.  Does nothing if the file is already large
+//		enough.
+//
+//  Inputs:
+//      position == IN: New end of file
+//
+//  Exceptions:
+//		runtime_error == file not open or disk full
+// --------------------------------------------------------------------------------
+void CFile::Expand
+(
+	FILEOFFSET position
+)
+{
+	m_mutex.Lock();
+
+	try
+	{
+		if (!m_hFile)
+		{
+			throw runtime_error("File not open");
+		}
+
+		if (m_cbSize < position)
+		{
+			fflush(m_hFile);
+
+#if defined (__WIN32__)
+			// Extending the end of file allocates the added clusters
+			if (_chsize(_fileno(m_hFile), position))
+			{
+				throw runtime_error("Expand failed");
+			}
+#elif defined (__LINUX__)
+			INT fd = fileno(m_hFile);
+
+			// posix_fallocate covers file systems without native preallocation
+			if (fallocate(fd, 0, m_cbSize, position - m_cbSize) &&
+				posix_fallocate(fd, m_cbSize, position - m_cbSize))
+			{
+				throw runtime_error("Expand failed");
+			}
+#endif
+			m_cbSize = position;
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Map
+//
+//  Description:
+//      Map the first n bytes of the file read-only into memory.  The view
+//		reflects later writes to the file.
+//
+//  Inputs:
+//		cbLen == IN: Count of bytes to map (must not exceed the file size)
+//
+//  Returns:
+//      Pointer to mapped view
+//
+//  Exceptions:
+//		runtime_error == file not open or mapping failed
+// --------------------------------------------------------------------------------
+const BYTE* CFile::Map
+(
+	UINT cbLen
+)
+{
+	const BYTE* pView = NULL;
+
+	if (!m_hFile)
+	{
+		throw runtime_error("File not open");
+	}
+
+#if defined (__WIN32__)
+	HANDLE hFile = (HANDLE) _get_osfhandle(_fileno(m_hFile));
+	HANDLE hMap	 = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, cbLen, NULL);
+
+	if (hMap)
+	{
+		pView = (const BYTE*) MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, cbLen);
+
+		// View holds its own reference to the mapping object
+		CloseHandle(hMap);
+	}
+#elif defined (__LINUX__)
+	void* pMap = mmap(NULL, cbLen, PROT_READ, MAP_SHARED, fileno(m_hFile), 0);
+
+	if (pMap != MAP_FAILED)
+	{
+		pView = (const BYTE*) pMap;
+	}
+#endif
+
+	if (!pView)
+	{
+		throw runtime_error("File mapping failed");
+	}
+
+	return pView;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Unmap
+//
+//  Description:
+//      Release view created by Map
+//
+//  Inputs:
+//		pView	== IN: Mapped view
+//		cbLen	== IN: Count of bytes mapped
+// --------------------------------------------------------------------------------
+void CFile::Unmap
+(
+	const BYTE*	pView,
+	UINT		cbLen
+)
+{
+#if defined (__WIN32__)
+	UnmapViewOfFile(pView);
+#elif defined (__LINUX__)
+	munmap((void*) pView, cbLen);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Sync
+//
+//  Description:
+//      Flush buffered data and force file contents to stable storage.  Returns
+//		once the device has acknowledged the write.
+//
+//  Exceptions:
+//		runtime_error == file not open or sync failed
+// --------------------------------------------------------------------------------
+void CFile::Sync()
+{
+	if (!m_hFile)
+	{
+		throw runtime_error("File not open");
+	}
+
+	fflush(m_hFile);
+
+#if defined (__WIN32__)
+	HANDLE hFile = (HANDLE) _get_osfhandle(_fileno(m_hFile));
+
+	if (!FlushFileBuffers(hFile))
+	{
+		throw runtime_error("Sync failed");
+	}
+#elif defined (__LINUX__)
+	if (fdatasync(fileno(m_hFile)))
+	{
+		throw runtime_error("Sync failed");
+	}
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::Truncate
+//
+//  Description:
+//      Set the file size.  Data past the new end of file is discarded.
+//
+//  Inputs:
+//      position == IN: New file size
+//
+//  Exceptions:
+//		runtime_error == file not open or truncate failed
+// --------------------------------------------------------------------------------
+void CFile::Truncate
+(
+	FILEOFFSET position
+)
+{
+	if (!m_hFile)
+	{
+		throw runtime_error("File not open");
+	}
+
+	fflush(m_hFile);
+
+#if defined (__WIN32__)
+	if (_chsize(_fileno(m_hFile), position))
+	{
+		throw runtime_error("Truncate failed");
+	}
+#elif defined (__LINUX__)
+	if (ftruncate(fileno(m_hFile), position))
+	{
+		throw runtime_error("Truncate failed");
+	}
+#endif
+
+	m_mutex.Lock();
+	m_cbSize = position;
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::GetFileSize
+//
+//  Description:
+//      Returns size of file in bytes.  The size of an open file is tracked
+//		by the writes made through this object.
+//
+//  Returns:
+//      File size in bytes
+// --------------------------------------------------------------------------------
+UINT CFile::GetFileSize()
+{
+	FILE*	hFile	= NULL;
+	UINT	cbSize	= 0;
+
+	m_mutex.Lock();
+
+	try
+	{
+		if (m_hFile)
+		{
+			cbSize = m_cbSize;
+			m_mutex.Unlock();
+			return cbSize;
+		}
+
+		hFile = fopen(m_strFile.c_str(), "rb");		
+		
+		if (!hFile)
+		{
+			throw runtime_error("File could not be opened");
+		}
+
+		if (fseek(hFile, 0, SEEK_END))
+		{
+			throw runtime_error("Seek failed");
+		}
+
+		cbSize = ftell(hFile);
+
+		if (hFile)
+		{
+			fclose(hFile);
+		}
+	}
+	catch ( ... )
+	{
+		if (hFile)
+		{
+			fclose(hFile);
+		}
+
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+	return cbSize;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::SetEndOfFile
+//
+//  Description:
+//      Record that a write ended past the tracked file size
+//
+//  Inputs:
+//      position == IN: End of the write
+// --------------------------------------------------------------------------------
+void CFile::SetEndOfFile
+(
+	FILEOFFSET position
+)
+{
+	m_mutex.Lock();
+
+	if (position > m_cbSize)
+	{
+		m_cbSize = position;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::AllocBuffer
+//
+//  Description:
+//      Allocate a buffer aligned for direct transfers
+//
+//  Inputs:
+//		cbLen == IN: Count of bytes
+//
+//	Returns:
+//		Pointer to buffer (release with FreeBuffer)
+//
+//  Exceptions:
+//		bad_alloc == out of memory
+// --------------------------------------------------------------------------------
+BYTE* CFile::AllocBuffer
+(
+	UINT cbLen
+)
+{
+	void* pBuffer = NULL;
+
+#if defined (__WIN32__)
+	pBuffer = _aligned_malloc(max(cbLen, 1U), FILE_ALIGNMENT);
+#elif defined (__LINUX__)
+	if (posix_memalign(&pBuffer, FILE_ALIGNMENT, max(cbLen, 1U)) != 0)
+	{
+		pBuffer = NULL;
+	}
+#endif
+
+	if (!pBuffer)
+	{
+		throw bad_alloc();
+	}
+
+	return (BYTE*) pBuffer;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CFile::FreeBuffer
+//
+//  Description:
+//      Release a buffer allocated by AllocBuffer
+//
+//  Inputs:
+//		pBuffer == IN: Buffer (may be NULL)
+// --------------------------------------------------------------------------------
+void CFile::FreeBuffer
+(
+	BYTE* pBuffer
+)
+{
+#if defined (__WIN32__)
+	_aligned_free(pBuffer);
+#elif defined (__LINUX__)
+	free(pBuffer);
+#endif
 }
 
 // --------------------------------------------------------------------------------
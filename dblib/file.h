@@ -26,9 +26,19 @@
 // --------------------------------------------------------------------------------
 typedef UINT FILEOFFSET;
 
+// --------------------------------------------------------------------------------
+//	CONSTANTS
+// --------------------------------------------------------------------------------
+const UINT FILE_DEFAULT		= 0x0000;
+const UINT FILE_DIRECT		= 0x0001;		// Bypass the system cache
+const UINT FILE_ALIGNMENT	= 4096;			// Offset, length and buffer alignment of direct transfers
+const UINT FILE_COPY_BUFFER	= 1024 * 1024;	// Buffer size of copies the kernel cannot perform
+
 
 SmartPointer(CFile);
 
+class CIoRing;
+
 // ================================================================================
 // Class:
 //      CFile
@@ -42,20 +52,32 @@ public:
 	CFile(const string& strFile);
 	virtual ~CFile();
 
-	void Create();
-	void Open();
+	void Create(UINT fFlags = FILE_DEFAULT);
+	void Open(UINT fFlags = FILE_DEFAULT);
 	void Close();
 	UINT Read(void* pBuffer, UINT cbLen);
 	UINT Write(void* pBuffer, UINT cbLen);
 	void Seek(FILEOFFSET position);
+	UINT ReadAt(FILEOFFSET position, void* pBuffer, UINT cbLen);
+	UINT WriteAt(FILEOFFSET position, const void* pBuffer, UINT cbLen);
+	void ReadAtAsync(FILEOFFSET position, void* pBuffer, UINT cbLen, UINT* pcbRead = NULL);
+	void WriteAtAsync(FILEOFFSET position, const void* pBuffer, UINT cbLen);
+	void WaitAsync();
 	void Rename(const string& strName);
 	void Delete();
 	void Copy(const string& strName);
-	void Expand(FILEOFFSET position, UINT uiValue);
+	UINT CopyRange(FILEOFFSET posSrc, CFile* pDest, FILEOFFSET posDest, UINT cbLen);
+	void Expand(FILEOFFSET position);
+
+	const BYTE* Map(UINT cbLen);
+	void Unmap(const BYTE* pView, UINT cbLen);
 	void Flush()						{ fflush(m_hFile); }
+	void Sync();
+	void Truncate(FILEOFFSET position);
 
 	bool Exists();
 	bool IsOpen()						{ return (m_hFile != NULL); }
+	bool IsDirect()						{ return m_fDirect; }
 	bool IsEOF()						{ return (feof(m_hFile) != 0); }
 
 	const string GetFilename()			{ return m_strFile; }
@@ -63,10 +85,24 @@ public:
 
 	UINT GetFileSize();
 
+	static BYTE* AllocBuffer(UINT cbLen);
+	static void	 FreeBuffer(BYTE* pBuffer);
+
+private:
+	CIoRing* GetRing();
+	FILE*	 OpenDirect(bool fCreate);
+	bool	 IsAligned(FILEOFFSET position, const void* pBuffer, UINT cbLen);
+	UINT	 ReadAtUnaligned(FILEOFFSET position, void* pBuffer, UINT cbLen);
+	UINT	 WriteAtUnaligned(FILEOFFSET position, const void* pBuffer, UINT cbLen);
+	void	 SetEndOfFile(FILEOFFSET position);
+
 private:
-	string	m_strFile;		// File name
-	FILE*	m_hFile;		// File handle
-	CMutex	m_mutex;		// Mutex to serialize file access
+	string		m_strFile;		// File name
+	FILE*		m_hFile;		// File handle
+	CMutex		m_mutex;		// Mutex to serialize file access
+	CIoRing*	m_pRing;		// Asynchronous I/O queue (created on first use)
+	bool		m_fDirect;		// Opened for direct (uncached) transfers
+	UINT		m_cbSize;		// File size while open
 };
 
 #endif // __DBFILE_H__
@@ -0,0 +1,106 @@
+// ================================================================================
+//
+//	File:
+//      futex.h
+//
+//	Component:
+//      Photon System
+//
+//	Description:
+//      Futex wait and wake (Linux)
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#if defined (__LINUX__)
+
+// ================================================================================
+//	INLINE FUNCTIONS
+// ================================================================================
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      FutexWait
+//
+//  Description:
+//      Sleep while a word holds an expected value.  Returns at once if the
+//		word has already changed; may also return spuriously, so callers
+//		check the word again.
+//
+//  Inputs:
+//		pWord		== IN: Word waited on
+//		uiExpected	== IN: Value the word holds while the caller should sleep
+//		ptsLimit	== IN: Absolute CLOCK_MONOTONIC time limit (NULL for none)
+//
+//  Returns:
+//      false if the time limit passed
+// --------------------------------------------------------------------------------
+inline bool FutexWait
+(
+	UINT*					pWord,
+	UINT					uiExpected,
+	const struct timespec*	ptsLimit
+)
+{
+	return !(syscall(SYS_futex, pWord, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, uiExpected,
+					 ptsLimit, NULL, FUTEX_BITSET_MATCH_ANY) == -1 && errno == ETIMEDOUT);
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      FutexWake
+//
+//  Description:
+//      Wake threads sleeping on a word
+//
+//  Inputs:
+//		pWord		== IN: Word waited on
+//		cThreads	== IN: Most threads to wake
+// --------------------------------------------------------------------------------
+inline void FutexWake
+(
+	UINT*	pWord,
+	INT		cThreads
+)
+{
+	syscall(SYS_futex, pWord, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, cThreads, NULL, NULL, 0);
+}
+
+// --------------------------------------------------------------------------------
+//  Function:
+//      FutexLimit
+//
+//  Description:
+//      Absolute time limit for FutexWait
+//
+//  Inputs:
+//		cMilliseconds	== IN:	Time from now
+//		ptsLimit		== OUT:	Time limit
+// --------------------------------------------------------------------------------
+inline void FutexLimit
+(
+	UINT				cMilliseconds,
+	struct timespec*	ptsLimit
+)
+{
+	clock_gettime(CLOCK_MONOTONIC, ptsLimit);
+	ptsLimit->tv_sec	+= cMilliseconds / 1000;
+	ptsLimit->tv_nsec	+= (cMilliseconds % 1000) * 1000000L;
+
+	if (ptsLimit->tv_nsec >= 1000000000L)
+	{
+		ptsLimit->tv_sec++;
+		ptsLimit->tv_nsec -= 1000000000L;
+	}
+}
+
+#endif
+
+#endif // __FUTEX_H__
@@ -0,0 +1,675 @@
+// ================================================================================
+//
+//	File:
+//      ioring.cpp
+//
+//	Component:
+//      System
+//
+//	Description:
+//      Asynchronous I/O queue implementation
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "sys.h"
+#include "trace.h"
+#include "file.h"
+#include "ioring.h"
+
+// Request operations
+const UINT IO_OP_READ	= 1;
+const UINT IO_OP_WRITE	= 2;
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::CIoRing
+//
+//  Description:
+//      Constructor.  Creates the kernel ring; on failure the queue is left
+//		unavailable rather than throwing, so callers can fall back.  Plain
+//		read and write operations need a newer kernel than the ring itself;
+//		the kernel is probed for them and readv/writev are used without them.
+//
+//  Inputs:
+//      cDepth == IN: Count of requests that may be in flight
+// --------------------------------------------------------------------------------
+CIoRing::CIoRing
+(
+	UINT cDepth
+)
+{
+	TRACE_INIT("CIoRing::CIoRing");
+
+	m_cQueued		= 0;
+	m_fAvailable	= false;
+
+#if defined (__LINUX__)
+	m_fdRing	= -1;
+	m_fVectored	= false;
+	m_pSqRing	= NULL;
+	m_pCqRing	= NULL;
+	m_pSqes		= NULL;
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	m_fdRing = (INT) syscall(__NR_io_uring_setup, cDepth, &params);
+
+	if (m_fdRing < 0)
+	{
+		// Kernel without io_uring or ring creation blocked
+		return;
+	}
+
+	m_cbSqRing	= params.sq_off.array + (params.sq_entries * sizeof(UINT));
+	m_cbCqRing	= params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+	m_cbSqes	= params.sq_entries * sizeof(io_uring_sqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		m_cbSqRing = m_cbCqRing = max(m_cbSqRing, m_cbCqRing);
+	}
+
+	void* pSqRing = mmap(NULL, m_cbSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						 m_fdRing, IORING_OFF_SQ_RING);
+	void* pCqRing = pSqRing;
+
+	if (pSqRing != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		pCqRing = mmap(NULL, m_cbCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					   m_fdRing, IORING_OFF_CQ_RING);
+	}
+
+	void* pSqes = mmap(NULL, m_cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					   m_fdRing, IORING_OFF_SQES);
+
+	if (pSqRing != MAP_FAILED)
+	{
+		m_pSqRing = (BYTE*) pSqRing;
+	}
+
+	if (pCqRing != MAP_FAILED)
+	{
+		m_pCqRing = (BYTE*) pCqRing;
+	}
+
+	if (pSqes != MAP_FAILED)
+	{
+		m_pSqes = pSqes;
+	}
+
+	if (!m_pSqRing || !m_pCqRing || !m_pSqes)
+	{
+		// Destructor releases whatever was mapped
+		return;
+	}
+
+	m_pSqTail	= (UINT*) (m_pSqRing + params.sq_off.tail);
+	m_pSqMask	= (UINT*) (m_pSqRing + params.sq_off.ring_mask);
+	m_pSqArray	= (UINT*) (m_pSqRing + params.sq_off.array);
+	m_pCqHead	= (UINT*) (m_pCqRing + params.cq_off.head);
+	m_pCqTail	= (UINT*) (m_pCqRing + params.cq_off.tail);
+	m_pCqMask	= (UINT*) (m_pCqRing + params.cq_off.ring_mask);
+	m_pCqes		= m_pCqRing + params.cq_off.cqes;
+	m_idxSqTail	= *m_pSqTail;
+
+	// Kernels without the probe predate plain read/write but have readv/writev
+	vector<BYTE>	rgProbe(sizeof(io_uring_probe) + (256 * sizeof(io_uring_probe_op)), 0);
+	io_uring_probe*	pProbe = (io_uring_probe*) &rgProbe[0];
+
+	if (syscall(__NR_io_uring_register, m_fdRing, IORING_REGISTER_PROBE, pProbe, 256) < 0)
+	{
+		m_fVectored = true;
+	}
+	else if (!IsSupported(pProbe, IORING_OP_READ) || !IsSupported(pProbe, IORING_OP_WRITE))
+	{
+		if (!IsSupported(pProbe, IORING_OP_READV) || !IsSupported(pProbe, IORING_OP_WRITEV))
+		{
+			// No positional transfer at all - callers stay synchronous
+			return;
+		}
+
+		m_fVectored = true;
+	}
+
+	// Never more requests than submission entries, so a slot can always be prepared
+	m_rgRequests.resize(params.sq_entries);
+
+	for (UINT idx = params.sq_entries; idx > 0; idx--)
+	{
+		m_rgFree.push_back(idx - 1);
+	}
+
+	m_fAvailable = true;
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::~CIoRing
+//
+//  Description:
+//      Destructor.  Outstanding requests of every thread are completed first
+//		because the kernel may still be using their buffers.
+// --------------------------------------------------------------------------------
+CIoRing::~CIoRing()
+{
+	TRACE_INIT("CIoRing::~CIoRing");
+
+	try
+	{
+		if (m_fAvailable)
+		{
+			Drain();
+		}
+	}
+	catch ( ... )
+	{
+	}
+
+#if defined (__LINUX__)
+	if (m_pSqes)
+	{
+		munmap(m_pSqes, m_cbSqes);
+	}
+
+	if (m_pCqRing && m_pCqRing != m_pSqRing)
+	{
+		munmap(m_pCqRing, m_cbCqRing);
+	}
+
+	if (m_pSqRing)
+	{
+		munmap(m_pSqRing, m_cbSqRing);
+	}
+
+	if (m_fdRing >= 0)
+	{
+		close(m_fdRing);
+	}
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Read
+//
+//  Description:
+//      Queue a read at an absolute file offset.  The buffer must stay valid
+//		until Wait returns.
+//
+//  Inputs:
+//		fd			== IN:	File descriptor
+//		position	== IN:	Absolute file offset
+//      pBuffer		== OUT: Output buffer
+//		cbLen		== IN:	Count of bytes to read
+//		pcbDone		== OUT: Count of bytes read (short at end of file; optional)
+// --------------------------------------------------------------------------------
+void CIoRing::Read
+(
+	INT			fd,
+	FILEOFFSET	position,
+	void*		pBuffer,
+	UINT		cbLen,
+	UINT*		pcbDone
+)
+{
+	Queue(IO_OP_READ, fd, position, (BYTE*) pBuffer, cbLen, pcbDone);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Write
+//
+//  Description:
+//      Queue a write at an absolute file offset.  The buffer must stay valid
+//		until Wait returns.
+//
+//  Inputs:
+//		fd			== IN:	File descriptor
+//		position	== IN:	Absolute file offset
+//      pBuffer		== IN:	Input buffer
+//		cbLen		== IN:	Count of bytes to write
+//		pcbDone		== OUT: Count of bytes written (optional)
+// --------------------------------------------------------------------------------
+void CIoRing::Write
+(
+	INT			fd,
+	FILEOFFSET	position,
+	const void*	pBuffer,
+	UINT		cbLen,
+	UINT*		pcbDone
+)
+{
+	Queue(IO_OP_WRITE, fd, position, (BYTE*) pBuffer, cbLen, pcbDone);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Wait
+//
+//  Description:
+//      Submit everything queued and wait until every request the calling
+//		thread queued has completed.  Requests of other threads that complete
+//		meanwhile are accounted to their own threads.
+//
+//  Exceptions:
+//		runtime_error == a request of the calling thread failed
+// --------------------------------------------------------------------------------
+void CIoRing::Wait()
+{
+	UINT idThread = CThread::GetCurrentId();
+
+	m_mutex.Lock();
+
+	try
+	{
+		UINT idxOwner = FindOwner(idThread);
+
+		while (idxOwner < m_rgOwners.size() && m_rgOwners[idxOwner].Pending > 0)
+		{
+			Submit();
+			Reap(true);
+		}
+
+		if (idxOwner < m_rgOwners.size())
+		{
+			bool fFailed = m_rgOwners[idxOwner].Failed;
+
+			m_rgOwners.erase(m_rgOwners.begin() + idxOwner);
+
+			if (fFailed)
+			{
+				throw runtime_error("Asynchronous I/O failed");
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Drain
+//
+//  Description:
+//      Submit everything queued and wait until the requests of every thread
+//		have completed.  Failures are left for each thread's own Wait.
+//
+//  Exceptions:
+//		runtime_error == submission or wait failed
+// --------------------------------------------------------------------------------
+void CIoRing::Drain()
+{
+	m_mutex.Lock();
+
+	try
+	{
+		while (m_rgFree.size() < m_rgRequests.size())
+		{
+			Submit();
+			Reap(true);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Queue
+//
+//  Description:
+//      Take a request slot and prepare its submission entry.  When every slot
+//		is in use the queue is submitted and completions reaped until one is
+//		free.
+//
+//  Exceptions:
+//		logic_error == queue not available
+// --------------------------------------------------------------------------------
+void CIoRing::Queue
+(
+	UINT		uiOp,
+	INT			fd,
+	FILEOFFSET	position,
+	BYTE*		pBuffer,
+	UINT		cbLen,
+	UINT*		pcbDone
+)
+{
+	if (!m_fAvailable)
+	{
+		throw logic_error("Asynchronous I/O not available");
+	}
+
+	UINT idThread = CThread::GetCurrentId();
+
+	m_mutex.Lock();
+
+	try
+	{
+		while (m_rgFree.empty())
+		{
+			Submit();
+			Reap(true);
+		}
+
+		UINT		idxRequest	= m_rgFree.back();
+		IoRequest&	request		= m_rgRequests[idxRequest];
+
+		m_rgFree.pop_back();
+
+		request.Op			= uiOp;
+		request.File		= fd;
+		request.Position	= position;
+		request.Buffer		= pBuffer;
+		request.Length		= cbLen;
+		request.Done		= 0;
+		request.Result		= pcbDone;
+		request.Owner		= idThread;
+
+		UINT idxOwner = FindOwner(idThread);
+
+		if (idxOwner == m_rgOwners.size())
+		{
+			IoOwner owner;
+
+			owner.Thread	= idThread;
+			owner.Pending	= 0;
+			owner.Failed	= false;
+
+			m_rgOwners.push_back(owner);
+		}
+
+		m_rgOwners[idxOwner].Pending++;
+
+		if (cbLen == 0)
+		{
+			Complete(idxRequest, 0);
+		}
+		else
+		{
+			Prepare(idxRequest);
+		}
+	}
+	catch ( ... )
+	{
+		m_mutex.Unlock();
+		throw;
+	}
+
+	m_mutex.Unlock();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Prepare
+//
+//  Description:
+//      Fill the next submission entry with the untransferred part of a
+//		request.  Caller must hold the access lock.
+//
+//  Inputs:
+//      idxRequest == IN: Request slot
+// --------------------------------------------------------------------------------
+void CIoRing::Prepare
+(
+	UINT idxRequest
+)
+{
+#if defined (__LINUX__)
+	IoRequest&		request	= m_rgRequests[idxRequest];
+	UINT			idxSqe	= m_idxSqTail & *m_pSqMask;
+	io_uring_sqe*	pSqe	= (io_uring_sqe*) m_pSqes + idxSqe;
+
+	memset(pSqe, 0, sizeof(io_uring_sqe));
+
+	pSqe->fd		= request.File;
+	pSqe->off		= request.Position + request.Done;
+	pSqe->user_data	= idxRequest;
+
+	if (m_fVectored)
+	{
+		request.Vector.iov_base	= request.Buffer + request.Done;
+		request.Vector.iov_len	= request.Length - request.Done;
+
+		pSqe->opcode	= (request.Op == IO_OP_READ) ? IORING_OP_READV : IORING_OP_WRITEV;
+		pSqe->addr		= (uintptr_t) &request.Vector;
+		pSqe->len		= 1;
+	}
+	else
+	{
+		pSqe->opcode	= (request.Op == IO_OP_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+		pSqe->addr		= (uintptr_t) (request.Buffer + request.Done);
+		pSqe->len		= request.Length - request.Done;
+	}
+
+	m_pSqArray[idxSqe] = idxSqe;
+	m_idxSqTail++;
+	m_cQueued++;
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Submit
+//
+//  Description:
+//      Publish the prepared entries and hand them to the kernel in one call.
+//		Caller must hold the access lock.
+//
+//  Exceptions:
+//		runtime_error == submission failed
+// --------------------------------------------------------------------------------
+void CIoRing::Submit()
+{
+#if defined (__LINUX__)
+	if (m_cQueued == 0)
+	{
+		return;
+	}
+
+	while (m_cQueued > 0)
+	{
+		__atomic_store_n(m_pSqTail, m_idxSqTail, __ATOMIC_RELEASE);
+
+		INT cSubmitted = (INT) syscall(__NR_io_uring_enter, m_fdRing, m_cQueued, 0, 0, NULL, 0);
+
+		if (cSubmitted < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EBUSY)
+			{
+				// Completion ring full - make room and retry
+				Reap(false);
+				continue;
+			}
+
+			throw runtime_error("Asynchronous I/O submission failed");
+		}
+
+		m_cQueued -= cSubmitted;
+	}
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Reap
+//
+//  Description:
+//      Process completions in the shared ring.  The ring is polled first; the
+//		kernel is only entered to wait when nothing has completed.  Caller must
+//		hold the access lock.
+//
+//  Inputs:
+//      fWait == IN: Block until at least one request completes
+// --------------------------------------------------------------------------------
+void CIoRing::Reap
+(
+	bool fWait
+)
+{
+#if defined (__LINUX__)
+	for (;;)
+	{
+		UINT cReaped	= 0;
+		UINT idxHead	= *m_pCqHead;
+		UINT idxTail	= __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+
+		while (idxHead != idxTail)
+		{
+			io_uring_cqe* pCqe = (io_uring_cqe*) m_pCqes + (idxHead & *m_pCqMask);
+
+			UINT idxRequest = (UINT) pCqe->user_data;
+			INT	 iResult	= pCqe->res;
+
+			idxHead++;
+			cReaped++;
+			__atomic_store_n(m_pCqHead, idxHead, __ATOMIC_RELEASE);
+
+			Complete(idxRequest, iResult);
+		}
+
+		if (cReaped > 0 || !fWait)
+		{
+			break;
+		}
+
+		// Resubmitted remainders must be in flight before waiting on them
+		Submit();
+
+		if (syscall(__NR_io_uring_enter, m_fdRing, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+			errno != EINTR)
+		{
+			throw runtime_error("Asynchronous I/O wait failed");
+		}
+	}
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::Complete
+//
+//  Description:
+//      Account for a completion.  Short transfers are resubmitted for the
+//		remainder; a read that reaches the end of file completes short.  The
+//		result is accounted to the thread that queued the request.  Caller
+//		must hold the access lock.
+//
+//  Inputs:
+//      idxRequest	== IN: Request slot
+//		iResult		== IN: Bytes transferred or negative error code
+// --------------------------------------------------------------------------------
+void CIoRing::Complete
+(
+	UINT	idxRequest,
+	INT		iResult
+)
+{
+	IoRequest&	request		= m_rgRequests[idxRequest];
+	UINT		idxOwner	= FindOwner(request.Owner);
+
+	if (iResult == -EINTR || iResult == -EAGAIN)
+	{
+		Prepare(idxRequest);
+		return;
+	}
+
+	if (iResult < 0 || (iResult == 0 && request.Op == IO_OP_WRITE && request.Length > 0))
+	{
+		m_rgOwners[idxOwner].Failed = true;
+	}
+	else if (iResult > 0)
+	{
+		request.Done += (UINT) iResult;
+
+		if (request.Done < request.Length)
+		{
+			Prepare(idxRequest);
+			return;
+		}
+	}
+
+	if (request.Result)
+	{
+		*request.Result = request.Done;
+	}
+
+	m_rgOwners[idxOwner].Pending--;
+	m_rgFree.push_back(idxRequest);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::FindOwner
+//
+//  Description:
+//      Find the requests of a thread.  Few threads share a queue, so the list
+//		is searched in order.  Caller must hold the access lock.
+//
+//  Inputs:
+//      idThread == IN: Thread id
+//
+//  Returns:
+//      Index in the owner list, or the list size if the thread has none
+// --------------------------------------------------------------------------------
+UINT CIoRing::FindOwner
+(
+	UINT idThread
+)
+{
+	UINT idxOwner = 0;
+
+	while (idxOwner < m_rgOwners.size() && m_rgOwners[idxOwner].Thread != idThread)
+	{
+		idxOwner++;
+	}
+
+	return idxOwner;
+}
+
+#if defined (__LINUX__)
+// --------------------------------------------------------------------------------
+//  Method:
+//      CIoRing::IsSupported
+//
+//  Description:
+//      Check a kernel probe for a ring operation
+//
+//  Inputs:
+//		pProbe	== IN: Probe filled by the kernel
+//      uiOp	== IN: Ring opcode
+//
+//  Returns:
+//      true if the kernel supports the operation
+// --------------------------------------------------------------------------------
+bool CIoRing::IsSupported
+(
+	const io_uring_probe*	pProbe,
+	UINT					uiOp
+)
+{
+	return uiOp < pProbe->ops_len && (pProbe->ops[uiOp].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+#endif
@@ -0,0 +1,124 @@
+// ================================================================================
+//
+//	File:
+//      ioring.h
+//
+//	Component:
+//      System
+//
+//	Description:
+//      Asynchronous I/O queue interface
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __IORING_H__
+#define __IORING_H__
+
+// Requests in flight per queue (default)
+const UINT IO_DEFAULT_QUEUE_DEPTH = 64;
+
+// ================================================================================
+// Class:
+//      CIoRing
+//
+//  Description:
+//      Asynchronous positional I/O queue.  On Linux requests go through an
+//		io_uring: they are collected in the submission ring and handed to the
+//		kernel in one call, and completions are polled from the shared ring
+//		before falling back to a blocking wait.  Short transfers are resubmitted
+//		for the remainder.  Where no ring can be created, or the kernel supports
+//		no positional read and write operation, IsAvailable is false and
+//		callers perform the I/O synchronously.
+//
+//		Many threads may share a queue.  Each request belongs to the thread
+//		that queued it: Wait returns once the calling thread's requests have
+//		completed and reports only their failures.
+// ================================================================================
+class CIoRing
+{
+public:
+	CIoRing(UINT cDepth = IO_DEFAULT_QUEUE_DEPTH);
+	virtual ~CIoRing();
+
+	void Read(INT fd, FILEOFFSET position, void* pBuffer, UINT cbLen, UINT* pcbDone);
+	void Write(INT fd, FILEOFFSET position, const void* pBuffer, UINT cbLen, UINT* pcbDone);
+	void Wait();
+	void Drain();
+
+	bool IsAvailable()					{ return m_fAvailable; }
+	UINT GetDepth()						{ return m_rgRequests.size(); }
+
+private:
+	// ----------------------------------------------------------------------------
+	//	Request slot (index is the ring user data)
+	// ----------------------------------------------------------------------------
+	struct IoRequest
+	{
+		UINT		Op;				// Ring opcode
+		INT			File;			// File descriptor
+		FILEOFFSET	Position;		// File offset of the request
+		BYTE*		Buffer;			// Data buffer
+		UINT		Length;			// Count of bytes requested
+		UINT		Done;			// Count of bytes transferred
+		UINT*		Result;			// Caller's transfer count (optional)
+		UINT		Owner;			// Id of the thread that queued the request
+#if defined (__LINUX__)
+		iovec		Vector;			// Transfer vector (vectored operations only)
+#endif
+	};
+
+	// ----------------------------------------------------------------------------
+	//	Requests of one thread
+	// ----------------------------------------------------------------------------
+	struct IoOwner
+	{
+		UINT		Thread;			// Thread id
+		UINT		Pending;		// Count of requests not yet completed
+		bool		Failed;			// A request failed since the thread's last Wait
+	};
+
+	void Queue(UINT uiOp, INT fd, FILEOFFSET position, BYTE* pBuffer, UINT cbLen, UINT* pcbDone);
+	void Prepare(UINT idxRequest);
+	void Submit();
+	void Reap(bool fWait);
+	void Complete(UINT idxRequest, INT iResult);
+	UINT FindOwner(UINT idThread);
+
+#if defined (__LINUX__)
+	static bool IsSupported(const io_uring_probe* pProbe, UINT uiOp);
+#endif
+
+private:
+	CMutex				m_mutex;		// Access lock
+	vector<IoRequest>	m_rgRequests;	// Request slots
+	vector<UINT>		m_rgFree;		// Free request slots
+	UINT				m_cQueued;		// Prepared but not submitted
+	bool				m_fAvailable;	// Kernel ring created
+	vector<IoOwner>		m_rgOwners;		// Threads with requests since their last Wait
+
+#if defined (__LINUX__)
+	INT					m_fdRing;		// Ring file descriptor
+	bool				m_fVectored;	// Kernel lacks plain read/write; use readv/writev
+	BYTE*				m_pSqRing;		// Submission ring mapping
+	BYTE*				m_pCqRing;		// Completion ring mapping
+	UINT				m_cbSqRing;		// Size of submission ring mapping
+	UINT				m_cbCqRing;		// Size of completion ring mapping
+	void*				m_pSqes;		// Submission entries
+	UINT				m_cbSqes;		// Size of submission entries
+	UINT*				m_pSqTail;		// Submission ring tail
+	UINT				m_idxSqTail;	// Tail including prepared entries
+	UINT*				m_pSqMask;		// Submission ring mask
+	UINT*				m_pSqArray;		// Submission ring index array
+	UINT*				m_pCqHead;		// Completion ring head
+	UINT*				m_pCqTail;		// Completion ring tail
+	UINT*				m_pCqMask;		// Completion ring mask
+	void*				m_pCqes;		// Completion entries
+#endif
+};
+
+#endif // __IORING_H__
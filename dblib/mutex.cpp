@@ -23,16 +23,19 @@
 //      CMutex::CMutex
 //
 //  Description:
-//      Constructor -- initializes critical section/mutex object
+//      Constructor -- initializes critical section/mutex object.  The mutex is
+//		recursive on every platform, matching critical section semantics.
 // --------------------------------------------------------------------------------
 CMutex::CMutex()
 {
-#ifdef WIN32
+#if defined (__WIN32__)
 	InitializeCriticalSection(&m_mutex);
-#elif LINUX
+#elif defined (__LINUX__)
 	pthread_mutexattr_t	attr;
 	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&m_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
 #endif
 }
 	
@@ -45,9 +48,9 @@ CMutex::CMutex()
 // --------------------------------------------------------------------------------
 CMutex::~CMutex()
 {
-#ifdef WIN32
+#if defined (__WIN32__)
 	DeleteCriticalSection(&m_mutex);
-#elif LINUX
+#elif defined (__LINUX__)
 	pthread_mutex_destroy(&m_mutex);
 #endif
 }
@@ -61,9 +64,9 @@ CMutex::~CMutex()
 // --------------------------------------------------------------------------------
 void CMutex::Lock()
 {
-#ifdef WIN32
+#if defined (__WIN32__)
 	EnterCriticalSection(&m_mutex);
-#elif LINUX
+#elif defined (__LINUX__)
 	pthread_mutex_lock(&m_mutex);
 #endif
 }
@@ -77,9 +80,9 @@ void CMutex::Lock()
 // --------------------------------------------------------------------------------
 void CMutex::Unlock()
 {
-#ifdef WIN32
+#if defined (__WIN32__)
 	LeaveCriticalSection(&m_mutex);
-#elif LINUX
+#elif defined (__LINUX__)
 	pthread_mutex_unlock(&m_mutex);
 #endif
 }
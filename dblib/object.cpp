@@ -50,11 +50,12 @@ CObject::~CObject()
 //      CObject::Increment
 //
 //  Description:
-//      Increment ref count
+//      Increment ref count.  The caller already holds a reference, so the
+//		increment needs no ordering.
 // --------------------------------------------------------------------------------
 void CObject::Increment()
 {
-	m_cRef++;
+	AtomicIncrementRelaxed(&m_cRef);
 }
 
 // --------------------------------------------------------------------------------
@@ -62,13 +63,15 @@ void CObject::Increment()
 //      CObject::Decrement
 //
 //  Description:
-//      Decrement ref count
+//      Decrement ref count.  Each release publishes the thread's changes to
+//		the object, and the thread dropping the last reference sees them all
+//		before it deletes the object.
 // --------------------------------------------------------------------------------
 void CObject::Decrement()
 {
-	m_cRef--;
+	LONG cRef = AtomicDecrementAcqRel(&m_cRef);
 
-	if (m_cRef == 0)
+	if (cRef == 0)
 	{
  		delete this;
 	}
@@ -86,7 +89,7 @@ void CObject::Decrement()
 // --------------------------------------------------------------------------------
 UINT CObject::GetReferences()
 {
-	return m_cRef;
+	return (UINT) AtomicLoad(&m_cRef);
 }
 
 
@@ -28,7 +28,7 @@ SmartPointer(CObject);
 //
 //  Description:
 //      Base system object.  Provides ref counting, smart pointers, rtti, and
-//		tracing
+//		tracing.  The ref count is atomic, so threads may share an object.
 // ================================================================================
 class CObject
 {
@@ -41,7 +41,7 @@ public:
 	UINT GetReferences();
 
 private:
-	UINT		m_cRef;			// Object reference count
+	volatile LONG	m_cRef;		// Object reference count (changed atomically)
 };
 
 #endif // __OBJECT_H__
@@ -30,7 +30,8 @@
 //
 //  Description:
 //      Reader/writer lock class.  Allows multiple simultaneous reads and only one
-//		write.
+//		write.  Writers take precedence: once a writer is waiting, new readers
+//		wait at the read barrier until no writers are left.
 // ================================================================================
 class CRWLock : private CMutex
 {
@@ -41,10 +42,11 @@ public:
 	void Unlock();
 
 private:
-  CSemaphore	m_WriteLock;		// used as a one-at-a-time release valve
-  CGate			m_ReadBarrier;		// used to block/wakeup readers
-  UINT			m_cWriter;			// # of writers waiting for or holding the lock
-  UINT			m_cReader;			// # of readers holding the lock
+	CSemaphore	m_WriteLock;		// Wakes a waiting writer when the lock may be free
+	CGate		m_ReadBarrier;		// Closed while writers wait for or hold the lock
+	UINT		m_cWriter;			// # of writers waiting for or holding the lock
+	UINT		m_cReader;			// # of readers holding the lock
+	bool		m_fWriting;			// A writer holds the lock
 };
 
 // ================================================================================
@@ -60,11 +62,11 @@ private:
 // --------------------------------------------------------------------------------
 inline CRWLock::CRWLock()
 {
-	m_cWriter = 0;
-	m_cReader = 0;
+	m_cWriter	= 0;
+	m_cReader	= 0;
+	m_fWriting	= false;
 
-	// Initialize semaphore count to one
-	m_WriteLock.Post();
+	m_ReadBarrier.Open();
 }
 
 // --------------------------------------------------------------------------------
@@ -99,17 +101,21 @@ inline void CRWLock::ReadLock()
 // --------------------------------------------------------------------------------
 inline void CRWLock::WriteLock()
 {
-    CMutex::Lock();
+	CMutex::Lock();
 
 	// Stop new readers from getting lock
-    m_cWriter++;
-
-    // Wait for write lock to become available
-	m_WriteLock.Wait();
-
-    // Give new readers something to wait for
+	m_cWriter++;
 	m_ReadBarrier.Close();
 
+	// Wait for the readers and the current writer to release the lock
+	while (m_cReader > 0 || m_fWriting)
+	{
+		CMutex::Unlock();
+		m_WriteLock.Wait();
+		CMutex::Lock();
+	}
+
+	m_fWriting = true;
 	CMutex::Unlock();
 }
 
@@ -122,14 +128,19 @@ inline void CRWLock::WriteLock()
 // --------------------------------------------------------------------------------
 inline void CRWLock::Unlock()
 {
-    CMutex::Lock();
+	CMutex::Lock();
 
-	if (m_cWriter > 0)
+	if (m_fWriting)
 	{
+		m_fWriting = false;
 		m_cWriter--;
-		m_WriteLock.Post();
 
-		if (m_cWriter == 0)
+		// Pass the lock to the next writer, or let the readers in
+		if (m_cWriter > 0)
+		{
+			m_WriteLock.Post();
+		}
+		else
 		{
 			m_ReadBarrier.Open();
 		}
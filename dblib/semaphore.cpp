@@ -23,14 +23,15 @@
 //      CSemaphore::CSemaphore
 //
 //  Description:
-//      Constructor
+//      Constructor.  The count starts at zero.
 // --------------------------------------------------------------------------------
-inline CSemaphore::CSemaphore()
+CSemaphore::CSemaphore()
 {
 #if defined (__WIN32__)
 	m_semaphore = CreateSemaphore(NULL, 0, 0x7ffffff, NULL);
 #elif defined (__LINUX__)
-	m_semaphore = semget(IPC_PRIVATE, 1, 0666);
+	m_uiCount	= 0;
+	m_cWaiters	= 0;
 #endif
 }
 	
@@ -44,12 +45,13 @@ inline CSemaphore::CSemaphore()
 //	Inputs:
 //		iCount == IN: Initial semaphore count
 // --------------------------------------------------------------------------------
-inline CSemaphore::CSemaphore(int iCount)
+CSemaphore::CSemaphore(int iCount)
 {
 #if defined (__WIN32__)
 	m_semaphore = CreateSemaphore(NULL, iCount, 0x7ffffff, NULL);
 #elif defined (__LINUX__)
-	m_semaphore = semget(IPC_PRIVATE, iCount, 0666);
+	m_uiCount	= iCount;
+	m_cWaiters	= 0;
 #endif
 }
 
@@ -60,12 +62,10 @@ inline CSemaphore::CSemaphore(int iCount)
 //  Description:
 //      Destructor
 // --------------------------------------------------------------------------------
-inline CSemaphore::~CSemaphore()
+CSemaphore::~CSemaphore()
 {
 #if defined (__WIN32__)
 	CloseHandle(m_semaphore);
-#elif defined (__LINUX__)
-	semctl(m_semaphore, 0, IPC_RMID);
 #endif
 }
 
@@ -74,18 +74,36 @@ inline CSemaphore::~CSemaphore()
 //      CSemaphore::Wait
 //
 //  Description:
-//      Wait for semaphore to reach 0
+//      Wait for the semaphore count to be above zero and decrease it by 1
 // --------------------------------------------------------------------------------
-inline void CSemaphore::Wait()
+void CSemaphore::Wait()
 {
 #if defined (__WIN32__)	
 	WaitForSingleObject(m_semaphore, INFINITE);
 #elif defined (__LINUX__)
-	m_sembuf.sem_num = 0;
-	m_sembuf.sem_op	 = 0;
-	m_sembuf.sem_flg = 0;	// BLOCK
-	
-	semop(m_semaphore, &m_sembuf, 1);
+	UINT uiCount = __atomic_load_n(&m_uiCount, __ATOMIC_RELAXED);
+
+	while (true)
+	{
+		if (uiCount > 0)
+		{
+			if (__atomic_compare_exchange_n(&m_uiCount, &uiCount, uiCount - 1,
+											true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			{
+				return;
+			}
+		}
+		else
+		{
+			// Counted before the futex looks at the word, so a Post that
+			// raises the count either wakes this thread or is seen by it
+			__atomic_add_fetch(&m_cWaiters, 1, __ATOMIC_SEQ_CST);
+			FutexWait(&m_uiCount, 0, NULL);
+			__atomic_sub_fetch(&m_cWaiters, 1, __ATOMIC_RELAXED);
+
+			uiCount = __atomic_load_n(&m_uiCount, __ATOMIC_RELAXED);
+		}
+	}
 #endif
 }
 	
@@ -96,17 +114,9 @@ inline void CSemaphore::Wait()
 //  Description:
 //      Increases semaphore count by 1
 // --------------------------------------------------------------------------------
-inline void CSemaphore::Post()
+void CSemaphore::Post()
 {
-#if defined (__WIN32__)
-	ReleaseSemaphore(m_semaphore, 1, NULL);
-#elif defined (__LINUX__)
-	m_sembuf.sem_num = 0;
-	m_sembuf.sem_op	 = 1;
-	m_sembuf.sem_flg = 0;	// BLOCK
-	
-	semop(m_semaphore, &m_sembuf, 1);
-#endif
+	Post(1);
 }
 	
 // --------------------------------------------------------------------------------
@@ -114,21 +124,24 @@ inline void CSemaphore::Post()
 //      CSemaphore::Post
 //
 //  Description:
-//      Increas semaphore count by n
+//      Increase semaphore count by n
 //
 //	Inputs:
 //		iCount == IN: Increase semaphore count by iCount
 // --------------------------------------------------------------------------------
-inline void CSemaphore::Post(int iCount)
+void CSemaphore::Post(int iCount)
 {
 #if defined (__WIN32__)
 	ReleaseSemaphore(m_semaphore, iCount, NULL);
 #elif defined (__LINUX__)
-	m_sembuf.sem_num = 0;
-	m_sembuf.sem_op	 = iCount;
-	m_sembuf.sem_flg = 0;	// BLOCK
-	
-	semop(m_semaphore, &m_sembuf, 1);
+	__atomic_add_fetch(&m_uiCount, iCount, __ATOMIC_SEQ_CST);
+
+	// Wake no more sleepers than the posts can satisfy
+	UINT cWaiters = __atomic_load_n(&m_cWaiters, __ATOMIC_SEQ_CST);
+
+	if (cWaiters > 0)
+	{
+		FutexWake(&m_uiCount, min(iCount, (int) cWaiters));
+	}
 #endif
 }
-
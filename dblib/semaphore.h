@@ -24,7 +24,11 @@
 //      CSemaphore
 //
 //  Description:
-//      Semaphore class
+//      Counting semaphore.  Post adds to the count and Wait blocks until the
+//		count is above zero, then takes one.  On Linux the count is a futex
+//		word and sleeping waiters are counted beside it, so Post wakes only as
+//		many waiters as it can satisfy, and Post and an uncontended Wait stay
+//		in user space.
 // ================================================================================
 class CSemaphore 
 {
@@ -41,8 +45,8 @@ private:
 #if defined (__WIN32__)
 	HANDLE	m_semaphore;			// Win32 semaphore handle
 #elif defined (__LINUX__)
-	int		m_semaphore;			// Linux semaphore id
-	sembuf	m_sembuf;				// Semaphore op buffer
+	UINT	m_uiCount;		// Futex word (see semaphore.cpp)
+	UINT	m_cWaiters;		// Threads sleeping in Wait
 #endif
 };
 
@@ -29,6 +29,11 @@
 // cast a smart pointer of one type to a pointer of another type.
 #define SmartPointerCast(type, smartptr)	((type*)(void*)(smartptr))
 
+// Compilers with rvalue references move pointers without touching the ref count
+#if (__cplusplus >= 201103L) || (defined (_MSC_VER) && (_MSC_VER >= 1900))
+#define SMARTPTR_MOVE
+#endif
+
 // ================================================================================
 //  Template:
 //      CPointer
@@ -58,6 +63,14 @@ public:
 			m_pObject->Increment();
 	}
 
+#if defined (SMARTPTR_MOVE)
+	CPointer (CPointer&& rPointer) noexcept
+	{
+		m_pObject = rPointer.m_pObject;
+		rPointer.m_pObject = 0;
+	}
+#endif
+
 	~CPointer()
 	{
 		if (m_pObject)
@@ -89,6 +102,21 @@ public:
 		return *this;
 	}
 
+#if defined (SMARTPTR_MOVE)
+	CPointer& operator= (CPointer&& rPointer) noexcept
+	{
+		if (this != &rPointer)
+		{
+			T* pOld = m_pObject;
+			m_pObject = rPointer.m_pObject;
+			rPointer.m_pObject = 0;
+			if (pOld)
+				pOld->Decrement();
+		}
+		return *this;
+	}
+#endif
+
 	CPointer& operator= (T* pObject)
 	{
 		if (m_pObject != pObject)
@@ -24,26 +24,39 @@
 #include <windows.h>
 #include <crtdbg.h>
 #include <process.h>
+#include <io.h>
+#include <fcntl.h>
 #elif defined (__LINUX__)
 #include <unistd.h>
 #include <stdint.h>
 #include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/sem.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <sched.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/io_uring.h>
 #endif
 
 // --------------------------------------------------------------------------------
 // STANDARD LIBRARY HEADERS
 // --------------------------------------------------------------------------------
 #include <cstdlib>
+#include <climits>
 #include <exception>
 #include <stdexcept>
 #include <memory>
 #include <string>
+#include <vector>
+#include <deque>
 #include <cwchar>
 #include <cstdio>
+#include <cerrno>
 #include <iostream>
 #include <fstream>
 #include <strstream>
@@ -55,17 +68,21 @@ using namespace std;
 // SYSTEM HEADERS
 // --------------------------------------------------------------------------------
 #include "types.h"
+#include "atomic.h"
+#include "futex.h"
 #include "mutex.h"
 #include "semaphore.h"
 #include "event.h"
 #include "gate.h"
 #include "rwlock.h"
+#include "distrwlock.h"
 #include "smartptr.h"
 #include "object.h"
 #include "file.h"
 #include "err.h"
 #include "trace.h"
 #include "thread.h"
+#include "threadpool.h"
 
 // --------------------------------------------------------------------------------
 // MACROS
@@ -27,6 +27,9 @@
 // --------------------------------------------------------------------------------
 CThread::CThread()
 {
+	m_ThreadID		= 0;
+	m_ThreadAddr	= 0;
+	m_ThreadState	= THREAD_STATE_NEW;
 }
 
 // --------------------------------------------------------------------------------
@@ -46,10 +49,20 @@ CThread::~CThread()
 
 // --------------------------------------------------------------------------------
 //  Method:
-//      CThread::Create
+//      CThread::Init
 //
 //  Description:
-//      Initialize thread
+//      Initialize thread and start it running pFunction(pArg)
+//
+//  Inputs:
+//		pFunction	== IN: Thread function
+//		pArg		== IN: Argument passed to the thread function
+//		fSuspended	== IN: Create suspended (WIN32 only)
+//		stack		== IN: Stack size (zero for the default)
+//
+//  Exceptions:
+//		runtime_error == thread could not be created
+//		logic_error	  == fSuspended under Linux
 // --------------------------------------------------------------------------------
 void CThread::Init
 (
@@ -59,7 +72,7 @@ void CThread::Init
 	THREAD_STACK		stack
 )
 {
-#ifdef WIN32
+#if defined (__WIN32__)
 	m_ThreadID = (HANDLE) _beginthreadex(NULL,
 										 stack,
 										 pFunction,
@@ -70,15 +83,31 @@ void CThread::Init
 	{
 		throw runtime_error("Thread could not be created");
 	}
-#elif LINUX
+#elif defined (__LINUX__)
+	if (fSuspended)
+	{
+		throw logic_error("Threads cannot be created suspended");
+	}
+
 	pthread_attr_t attr;
 
 	pthread_attr_init(&attr);
-	if (pthread_create(&m_ThreadAddr, &attr, pFunction, pArg))
+
+	if (stack)
+	{
+		pthread_attr_setstacksize(&attr, stack);
+	}
+
+	if (pthread_create(&m_ThreadID, &attr, pFunction, pArg))
 	{
+		pthread_attr_destroy(&attr);
 		throw runtime_error("Thread could not be created");
 	}
+
+	pthread_attr_destroy(&attr);
 #endif
+
+	m_ThreadState = fSuspended ? THREAD_STATE_SUSPENDED : THREAD_STATE_RUNNING;
 }
 
 // --------------------------------------------------------------------------------
@@ -86,14 +115,19 @@ void CThread::Init
 //      CThread::Suspend
 //
 //  Description:
-//      Suspend thread execution
+//      Suspend thread execution.  POSIX threads cannot be suspended by another
+//		thread, so under Linux this always fails.
+//
+//  Exceptions:
+//		logic_error == called under Linux
 // --------------------------------------------------------------------------------
 void CThread::Suspend()
 {
 #if defined (__WIN32__)
 	SuspendThread(m_ThreadID);
+	m_ThreadState = THREAD_STATE_SUSPENDED;
 #elif defined (__LINUX__)
-
+	throw logic_error("Threads cannot be suspended");
 #endif
 }
 
@@ -102,14 +136,107 @@ void CThread::Suspend()
 //      CThread::Resume
 //
 //  Description:
-//      Resume thread execution
+//      Resume thread execution.  Under Linux a thread is never suspended
+//		(see Suspend), so there is nothing to resume.
 // --------------------------------------------------------------------------------
 void CThread::Resume()
 {
 #if defined (__WIN32__)
 	ResumeThread(m_ThreadID);
+	m_ThreadState = THREAD_STATE_RUNNING;
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThread::Join
+//
+//  Description:
+//      Wait for the thread function to return and release the thread
+// --------------------------------------------------------------------------------
+void CThread::Join()
+{
+	if (m_ThreadState != THREAD_STATE_RUNNING && m_ThreadState != THREAD_STATE_SUSPENDED)
+	{
+		return;
+	}
+
+#if defined (__WIN32__)
+	WaitForSingleObject(m_ThreadID, INFINITE);
+	CloseHandle(m_ThreadID);
 #elif defined (__LINUX__)
+	pthread_join(m_ThreadID, NULL);
+#endif
+
+	m_ThreadState = THREAD_STATE_EXITED;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThread::GetProcessorCount
+//
+//  Description:
+//      Count of processors available to run threads
+//
+//  Returns:
+//      Processor count (at least one)
+// --------------------------------------------------------------------------------
+UINT CThread::GetProcessorCount()
+{
+	INT cProcessors = 1;
 
+#if defined (__WIN32__)
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	cProcessors = (INT) info.dwNumberOfProcessors;
+#elif defined (__LINUX__)
+	cProcessors = (INT) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	return (cProcessors > 0) ? (UINT) cProcessors : 1;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThread::GetCurrentId
+//
+//  Description:
+//      Id of the calling thread, unique among running threads
+//
+//  Returns:
+//      Thread id (never zero)
+// --------------------------------------------------------------------------------
+UINT CThread::GetCurrentId()
+{
+#if defined (__WIN32__)
+	return (UINT) GetCurrentThreadId();
+#elif defined (__LINUX__)
+	// Kept per thread to save a system call
+	static __thread UINT s_idThread = 0;
+
+	if (s_idThread == 0)
+	{
+		s_idThread = (UINT) syscall(SYS_gettid);
+	}
+
+	return s_idThread;
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThread::Relinquish
+//
+//  Description:
+//      Give the rest of the calling thread's time slice to another thread
+// --------------------------------------------------------------------------------
+void CThread::Relinquish()
+{
+#if defined (__WIN32__)
+	SwitchToThread();
+#elif defined (__LINUX__)
+	sched_yield();
 #endif
 }
 
@@ -118,14 +245,14 @@ void CThread::Resume()
 //      CThread::Close
 //
 //  Description:
-//      Close and exit thread
+//      Exit the calling thread
 // --------------------------------------------------------------------------------
 void CThread::Close()
 {
 #if defined (__WIN32__)
 	ExitThread(-1);
 #elif defined (__LINUX__)
-
+	pthread_exit(NULL);
 #endif
 }
 
@@ -134,14 +261,15 @@ void CThread::Close()
 //      CThread::Destroy
 //
 //  Description:
-//      Kill thread
+//      Kill thread.  The thread is stopped at once under WIN32; a POSIX thread
+//		is canceled at its next cancellation point.
 // --------------------------------------------------------------------------------
 void CThread::Destroy()
 {
 #if defined (__WIN32__)
 	TerminateThread(m_ThreadID, -1);
 #elif defined (__LINUX__)
-
+	pthread_cancel(m_ThreadID);
 #endif
 }
 
@@ -150,15 +278,25 @@ void CThread::Destroy()
 //      CThread::Cancel
 //
 //  Description:
-//      Cancel thread
+//      Cancel thread and wait for it to end
 // --------------------------------------------------------------------------------
 void CThread::Cancel()
 {
-#if defined (__WIN32__)
+	if (m_ThreadState != THREAD_STATE_RUNNING && m_ThreadState != THREAD_STATE_SUSPENDED)
+	{
+		return;
+	}
 
+#if defined (__WIN32__)
+	TerminateThread(m_ThreadID, -1);
+	WaitForSingleObject(m_ThreadID, INFINITE);
+	CloseHandle(m_ThreadID);
 #elif defined (__LINUX__)
-
+	pthread_cancel(m_ThreadID);
+	pthread_join(m_ThreadID, NULL);
 #endif
+
+	m_ThreadState = THREAD_STATE_CANCELED;
 }
 
 
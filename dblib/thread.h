@@ -37,8 +37,12 @@ typedef pthread_attr_t			THREAD_ATTRIBUTE;	// POSIX thread attribute type
 // Thread function pointers
 #if defined (__WIN32__)
 typedef unsigned (__stdcall *PTHREAD_FUNCTION)(void *arg);	// WIN32 thread function
+typedef unsigned				THREAD_RESULT;		// Thread function return type
+#define THREAD_CALL				__stdcall			// Thread function calling convention
 #elif defined (__LINUX__)
 typedef void *(*PTHREAD_FUNCTION)(void* arg);				// POSIX thread function
+typedef void*					THREAD_RESULT;		// Thread function return type
+#define THREAD_CALL									// Thread function calling convention
 #endif
 
 // --------------------------------------------------------------------------------
@@ -134,11 +138,16 @@ public:
 
 	void Suspend();
 	void Resume();
+	void Join();
 	void Close();
 	void Destroy();
 	void Cancel();
 	void GetState();
 
+	static UINT GetProcessorCount();
+	static UINT GetCurrentId();
+	static void Relinquish();
+
 private:
 	THREAD_ID		m_ThreadID;
 	UINT			m_ThreadAddr;
@@ -0,0 +1,542 @@
+// ================================================================================
+//
+//	File:
+//      threadpool.cpp
+//
+//	Component:
+//      System
+//
+//	Description:
+//      Thread pool implementation
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#include "sys.h"
+
+// Shared pool (created on first use)
+static CThreadPool*	s_pDefaultPool = NULL;
+static CMutex		s_mutexDefaultPool;
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CTask::CTask
+//
+//  Description:
+//      Constructor
+//
+//  Inputs:
+//		pFunction	== IN: Task function
+//		pArg		== IN: Argument passed to the task function
+// --------------------------------------------------------------------------------
+CTask::CTask
+(
+	PTASK_FUNCTION	pFunction,
+	void*			pArg
+)
+{
+	m_pFunction	= pFunction;
+	m_pArg		= pArg;
+	m_pPool		= NULL;
+	m_fFailed	= false;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CTask::~CTask
+//
+//  Description:
+//      Destructor.  Waits for a submitted task to run; its failure is not
+//		reported.
+// --------------------------------------------------------------------------------
+CTask::~CTask()
+{
+	if (m_pPool)
+	{
+		m_pPool->Wait(this);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CTask::Wait
+//
+//  Description:
+//      Wait for the task to run
+//
+//  Exceptions:
+//		logic_error	  == task never submitted
+//		runtime_error == task function threw
+// --------------------------------------------------------------------------------
+void CTask::Wait()
+{
+	if (!m_pPool)
+	{
+		throw logic_error("Task not submitted");
+	}
+
+	m_pPool->Wait(this);
+
+	if (m_fFailed)
+	{
+		throw runtime_error(m_strError);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CTask::Run
+//
+//  Description:
+//      Run the task function and record how it ended
+// --------------------------------------------------------------------------------
+void CTask::Run()
+{
+	try
+	{
+		m_pFunction(m_pArg);
+	}
+	catch (exception& e)
+	{
+		m_fFailed	= true;
+		m_strError	= e.what();
+	}
+	catch ( ... )
+	{
+		m_fFailed	= true;
+		m_strError	= "Task failed";
+	}
+
+	// The owner may free the task as soon as it is done
+	CThreadPool* pPool = m_pPool;
+
+	m_evDone.Set();
+
+	if (pPool)
+	{
+		pPool->WakeWaiters();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::CThreadPool
+//
+//  Description:
+//      Constructor.  Starts the worker threads.
+//
+//  Inputs:
+//		cWorkers == IN: Count of worker threads (zero for one per processor)
+//
+//  Exceptions:
+//		runtime_error == no worker thread could be started
+// --------------------------------------------------------------------------------
+CThreadPool::CThreadPool
+(
+	UINT cWorkers
+)
+{
+	m_idxNext	= 0;
+	m_fStop		= false;
+	m_cWaiting	= 0;
+
+	if (cWorkers == 0)
+	{
+		cWorkers = CThread::GetProcessorCount();
+	}
+
+#if defined (__WIN32__)
+	m_key = TlsAlloc();
+#elif defined (__LINUX__)
+	pthread_key_create(&m_key, NULL);
+#endif
+
+	for (UINT idx = 0; idx < cWorkers; idx++)
+	{
+		Worker* pWorker = new Worker;
+
+		pWorker->Pool	= this;
+		pWorker->Index	= idx;
+
+		try
+		{
+			pWorker->Thread.Init(WorkerThread, pWorker);
+		}
+		catch ( ... )
+		{
+			// Run with the threads that started
+			delete pWorker;
+			break;
+		}
+
+		m_rgWorkers.push_back(pWorker);
+	}
+
+	if (m_rgWorkers.empty())
+	{
+		throw runtime_error("Thread pool could not be started");
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::~CThreadPool
+//
+//  Description:
+//      Destructor.  Tasks already submitted are run before the workers exit.
+// --------------------------------------------------------------------------------
+CThreadPool::~CThreadPool()
+{
+	m_mutex.Lock();
+	m_fStop = true;
+	m_mutex.Unlock();
+
+	m_semWork.Post(m_rgWorkers.size());
+
+	// Workers steal from each other until they exit
+	for (UINT idx = 0; idx < m_rgWorkers.size(); idx++)
+	{
+		m_rgWorkers[idx]->Thread.Join();
+	}
+
+	for (UINT idx = 0; idx < m_rgWorkers.size(); idx++)
+	{
+		delete m_rgWorkers[idx];
+	}
+
+#if defined (__WIN32__)
+	TlsFree(m_key);
+#elif defined (__LINUX__)
+	pthread_key_delete(m_key);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::GetDefault
+//
+//  Description:
+//      Pool shared by the engine, with one worker per processor.  It is
+//		created on first use and lives until the process exits.
+//
+//  Returns:
+//      Pointer to the shared pool
+// --------------------------------------------------------------------------------
+CThreadPool* CThreadPool::GetDefault()
+{
+	s_mutexDefaultPool.Lock();
+
+	try
+	{
+		if (!s_pDefaultPool)
+		{
+			s_pDefaultPool = new CThreadPool();
+		}
+	}
+	catch ( ... )
+	{
+		s_mutexDefaultPool.Unlock();
+		throw;
+	}
+
+	s_mutexDefaultPool.Unlock();
+	return s_pDefaultPool;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::Submit
+//
+//  Description:
+//      Queue a task.  A worker queues to its own deque; other threads deal
+//		tasks out to the workers in turn.
+//
+//  Inputs:
+//		pTask == IN: Task to run (kept alive by the caller until it has run)
+//
+//  Exceptions:
+//		logic_error == task already submitted
+// --------------------------------------------------------------------------------
+void CThreadPool::Submit
+(
+	CTask* pTask
+)
+{
+	if (pTask->m_pPool)
+	{
+		throw logic_error("Task already submitted");
+	}
+
+	pTask->m_pPool = this;
+
+	Worker* pWorker = GetCurrentWorker();
+
+	if (!pWorker)
+	{
+		m_mutex.Lock();
+		pWorker = m_rgWorkers[m_idxNext];
+		m_idxNext = (m_idxNext + 1) % m_rgWorkers.size();
+		m_mutex.Unlock();
+	}
+
+	Push(pWorker, pTask);
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::Wait
+//
+//  Description:
+//      Wait for a task to run.  A worker of this pool runs queued tasks while
+//		it waits, and sleeps only while there is nothing to run; it is woken
+//		when a task is pushed or completes.
+//
+//  Inputs:
+//		pTask == IN: Submitted task
+// --------------------------------------------------------------------------------
+void CThreadPool::Wait
+(
+	CTask* pTask
+)
+{
+	Worker* pSelf = GetCurrentWorker();
+
+	if (!pSelf)
+	{
+		pTask->m_evDone.Wait();
+		return;
+	}
+
+	while (!pTask->m_evDone.Wait(0))
+	{
+		CTask* pOther = TakeTask(pSelf->Index);
+
+		if (pOther)
+		{
+			pOther->Run();
+			continue;
+		}
+
+		// The task is running on another thread.  The worker counts itself
+		// asleep before looking again, so a push or completion the second
+		// look misses sees the count and wakes it.
+		pSelf->Wake.Reset();
+		AtomicIncrement(&m_cWaiting);
+
+		if (!pTask->m_evDone.Wait(0) && IsEmpty())
+		{
+			pSelf->Wake.Wait();
+		}
+
+		AtomicDecrement(&m_cWaiting);
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::GetCurrentWorker
+//
+//  Description:
+//      Worker of this pool running on the calling thread
+//
+//  Returns:
+//      Pointer to the worker; NULL for other threads
+// --------------------------------------------------------------------------------
+CThreadPool::Worker* CThreadPool::GetCurrentWorker()
+{
+#if defined (__WIN32__)
+	return (Worker*) TlsGetValue(m_key);
+#elif defined (__LINUX__)
+	return (Worker*) pthread_getspecific(m_key);
+#endif
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::Push
+//
+//  Description:
+//      Add a task to the back of a worker's deque and wake a worker
+//
+//  Inputs:
+//		pWorker	== IN: Worker
+//		pTask	== IN: Task
+// --------------------------------------------------------------------------------
+void CThreadPool::Push
+(
+	Worker*	pWorker,
+	CTask*	pTask
+)
+{
+	pWorker->Lock.Lock();
+	pWorker->Tasks.push_back(pTask);
+	pWorker->Lock.Unlock();
+
+	m_semWork.Post();
+	WakeWaiters();
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::WakeWaiters
+//
+//  Description:
+//      Wake the workers asleep in Wait after a task is pushed or completes
+// --------------------------------------------------------------------------------
+void CThreadPool::WakeWaiters()
+{
+	if (AtomicLoad(&m_cWaiting) == 0)
+	{
+		return;
+	}
+
+	for (UINT idx = 0; idx < m_rgWorkers.size(); idx++)
+	{
+		m_rgWorkers[idx]->Wake.Set();
+	}
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::TakeTask
+//
+//  Description:
+//      Take the newest task of a worker's own deque, or steal the oldest task
+//		of another worker
+//
+//  Inputs:
+//		idxWorker == IN: Worker index
+//
+//  Returns:
+//      Task to run; NULL if every deque is empty
+// --------------------------------------------------------------------------------
+CTask* CThreadPool::TakeTask
+(
+	UINT idxWorker
+)
+{
+	CTask*	pTask	= NULL;
+	Worker*	pOwn	= m_rgWorkers[idxWorker];
+
+	pOwn->Lock.Lock();
+
+	if (!pOwn->Tasks.empty())
+	{
+		pTask = pOwn->Tasks.back();
+		pOwn->Tasks.pop_back();
+	}
+
+	pOwn->Lock.Unlock();
+
+	for (UINT idx = 1; !pTask && idx < m_rgWorkers.size(); idx++)
+	{
+		Worker* pVictim = m_rgWorkers[(idxWorker + idx) % m_rgWorkers.size()];
+
+		pVictim->Lock.Lock();
+
+		if (!pVictim->Tasks.empty())
+		{
+			pTask = pVictim->Tasks.front();
+			pVictim->Tasks.pop_front();
+		}
+
+		pVictim->Lock.Unlock();
+	}
+
+	return pTask;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::IsEmpty
+//
+//  Description:
+//      Check every deque at one instant.  TakeTask looks at the deques one at
+//		a time, so it can miss a task pushed to a deque it already passed.
+//
+//  Returns:
+//      true if no tasks are queued
+// --------------------------------------------------------------------------------
+bool CThreadPool::IsEmpty()
+{
+	bool fEmpty = true;
+
+	for (UINT idx = 0; idx < m_rgWorkers.size(); idx++)
+	{
+		m_rgWorkers[idx]->Lock.Lock();
+	}
+
+	for (UINT idx = 0; idx < m_rgWorkers.size(); idx++)
+	{
+		fEmpty = fEmpty && m_rgWorkers[idx]->Tasks.empty();
+	}
+
+	for (UINT idx = 0; idx < m_rgWorkers.size(); idx++)
+	{
+		m_rgWorkers[idx]->Lock.Unlock();
+	}
+
+	return fEmpty;
+}
+
+// --------------------------------------------------------------------------------
+//  Method:
+//      CThreadPool::WorkerThread
+//
+//  Description:
+//      Worker thread.  Sleeps until a task is submitted, then runs tasks until
+//		the pool stops.  A wakeup finds no task when a waiting worker ran the
+//		task first; the deques are then all empty.
+//
+//  Inputs:
+//      pArg == IN: Worker
+// --------------------------------------------------------------------------------
+THREAD_RESULT THREAD_CALL CThreadPool::WorkerThread
+(
+	void* pArg
+)
+{
+	Worker*			pWorker	= (Worker*) pArg;
+	CThreadPool*	pPool	= pWorker->Pool;
+
+#if defined (__WIN32__)
+	TlsSetValue(pPool->m_key, pWorker);
+#elif defined (__LINUX__)
+	pthread_setspecific(pPool->m_key, pWorker);
+#endif
+
+	while (true)
+	{
+		pPool->m_semWork.Wait();
+
+		CTask* pTask;
+
+		// A task pushed behind the scan would be left without a wakeup
+		do
+		{
+			pTask = pPool->TakeTask(pWorker->Index);
+		}
+		while (!pTask && !pPool->IsEmpty());
+
+		if (pTask)
+		{
+			pTask->Run();
+			continue;
+		}
+
+		pPool->m_mutex.Lock();
+		bool fStop = pPool->m_fStop;
+		pPool->m_mutex.Unlock();
+
+		if (fStop)
+		{
+			break;
+		}
+	}
+
+	return 0;
+}
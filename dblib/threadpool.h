@@ -0,0 +1,125 @@
+// ================================================================================
+//
+//	File:
+//      threadpool.h
+//
+//	Component:
+//      System
+//
+//	Description:
+//      Thread pool interface
+//
+//	Author:
+//		andrewc
+// --------------------------------------------------------------------------------
+//  Copyright (c) 2001-2004 Andrew Carter
+//  All rights reserved
+// ================================================================================
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+class CThreadPool;
+
+// Task function
+typedef void (*PTASK_FUNCTION)(void* pArg);
+
+// ================================================================================
+// Class:
+//      CTask
+//
+//  Description:
+//      Unit of work run by a thread pool.  The task is also its own future:
+//		Wait returns once the function has run and rethrows a failure as a
+//		runtime_error.  The owner keeps the task alive until it has run; the
+//		destructor waits for a submitted task.
+// ================================================================================
+class CTask
+{
+public:
+	CTask(PTASK_FUNCTION pFunction, void* pArg);
+	~CTask();
+
+	void Wait();
+	bool IsDone()						{ return m_evDone.Wait(0); }
+
+private:
+	CTask(const CTask&);
+	CTask& operator=(const CTask&);
+
+	void Run();
+
+private:
+	PTASK_FUNCTION	m_pFunction;	// Task function
+	void*			m_pArg;			// Argument passed to the task function
+	CThreadPool*	m_pPool;		// Pool the task was submitted to
+	CEvent			m_evDone;		// Set when the task has run
+	bool			m_fFailed;		// Task function threw
+	string			m_strError;		// Description of the failure
+
+	friend class CThreadPool;
+};
+
+// ================================================================================
+// Class:
+//      CThreadPool
+//
+//  Description:
+//      Work-stealing task scheduler.  Each worker thread has its own deque of
+//		tasks: a worker takes its newest task first, and when its deque is
+//		empty it steals the oldest task of another worker.  Tasks submitted by
+//		a worker go to its own deque; others are dealt out in turn.  A worker
+//		waiting on a task runs other tasks meanwhile, so tasks may wait on the
+//		tasks they submit.
+// ================================================================================
+class CThreadPool
+{
+public:
+	CThreadPool(UINT cWorkers = 0);
+	~CThreadPool();
+
+	void Submit(CTask* pTask);
+	void Wait(CTask* pTask);
+
+	UINT GetWorkerCount()				{ return m_rgWorkers.size(); }
+
+	static CThreadPool* GetDefault();
+
+private:
+	CThreadPool(const CThreadPool&);
+	CThreadPool& operator=(const CThreadPool&);
+
+	// ----------------------------------------------------------------------------
+	//	Worker thread and its task deque
+	// ----------------------------------------------------------------------------
+	struct Worker
+	{
+		CThreadPool*	Pool;		// Owning pool
+		UINT			Index;		// Worker index
+		CThread			Thread;		// Worker thread
+		CMutex			Lock;		// Guards the deque
+		deque<CTask*>	Tasks;		// Newest task at the back
+		CEvent			Wake;		// Set when work arrives or a task completes
+	};
+
+	Worker*	GetCurrentWorker();
+	CTask*	TakeTask(UINT idxWorker);
+	bool	IsEmpty();
+	void	Push(Worker* pWorker, CTask* pTask);
+	void	WakeWaiters();
+
+	static THREAD_RESULT THREAD_CALL WorkerThread(void* pArg);
+
+private:
+	vector<Worker*>	m_rgWorkers;	// Worker threads
+	CSemaphore		m_semWork;		// Count of tasks submitted and not yet taken
+	CMutex			m_mutex;		// Guards m_idxNext and m_fStop
+	UINT			m_idxNext;		// Worker given the next outside task
+	bool			m_fStop;		// Workers exit once the deques are empty
+	THREAD_KEY		m_key;			// Worker of the current thread
+	volatile LONG	m_cWaiting;		// Workers asleep in Wait
+
+	friend class CTask;
+};
+
+#endif // __THREADPOOL_H__
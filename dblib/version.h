@@ -18,7 +18,7 @@
 #define __VERSION_H__
 
 const version verSystem = { 1, 0, 0 };
-const version verDbEngine = { 1, 0, 0 };
+const version verDbEngine = { 2, 0, 0 };
 
 #endif // __VERSION_H__
 
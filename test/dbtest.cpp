@@ -21,16 +21,182 @@
 // FUNCTION PROTOTYPES
 // --------------------------------------------------------------------------------
 void		DisplayRecords(CDbTable* pTable);
-CDbFile*	CreateTestFile(const string& strFile);
+CDbFile*	CreateTestFile(const string& strFile, UINT fMode = DB_OPEN_DEFAULT);
 void		CreateTestTables(CDbFile* pFile);
 void		StressAdd(CDbTable* pTable);
 void		StressUpdate(CDbTable* pTable);
 void		StressDelete(CDbTable* pTable);
 void		Compact(CDbFile* pFile);
 
+typedef void (*TestProc)(const string& strFile);
+
+void		RunTest(TestProc pfnTest, const string& strFile);
+void		Check(bool fPassed, const string& strTest);
+void		FillRecords(UserRecord* pRecords, UINT cRecords, UINT idFirst);
+UINT		CountRecords(CDbTable* pTable);
+bool		CompareValue(UINT uiValue, DB_SCAN_OP op, UINT uiCompare);
+void		TestBufferPool(const string& strFile);
+void		TestPositionalIO(const string& strFile);
+void		TestMappedView(const string& strFile);
+void		TestFindRecord(const string& strFile);
+void		TestSecondaryIndex(const string& strFile);
+void		TestHashIndex(const string& strFile);
+void		TestBatchChanges(const string& strFile);
+void		TestLoggedReopen(const string& strFile);
+void		TestLogRecovery(const string& strFile);
+void		TestLoggedRollback(const string& strFile);
+void		TestLoggedFlush(const string& strFile);
+void		TestAsyncIO(const string& strFile);
+void		TestDirectIO(const string& strFile);
+void		TestExpand(const string& strFile);
+void		TestTableGrowth(const string& strFile);
+void		TestUpgrade(const string& strFile);
+void		TestOnlineCompact(const string& strFile);
+void		TestFileCopy(const string& strFile);
+void		TestParallelCompact(const string& strFile);
+void		TestStableSlots(const string& strFile);
+void		TestPaxColumns(const string& strFile);
+void		TestPredicateScan(const string& strFile);
+void		TestParallelScan(const string& strFile);
+void		TestThreadPool(const string& strFile);
+void		TestSyncObjects(const string& strFile);
+void		TestDistRWLock(const string& strFile);
+void		TestRefCount(const string& strFile);
+void		TestSnapshotRead(const string& strFile);
+void		TestCursors(const string& strFile);
+void		CursorTaskProc(void* pArg);
+void		UnpinTaskProc(void* pArg);
+void		CommitTaskProc(void* pArg);
+void		SnapshotTaskProc(void* pArg);
+void		RefTaskProc(void* pArg);
+void		LockWriterProc(void* pArg);
+void		LockReaderProc(void* pArg);
+void		SyncTaskProc(void* pArg);
+void		WaitTaskProc(void* pArg);
+void		TreeTaskProc(void* pArg);
+void		FailTaskProc(void* pArg);
+
+// --------------------------------------------------------------------------------
+// Parallel scan consumer that counts and checks the records it is passed
+// --------------------------------------------------------------------------------
+class CCountConsumer : public CDbScanConsumer
+{
+public:
+	void Start(UINT cWorkers)			{ m_rgCounts.assign(cWorkers, 0); }
+
+	void Consume(UINT idxWorker, const DbRecord* prgRecords, UINT cRecords)
+	{
+		const UserRecord* pRecords = (const UserRecord*) prgRecords;
+
+		for (UINT iRec = 0; iRec < cRecords; iRec++)
+		{
+			if (pRecords[iRec].RID == 0)
+			{
+				throw logic_error("Deleted slot passed to consumer");
+			}
+		}
+
+		m_rgCounts[idxWorker] += cRecords;
+	}
+
+	UINT GetCount()
+	{
+		UINT cTotal = 0;
+
+		for (UINT iWorker = 0; iWorker < m_rgCounts.size(); iWorker++)
+		{
+			cTotal += m_rgCounts[iWorker];
+		}
+
+		return cTotal;
+	}
+
+private:
+	vector<UINT>	m_rgCounts;		// Count of records consumed by each worker
+};
+
+// --------------------------------------------------------------------------------
+// Pinned page released by a pool task
+// --------------------------------------------------------------------------------
+struct UnpinTask
+{
+	CDbBufferManager*	Buffer;		// Pool holding the page
+	CDbPage*			Page;		// Page to unpin
+};
+
+// --------------------------------------------------------------------------------
+// Pool task that commits small inserts one after another
+// --------------------------------------------------------------------------------
+struct CommitTask
+{
+	CDbTable*	Table;		// Table inserted into
+	UINT		First;		// Id of the first record inserted
+	UINT		Blocks;		// Count of REC_BUFFER record inserts
+};
+
+// --------------------------------------------------------------------------------
+// Node of a tree of nested thread pool tasks
+// --------------------------------------------------------------------------------
+struct TreeTask
+{
+	CThreadPool*	Pool;		// Pool the children are submitted to
+	UINT			Depth;		// Levels of children below this task
+	volatile LONG*	Leaves;		// Count of leaf tasks run
+};
+
+// --------------------------------------------------------------------------------
+// Pool task that posts a semaphore once started
+// --------------------------------------------------------------------------------
+struct SyncTask
+{
+	CEvent*		Start;		// Set to start posting
+	CSemaphore	Done;		// Posted Count + 3 times
+	UINT		Count;		// Count of single posts
+};
+
+// --------------------------------------------------------------------------------
+// Pool task that waits on a shared semaphore once
+// --------------------------------------------------------------------------------
+struct WaitTask
+{
+	CSemaphore*		Sem;		// Semaphore waited on
+	volatile LONG*	Passed;		// Count of tasks past the wait
+};
+
+// --------------------------------------------------------------------------------
+// Counters shared by reader and writer tasks
+// --------------------------------------------------------------------------------
+struct LockTask
+{
+	CDistRWLock		Lock;		// Guards First and Second
+	UINT			First;		// Incremented first by writers
+	UINT			Second;		// Incremented second by writers
+	volatile LONG	Torn;		// Count of reads that saw the counters differ
+};
+
+// --------------------------------------------------------------------------------
+// Table changes made while a snapshot is read
+// --------------------------------------------------------------------------------
+struct SnapshotTask
+{
+	CDbTable*		Table;		// Table changed
+	UserRecord*		Records;	// Records in the table (REC_BLOCK)
+};
+
+// --------------------------------------------------------------------------------
+// Reader of a table through its own cursor
+// --------------------------------------------------------------------------------
+struct CursorTask
+{
+	CDbTable*		Table;		// Table read
+	UINT			Total;		// Sum of the user ids read
+};
+
 const UINT REC_BUFFER	= 10;
 const UINT REC_BLOCK	= 100;
 
+UINT g_cFailed = 0;		// Count of failed checks
+
 // --------------------------------------------------------------------------------
 //  Method:
 //      main
@@ -91,7 +257,39 @@ int main(int argc, char* argv[])
 	catch ( exception& e )
 	{
 		cerr << e.what() << endl;
+		g_cFailed++;
 	}
+
+	// Behaviour checks - each test works on its own file
+	RunTest(TestBufferPool, argv[1]);
+	RunTest(TestPositionalIO, argv[1]);
+	RunTest(TestMappedView, argv[1]);
+	RunTest(TestFindRecord, argv[1]);
+	RunTest(TestSecondaryIndex, argv[1]);
+	RunTest(TestHashIndex, argv[1]);
+	RunTest(TestBatchChanges, argv[1]);
+	RunTest(TestLoggedReopen, argv[1]);
+	RunTest(TestLogRecovery, argv[1]);
+	RunTest(TestLoggedRollback, argv[1]);
+	RunTest(TestLoggedFlush, argv[1]);
+	RunTest(TestAsyncIO, argv[1]);
+	RunTest(TestDirectIO, argv[1]);
+	RunTest(TestExpand, argv[1]);
+	RunTest(TestTableGrowth, argv[1]);
+	RunTest(TestUpgrade, argv[1]);
+	RunTest(TestOnlineCompact, argv[1]);
+	RunTest(TestFileCopy, argv[1]);
+	RunTest(TestParallelCompact, argv[1]);
+	RunTest(TestStableSlots, argv[1]);
+	RunTest(TestPaxColumns, argv[1]);
+	RunTest(TestPredicateScan, argv[1]);
+	RunTest(TestParallelScan, argv[1]);
+	RunTest(TestThreadPool, argv[1]);
+	RunTest(TestSyncObjects, argv[1]);
+	RunTest(TestDistRWLock, argv[1]);
+	RunTest(TestRefCount, argv[1]);
+	RunTest(TestSnapshotRead, argv[1]);
+	RunTest(TestCursors, argv[1]);
 	
 	tAfter = clock();
 
@@ -101,6 +299,12 @@ int main(int argc, char* argv[])
 	float duration = (float) (tAfter - tBefore) / CLOCKS_PER_SEC;
 	cout << "Total program execution: " << duration << "s" << endl;
 
+	if (g_cFailed > 0)
+	{
+		cout << g_cFailed << " checks failed" << endl;
+		return 1;
+	}
+
 	return 0;
 }
 
@@ -152,7 +356,7 @@ void DisplayRecords(CDbTable* pTable)
 	cout << duration << "s\t" << (float) (REC_BLOCK) / duration << " records per second)" << endl;
 }
 
-CDbFile* CreateTestFile(const string& strFile)
+CDbFile* CreateTestFile(const string& strFile, UINT fMode)
 {
 	CDbFile* pFile = new CDbFile(strFile);
 
@@ -161,7 +365,7 @@ CDbFile* CreateTestFile(const string& strFile)
 		pFile->Delete();
 	}
 
-	pFile->Create();
+	pFile->Create(DB_DEFAULT_TABLES, fMode);
 
 	return pFile;
 }
@@ -310,3 +514,1755 @@ void Compact(CDbFile* pFile)
 	cout << "Compacted file (";
 	cout << duration << "s)" << endl;
 }
+
+void RunTest(TestProc pfnTest, const string& strFile)
+{
+	try
+	{
+		pfnTest(strFile);
+	}
+	catch ( exception& e )
+	{
+		Check(false, e.what());
+	}
+}
+
+void Check(bool fPassed, const string& strTest)
+{
+	cout << (fPassed ? "Passed: " : "FAILED: ") << strTest << endl;
+
+	if (!fPassed)
+	{
+		g_cFailed++;
+	}
+}
+
+void FillRecords(UserRecord* pRecords, UINT cRecords, UINT idFirst)
+{
+	memset(pRecords, 0, sizeof(UserRecord) * cRecords);
+
+	for (UINT iRec = 0; iRec < cRecords; iRec++)
+	{
+		UserRecord* pRecord = &pRecords[iRec];
+
+		sprintf(pRecord->Login, "%s%d", "record", idFirst + iRec);
+
+		pRecord->UserId		= idFirst + iRec;
+		pRecord->Age		= 20 + (iRec % 20);
+		pRecord->BirthMonth = (iRec % 12) + 1;
+		pRecord->BirthDay	= (iRec % 28) + 1;
+		pRecord->BirthYear	= 2001 - pRecord->Age;
+	}
+}
+
+UINT CountRecords(CDbTable* pTable)
+{
+	UserRecord	rgRecords[REC_BUFFER];
+	UINT		cRecords = 0;
+	UINT		cTotal	 = 0;
+
+	pTable->MoveFirst();
+
+	while ((cRecords = pTable->Fetch(rgRecords, REC_BUFFER)) > 0)
+	{
+		cTotal += cRecords;
+	}
+
+	return cTotal;
+}
+
+bool CompareValue(UINT uiValue, DB_SCAN_OP op, UINT uiCompare)
+{
+	switch (op)
+	{
+	case DB_SCAN_EQ:	return uiValue == uiCompare;
+	case DB_SCAN_NE:	return uiValue != uiCompare;
+	case DB_SCAN_LT:	return uiValue <  uiCompare;
+	case DB_SCAN_LE:	return uiValue <= uiCompare;
+	case DB_SCAN_GT:	return uiValue >  uiCompare;
+	case DB_SCAN_GE:	return uiValue >= uiCompare;
+	}
+
+	return false;
+}
+
+void TestBufferPool(const string& strFile)
+{
+	CFilePtr		pFile	= new CFile(strFile + ".pool");
+	vector<BYTE>	rgWrite(20 * DB_PAGE_SIZE);
+	vector<BYTE>	rgRead(rgWrite.size());
+
+	if (pFile->Exists())
+	{
+		pFile->Delete();
+	}
+
+	pFile->Create();
+
+	for (UINT ib = 0; ib < rgWrite.size(); ib++)
+	{
+		rgWrite[ib] = (BYTE) (ib % 251);
+	}
+
+	// Twenty pages through an eight page pool forces evictions
+	CDbBufferManagerPtr pBuffer = new CDbBufferManager(pFile, 8 * DB_PAGE_SIZE);
+
+	pBuffer->Write(100, &rgWrite[0], rgWrite.size());
+	pBuffer->Read(100, &rgRead[0], rgRead.size());
+	Check(rgRead == rgWrite, "Buffer pool reads back pages it evicted");
+
+	// With every frame pinned a read waits for a pin to be released
+	vector<CDbPage*> rgPinned;
+
+	for (UINT iPage = 0; iPage < 8; iPage++)
+	{
+		rgPinned.push_back(pBuffer->Pin(iPage));
+	}
+
+	CThreadPool	pool(1);
+	UnpinTask	unpin	= { pBuffer, rgPinned[0] };
+	CTask		task(UnpinTaskProc, &unpin);
+
+	pool.Submit(&task);
+	pBuffer->Read(10 * DB_PAGE_SIZE, &rgRead[0], DB_PAGE_SIZE);
+	task.Wait();
+
+	for (UINT iPage = 1; iPage < rgPinned.size(); iPage++)
+	{
+		pBuffer->Unpin(rgPinned[iPage]);
+	}
+
+	Check(memcmp(&rgRead[0], &rgWrite[10 * DB_PAGE_SIZE - 100], DB_PAGE_SIZE) == 0 &&
+		  pBuffer->GetPageCount() == 8, "Buffer pool waits for a pinned frame instead of growing");
+
+	pBuffer->Flush();
+	pBuffer = NULL;
+
+	fill(rgRead.begin(), rgRead.end(), 0);
+	pFile->ReadAt(100, &rgRead[0], rgRead.size());
+	Check(rgRead == rgWrite, "Buffer pool flush writes every dirty page");
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void UnpinTaskProc(void* pArg)
+{
+	UnpinTask*	pUnpin = (UnpinTask*) pArg;
+	CEvent		evDelay;
+
+	// Give the reader time to find every frame pinned
+	evDelay.Wait(50);
+	pUnpin->Buffer->Unpin(pUnpin->Page);
+}
+
+void TestPositionalIO(const string& strFile)
+{
+	CFilePtr	pFile	= new CFile(strFile + ".pos");
+	BYTE		rgFirst[64];
+	BYTE		rgSecond[64];
+	BYTE		rgRead[128];
+
+	if (pFile->Exists())
+	{
+		pFile->Delete();
+	}
+
+	pFile->Create();
+
+	memset(rgFirst, 'a', sizeof(rgFirst));
+	memset(rgSecond, 'b', sizeof(rgSecond));
+
+	// Write out of order; the gap between the writes reads as zero
+	pFile->WriteAt(1000, rgSecond, sizeof(rgSecond));
+	pFile->WriteAt(0, rgFirst, sizeof(rgFirst));
+
+	pFile->ReadAt(0, rgRead, sizeof(rgFirst));
+	Check(memcmp(rgRead, rgFirst, sizeof(rgFirst)) == 0, "ReadAt returns data written at offset 0");
+
+	pFile->ReadAt(1000, rgRead, sizeof(rgSecond));
+	Check(memcmp(rgRead, rgSecond, sizeof(rgSecond)) == 0, "ReadAt returns data written at a later offset");
+
+	memset(rgRead, 0xff, sizeof(rgRead));
+	pFile->ReadAt(500, rgRead, sizeof(rgRead));
+	Check(rgRead[0] == 0 && rgRead[sizeof(rgRead) - 1] == 0, "ReadAt reads a gap as zero");
+
+	Check(pFile->ReadAt(1000 + 32, rgRead, sizeof(rgRead)) == 32, "ReadAt stops at the end of the file");
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestMappedView(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".mapped");
+	UserRecord	rgRecords[REC_BLOCK];
+
+	CDbTablePtr pTable = pFile->CreateTable("Mapped", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Open(DB_OPEN_MAPPED);
+
+	const DbRecord*	pView	= NULL;
+	UINT			cView	= 0;
+	UINT			cTotal	= 0;
+	bool			fOrder	= true;
+
+	pTable = pFile->GetTable("Mapped");
+
+	while ((cView = pTable->FetchView(&pView, REC_BUFFER)) > 0)
+	{
+		const UserRecord* pRecords = (const UserRecord*) pView;
+
+		for (UINT iRec = 0; iRec < cView; iRec++)
+		{
+			fOrder = fOrder && pRecords[iRec].UserId == cTotal + iRec + 1;
+		}
+
+		cTotal += cView;
+	}
+
+	Check(cTotal == REC_BLOCK && fOrder, "Mapped views return every record in place");
+
+	// A view reflects later changes to its rows
+	pTable->MoveFirst();
+	pTable->FetchView(&pView, 1);
+
+	rgRecords[0].UserId = 5000;
+	pTable->Update(rgRecords, 1);
+	Check(((const UserRecord*) pView)->UserId == 5000, "Mapped view sees an update");
+
+#if !defined (__WIN32__)
+	// The view has room to grow, so growth does not remap the file
+	const DbRecord* pFirst = pView;
+
+	for (UINT iBlock = 0; iBlock < 20; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BLOCK, (iBlock + 1) * REC_BLOCK + 1);
+		pTable->Insert(rgRecords, REC_BLOCK);
+	}
+
+	pTable->MoveFirst();
+	pTable->FetchView(&pView, 1);
+	Check(pView == pFirst && CountRecords(pTable) == 21 * REC_BLOCK, "Mapped view is kept as the data region grows");
+#endif
+
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestFindRecord(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".find");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+
+	CDbTablePtr pTable = pFile->CreateTable("Find", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	DBRECID idFind = rgRecords[50].RID;
+
+	Check(pTable->Find(idFind) != DB_INVALID_POS, "Find locates a record by id");
+	Check(pTable->Fetch(&record, 1) == 1 && record.UserId == 51, "Find positions the cursor on the record");
+
+	// Deleting a record moves the last record into its slot
+	DBRECID idLast = rgRecords[REC_BLOCK - 1].RID;
+
+	pTable->Delete(&rgRecords[50], 1);
+	Check(pTable->Find(idFind) == DB_INVALID_POS, "Find does not locate a deleted record");
+
+	memset(&record, 0, sizeof(record));
+	Check(pTable->Find(idLast) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == REC_BLOCK,
+		  "Find locates a record that moved");
+	pTable = NULL;
+
+	// The record id index is stored in the file
+	pFile->Close();
+	pFile->Open();
+
+	pTable = pFile->GetTable("Find");
+	Check(pTable->Find(rgRecords[10].RID) != DB_INVALID_POS, "Find locates a record after a reopen");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestSecondaryIndex(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".index");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+	UINT		idKey	= 0;
+
+	CDbTablePtr pTable = pFile->CreateTable("Index", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK / 2, 1);
+	pTable->Insert(rgRecords, REC_BLOCK / 2);
+
+	// Records inserted before and after the index is created are both indexed
+	UINT idUser  = pFile->CreateIndex("Index", (UINT) ((BYTE*) &record.UserId - (BYTE*) &record), sizeof(record.UserId));
+	UINT idLogin = pFile->CreateIndex("Index", (UINT) ((BYTE*) record.Login - (BYTE*) &record), sizeof(record.Login), DB_KEY_STRING);
+
+	FillRecords(&rgRecords[REC_BLOCK / 2], REC_BLOCK / 2, (REC_BLOCK / 2) + 1);
+	pTable->Insert(&rgRecords[REC_BLOCK / 2], REC_BLOCK / 2);
+
+	idKey = 20;
+	Check(pTable->Seek(idUser, &idKey) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == 20,
+		  "Seek finds a record indexed when the index was created");
+
+	idKey = 80;
+	Check(pTable->Seek(idUser, &idKey) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == 80,
+		  "Seek finds a record inserted after the index was created");
+
+	Check(pTable->Seek(idLogin, "record64") != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == 64,
+		  "Seek finds a string key");
+
+	// An update moves the index entry to the new key
+	rgRecords[29].UserId = 9000;
+	pTable->Update(&rgRecords[29], 1);
+
+	idKey = 9000;
+	Check(pTable->Seek(idUser, &idKey) != DB_INVALID_POS, "Seek finds an updated key");
+
+	idKey = 30;
+	Check(pTable->Seek(idUser, &idKey) == DB_INVALID_POS, "Seek does not find a replaced key");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestHashIndex(const string& strFile)
+{
+	CDbFilePtr	pFile	= CreateTestFile(strFile + ".hash");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+	UINT		cFound	= 0;
+
+	CDbTablePtr pTable = pFile->CreateTable("Hash", sizeof(UserRecord), REC_BLOCK, REC_BLOCK);
+	UINT		idHash = pFile->CreateIndex("Hash", (UINT) ((BYTE*) &record.UserId - (BYTE*) &record), sizeof(record.UserId),
+											DB_KEY_UINT, DB_INDEX_HASH);
+
+	// Enough keys to split the buckets several times
+	for (UINT iBlock = 0; iBlock < 20; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BLOCK, (iBlock * REC_BLOCK) + 1);
+		pTable->Insert(rgRecords, REC_BLOCK);
+	}
+
+	for (UINT idKey = 1; idKey <= 20 * REC_BLOCK; idKey++)
+	{
+		if (pTable->Seek(idHash, &idKey) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == idKey)
+		{
+			cFound++;
+		}
+	}
+
+	Check(cFound == 20 * REC_BLOCK, "Hash index finds every key");
+
+	UINT idMissing = (20 * REC_BLOCK) + 1;
+	Check(pTable->Seek(idHash, &idMissing) == DB_INVALID_POS, "Hash index does not find a missing key");
+
+	// The last block inserted is still in the record buffer
+	pTable->Delete(rgRecords, REC_BUFFER);
+
+	UINT idDeleted = rgRecords[0].UserId;
+	Check(pTable->Seek(idHash, &idDeleted) == DB_INVALID_POS, "Hash index drops a deleted key");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestBatchChanges(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".batch");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	rgBatch[REC_BUFFER + 2];
+	UINT		cChanged = 0;
+
+	CDbTablePtr pTable = pFile->CreateTable("Batch", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	// Records in reverse order plus a record id that does not exist
+	for (UINT iRec = 0; iRec < REC_BUFFER; iRec++)
+	{
+		rgBatch[iRec] = rgRecords[REC_BLOCK - (iRec * 7) - 1];
+		rgBatch[iRec].Age = 99;
+	}
+
+	rgBatch[REC_BUFFER]		= rgRecords[0];
+	rgBatch[REC_BUFFER].RID	= 100000;
+
+	cChanged = pTable->Update(rgBatch, REC_BUFFER + 1);
+	Check(cChanged == REC_BUFFER, "Batched update changes every record found");
+
+	UINT	cOld	= 0;
+	UINT	cNew	= 0;
+
+	pTable->MoveFirst();
+	while (pTable->Fetch(rgRecords, REC_BUFFER) > 0)
+	{
+		for (UINT iRec = 0; iRec < REC_BUFFER; iRec++)
+		{
+			if (rgRecords[iRec].Age == 99)
+			{
+				cNew++;
+			}
+			else if (rgRecords[iRec].RID != 0)
+			{
+				cOld++;
+			}
+		}
+	}
+
+	Check(cNew == REC_BUFFER && cOld == REC_BLOCK - REC_BUFFER, "Batched update leaves other records unchanged");
+
+	// The same record twice is deleted once
+	rgBatch[REC_BUFFER + 1] = rgBatch[0];
+
+	cChanged = pTable->Delete(rgBatch, REC_BUFFER + 2);
+	Check(cChanged == REC_BUFFER, "Batched delete removes every record found once");
+	Check(CountRecords(pTable) == REC_BLOCK - REC_BUFFER, "Batched delete leaves the other records");
+	Check(pTable->Find(rgBatch[3].RID) == DB_INVALID_POS, "Batched delete removes the records in the batch");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestLoggedReopen(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".logged", DB_OPEN_LOGGED);
+	UserRecord	rgRecords[REC_BLOCK];
+
+	// An empty logged file must reopen
+	pFile->Close();
+	pFile->Open(DB_OPEN_LOGGED);
+	Check(true, "Empty logged file reopens");
+
+	CDbTablePtr pTable = pFile->CreateTable("Logged", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Open(DB_OPEN_LOGGED);
+
+	pTable = pFile->GetTable("Logged");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK, "Logged file keeps its records across a reopen");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestLogRecovery(const string& strFile)
+{
+	CDbFilePtr	pFile	= CreateTestFile(strFile + ".wal", DB_OPEN_LOGGED);
+	CDbFilePtr	pCrash	= new CDbFile(strFile + ".crash");
+	UserRecord	rgRecords[REC_BLOCK];
+
+	if (pCrash->Exists())
+	{
+		pCrash->Delete();
+	}
+
+	CDbTablePtr pTable = pFile->CreateTable("Logged", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	rgRecords[0].Age = 99;
+	pTable->Update(rgRecords, 1);
+	pTable->Delete(&rgRecords[REC_BLOCK - 1], 1);
+
+	// Copy the open file and its log as a crash would leave them
+	CFile(strFile + ".wal").Copy(strFile + ".crash");
+	CFile(strFile + ".wal.log").Copy(strFile + ".crash.log");
+
+	pTable = NULL;
+	pFile->Close();
+	pFile->Delete();
+
+	pCrash->Open(DB_OPEN_LOGGED);
+
+	UserRecord record;
+
+	pTable = pCrash->GetTable("Logged");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK - 1, "Log recovery restores committed inserts and deletes");
+	Check(pTable && pTable->Find(rgRecords[0].RID) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.Age == 99,
+		  "Log recovery restores a committed update");
+	pTable = NULL;
+
+	pCrash->Close();
+	pCrash->Delete();
+}
+
+void TestLoggedRollback(const string& strFile)
+{
+	CDbFilePtr			pFile = new CDbFile(strFile + ".rollback", DB_DATA_BUFFER, 16 * DB_PAGE_SIZE);
+	vector<UserRecord>	rgRecords(REC_BLOCK * 10);
+
+	if (pFile->Exists())
+	{
+		pFile->Delete();
+	}
+
+	pFile->Create(DB_DEFAULT_TABLES, DB_OPEN_LOGGED);
+
+	CDbTablePtr pTable = pFile->CreateTable("Logged", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(&rgRecords[0], REC_BLOCK, 1);
+	pTable->Insert(&rgRecords[0], REC_BLOCK);
+
+	// A change larger than the page cache fails part way through
+	bool fFailed = false;
+
+	FillRecords(&rgRecords[0], rgRecords.size(), REC_BLOCK + 1);
+
+	try
+	{
+		pTable->Insert(&rgRecords[0], rgRecords.size());
+	}
+	catch (runtime_error&)
+	{
+		fFailed = true;
+	}
+
+	Check(fFailed && CountRecords(pTable) == REC_BLOCK && pTable->Find(REC_BLOCK + 1) == DB_INVALID_POS,
+		  "Failed logged change is rolled back");
+
+	FillRecords(&rgRecords[0], REC_BUFFER, REC_BLOCK + 1);
+	pTable->Insert(&rgRecords[0], REC_BUFFER);
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Open(DB_OPEN_LOGGED);
+
+	pTable = pFile->GetTable("Logged");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK + REC_BUFFER && pTable->Find(REC_BLOCK + 1) != DB_INVALID_POS,
+		  "Logged file commits changes after a rollback");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestLoggedFlush(const string& strFile)
+{
+	CFilePtr		pData	= new CFile(strFile + ".flush");
+	CDbLogPtr		pLog	= new CDbLog(strFile + ".flush.log");
+	vector<BYTE>	rgPage(DB_PAGE_SIZE, 1);
+	vector<BYTE>	rgRead(DB_PAGE_SIZE);
+
+	if (pData->Exists())
+	{
+		pData->Delete();
+	}
+
+	if (pLog->Exists())
+	{
+		pLog->Delete();
+	}
+
+	pData->Create();
+	pLog->Open();
+
+	CDbBufferManagerPtr pBuffer = new CDbBufferManager(pData, 8 * DB_PAGE_SIZE);
+	pBuffer->SetLog(pLog);
+
+	pBuffer->BeginChange();
+	pBuffer->Write(0, &rgPage[0], DB_PAGE_SIZE);
+	pLog->Flush(pBuffer->LogPages());
+	pBuffer->EndChange(true);
+	pBuffer->Flush();
+
+	// A committed change leaves the page dirty
+	vector<BYTE> rgDirty(DB_PAGE_SIZE, 3);
+
+	pBuffer->BeginChange();
+	pBuffer->Write(0, &rgDirty[0], DB_PAGE_SIZE);
+	pLog->Flush(pBuffer->LogPages());
+	pBuffer->EndChange(true);
+
+	// The changing thread modifies a pinned page in place, as indexes do
+	pBuffer->BeginChange();
+
+	CDbPage* pPage = pBuffer->Pin(0);
+	memset(pPage->GetData(), 2, DB_PAGE_SIZE);
+
+	pBuffer->Flush();
+	pData->ReadAt(0, &rgRead[0], DB_PAGE_SIZE);
+	Check(rgRead == rgPage, "Flush leaves a page pinned by the changing thread alone");
+
+	pBuffer->Unpin(pPage, true);
+	pLog->Flush(pBuffer->LogPages());
+	pBuffer->EndChange(true);
+	pBuffer->Flush();
+
+	fill(rgPage.begin(), rgPage.end(), 2);
+	pData->ReadAt(0, &rgRead[0], DB_PAGE_SIZE);
+	Check(rgRead == rgPage, "Flush writes the page once its change commits");
+
+	pBuffer = NULL;
+	pLog->Close();
+	pLog->Delete();
+	pData->Close();
+	pData->Delete();
+
+	// Index inserts run while another thread's commits flush the cache
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".mapindex", DB_OPEN_MAPPED | DB_OPEN_LOGGED);
+	UserRecord	rgRecords[REC_BUFFER];
+	UserRecord	record;
+	UINT		offUser		= (UINT) ((BYTE*) &record.UserId - (BYTE*) &record);
+	UINT		offLogin	= (UINT) ((BYTE*) record.Login - (BYTE*) &record);
+
+	pFile->CreateTable("Commits", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	pFile->CreateTable("Indexed", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	UINT idUser		= pFile->CreateIndex("Indexed", offUser, sizeof(record.UserId));
+	UINT idLogin	= pFile->CreateIndex("Indexed", offLogin, sizeof(record.Login), DB_KEY_STRING, DB_INDEX_HASH);
+
+	CDbTablePtr	pCommits	= pFile->GetTable("Commits");
+	CDbTablePtr	pTable		= pFile->GetTable("Indexed");
+	CThreadPool	pool(1);
+	CommitTask	commit		= { pCommits, 1, 100 };
+	CTask		task(CommitTaskProc, &commit);
+
+	pool.Submit(&task);
+
+	for (UINT iBlock = 0; iBlock < 100; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BUFFER, 10000 + (iBlock * REC_BUFFER) + 1);
+		pTable->Insert(rgRecords, REC_BUFFER);
+	}
+
+	task.Wait();
+
+	pCommits	= NULL;
+	pTable		= NULL;
+
+	pFile->Close();
+	pFile->Open(DB_OPEN_MAPPED | DB_OPEN_LOGGED);
+
+	pTable = pFile->GetTable("Indexed");
+
+	UINT cFound = 0;
+
+	for (UINT idKey = 10001; idKey <= 10000 + (100 * REC_BUFFER); idKey++)
+	{
+		char szLogin[sizeof(record.Login)] = { 0 };
+
+		sprintf(szLogin, "%s%d", "record", idKey);
+
+		if (pTable->Seek(idUser, &idKey) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == idKey &&
+			pTable->Seek(idLogin, szLogin) != DB_INVALID_POS)
+		{
+			cFound++;
+		}
+	}
+
+	Check(cFound == 100 * REC_BUFFER, "Index inserts survive another thread's mapped commits");
+
+	pCommits = pFile->GetTable("Commits");
+	Check(pCommits && CountRecords(pCommits) == 100 * REC_BUFFER, "Mapped commits keep their records");
+
+	pCommits	= NULL;
+	pTable		= NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void CommitTaskProc(void* pArg)
+{
+	CommitTask*	pCommit = (CommitTask*) pArg;
+	UserRecord	rgRecords[REC_BUFFER];
+
+	for (UINT iBlock = 0; iBlock < pCommit->Blocks; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BUFFER, pCommit->First + (iBlock * REC_BUFFER));
+		pCommit->Table->Insert(rgRecords, REC_BUFFER);
+	}
+}
+
+void TestAsyncIO(const string& strFile)
+{
+	CFilePtr		pFile	= new CFile(strFile + ".async");
+	vector<BYTE>	rgWrite(8 * DB_PAGE_SIZE);
+	vector<BYTE>	rgRead(rgWrite.size());
+	UINT			rgcbRead[8];
+
+	if (pFile->Exists())
+	{
+		pFile->Delete();
+	}
+
+	pFile->Create();
+
+	for (UINT ib = 0; ib < rgWrite.size(); ib++)
+	{
+		rgWrite[ib] = (BYTE) (ib % 253);
+	}
+
+	// Queue one write and one read per page
+	for (UINT iPage = 0; iPage < 8; iPage++)
+	{
+		pFile->WriteAtAsync(iPage * DB_PAGE_SIZE, &rgWrite[iPage * DB_PAGE_SIZE], DB_PAGE_SIZE);
+	}
+
+	pFile->WaitAsync();
+
+	for (UINT iPage = 0; iPage < 8; iPage++)
+	{
+		rgcbRead[iPage] = 0;
+		pFile->ReadAtAsync(iPage * DB_PAGE_SIZE, &rgRead[iPage * DB_PAGE_SIZE], DB_PAGE_SIZE, &rgcbRead[iPage]);
+	}
+
+	pFile->WaitAsync();
+
+	UINT cbRead = 0;
+
+	for (UINT iPage = 0; iPage < 8; iPage++)
+	{
+		cbRead += rgcbRead[iPage];
+	}
+
+	Check(rgRead == rgWrite, "Asynchronous reads return asynchronous writes");
+	Check(cbRead == rgRead.size(), "Asynchronous reads report the bytes read");
+
+	// A read past the end of the file completes short
+	UINT cbShort = DB_PAGE_SIZE;
+
+	pFile->ReadAtAsync(rgWrite.size() - 100, &rgRead[0], DB_PAGE_SIZE, &cbShort);
+	pFile->WaitAsync();
+	Check(cbShort == 100, "Asynchronous read stops at the end of the file");
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestDirectIO(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".direct", DB_OPEN_DIRECT);
+	UserRecord	rgRecords[REC_BLOCK];
+
+	CDbTablePtr pTable = pFile->CreateTable("Direct", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	Check(CountRecords(pTable) == REC_BLOCK, "Direct file reads back its records");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Open(DB_OPEN_DIRECT);
+
+	UserRecord record;
+
+	pTable = pFile->GetTable("Direct");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK, "Direct file keeps its records across a reopen");
+	Check(pTable && pTable->Find(rgRecords[77].RID) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == 78,
+		  "Direct file record contents survive a reopen");
+	pTable = NULL;
+
+	// The same file opens without direct access
+	pFile->Close();
+	pFile->Open();
+
+	pTable = pFile->GetTable("Direct");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK, "Direct file opens through the system cache");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestExpand(const string& strFile)
+{
+	CFilePtr	pFile	= new CFile(strFile + ".expand");
+	BYTE		rgData[16];
+	BYTE		rgRead[DB_PAGE_SIZE];
+
+	if (pFile->Exists())
+	{
+		pFile->Delete();
+	}
+
+	pFile->Create();
+
+	memset(rgData, 'x', sizeof(rgData));
+	pFile->WriteAt(0, rgData, sizeof(rgData));
+
+	pFile->Expand(64 * DB_PAGE_SIZE);
+	Check(pFile->GetFileSize() == 64 * DB_PAGE_SIZE, "Expand grows the file");
+
+	memset(rgRead, 0xff, sizeof(rgRead));
+	pFile->ReadAt(63 * DB_PAGE_SIZE, rgRead, sizeof(rgRead));
+	Check(rgRead[0] == 0 && rgRead[sizeof(rgRead) - 1] == 0, "Expand fills the added range with zero");
+
+	pFile->ReadAt(0, rgRead, sizeof(rgData));
+	Check(memcmp(rgRead, rgData, sizeof(rgData)) == 0, "Expand keeps the existing data");
+
+	// A smaller size leaves the file alone
+	pFile->Expand(DB_PAGE_SIZE);
+	Check(pFile->GetFileSize() == 64 * DB_PAGE_SIZE, "Expand never shrinks the file");
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestTableGrowth(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".grow");
+	UserRecord	rgRecords[REC_BUFFER];
+	UserRecord	rgFirst[REC_BUFFER];
+
+	CDbTablePtr pFirst	= pFile->CreateTable("First", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	CDbTablePtr pSecond	= pFile->CreateTable("Second", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+
+	FillRecords(rgFirst, REC_BUFFER, 1);
+	pFirst->Insert(rgFirst, REC_BUFFER);
+
+	DBPOS idxBefore = pFirst->Find(rgFirst[5].RID);
+
+	// Interleaved inserts grow each table past the other's extents
+	for (UINT iBlock = 1; iBlock < 20; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BUFFER, (iBlock * REC_BUFFER) + 1);
+		pFirst->Insert(rgRecords, REC_BUFFER);
+
+		FillRecords(rgRecords, REC_BUFFER, (iBlock * REC_BUFFER) + 1);
+		pSecond->Insert(rgRecords, REC_BUFFER);
+	}
+
+	Check(pFirst->Find(rgFirst[5].RID) == idxBefore, "Table growth keeps a record in its slot");
+	Check(CountRecords(pFirst) == 20 * REC_BUFFER && CountRecords(pSecond) == 19 * REC_BUFFER,
+		  "Table growth keeps the records of both tables");
+
+	UINT	idNext	= 1;
+	bool	fOrder	= true;
+	UINT	cRecords;
+
+	pFirst->MoveFirst();
+	while ((cRecords = pFirst->Fetch(rgRecords, REC_BUFFER)) > 0)
+	{
+		for (UINT iRec = 0; iRec < cRecords; iRec++)
+		{
+			fOrder = fOrder && rgRecords[iRec].UserId == idNext++;
+		}
+	}
+
+	Check(fOrder, "Table growth keeps the records in insert order");
+	pFirst	= NULL;
+	pSecond	= NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestUpgrade(const string& strFile)
+{
+	CFilePtr		pOld	= new CFile(strFile + ".v1");
+	DbFileInfoV1	fileInfo;
+	DbTableInfoV1	tableInfo;
+	UserRecord		rgRecords[REC_BLOCK];
+
+	if (pOld->Exists())
+	{
+		pOld->Delete();
+	}
+
+	// Version 1 layout: header, table catalog, empty index catalog, table data
+	memset(&fileInfo, 0, sizeof(fileInfo));
+	memset(&tableInfo, 0, sizeof(tableInfo));
+	FillRecords(rgRecords, REC_BLOCK, 1);
+
+	for (UINT iRec = 0; iRec < REC_BLOCK; iRec++)
+	{
+		rgRecords[iRec].RID = iRec + 1;
+	}
+
+	fileInfo.MajorVersion			= 1;
+	fileInfo.Tables.Offset			= sizeof(fileInfo);
+	fileInfo.Tables.Size			= sizeof(DbTableInfoV1);
+	fileInfo.Tables.Entries			= 1;
+	fileInfo.Tables.Slots			= 1;
+	fileInfo.Tables.LastId			= 1;
+	fileInfo.Indexes.Offset			= sizeof(fileInfo) + sizeof(tableInfo);
+	fileInfo.Indexes.Size			= sizeof(DbIndexInfoV1);
+	fileInfo.DataOffsetStart		= sizeof(fileInfo);
+	fileInfo.DataOffsetEnd			= sizeof(fileInfo) + sizeof(tableInfo) + sizeof(rgRecords);
+
+	strcpy(tableInfo.Name, "Old");
+	tableInfo.Id					= 1;
+	tableInfo.Offset				= sizeof(fileInfo) + sizeof(tableInfo);
+	tableInfo.Size					= sizeof(UserRecord);
+	tableInfo.Entries				= REC_BLOCK;
+	tableInfo.Slots					= REC_BLOCK;
+	tableInfo.GrowthFactor			= REC_BUFFER;
+	tableInfo.LastRecordId			= REC_BLOCK;
+
+	pOld->Create();
+	pOld->WriteAt(0, &fileInfo, sizeof(fileInfo));
+	pOld->WriteAt(fileInfo.Tables.Offset, &tableInfo, sizeof(tableInfo));
+	pOld->WriteAt(tableInfo.Offset, rgRecords, sizeof(rgRecords));
+	pOld->Close();
+
+	CDbFilePtr	pFile = new CDbFile(strFile + ".v1");
+	UserRecord	record;
+
+	pFile->Open();
+
+	CDbTablePtr pTable = pFile->GetTable("Old");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK, "Version 1 file is upgraded with its records");
+	Check(pTable && pTable->Find(50) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 && record.UserId == 50,
+		  "Upgraded table finds records by id");
+
+	FillRecords(rgRecords, REC_BUFFER, REC_BLOCK + 1);
+	pTable->Insert(rgRecords, REC_BUFFER);
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Open();
+
+	pTable = pFile->GetTable("Old");
+	Check(pTable && CountRecords(pTable) == REC_BLOCK + REC_BUFFER, "Upgraded file reopens in the current format");
+	pTable = NULL;
+
+	pFile->Close();
+
+	// A file from a newer engine is refused
+	bool fRefused = false;
+
+	pOld->Open();
+	fileInfo.MajorVersion = verDbEngine.Major + 1;
+	pOld->WriteAt(0, &fileInfo.MajorVersion, sizeof(fileInfo.MajorVersion));
+	pOld->Close();
+
+	try
+	{
+		pFile->Open();
+	}
+	catch (runtime_error&)
+	{
+		fRefused = true;
+	}
+
+	Check(fRefused, "Unsupported file version is refused");
+
+	pOld->Delete();
+}
+
+void TestOnlineCompact(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".online");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+
+	CDbTablePtr pKeep = pFile->CreateTable("Keep", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	CDbTablePtr pDrop = pFile->CreateTable("Drop", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+
+	// Interleave the tables so dropping one leaves holes
+	for (UINT iBlock = 0; iBlock < 10; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BLOCK, (iBlock * REC_BLOCK) + 1);
+		pKeep->Insert(rgRecords, REC_BLOCK);
+		pDrop->Insert(rgRecords, REC_BLOCK);
+	}
+
+	DBRECID idFind = rgRecords[REC_BLOCK - 1].RID;
+
+	pDrop = NULL;
+	pFile->DeleteTable("Drop");
+
+	UINT cbBefore	= pFile->GetFileSize();
+	UINT cSteps		= 0;
+
+	while (pFile->CompactStep() && cSteps < 10000)
+	{
+		cSteps++;
+	}
+
+	Check(cSteps > 0 && pFile->GetFileSize() < cbBefore, "Online compaction shrinks the open file");
+	Check(CountRecords(pKeep) == 10 * REC_BLOCK, "Online compaction keeps every record");
+	Check(pKeep->Find(idFind) != DB_INVALID_POS && pKeep->Fetch(&record, 1) == 1 && record.UserId == 10 * REC_BLOCK,
+		  "Online compaction keeps record contents");
+
+	// The table is still writable after compaction
+	FillRecords(rgRecords, REC_BLOCK, (10 * REC_BLOCK) + 1);
+	pKeep->Insert(rgRecords, REC_BLOCK);
+	Check(CountRecords(pKeep) == 11 * REC_BLOCK, "Online compaction leaves the table writable");
+	pKeep = NULL;
+
+	pFile->Close();
+	pFile->Open();
+
+	pKeep = pFile->GetTable("Keep");
+	Check(pKeep && CountRecords(pKeep) == 11 * REC_BLOCK, "Online compaction survives a reopen");
+	pKeep = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestFileCopy(const string& strFile)
+{
+	CFilePtr		pFile	= new CFile(strFile + ".src");
+	CFilePtr		pDest	= new CFile(strFile + ".dst");
+	vector<BYTE>	rgWrite((3 * DB_PAGE_SIZE) + 100);
+	vector<BYTE>	rgRead(rgWrite.size());
+
+	if (pFile->Exists())
+	{
+		pFile->Delete();
+	}
+
+	pFile->Create();
+
+	for (UINT ib = 0; ib < rgWrite.size(); ib++)
+	{
+		rgWrite[ib] = (BYTE) (ib % 241);
+	}
+
+	pFile->WriteAt(0, &rgWrite[0], rgWrite.size());
+
+	// Leave a longer destination behind for Copy to replace
+	if (pDest->Exists())
+	{
+		pDest->Delete();
+	}
+
+	pDest->Create();
+	pDest->Expand(8 * DB_PAGE_SIZE);
+	pDest->Close();
+
+	pFile->Copy(strFile + ".dst");
+
+	pDest->Open();
+	pDest->ReadAt(0, &rgRead[0], rgRead.size());
+	Check(pDest->GetFileSize() == rgWrite.size() && rgRead == rgWrite, "Copy replaces an existing destination");
+
+	// Copy a range to the end of the same file
+	UINT cbCopied = pFile->CopyRange(DB_PAGE_SIZE, pFile, rgWrite.size(), DB_PAGE_SIZE);
+
+	pFile->ReadAt(rgWrite.size(), &rgRead[0], DB_PAGE_SIZE);
+	Check(cbCopied == DB_PAGE_SIZE && equal(rgRead.begin(), rgRead.begin() + DB_PAGE_SIZE, rgWrite.begin() + DB_PAGE_SIZE),
+		  "CopyRange copies within a file");
+
+	cbCopied = pFile->CopyRange(pFile->GetFileSize() - 50, pDest, 0, DB_PAGE_SIZE);
+	Check(cbCopied == 50, "CopyRange stops at the end of the source file");
+
+	pDest->Close();
+	pDest->Delete();
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestParallelCompact(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".pcompact");
+	UserRecord	rgRecords[REC_BLOCK];
+	UINT		iTable;
+
+	// Several tables with deleted records to compact at once
+	for (iTable = 0; iTable < 6; iTable++)
+	{
+		strstream strTable;
+		strTable << "Table" << iTable << ends;
+
+		CDbTablePtr pTable = pFile->CreateTable(strTable.str(), sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+		strTable.freeze(false);
+
+		for (UINT iBlock = 0; iBlock < 4; iBlock++)
+		{
+			FillRecords(rgRecords, REC_BLOCK, (iBlock * REC_BLOCK) + 1);
+			pTable->Insert(rgRecords, REC_BLOCK);
+		}
+
+		pTable->Delete(rgRecords, iTable * 10);
+	}
+
+	pFile->DeleteTable("Table5");
+	pFile->Close();
+
+	UINT cbBefore = pFile->GetFileSize();
+
+	pFile->Compact(4);
+	Check(pFile->GetFileSize() < cbBefore, "Parallel compaction shrinks the file");
+
+	pFile->Open();
+
+	bool fCounts = true;
+
+	for (iTable = 0; iTable < 5; iTable++)
+	{
+		strstream strTable;
+		strTable << "Table" << iTable << ends;
+
+		CDbTablePtr pTable = pFile->GetTable(strTable.str());
+		strTable.freeze(false);
+
+		fCounts = fCounts && pTable && CountRecords(pTable) == (4 * REC_BLOCK) - (iTable * 10);
+	}
+
+	Check(fCounts, "Parallel compaction keeps the records of every table");
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestStableSlots(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".stable");
+	UserRecord	rgRecords[REC_BLOCK];
+
+	CDbTablePtr pTable = pFile->CreateTable("Stable", sizeof(UserRecord), REC_BUFFER, REC_BUFFER, DB_TABLE_STABLE);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	DBPOS	idxLast	= pTable->Find(rgRecords[REC_BLOCK - 1].RID);
+	UINT	cFree	= pTable->GetFreeSlotCount();
+
+	pTable->Delete(&rgRecords[20], REC_BUFFER);
+	Check(pTable->Find(rgRecords[REC_BLOCK - 1].RID) == idxLast, "Stable delete leaves other records in their slots");
+	Check(pTable->GetRecordCount() == REC_BLOCK - REC_BUFFER && pTable->GetFreeSlotCount() == cFree + REC_BUFFER,
+		  "Stable delete frees the deleted slots");
+	Check(CountRecords(pTable) == REC_BLOCK - REC_BUFFER, "Fetch skips deleted slots");
+
+	// New records fill the freed slots before the table grows
+	UINT cSlots = pTable->GetSlotCount();
+
+	FillRecords(rgRecords, 5, REC_BLOCK + 1);
+	pTable->Insert(rgRecords, 5);
+
+	DBPOS idxNew = pTable->Find(rgRecords[0].RID);
+
+	Check(idxNew >= 20 && idxNew < 20 + REC_BUFFER, "Stable insert reuses a freed slot");
+	Check(pTable->GetSlotCount() == cSlots && pTable->GetFreeSlotCount() == cFree + REC_BUFFER - 5,
+		  "Stable insert does not grow the table while slots are free");
+	pTable = NULL;
+
+	// The free slots are kept in the file
+	pFile->Close();
+	pFile->Open();
+
+	pTable = pFile->GetTable("Stable");
+	Check(pTable && pTable->GetFreeSlotCount() == cFree + REC_BUFFER - 5 && CountRecords(pTable) == REC_BLOCK - 5,
+		  "Stable table keeps its free slots across a reopen");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestPaxColumns(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".pax");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	rgRead[REC_BLOCK];
+	UserRecord	record;
+
+	// RID, UserId, names, birth fields and text columns
+	UINT rgColumns[] =
+	{
+		0,
+		(UINT) ((BYTE*) &record.UserId - (BYTE*) &record),
+		(UINT) ((BYTE*) record.FirstName - (BYTE*) &record),
+		(UINT) ((BYTE*) &record.Age - (BYTE*) &record),
+		(UINT) ((BYTE*) record.Hometown - (BYTE*) &record)
+	};
+
+	CDbTablePtr pTable = pFile->CreateTable("Pax", sizeof(UserRecord), REC_BUFFER, REC_BUFFER, DB_TABLE_PAX,
+											rgColumns, sizeof(rgColumns) / sizeof(rgColumns[0]));
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	pTable->MoveFirst();
+	Check(pTable->Fetch(rgRead, REC_BLOCK) == REC_BLOCK && memcmp(rgRead, rgRecords, sizeof(rgRecords)) == 0,
+		  "PAX table returns whole records");
+
+	// Fetch only the birth fields
+	bool fColumns = true;
+
+	pTable->MoveFirst();
+	Check(pTable->Fetch(rgRead, REC_BLOCK, 1 << 3) == REC_BLOCK, "PAX table fetches a column subset");
+
+	for (UINT iRec = 0; iRec < REC_BLOCK; iRec++)
+	{
+		fColumns = fColumns && rgRead[iRec].RID == rgRecords[iRec].RID && rgRead[iRec].Age == rgRecords[iRec].Age &&
+				   rgRead[iRec].BirthYear == rgRecords[iRec].BirthYear && rgRead[iRec].UserId == 0 && rgRead[iRec].Login[0] == 0;
+	}
+
+	Check(fColumns, "PAX column subset holds only the selected columns");
+
+	// Updates and deletes keep the columns of a row together
+	rgRecords[10].Age = 99;
+	pTable->Update(&rgRecords[10], 1);
+	pTable->Delete(&rgRecords[0], 1);
+
+	Check(pTable->Find(rgRecords[10].RID) != DB_INVALID_POS && pTable->Fetch(&record, 1) == 1 &&
+		  record.Age == 99 && record.UserId == 11, "PAX table updates a row");
+	Check(CountRecords(pTable) == REC_BLOCK - 1, "PAX table deletes a row");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestPredicateScan(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".scan");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+	UINT		cRecords;
+
+	CDbTablePtr pTable = pFile->CreateTable("Scan", sizeof(UserRecord), REC_BLOCK, REC_BUFFER);
+
+	// Enough records to cross several scan blocks
+	for (UINT iBlock = 0; iBlock < 30; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BLOCK, (iBlock * REC_BLOCK) + 1);
+		pTable->Insert(rgRecords, REC_BLOCK);
+	}
+
+	DbPredicate predicate;
+
+	predicate.Offset	= (UINT) ((BYTE*) &record.Age - (BYTE*) &record);
+	predicate.Type		= DB_KEY_UINT;
+	predicate.Value		= 30;
+
+	bool fMatched = true;
+
+	for (UINT uiOp = DB_SCAN_EQ; uiOp <= DB_SCAN_GE; uiOp++)
+	{
+		UINT cExpected	= 0;
+		UINT cFound		= 0;
+		bool fMatch		= true;
+
+		predicate.Op = (DB_SCAN_OP) uiOp;
+
+		// Brute force count
+		pTable->MoveFirst();
+		while ((cRecords = pTable->Fetch(rgRecords, REC_BLOCK)) > 0)
+		{
+			for (UINT iRec = 0; iRec < cRecords; iRec++)
+			{
+				cExpected += CompareValue(rgRecords[iRec].Age, predicate.Op, predicate.Value) ? 1 : 0;
+			}
+		}
+
+		pTable->MoveFirst();
+		while ((cRecords = pTable->Scan(predicate, rgRecords, REC_BUFFER)) > 0)
+		{
+			for (UINT iRec = 0; iRec < cRecords; iRec++)
+			{
+				fMatch = fMatch && CompareValue(rgRecords[iRec].Age, predicate.Op, predicate.Value);
+			}
+
+			cFound += cRecords;
+		}
+
+		vector<DBPOS> rgSlots;
+
+		pTable->MoveFirst();
+		fMatched = fMatched && fMatch && cFound == cExpected && pTable->Scan(predicate, rgSlots) == cExpected &&
+				   rgSlots.size() == cExpected;
+	}
+
+	Check(fMatched, "Predicate scan finds the same records as a full fetch");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestParallelScan(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".pscan");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+
+	CDbTablePtr pTable = pFile->CreateTable("Parallel", sizeof(UserRecord), REC_BLOCK, 50, DB_TABLE_STABLE);
+
+	// More slots than two morsels, with deleted slots in between
+	for (UINT iBlock = 0; iBlock < 400; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BLOCK, (iBlock * REC_BLOCK) + 1);
+		pTable->Insert(rgRecords, REC_BLOCK);
+	}
+
+	pTable->Delete(rgRecords, REC_BUFFER);
+
+	DbPredicate		predicate;
+	vector<DBPOS>	rgSerial;
+	vector<DBPOS>	rgParallel;
+
+	predicate.Offset	= (UINT) ((BYTE*) &record.BirthMonth - (BYTE*) &record);
+	predicate.Type		= DB_KEY_UINT;
+	predicate.Op		= DB_SCAN_LE;
+	predicate.Value		= 3;
+
+	pTable->MoveFirst();
+	pTable->Scan(predicate, rgSerial);
+
+	UINT cFound = pTable->ParallelScan(predicate, rgParallel, 4);
+	Check(cFound == rgSerial.size() && rgParallel == rgSerial, "Parallel scan finds the same slots as a serial scan");
+
+	CCountConsumer consumer;
+
+	Check(pTable->ParallelScan(&consumer, 4) == CountRecords(pTable) && consumer.GetCount() == CountRecords(pTable),
+		  "Parallel scan passes every record to the consumer once");
+	pTable = NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void TestThreadPool(const string& /*strFile*/)
+{
+	CThreadPool		pool(2);
+	volatile LONG	cLeaves	= 0;
+	TreeTask		tree;
+
+	// Every level waits on its children; a worker must run them meanwhile
+	tree.Pool	= &pool;
+	tree.Depth	= 8;
+	tree.Leaves	= &cLeaves;
+
+	CTask task(TreeTaskProc, &tree);
+
+	pool.Submit(&task);
+	task.Wait();
+	Check(AtomicLoad(&cLeaves) == 256, "Thread pool runs nested tasks on two workers");
+
+	CTask	failed(FailTaskProc, NULL);
+	bool	fThrown = false;
+
+	pool.Submit(&failed);
+
+	try
+	{
+		failed.Wait();
+	}
+	catch ( runtime_error& )
+	{
+		fThrown = true;
+	}
+
+	Check(fThrown, "Thread pool reports a failed task to its waiter");
+}
+
+void TreeTaskProc(void* pArg)
+{
+	TreeTask* pTree = (TreeTask*) pArg;
+
+	if (pTree->Depth == 0)
+	{
+		AtomicIncrement(pTree->Leaves);
+		return;
+	}
+
+	TreeTask rgChildren[2];
+
+	rgChildren[0]		= *pTree;
+	rgChildren[0].Depth	= pTree->Depth - 1;
+	rgChildren[1]		= rgChildren[0];
+
+	CTask left(TreeTaskProc, &rgChildren[0]);
+	CTask right(TreeTaskProc, &rgChildren[1]);
+
+	pTree->Pool->Submit(&left);
+	pTree->Pool->Submit(&right);
+
+	left.Wait();
+	right.Wait();
+}
+
+void FailTaskProc(void* /*pArg*/)
+{
+	throw runtime_error("Task failed");
+}
+
+void TestSyncObjects(const string& /*strFile*/)
+{
+	CEvent event;
+
+	Check(!event.Wait(10), "Event wait times out while the event is reset");
+
+	event.Set();
+	Check(event.Wait(0) && event.Wait(0), "Event stays signaled until it is reset");
+
+	event.Reset();
+	Check(!event.Wait(0), "Event reset clears the signal");
+
+	// A pool task waits for the event, then posts the semaphore in two ways
+	CThreadPool		pool(1);
+	SyncTask		sync;
+
+	sync.Start	= &event;
+	sync.Count	= 100;
+
+	CTask task(SyncTaskProc, &sync);
+
+	pool.Submit(&task);
+	event.Set();
+
+	for (UINT iWait = 0; iWait < sync.Count + 3; iWait++)
+	{
+		sync.Done.Wait();
+	}
+
+	task.Wait();
+	Check(true, "Semaphore passes every post to its waiter");
+
+	// Four sleeping waiters share the posts
+	CThreadPool		waiters(4);
+	CSemaphore		sem;
+	volatile LONG	cPassed = 0;
+	WaitTask		wait	= { &sem, &cPassed };
+	vector<CTask*>	rgTasks;
+
+	for (UINT iTask = 0; iTask < 4; iTask++)
+	{
+		rgTasks.push_back(new CTask(WaitTaskProc, &wait));
+		waiters.Submit(rgTasks.back());
+	}
+
+	sem.Post();
+
+	while (AtomicLoad(&cPassed) == 0)
+	{
+		CThread::Relinquish();
+	}
+
+	event.Reset();
+	Check(!event.Wait(20) && AtomicLoad(&cPassed) == 1, "Semaphore post releases a single waiter");
+
+	sem.Post(3);
+
+	for (UINT iTask = 0; iTask < rgTasks.size(); iTask++)
+	{
+		rgTasks[iTask]->Wait();
+		delete rgTasks[iTask];
+	}
+
+	Check(AtomicLoad(&cPassed) == 4, "Semaphore post wakes as many waiters as it has posts");
+}
+
+void SyncTaskProc(void* pArg)
+{
+	SyncTask* pSync = (SyncTask*) pArg;
+
+	pSync->Start->Wait();
+
+	for (UINT iPost = 0; iPost < pSync->Count; iPost++)
+	{
+		pSync->Done.Post();
+	}
+
+	pSync->Done.Post(3);
+}
+
+void WaitTaskProc(void* pArg)
+{
+	WaitTask* pWait = (WaitTask*) pArg;
+
+	pWait->Sem->Wait();
+	AtomicIncrement(pWait->Passed);
+}
+
+void TestDistRWLock(const string& /*strFile*/)
+{
+	CThreadPool		pool(4);
+	LockTask		lock;
+	vector<CTask*>	rgTasks;
+
+	lock.First	= 0;
+	lock.Second	= 0;
+	lock.Torn	= 0;
+
+	// Writers keep the two counters equal; readers check them
+	for (UINT iTask = 0; iTask < 8; iTask++)
+	{
+		rgTasks.push_back(new CTask(iTask % 2 ? LockWriterProc : LockReaderProc, &lock));
+		pool.Submit(rgTasks.back());
+	}
+
+	for (UINT iTask = 0; iTask < rgTasks.size(); iTask++)
+	{
+		rgTasks[iTask]->Wait();
+		delete rgTasks[iTask];
+	}
+
+	Check(lock.First == 4 * 1000 && lock.Second == lock.First, "Write lock excludes other writers");
+	Check(AtomicLoad(&lock.Torn) == 0, "Read lock excludes writers");
+
+	// The writer may take the lock again
+	lock.Lock.WriteLock();
+	lock.Lock.ReadLock();
+	lock.Lock.WriteLock();
+	lock.Lock.Unlock();
+	lock.Lock.Unlock();
+	lock.Lock.Unlock();
+
+	lock.Lock.ReadLock();
+	lock.Lock.Unlock();
+	Check(true, "Write lock is reentrant for its holder");
+}
+
+void LockWriterProc(void* pArg)
+{
+	LockTask* pLock = (LockTask*) pArg;
+
+	for (UINT iPass = 0; iPass < 1000; iPass++)
+	{
+		pLock->Lock.WriteLock();
+		pLock->First++;
+		CThread::Relinquish();
+		pLock->Second++;
+		pLock->Lock.Unlock();
+	}
+}
+
+void LockReaderProc(void* pArg)
+{
+	LockTask* pLock = (LockTask*) pArg;
+
+	for (UINT iPass = 0; iPass < 1000; iPass++)
+	{
+		pLock->Lock.ReadLock();
+
+		if (pLock->First != pLock->Second)
+		{
+			AtomicIncrement(&pLock->Torn);
+		}
+
+		pLock->Lock.Unlock();
+	}
+}
+
+void TestRefCount(const string& /*strFile*/)
+{
+	CPointer<CObject> pObject = new CObject;
+
+	{
+		CPointer<CObject> pCopy = pObject;
+		Check(pObject->GetReferences() == 2, "Smart pointer copy adds a reference");
+	}
+
+	Check(pObject->GetReferences() == 1, "Smart pointer release drops a reference");
+
+#if defined (SMARTPTR_MOVE)
+	CPointer<CObject> pMoved = std::move(pObject);
+	Check(pMoved->GetReferences() == 1 && pObject == NULL, "Smart pointer move keeps the reference count");
+
+	pObject = std::move(pMoved);
+#endif
+
+	// Copies made and dropped on several threads at once
+	CThreadPool		pool(4);
+	vector<CTask*>	rgTasks;
+
+	for (UINT iTask = 0; iTask < 8; iTask++)
+	{
+		rgTasks.push_back(new CTask(RefTaskProc, &pObject));
+		pool.Submit(rgTasks.back());
+	}
+
+	for (UINT iTask = 0; iTask < rgTasks.size(); iTask++)
+	{
+		rgTasks[iTask]->Wait();
+		delete rgTasks[iTask];
+	}
+
+	Check(pObject->GetReferences() == 1, "Reference count survives concurrent copies");
+}
+
+void RefTaskProc(void* pArg)
+{
+	CPointer<CObject>* ppObject = (CPointer<CObject>*) pArg;
+
+	for (UINT iPass = 0; iPass < 10000; iPass++)
+	{
+		CPointer<CObject> pCopy = *ppObject;
+	}
+}
+
+void TestSnapshotRead(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".snapshot");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+
+	CDbTablePtr pTable = pFile->CreateTable("Snapshot", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	CDbTablePtr pReader = pFile->GetTable("Snapshot");
+	pReader->OpenSnapshot();
+
+	// Change the table on another thread while the snapshot is read
+	CThreadPool		pool(1);
+	SnapshotTask	change;
+
+	change.Table	= pTable;
+	change.Records	= rgRecords;
+
+	CTask task(SnapshotTaskProc, &change);
+	pool.Submit(&task);
+
+	bool fStable = true;
+
+	while (!task.IsDone())
+	{
+		fStable = fStable && CountRecords(pReader) == REC_BLOCK;
+	}
+
+	task.Wait();
+
+	DbPredicate predicate;
+
+	predicate.Offset	= (UINT) ((BYTE*) &record.Age - (BYTE*) &record);
+	predicate.Type		= DB_KEY_UINT;
+	predicate.Op		= DB_SCAN_EQ;
+	predicate.Value		= 99;
+
+	pReader->MoveFirst();
+	Check(fStable && CountRecords(pReader) == REC_BLOCK, "Snapshot hides inserts and deletes");
+	Check(pReader->Scan(predicate, &record, 1) == 0, "Snapshot hides updates");
+
+	pReader->MoveFirst();
+	Check(pReader->Fetch(&record, 1) == 1 && record.UserId == 1 && record.Age == 20, "Snapshot returns the old record image");
+
+	pReader->CloseSnapshot();
+	Check(CountRecords(pReader) == (2 * REC_BLOCK) - 1, "Closed snapshot sees the changes");
+
+	pReader->MoveFirst();
+	Check(pReader->Scan(predicate, &record, 1) == 1 && record.UserId == 1, "Closed snapshot sees an update");
+
+	pReader	= NULL;
+	pTable	= NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void SnapshotTaskProc(void* pArg)
+{
+	SnapshotTask*	pChange = (SnapshotTask*) pArg;
+	UserRecord		rgRecords[REC_BLOCK];
+
+	pChange->Records[0].Age = 99;
+	pChange->Table->Update(pChange->Records, 1);
+	pChange->Table->Delete(&pChange->Records[REC_BLOCK - 1], 1);
+
+	for (UINT iBlock = 0; iBlock < 10; iBlock++)
+	{
+		FillRecords(rgRecords, REC_BUFFER, REC_BLOCK + (iBlock * REC_BUFFER) + 1);
+		pChange->Table->Insert(rgRecords, REC_BUFFER);
+	}
+}
+
+void TestCursors(const string& strFile)
+{
+	CDbFilePtr	pFile = CreateTestFile(strFile + ".cursor");
+	UserRecord	rgRecords[REC_BLOCK];
+	UserRecord	record;
+
+	CDbTablePtr pTable = pFile->CreateTable("Cursor", sizeof(UserRecord), REC_BUFFER, REC_BUFFER);
+	FillRecords(rgRecords, REC_BLOCK, 1);
+	pTable->Insert(rgRecords, REC_BLOCK);
+
+	CDbCursorPtr pFirst		= pTable->OpenCursor();
+	CDbCursorPtr pSecond	= pTable->OpenCursor();
+
+	// Each cursor keeps its own position
+	pSecond->SetPosition(50);
+	pTable->SetPosition(90);
+
+	pFirst->Fetch(&record, 1);
+	Check(record.UserId == 1, "Cursor starts at the first record");
+
+	pSecond->Fetch(&record, 1);
+	Check(record.UserId == 51 && pFirst->GetPosition() == 1 && pTable->GetPosition() == 90,
+		  "Cursors and the table move independently");
+
+	// A committed change replaces the records read ahead
+	rgRecords[1].Age = 99;
+	pTable->Update(&rgRecords[1], 1);
+
+	pFirst->Fetch(&record, 1);
+	Check(record.UserId == 2 && record.Age == 99, "Cursor sees a change made after it read ahead");
+
+	// A cursor snapshot hides later changes
+	CDbCursorPtr pSnapshot = pTable->OpenCursor(true);
+
+	FillRecords(rgRecords, REC_BUFFER, REC_BLOCK + 1);
+	pTable->Insert(rgRecords, REC_BUFFER);
+
+	UINT cSnapshot = 0;
+
+	while (pSnapshot->Fetch(&record, 1) > 0)
+	{
+		cSnapshot++;
+	}
+
+	Check(cSnapshot == REC_BLOCK && pSnapshot->IsEOF(), "Cursor snapshot hides later inserts");
+
+	// Readers on several threads share the table object
+	CThreadPool		pool(4);
+	CursorTask		rgReaders[4];
+	vector<CTask*>	rgTasks;
+
+	for (UINT iTask = 0; iTask < 4; iTask++)
+	{
+		rgReaders[iTask].Table	= pTable;
+		rgReaders[iTask].Total	= 0;
+
+		rgTasks.push_back(new CTask(CursorTaskProc, &rgReaders[iTask]));
+		pool.Submit(rgTasks.back());
+	}
+
+	bool fTotals = true;
+
+	for (UINT iTask = 0; iTask < rgTasks.size(); iTask++)
+	{
+		rgTasks[iTask]->Wait();
+		delete rgTasks[iTask];
+
+		fTotals = fTotals && rgReaders[iTask].Total == ((REC_BLOCK + REC_BUFFER) * (REC_BLOCK + REC_BUFFER + 1)) / 2;
+	}
+
+	Check(fTotals, "Concurrent cursors each read the whole table");
+
+	pFirst		= NULL;
+	pSecond		= NULL;
+	pSnapshot	= NULL;
+	pTable		= NULL;
+
+	pFile->Close();
+	pFile->Delete();
+}
+
+void CursorTaskProc(void* pArg)
+{
+	CursorTask*		pReader	= (CursorTask*) pArg;
+	CDbCursorPtr	pCursor	= pReader->Table->OpenCursor();
+	UserRecord		rgRecords[REC_BUFFER];
+	UINT			cRecords;
+
+	// Small fetches are served from the cursor's read-ahead
+	while ((cRecords = pCursor->Fetch(rgRecords, 3)) > 0)
+	{
+		for (UINT iRec = 0; iRec < cRecords; iRec++)
+		{
+			pReader->Total += rgRecords[iRec].UserId;
+		}
+	}
+}